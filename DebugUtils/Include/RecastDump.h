@@ -39,5 +39,10 @@ bool duReadCompactHeightfield(struct rcCompactHeightfield& chf, duFileIO* io);
 
 void duLogBuildTimes(rcContext& ctx, const int totalTileUsec);
 
+/// Writes the telemetry samples as a JSON document with one object per sample.
+bool duDumpBuildTelemetryJson(const class rcBuildTelemetry& telemetry, duFileIO* io);
+/// Writes the telemetry samples in the Chrome trace event format. (chrome://tracing, Perfetto)
+bool duDumpBuildTelemetryChromeTrace(const class rcBuildTelemetry& telemetry, duFileIO* io);
+
 
 #endif // RECAST_DUMP_H
@@ -92,12 +92,13 @@ static void drawPolyBoundaries(duDebugDraw* dd, const dtMeshTile* tile,
 			{
 				const unsigned char* t = &tile->detailTris[(pd->triBase+k)*4];
 				const float* tv[3];
+				float tmp[3*3];
 				for (int m = 0; m < 3; ++m)
 				{
 					if (t[m] < p->vertCount)
 						tv[m] = &tile->verts[p->verts[t[m]]*3];
 					else
-						tv[m] = &tile->detailVerts[(pd->vertBase+(t[m]-p->vertCount))*3];
+						tv[m] = dtGetDetailVert(tile, pd->vertBase+(t[m]-p->vertCount), &tmp[m*3]);
 				}
 				for (int m = 0, n = 2; m < 3; n=m++)
 				{
@@ -155,7 +156,10 @@ static void drawMeshTile(duDebugDraw* dd, const dtNavMesh& mesh, const dtNavMesh
 				if (t[k] < p->vertCount)
 					dd->vertex(&tile->verts[p->verts[t[k]]*3], col);
 				else
-					dd->vertex(&tile->detailVerts[(pd->vertBase+t[k]-p->vertCount)*3], col);
+				{
+					float tmp[3];
+					dd->vertex(dtGetDetailVert(tile, pd->vertBase+t[k]-p->vertCount, tmp), col);
+				}
 			}
 		}
 	}
@@ -269,30 +273,22 @@ void duDebugDrawNavMeshNodes(struct duDebugDraw* dd, const dtNavMeshQuery& query
 	{
 		const float off = 0.5f;
 		dd->begin(DU_DRAW_POINTS, 4.0f);
-		for (int i = 0; i < pool->getHashSize(); ++i)
+		for (int i = 0; i < pool->getNodeCount(); ++i)
 		{
-			for (dtNodeIndex j = pool->getFirst(i); j != DT_NULL_IDX; j = pool->getNext(j))
-			{
-				const dtNode* node = pool->getNodeAtIdx(j+1);
-				if (!node) continue;
-				dd->vertex(node->pos[0],node->pos[1],node->pos[2] + off, duRGBA(255,192,0,255));
-			}
+			const dtNode* node = pool->getNodeAtIdx(i+1);
+			dd->vertex(node->pos[0],node->pos[1],node->pos[2] + off, duRGBA(255,192,0,255));
 		}
 		dd->end();
 		
 		dd->begin(DU_DRAW_LINES, 2.0f);
-		for (int i = 0; i < pool->getHashSize(); ++i)
+		for (int i = 0; i < pool->getNodeCount(); ++i)
 		{
-			for (dtNodeIndex j = pool->getFirst(i); j != DT_NULL_IDX; j = pool->getNext(j))
-			{
-				const dtNode* node = pool->getNodeAtIdx(j+1);
-				if (!node) continue;
-				if (!node->pidx) continue;
-				const dtNode* parent = pool->getNodeAtIdx(node->pidx);
-				if (!parent) continue;
-				dd->vertex(node->pos[0],node->pos[1],node->pos[2] + off, duRGBA(255,192,0,128));
-				dd->vertex(parent->pos[0],parent->pos[1],parent->pos[2] + off, duRGBA(255,192,0,128));
-			}
+			const dtNode* node = pool->getNodeAtIdx(i+1);
+			if (!node->pidx) continue;
+			const dtNode* parent = pool->getNodeAtIdx(node->pidx);
+			if (!parent) continue;
+			dd->vertex(node->pos[0],node->pos[1],node->pos[2] + off, duRGBA(255,192,0,128));
+			dd->vertex(parent->pos[0],parent->pos[1],parent->pos[2] + off, duRGBA(255,192,0,128));
 		}
 		dd->end();
 	}
@@ -474,7 +470,10 @@ void duDebugDrawNavMeshPoly(duDebugDraw* dd, const dtNavMesh& mesh, dtPolyRef re
 				if (t[j] < poly->vertCount)
 					dd->vertex(&tile->verts[poly->verts[t[j]]*3], c);
 				else
-					dd->vertex(&tile->detailVerts[(pd->vertBase+t[j]-poly->vertCount)*3], c);
+				{
+					float tmp[3];
+					dd->vertex(dtGetDetailVert(tile, pd->vertBase+t[j]-poly->vertCount, tmp), c);
+				}
 			}
 		}
 		dd->end();
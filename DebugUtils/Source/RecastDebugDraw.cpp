@@ -21,6 +21,7 @@
 #include "DebugDraw.h"
 #include "RecastDebugDraw.h"
 #include "Recast.h"
+#include "RecastCompactSpans.h"
 
 void duDebugDrawTriMesh(duDebugDraw* dd, const float* verts, int /*nverts*/,
 						const int* tris, const float* normals, int ntris,
@@ -209,7 +210,8 @@ void duDebugDrawHeightfieldWalkable(duDebugDraw* dd, const rcHeightfield& hf)
 	dd->end();
 }
 
-void duDebugDrawCompactHeightfieldSolid(duDebugDraw* dd, const rcCompactHeightfield& chf)
+template<class Spans>
+static void drawCompactHeightfieldSolid(duDebugDraw* dd, const rcCompactHeightfield& chf, const Spans& spans)
 {
 	if (!dd) return;
 
@@ -228,7 +230,7 @@ void duDebugDrawCompactHeightfieldSolid(duDebugDraw* dd, const rcCompactHeightfi
 
 			for (unsigned i = c.index, ni = c.index+c.count; i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
+				const rcCompactSpan s = spans[i];
 
 				const unsigned char area = chf.areas[i];
 				unsigned int color;
@@ -250,7 +252,16 @@ void duDebugDrawCompactHeightfieldSolid(duDebugDraw* dd, const rcCompactHeightfi
 	dd->end();
 }
 
-void duDebugDrawCompactHeightfieldRegions(duDebugDraw* dd, const rcCompactHeightfield& chf)
+void duDebugDrawCompactHeightfieldSolid(duDebugDraw* dd, const rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		drawCompactHeightfieldSolid(dd, chf, rcCompactSpansSoA(chf));
+	else
+		drawCompactHeightfieldSolid(dd, chf, rcCompactSpansAoS(chf));
+}
+
+template<class Spans>
+static void drawCompactHeightfieldRegions(duDebugDraw* dd, const rcCompactHeightfield& chf, const Spans& spans)
 {
 	if (!dd) return;
 
@@ -269,7 +280,7 @@ void duDebugDrawCompactHeightfieldRegions(duDebugDraw* dd, const rcCompactHeight
 			
 			for (unsigned i = c.index, ni = c.index+c.count; i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
+				const rcCompactSpan s = spans[i];
 				const float fz = chf.bmin[2] + (s.z)*ch;
 				unsigned int color;
 				if (s.reg)
@@ -288,8 +299,17 @@ void duDebugDrawCompactHeightfieldRegions(duDebugDraw* dd, const rcCompactHeight
 	dd->end();
 }
 
+void duDebugDrawCompactHeightfieldRegions(duDebugDraw* dd, const rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		drawCompactHeightfieldRegions(dd, chf, rcCompactSpansSoA(chf));
+	else
+		drawCompactHeightfieldRegions(dd, chf, rcCompactSpansAoS(chf));
+}
 
-void duDebugDrawCompactHeightfieldDistance(duDebugDraw* dd, const rcCompactHeightfield& chf)
+
+template<class Spans>
+static void drawCompactHeightfieldDistance(duDebugDraw* dd, const rcCompactHeightfield& chf, const Spans& spans)
 {
 	if (!dd) return;
 	if (!chf.dist) return;
@@ -313,7 +333,7 @@ void duDebugDrawCompactHeightfieldDistance(duDebugDraw* dd, const rcCompactHeigh
 			
 			for (unsigned i = c.index, ni = c.index+c.count; i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
+				const rcCompactSpan s = spans[i];
 				const float fz = chf.bmin[2] + (s.z+1)*ch;
 				const unsigned char cd = (unsigned char)(chf.dist[i] * dscale);
 				const unsigned int color = duRGBA(cd,cd,cd,255);
@@ -327,6 +347,14 @@ void duDebugDrawCompactHeightfieldDistance(duDebugDraw* dd, const rcCompactHeigh
 	dd->end();
 }
 
+void duDebugDrawCompactHeightfieldDistance(duDebugDraw* dd, const rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		drawCompactHeightfieldDistance(dd, chf, rcCompactSpansSoA(chf));
+	else
+		drawCompactHeightfieldDistance(dd, chf, rcCompactSpansAoS(chf));
+}
+
 static void drawLayerPortals(duDebugDraw* dd, const rcHeightfieldLayer* layer)
 {
 	const float cs = layer->cs;
@@ -24,6 +24,7 @@
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastDump.h"
+#include "RecastTelemetry.h"
 
 
 duFileIO::~duFileIO()
@@ -296,7 +297,7 @@ bool duDumpCompactHeightfield(struct rcCompactHeightfield& chf, duFileIO* io)
 
 	int tmp = 0;
 	if (chf.cells) tmp |= 1;
-	if (chf.spans) tmp |= 2;
+	if (chf.spans || chf.spanZ) tmp |= 2;
 	if (chf.dist) tmp |= 4;
 	if (chf.areas) tmp |= 8;
 
@@ -305,7 +306,22 @@ bool duDumpCompactHeightfield(struct rcCompactHeightfield& chf, duFileIO* io)
 	if (chf.cells)
 		io->write(chf.cells, sizeof(rcCompactCell)*chf.width*chf.height);
 	if (chf.spans)
+	{
 		io->write(chf.spans, sizeof(rcCompactSpan)*chf.spanCount);
+	}
+	else if (chf.spanZ)
+	{
+		// The file always stores the spans as rcCompactSpan records.
+		for (int i = 0; i < chf.spanCount; ++i)
+		{
+			rcCompactSpan s;
+			s.z = chf.spanZ[i];
+			s.reg = chf.spanReg[i];
+			s.con = chf.spanCon[i];
+			s.h = chf.spanH[i];
+			io->write(&s, sizeof(s));
+		}
+	}
 	if (chf.dist)
 		io->write(chf.dist, sizeof(unsigned short)*chf.spanCount);
 	if (chf.areas)
@@ -449,3 +465,127 @@ void duLogBuildTimes(rcContext& ctx, const int totalTimeUsec)
 	ctx.log(RC_LOG_PROGRESS, "=== TOTAL:\t%.2fms", totalTimeUsec/1000.0f);
 }
 
+static const char* getTimerLabelName(const rcTimerLabel label)
+{
+	switch (label)
+	{
+	case RC_TIMER_TOTAL:						return "Total";
+	case RC_TIMER_TEMP:							return "Temp";
+	case RC_TIMER_RASTERIZE_TRIANGLES:			return "Rasterize";
+	case RC_TIMER_BUILD_COMPACTHEIGHTFIELD:		return "Build Compact";
+	case RC_TIMER_BUILD_CONTOURS:				return "Build Contours";
+	case RC_TIMER_BUILD_CONTOURS_TRACE:			return "Trace";
+	case RC_TIMER_BUILD_CONTOURS_SIMPLIFY:		return "Simplify";
+	case RC_TIMER_FILTER_BORDER:				return "Filter Border";
+	case RC_TIMER_FILTER_WALKABLE:				return "Filter Walkable";
+	case RC_TIMER_MEDIAN_AREA:					return "Median Area";
+	case RC_TIMER_FILTER_LOW_OBSTACLES:			return "Filter Low Obstacles";
+	case RC_TIMER_BUILD_POLYMESH:				return "Build Polymesh";
+	case RC_TIMER_MERGE_POLYMESH:				return "Merge Polymeshes";
+	case RC_TIMER_ERODE_AREA:					return "Erode Area";
+	case RC_TIMER_MARK_BOX_AREA:				return "Mark Box Area";
+	case RC_TIMER_MARK_CYLINDER_AREA:			return "Mark Cylinder Area";
+	case RC_TIMER_MARK_CONVEXPOLY_AREA:			return "Mark Convex Area";
+	case RC_TIMER_BUILD_DISTANCEFIELD:			return "Build Distance Field";
+	case RC_TIMER_BUILD_DISTANCEFIELD_DIST:		return "Distance";
+	case RC_TIMER_BUILD_DISTANCEFIELD_BLUR:		return "Blur";
+	case RC_TIMER_BUILD_REGIONS:				return "Build Regions";
+	case RC_TIMER_BUILD_REGIONS_WATERSHED:		return "Watershed";
+	case RC_TIMER_BUILD_REGIONS_EXPAND:			return "Expand";
+	case RC_TIMER_BUILD_REGIONS_FLOOD:			return "Find Basins";
+	case RC_TIMER_BUILD_REGIONS_FILTER:			return "Filter";
+	case RC_TIMER_BUILD_LAYERS:					return "Build Layers";
+	case RC_TIMER_BUILD_POLYMESHDETAIL:			return "Build Polymesh Detail";
+	case RC_TIMER_MERGE_POLYMESHDETAIL:			return "Merge Polymesh Details";
+	default:									return "Unknown";
+	}
+}
+
+static const char* s_counterNames[RC_MAX_COUNTERS] =
+{
+	"spans",
+	"compactSpans",
+	"regions",
+	"layers",
+	"contours",
+	"contourVerts",
+	"polys",
+	"polyVerts",
+	"detailVerts",
+	"detailTris",
+};
+
+static void ioprintCounters(duFileIO* io, const rcTelemetrySample& sample)
+{
+	bool first = true;
+	for (int j = 0; j < RC_MAX_COUNTERS; ++j)
+	{
+		if (!sample.counters[j])
+			continue;
+		ioprintf(io, "%s\"%s\":%lld", first ? "" : ",", s_counterNames[j], sample.counters[j]);
+		first = false;
+	}
+}
+
+bool duDumpBuildTelemetryJson(const rcBuildTelemetry& telemetry, duFileIO* io)
+{
+	if (!io)
+	{
+		printf("duDumpBuildTelemetryJson: input IO is null.\n"); 
+		return false;
+	}
+	if (!io->isWriting())
+	{
+		printf("duDumpBuildTelemetryJson: input IO not writing.\n"); 
+		return false;
+	}
+
+	ioprintf(io, "{\"samples\":[\n");
+	for (int i = 0; i < telemetry.getSampleCount(); ++i)
+	{
+		const rcTelemetrySample& s = telemetry.getSample(i);
+		ioprintf(io, "{\"stage\":\"%s\",\"tile\":[%d,%d,%d],\"thread\":%d,\"parent\":%d,\"depth\":%d,\"calls\":%d,",
+				 getTimerLabelName(s.label), s.tileX, s.tileY, s.tileLayer, s.thread, s.parent, s.depth, s.calls);
+		ioprintf(io, "\"startUs\":%lld,\"durationUs\":%lld,\"peakTempBytes\":%lld,\"counters\":{",
+				 s.startUsec, s.durationUsec, s.peakTempBytes);
+		ioprintCounters(io, s);
+		ioprintf(io, "}}%s\n", i+1 < telemetry.getSampleCount() ? "," : "");
+	}
+	ioprintf(io, "]}\n");
+
+	return true;
+}
+
+bool duDumpBuildTelemetryChromeTrace(const rcBuildTelemetry& telemetry, duFileIO* io)
+{
+	if (!io)
+	{
+		printf("duDumpBuildTelemetryChromeTrace: input IO is null.\n"); 
+		return false;
+	}
+	if (!io->isWriting())
+	{
+		printf("duDumpBuildTelemetryChromeTrace: input IO not writing.\n"); 
+		return false;
+	}
+
+	// Merged samples are emitted as one complete event starting at the first call.
+	ioprintf(io, "{\"traceEvents\":[\n");
+	for (int i = 0; i < telemetry.getSampleCount(); ++i)
+	{
+		const rcTelemetrySample& s = telemetry.getSample(i);
+		ioprintf(io, "{\"name\":\"%s\",\"cat\":\"recast\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%lld,\"dur\":%lld,",
+				 getTimerLabelName(s.label), s.thread, s.startUsec, s.durationUsec);
+		ioprintf(io, "\"args\":{\"tile\":\"%d,%d,%d\",\"calls\":%d,\"peakTempBytes\":%lld",
+				 s.tileX, s.tileY, s.tileLayer, s.calls, s.peakTempBytes);
+		for (int j = 0; j < RC_MAX_COUNTERS; ++j)
+		{
+			if (s.counters[j])
+				ioprintf(io, ",\"%s\":%lld", s_counterNames[j], s.counters[j]);
+		}
+		ioprintf(io, "}}%s\n", i+1 < telemetry.getSampleCount() ? "," : "");
+	}
+	ioprintf(io, "],\"displayTimeUnit\":\"ms\"}\n");
+
+	return true;
+}
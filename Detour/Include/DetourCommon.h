@@ -22,6 +22,11 @@
 #include "DetourMath.h"
 #include <stddef.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DT_SSE2 1
+#include <emmintrin.h>
+#endif
+
 /**
 @defgroup detour Detour
 
@@ -345,6 +350,111 @@ inline float dtTriArea2D(const float* a, const float* b, const float* c)
 	return acx*aby - abx*acy;
 }
 
+/// Determines which of four triangles contain a point on the xy-plane, and their heights at the point.
+/// Gives the same results as four calls to #dtClosestHeightPointTriangle.
+///  @param[in]		p		The point. [(x, y, z)]
+///  @param[in]		a		The first vertices of the triangles, one row per axis. [(x, y, z) * 4]
+///  @param[in]		ac		The edges from the first to the third vertices. [(x, y, z) * 4]
+///  @param[in]		ab		The edges from the first to the second vertices. [(x, y, z) * 4]
+///  @param[out]	h		The heights at the point, only valid for the triangles that contain it. [4]
+/// @return A mask with bit i set if triangle i contains the point.
+inline unsigned int dtClosestHeightPointTriangle4(const float* p, const float a[3][4], const float ac[3][4],
+												  const float ab[3][4], float* h)
+{
+	const float EPS = 1e-6f;
+#ifdef DT_SSE2
+	const __m128 ax = _mm_loadu_ps(a[0]), ay = _mm_loadu_ps(a[1]);
+	const __m128 v0x = _mm_loadu_ps(ac[0]), v0y = _mm_loadu_ps(ac[1]);
+	const __m128 v1x = _mm_loadu_ps(ab[0]), v1y = _mm_loadu_ps(ab[1]);
+	const __m128 v2x = _mm_sub_ps(_mm_set1_ps(p[0]), ax);
+	const __m128 v2y = _mm_sub_ps(_mm_set1_ps(p[1]), ay);
+
+	// Scaled barycentric coordinates, with the sign of the denominator moved to the coordinates.
+	const __m128 denom = _mm_sub_ps(_mm_mul_ps(v0x, v1y), _mm_mul_ps(v0y, v1x));
+	const __m128 sign = _mm_and_ps(denom, _mm_set1_ps(-0.0f));
+	const __m128 absDenom = _mm_xor_ps(denom, sign);
+	const __m128 u = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(v1y, v2x), _mm_mul_ps(v1x, v2y)), sign);
+	const __m128 v = _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(v0x, v2y), _mm_mul_ps(v0y, v2x)), sign);
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 inside = _mm_cmpge_ps(absDenom, _mm_set1_ps(EPS));
+	inside = _mm_and_ps(inside, _mm_cmpge_ps(u, zero));
+	inside = _mm_and_ps(inside, _mm_cmpge_ps(v, zero));
+	inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(u, v), absDenom));
+	const unsigned int mask = (unsigned int)_mm_movemask_ps(inside);
+	if (mask)
+	{
+		const __m128 num = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ac[2]), u), _mm_mul_ps(_mm_loadu_ps(ab[2]), v));
+		// Lanes without the point divide by one instead, their heights are ignored.
+		_mm_storeu_ps(h, _mm_add_ps(_mm_loadu_ps(a[2]), _mm_div_ps(num, _mm_or_ps(_mm_and_ps(inside, absDenom), _mm_andnot_ps(inside, _mm_set1_ps(1.0f))))));
+	}
+	return mask;
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		const float v2x = p[0] - a[0][i];
+		const float v2y = p[1] - a[1][i];
+		float denom = ac[0][i] * ab[1][i] - ac[1][i] * ab[0][i];
+		if (dtMathFabsf(denom) < EPS)
+			continue;
+		float u = ab[1][i] * v2x - ab[0][i] * v2y;
+		float v = ac[0][i] * v2y - ac[1][i] * v2x;
+		if (denom < 0)
+		{
+			denom = -denom;
+			u = -u;
+			v = -v;
+		}
+		if (u >= 0.0f && v >= 0.0f && (u + v) <= denom)
+		{
+			h[i] = a[2][i] + (ac[2][i] * u + ab[2][i] * v) / denom;
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/// Derives the squared distances on the xy-plane between a point and four line segments.
+/// Gives the same results as four calls to #dtDistancePtSegSqr2D.
+///  @param[in]		pt		The point. [(x, y, z)]
+///  @param[in]		p		The start points of the segments, one row per axis. [(x, y, z) * 4]
+///  @param[in]		pq		The segments from the start to the end points. [(x, y, z) * 4]
+///  @param[out]	d		The squared distances. [4]
+///  @param[out]	t		The parameters of the closest points along the segments. [4]
+inline void dtDistancePtSegSqr2D4(const float* pt, const float p[3][4], const float pq[3][4], float* d, float* t)
+{
+#ifdef DT_SSE2
+	const __m128 px = _mm_loadu_ps(p[0]), py = _mm_loadu_ps(p[1]);
+	const __m128 pqx = _mm_loadu_ps(pq[0]), pqy = _mm_loadu_ps(pq[1]);
+	const __m128 ptx = _mm_set1_ps(pt[0]), pty = _mm_set1_ps(pt[1]);
+	const __m128 len = _mm_add_ps(_mm_mul_ps(pqx, pqx), _mm_mul_ps(pqy, pqy));
+	__m128 s = _mm_add_ps(_mm_mul_ps(pqx, _mm_sub_ps(ptx, px)), _mm_mul_ps(pqy, _mm_sub_ps(pty, py)));
+	const __m128 positive = _mm_cmpgt_ps(len, _mm_setzero_ps());
+	const __m128 one = _mm_set1_ps(1.0f);
+	s = _mm_div_ps(s, _mm_or_ps(_mm_and_ps(positive, len), _mm_andnot_ps(positive, one)));
+	s = _mm_min_ps(_mm_max_ps(s, _mm_setzero_ps()), one);
+	const __m128 dx = _mm_sub_ps(_mm_add_ps(px, _mm_mul_ps(s, pqx)), ptx);
+	const __m128 dy = _mm_sub_ps(_mm_add_ps(py, _mm_mul_ps(s, pqy)), pty);
+	_mm_storeu_ps(d, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+	_mm_storeu_ps(t, s);
+#else
+	for (int i = 0; i < 4; ++i)
+	{
+		const float len = pq[0][i]*pq[0][i] + pq[1][i]*pq[1][i];
+		float s = pq[0][i]*(pt[0] - p[0][i]) + pq[1][i]*(pt[1] - p[1][i]);
+		if (len > 0) s /= len;
+		if (s < 0) s = 0;
+		else if (s > 1) s = 1;
+		const float dx = p[0][i] + s*pq[0][i] - pt[0];
+		const float dy = p[1][i] + s*pq[1][i] - pt[1];
+		d[i] = dx*dx + dy*dy;
+		t[i] = s;
+	}
+#endif
+}
+
 /// Determines if two axis-aligned bounding boxes overlap.
 ///  @param[in]		amin	Minimum bounds of box A. [(x, y, z)]
 ///  @param[in]		amax	Maximum bounds of box A. [(x, y, z)]
@@ -362,6 +472,44 @@ inline bool dtOverlapQuantBounds(const unsigned short amin[3], const unsigned sh
 	return overlap;
 }
 
+/// Determines which of four quantized bounding boxes overlap a quantized bounding box.
+///  @param[in]		amin	Minimum bounds of box A. [(x, y, z)]
+///  @param[in]		amax	Maximum bounds of box A. [(x, y, z)]
+///  @param[in]		bmin	Minimum bounds of the four boxes, one row per axis. [(x, y, z) * 4]
+///  @param[in]		bmax	Maximum bounds of the four boxes, one row per axis. [(x, y, z) * 4]
+/// @return A mask with bit i set if box A overlaps box i.
+/// @see dtOverlapQuantBounds
+inline unsigned int dtOverlapQuantBounds4(const unsigned short amin[3], const unsigned short amax[3],
+										  const unsigned short bmin[3][4], const unsigned short bmax[3][4])
+{
+#ifdef DT_SSE2
+	// a <= b exactly when the saturated difference a - b is zero. The z test checks
+	// bmin <= amax in the low four lanes and amin <= bmax in the high four lanes.
+	const __m128i bminXY = _mm_loadu_si128((const __m128i*)bmin[0]);
+	const __m128i bmaxXY = _mm_loadu_si128((const __m128i*)bmax[0]);
+	const __m128i aminXY = _mm_unpacklo_epi64(_mm_set1_epi16((short)amin[0]), _mm_set1_epi16((short)amin[1]));
+	const __m128i amaxXY = _mm_unpacklo_epi64(_mm_set1_epi16((short)amax[0]), _mm_set1_epi16((short)amax[1]));
+	const __m128i zlo = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)bmin[2]), _mm_set1_epi16((short)amin[2]));
+	const __m128i zhi = _mm_unpacklo_epi64(_mm_set1_epi16((short)amax[2]), _mm_loadl_epi64((const __m128i*)bmax[2]));
+	__m128i d = _mm_or_si128(_mm_subs_epu16(bminXY, amaxXY), _mm_subs_epu16(aminXY, bmaxXY));
+	d = _mm_or_si128(d, _mm_subs_epu16(zlo, zhi));
+	d = _mm_or_si128(d, _mm_srli_si128(d, 8));
+	const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(d, _mm_setzero_si128()));
+	// Keep one of the two mask bits of each 16-bit lane.
+	return (unsigned int)((mask & 1) | ((mask >> 1) & 2) | ((mask >> 2) & 4) | ((mask >> 3) & 8));
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (amin[0] <= bmax[0][i] && amax[0] >= bmin[0][i] &&
+			amin[1] <= bmax[1][i] && amax[1] >= bmin[1][i] &&
+			amin[2] <= bmax[2][i] && amax[2] >= bmin[2][i])
+			mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
 /// Determines if two axis-aligned bounding boxes overlap.
 ///  @param[in]		amin	Minimum bounds of box A. [(x, y, z)]
 ///  @param[in]		amax	Maximum bounds of box A. [(x, y, z)]
@@ -401,6 +549,101 @@ bool dtIntersectSegmentPoly2D(const float* p0, const float* p1,
 							  float& tmin, float& tmax,
 							  int& segMin, int& segMax);
 
+/// Stores four points as one row per axis, the layout of the four-wide functions.
+///  @param[out]	rows	The points, one row per axis. [(x, y, z) * 4]
+///  @param[in]		a		The first point. [(x, y, z)]
+///  @param[in]		b		The second point. [(x, y, z)]
+///  @param[in]		c		The third point. [(x, y, z)]
+///  @param[in]		d		The fourth point. [(x, y, z)]
+inline void dtVgather4(float rows[3][4], const float* a, const float* b, const float* c, const float* d)
+{
+#ifdef DT_SSE2
+	// Whole row stores, so that the rows can be loaded right away without store forwarding stalls.
+	_mm_storeu_ps(rows[0], _mm_set_ps(d[0], c[0], b[0], a[0]));
+	_mm_storeu_ps(rows[1], _mm_set_ps(d[1], c[1], b[1], a[1]));
+	_mm_storeu_ps(rows[2], _mm_set_ps(d[2], c[2], b[2], a[2]));
+#else
+	const float* p[4] = { a, b, c, d };
+	for (int i = 0; i < 4; ++i)
+	{
+		rows[0][i] = p[i][0];
+		rows[1][i] = p[i][1];
+		rows[2][i] = p[i][2];
+	}
+#endif
+}
+
+/// Intersects four segments with a convex polygon on the xy-plane.
+/// Gives the same results as four calls to #dtIntersectSegmentPoly2D.
+///  @param[in]		p0		The start points of the segments, one row per axis. [(x, y, z) * 4]
+///  @param[in]		p1		The end points of the segments, one row per axis. [(x, y, z) * 4]
+///  @param[in]		verts	The polygon vertices. [(x, y, z) * @p nverts]
+///  @param[in]		nverts	The number of vertices.
+///  @param[out]	tmin	The parameters where the segments enter the polygon. [4]
+///  @param[out]	tmax	The parameters where the segments leave the polygon. [4]
+///  @param[out]	segMin	The edges through which the segments enter the polygon, or -1. [4]
+///  @param[out]	segMax	The edges through which the segments leave the polygon, or -1. [4]
+/// @return A mask with bit i set if segment i intersects the polygon. The outputs are only valid for these segments.
+inline unsigned int dtIntersectSegmentPoly2D4(const float p0[3][4], const float p1[3][4],
+											  const float* verts, const int nverts,
+											  float* tmin, float* tmax, int* segMin, int* segMax)
+{
+#ifdef DT_SSE2
+	const float EPS = 0.00000001f;
+	const __m128 p0x = _mm_loadu_ps(p0[0]), p0y = _mm_loadu_ps(p0[1]);
+	const __m128 dirx = _mm_sub_ps(_mm_loadu_ps(p1[0]), p0x);
+	const __m128 diry = _mm_sub_ps(_mm_loadu_ps(p1[1]), p0y);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 t0 = zero, t1 = _mm_set1_ps(1.0f), outside = zero;
+	__m128i s0 = _mm_set1_epi32(-1), s1 = s0;
+
+	for (int i = 0, j = nverts-1; i < nverts; j = i++)
+	{
+		const float* vi = &verts[i*3];
+		const float* vj = &verts[j*3];
+		const __m128 ex = _mm_set1_ps(vi[0] - vj[0]), ey = _mm_set1_ps(vi[1] - vj[1]);
+		const __m128 dx = _mm_sub_ps(p0x, _mm_set1_ps(vj[0])), dy = _mm_sub_ps(p0y, _mm_set1_ps(vj[1]));
+		const __m128 n = _mm_sub_ps(_mm_mul_ps(ex, dy), _mm_mul_ps(ey, dx));
+		const __m128 d = _mm_sub_ps(_mm_mul_ps(dirx, ey), _mm_mul_ps(diry, ex));
+
+		// Segments parallel to the edge miss the polygon if they are outside of the edge.
+		// The parameters of the parallel lanes are not used.
+		const __m128 parallel = _mm_cmplt_ps(_mm_and_ps(d, absMask), _mm_set1_ps(EPS));
+		outside = _mm_or_ps(outside, _mm_and_ps(parallel, _mm_cmplt_ps(n, zero)));
+
+		const __m128 t = _mm_div_ps(n, d);
+		const __m128 negative = _mm_cmplt_ps(d, zero);
+		const __m128 enter = _mm_and_ps(_mm_andnot_ps(parallel, negative), _mm_cmpgt_ps(t, t0));
+		const __m128 leave = _mm_andnot_ps(_mm_or_ps(parallel, negative), _mm_cmplt_ps(t, t1));
+		const __m128i seg = _mm_set1_epi32(j);
+		t0 = _mm_or_ps(_mm_and_ps(enter, t), _mm_andnot_ps(enter, t0));
+		t1 = _mm_or_ps(_mm_and_ps(leave, t), _mm_andnot_ps(leave, t1));
+		s0 = _mm_or_si128(_mm_and_si128(_mm_castps_si128(enter), seg), _mm_andnot_si128(_mm_castps_si128(enter), s0));
+		s1 = _mm_or_si128(_mm_and_si128(_mm_castps_si128(leave), seg), _mm_andnot_si128(_mm_castps_si128(leave), s1));
+	}
+
+	// The entering parameter only grows and the leaving one only shrinks, so the segments
+	// that leave before they enter at any edge still do so after the last edge.
+	outside = _mm_or_ps(outside, _mm_cmpgt_ps(t0, t1));
+	_mm_storeu_ps(tmin, t0);
+	_mm_storeu_ps(tmax, t1);
+	_mm_storeu_si128((__m128i*)segMin, s0);
+	_mm_storeu_si128((__m128i*)segMax, s1);
+	return (unsigned int)_mm_movemask_ps(outside) ^ 0xf;
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		const float a[3] = { p0[0][i], p0[1][i], p0[2][i] };
+		const float b[3] = { p1[0][i], p1[1][i], p1[2][i] };
+		if (dtIntersectSegmentPoly2D(a, b, verts, nverts, tmin[i], tmax[i], segMin[i], segMax[i]))
+			mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
 bool dtIntersectSegSeg2D(const float* ap, const float* aq,
 						 const float* bp, const float* bq,
 						 float& s, float& t);
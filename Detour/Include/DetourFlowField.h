@@ -0,0 +1,117 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURFLOWFIELD_H
+#define DETOURFLOWFIELD_H
+
+#include "DetourNavMesh.h"
+
+class dtNodePool;
+
+/// The polygons of a single tile in a #dtFlowField.
+/// @note This structure is rarely if ever used by the end user.
+struct dtFlowFieldTile
+{
+	dtTileRef ref;				///< The tile the entries were built for.
+	int firstEntry;				///< The index of the entry of the first polygon of the tile.
+	int polyCount;				///< The number of polygons in the tile.
+};
+
+/// The next hop towards the goal of a polygon in a #dtFlowField.
+/// @note This structure is rarely if ever used by the end user.
+struct dtFlowFieldEntry
+{
+	dtPolyRef next;				///< The next polygon towards the goal, or zero for the goal and unreached polygons.
+	float cost;					///< The cost from the polygon to the goal, or FLT_MAX for unreached polygons.
+};
+
+/// The next hop and cost to a single goal polygon of every polygon within a cost bound.
+///
+/// A field is built with dtNavMeshQuery::buildFlowField. Any number of agents can then follow
+/// it to the goal in time linear in the length of their path, without running a search.
+///
+/// The field stays valid until a tile it covers is removed or replaced. The lookups check the
+/// salt of every polygon they visit, so a stale field fails instead of returning a wrong path.
+/// @ingroup detour
+class dtFlowField
+{
+public:
+	dtFlowField();
+	~dtFlowField();
+
+	/// Clears the field and releases its memory.
+	void clear();
+
+	/// Returns true if none of the tiles the field covers has been removed or replaced since it was built.
+	bool isValid() const;
+
+	/// Gets the next hop towards the goal.
+	///  @param[in]		ref		The polygon to look up.
+	///  @param[out]	next	The next polygon towards the goal, or zero if @p ref is the goal.
+	///  @param[out]	cost	The cost from the polygon to the goal. [opt]
+	/// @return True if the polygon was reached by the field.
+	bool getNextHop(dtPolyRef ref, dtPolyRef* next, float* cost) const;
+
+	/// Follows the field from the start polygon to the goal.
+	///  @param[in]		startRef	The reference id of the start polygon.
+	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to end.)
+	///  							[(polyRef) * @p pathCount]
+	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
+	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	/// @returns The status flags for the query.
+	dtStatus getPath(dtPolyRef startRef, dtPolyRef* path, int* pathCount, const int maxPath) const;
+
+	/// The goal polygon of the field.
+	dtPolyRef getGoalRef() const { return m_goalRef; }
+
+	/// The number of tiles the field covers.
+	int getTileCount() const { return m_tileCount; }
+
+	/// Gets a tile of the field.
+	///  @param[in]	i		The index of the tile. [Limit: 0 <= index < #getTileCount()]
+	const dtFlowFieldTile* getTile(const int i) const { return &m_tiles[i]; }
+
+	/// @name Internal
+	/// Used by dtNavMeshQuery::buildFlowField.
+	/// @{
+
+	/// Stores the closed nodes of a search from the goal polygon.
+	dtStatus build(const dtNavMesh* nav, dtPolyRef goalRef, const dtNodePool& pool);
+
+	/// @}
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtFlowField(const dtFlowField&);
+	dtFlowField& operator=(const dtFlowField&);
+
+	const dtFlowFieldEntry* getEntry(dtPolyRef ref) const;
+
+	const dtNavMesh* m_nav;
+	dtPolyRef m_goalRef;
+	int* m_tileSlots;				///< The index in #m_tiles of each tile of the navigation mesh, or -1. [Size: #m_maxTiles]
+	int m_maxTiles;
+	dtFlowFieldTile* m_tiles;
+	int m_tileCount;
+	int m_tileCapacity;
+	dtFlowFieldEntry* m_entries;
+	int m_entryCount;
+	int m_entryCapacity;
+};
+
+#endif // DETOURFLOWFIELD_H
@@ -69,6 +69,10 @@ static const int DT_VERTS_PER_POLYGON = 6;
 /// A magic number used to detect compatibility of navigation tile data.
 static const int DT_NAVMESH_MAGIC = 'D'<<24 | 'N'<<16 | 'A'<<8 | 'V';
 
+/// A magic number used to detect navigation tile data whose detail mesh vertices are quantized to 16 bits.
+/// The rest of the data is the same as #DT_NAVMESH_MAGIC data. (See: dtPackNavMeshDetailVerts)
+static const int DT_NAVMESH_PACKED_DETAIL_MAGIC = 'D'<<24 | 'N'<<16 | 'A'<<8 | 'P';
+
 /// A version number used to detect compatibility of navigation tile data.
 static const int DT_NAVMESH_VERSION = 13;
 
@@ -100,6 +104,20 @@ enum dtTileFlags
 {
 	/// The navigation mesh owns the tile memory and is responsible for freeing it.
 	DT_TILE_FREE_DATA = 0x01,
+
+	/// Do not build the wide bounding volume tree of the tile. Queries walk dtMeshTile::bvTree instead.
+	DT_TILE_NO_WIDE_BVTREE = 0x02,
+
+	/// The navigation mesh never writes to the tile data, so the same data can be added to several
+	/// navigation meshes. The polygons, the links and, for tiles with off-mesh connections, the
+	/// vertices are copied to dtMeshTile::runtimeData instead.
+	DT_TILE_READ_ONLY_DATA = 0x04,
+
+	/// Build the detail triangle and edge blocks of the tile, which height and closest point
+	/// queries test four at a time. Without it they walk dtMeshTile::detailTris.
+	/// The blocks cost 36 bytes per detail triangle and 24 bytes per boundary edge on top of the
+	/// tile data, several times what #DT_NAVMESH_PACKED_DETAIL_MAGIC tiles save, so they are opt-in.
+	DT_TILE_DETAIL_BLOCKS = 0x08,
 };
 
 /// Vertex flags returned by dtNavMeshQuery::findStraightPath.
@@ -118,10 +136,26 @@ enum dtStraightPathOptions
 };
 
 
-/// Options for dtNavMeshQuery::initSlicedFindPath and updateSlicedFindPath
+/// Options for dtNavMeshQuery::findPath, initSlicedFindPath and updateSlicedFindPath
 enum dtFindPathOptions
 {
 	DT_FINDPATH_ANY_ANGLE	= 0x02,		///< use raycasts during pathfind to "shortcut" (raycast still consider costs)
+	DT_FINDPATH_CLOSEST_REACHABLE = 0x04,	///< if the end polygon is known to be unreachable, search toward the nearest reachable polygon instead
+};
+
+/// Node lookup used by the search node pool of dtNavMeshQuery. (See: dtNavMeshQuery::init)
+enum dtNodePoolType
+{
+	DT_NODE_POOL_HASH = 0,			///< Nodes are found through a hash table, which is cleared before every search.
+	DT_NODE_POOL_TILE_INDEXED = 1,	///< Nodes are found through dense per tile arrays, which are cleared lazily per tile.
+};
+
+/// Open list used by the searches of dtNavMeshQuery. (See: dtNavMeshQuery::init)
+enum dtNodeQueueType
+{
+	DT_NODE_QUEUE_BINARY_HEAP = 0,		///< Binary heap. Decreasing the cost of a node searches the heap for it.
+	DT_NODE_QUEUE_QUATERNARY_HEAP = 1,	///< 4-ary heap that stores the heap position in the node.
+	DT_NODE_QUEUE_RADIX_HEAP = 2,		///< Radix heap on the bits of the node cost. Assumes monotone costs.
 };
 
 /// Options for dtNavMeshQuery::raycast
@@ -140,6 +174,9 @@ enum dtDetailTriEdgeFlags
 /// The limit is given as a multiple of the character radius
 static const float DT_RAY_CAST_LIMIT_PROPORTIONS = 50.0f;
 
+/// The maximum number of rays dtNavMeshQuery::raycasts traverses together.
+static const int DT_MAX_RAYCAST_BATCH = 64;
+
 /// Flags representing the type of a navigation mesh polygon.
 enum dtPolyTypes
 {
@@ -174,6 +211,7 @@ struct dtPoly
 	/// @note Use the structure's set and get methods to acess this value.
 	unsigned char areaAndtype;
 
+	/// The disjoint poly group of the polygon. (See: dtNavMesh::isGoalPolyReachable)
 	unsigned short disjointSetId;
 	unsigned short unk;				//IDK but looks filled
 	float org[3];					//NO IDEA
@@ -224,6 +262,71 @@ struct dtBVNode
 	int i;							///< The node's index. (Negative for escape sequence.)
 };
 
+/// The number of children of a wide bounding volume node.
+static const int DT_WIDE_BVNODE_WIDTH = 4;
+
+/// The maximum depth of a wide bounding volume tree.
+static const int DT_WIDE_BVTREE_MAX_DEPTH = 20;
+
+/// Wide bounding volume node, holding the bounds of its children side by side.
+/// The bounds are quantized the same way as the ones of dtBVNode.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile, dtCreateWideBVTree
+struct dtWideBVNode
+{
+	unsigned short bmin[3][DT_WIDE_BVNODE_WIDTH];	///< Minimum bounds of the children's AABBs. [(x, y, z) * #DT_WIDE_BVNODE_WIDTH]
+	unsigned short bmax[3][DT_WIDE_BVNODE_WIDTH];	///< Maximum bounds of the children's AABBs. [(x, y, z) * #DT_WIDE_BVNODE_WIDTH]
+
+	/// The children. Positive for the index of a wide node, negative for the polygon
+	/// index of a leaf as <tt>-(index+1)</tt>, and zero for unused children.
+	int child[DT_WIDE_BVNODE_WIDTH];
+};
+
+/// Four detail triangles of a polygon, stored side by side so they can be tested at once.
+/// The edges are computed the same way as in #dtClosestHeightPointTriangle, so both give the same heights.
+/// Unused triangles have zero edges and never contain a point.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile::detailTriBlocks, dtClosestHeightPointTriangle4
+struct dtDetailTriBlock
+{
+	float a[3][4];			///< The first vertices of the triangles. [(x, y, z) * 4]
+	float ac[3][4];			///< The edges from the first to the third vertices. [(x, y, z) * 4]
+	float ab[3][4];			///< The edges from the first to the second vertices. [(x, y, z) * 4]
+};
+
+/// Four boundary edges of the detail mesh of a polygon, stored side by side so they can be tested at once.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile::detailEdgeBlocks, dtDistancePtSegSqr2D4
+struct dtDetailEdgeBlock
+{
+	float p[3][4];			///< The start points of the edges. [(x, y, z) * 4]
+	float pq[3][4];			///< The edges from the start to the end points. [(x, y, z) * 4]
+};
+
+/// The detail triangle and edge blocks of a polygon.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile::detailBlocks
+struct dtPolyDetailBlocks
+{
+	unsigned int triBase;		///< The index of the first triangle block. The block count follows from dtPolyDetail::triCount.
+	unsigned int edgeBase;		///< The index of the first edge block.
+	unsigned int edgeCount;		///< The number of boundary edges, in the order they are found in the detail triangles.
+};
+
+/// A polygon edge on the border of a tile that leads to a neighbour tile.
+/// The edges of a side are sorted along the border, so links are found with a binary search.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile::portalEdges
+struct dtPortalEdge
+{
+	float smin;				///< The minimum coordinate of the edge along the border.
+	float smax;				///< The maximum coordinate of the edge along the border.
+	float reach;			///< The largest #smax of this and the preceding edges of the side.
+	unsigned short poly;	///< The index of the polygon within the tile.
+	unsigned char edge;		///< The index of the edge within the polygon.
+	unsigned char side;		///< The side of the tile the edge is on.
+};
+
 /// Defines an navigation mesh off-mesh connection within a dtMeshTile object.
 /// An off-mesh connection is a user defined traversable connection made up to two vertices.
 struct dtOffMeshConnection
@@ -302,8 +405,15 @@ struct dtMeshTile
 	dtPolyDetail* detailMeshes;			///< The tile's detail sub-meshes. [Size: dtMeshHeader::detailMeshCount]
 	
 	/// The detail mesh's unique vertices. [(x, y, z) * dtMeshHeader::detailVertCount]
+	/// (Will be null if the detail vertices are packed, use #dtGetDetailVert to read the vertices of any tile.)
 	float* detailVerts;	
 
+	/// The detail mesh's unique vertices, quantized to 16 bits. [(x, y, z) * dtMeshHeader::detailVertCount]
+	/// (Will be null unless the detail vertices are packed. See: #DT_NAVMESH_PACKED_DETAIL_MAGIC)
+	const unsigned short* packedDetailVerts;
+	float packedDetailOrig[3];			///< The position of the quantized vertex (0, 0, 0). [(x, y, z)]
+	float packedDetailScale[3];			///< The size of a quantization step along each axis. [(x, y, z)]
+
 	/// The detail mesh's triangles. [(vertA, vertB, vertC, triFlags) * dtMeshHeader::detailTriCount].
 	/// See dtDetailTriEdgeFlags and dtGetDetailTriEdgeFlags.
 	unsigned char* detailTris;	
@@ -312,10 +422,39 @@ struct dtMeshTile
 	/// (Will be null if bounding volumes are disabled.)
 	dtBVNode* bvTree;
 
+	/// The wide bounding volume tree built from #bvTree when the tile is added. The root is the first node.
+	/// (Will be null if bounding volumes are disabled or the tile was added with #DT_TILE_NO_WIDE_BVTREE.)
+	dtWideBVNode* wideBvTree;
+	int wideBvNodeCount;				///< The number of wide bounding volume nodes.
+
+	/// The detail triangles and boundary edges of the polygons, grouped in blocks of four, built when the tile is
+	/// added. Holds the memory of #detailBlocks and #detailEdgeBlocks as well.
+	/// (Will be null if the tile has no detail triangles or was added without #DT_TILE_DETAIL_BLOCKS.)
+	dtDetailTriBlock* detailTriBlocks;
+	dtDetailEdgeBlock* detailEdgeBlocks;	///< The boundary edge blocks. (See: #detailTriBlocks)
+	dtPolyDetailBlocks* detailBlocks;		///< The blocks of each polygon. [Size: dtMeshHeader::detailMeshCount]
+
+	/// The portal edges of the tile, grouped by side, built when the tile is added.
+	/// (Will be null if the tile has no portal edges.)
+	dtPortalEdge* portalEdges;
+
+	/// The index of the first portal edge of each side, followed by the number of portal edges.
+	int portalEdgeSides[9];
+
+	/// The indices of the off-mesh connections, grouped by the side of the tile their end point is on,
+	/// followed by the connections that end inside the tile. Built when the tile is added.
+	/// (Will be null if the tile has no off-mesh connections.)
+	unsigned short* offMeshConsBySide;
+
+	/// The index of the first connection of each side in #offMeshConsBySide, then of the connections
+	/// ending inside the tile, followed by the number of indexed connections.
+	int offMeshConSides[10];
+
 	dtOffMeshConnection* offMeshCons;		///< The tile off-mesh connections. [Size: dtMeshHeader::offMeshConCount]
 		
 	unsigned char* data;					///< The tile data. (Not directly accessed under normal situations.)
 	int dataSize;							///< Size of the tile data.
+	unsigned char* runtimeData;				///< The copy of the parts of the tile data the mesh writes to, or null. (See: #DT_TILE_READ_ONLY_DATA)
 	int flags;								///< Tile flags. (See: #dtTileFlags)
 	dtMeshTile* next;						///< The next free tile, or the next tile in the spatial grid.
 private:
@@ -332,6 +471,22 @@ inline int dtGetDetailTriEdgeFlags(unsigned char triFlags, int edgeIndex)
 	return (triFlags >> (edgeIndex * 2)) & 0x3;
 }
 
+/// Gets a vertex of the detail mesh of a tile, unpacking it if the detail vertices are packed.
+///  @param[in]		tile	The tile.
+///  @param[in]		i		The index of the vertex in the detail vertices of the tile.
+///  @param[out]	tmp		Storage for the unpacked vertex. [(x, y, z)]
+/// @return The vertex, which points to either the tile data or @p tmp. [(x, y, z)]
+inline const float* dtGetDetailVert(const dtMeshTile* tile, const int i, float* tmp)
+{
+	if (tile->detailVerts)
+		return &tile->detailVerts[i*3];
+	const unsigned short* q = &tile->packedDetailVerts[i*3];
+	tmp[0] = tile->packedDetailOrig[0] + q[0]*tile->packedDetailScale[0];
+	tmp[1] = tile->packedDetailOrig[1] + q[1]*tile->packedDetailScale[1];
+	tmp[2] = tile->packedDetailOrig[2] + q[2]*tile->packedDetailScale[2];
+	return tmp;
+}
+
 /// Configuration parameters used to define multi-tile navigation meshes.
 /// The values are used to allocate space during the initialization of a navigation mesh.
 /// @see dtNavMesh::init()
@@ -345,10 +500,92 @@ struct dtNavMeshParams
 	int maxPolys;					///< The maximum number of polygons each tile can contain. This and maxTiles are used to calculate how many bits are needed to identify tiles and polygons uniquely.
 //	
 //// i hate this
-	int disjointPolyGroupCount = 0;
-	int reachabilityTableSize = 0;
-	int reachabilityTableCount = 0;
+	int disjointPolyGroupCount = 0;	///< The number of disjoint poly groups. (See: dtPoly::disjointSetId)
+	int reachabilityTableSize = 0;	///< The size of each reachability table. [Units: bytes]
+	int reachabilityTableCount = 0;	///< The number of reachability tables.
+
+};
+
+/// The maximum number of polygon grid cells along each side of a tile.
+/// @see dtNavMesh::initPolyGrid
+static const int DT_POLYGRID_MAX_CELLS_PER_TILE = 64;
+
+/// A polygon in a cell of the polygon grid.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtNavMesh::initPolyGrid
+struct dtPolyGridEntry
+{
+	float bmin[3];				///< The minimum bounds of the polygon. [(x, y, z)]
+	float bmax[3];				///< The maximum bounds of the polygon. [(x, y, z)]
+	unsigned short qbmin[3];	///< The minimum bounds of the polygon's bounding volume tree leaf, if the tile has a tree. [(x, y, z)]
+	unsigned short qbmax[3];	///< The maximum bounds of the polygon's bounding volume tree leaf, if the tile has a tree. [(x, y, z)]
+	dtPolyRef ref;				///< The reference of the polygon.
+	unsigned char cellX;		///< The cell of the entry along the x-axis.
+	unsigned char cellY;		///< The cell of the entry along the y-axis.
+	unsigned char firstCellX;	///< The first cell of the column the polygon overlaps along the x-axis.
+	unsigned char firstCellY;	///< The first cell of the column the polygon overlaps along the y-axis.
+};
+
+/// The polygon grid cells covering one tile location, for all of its layers.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtNavMesh::initPolyGrid
+struct dtPolyGridColumn
+{
+	int x;						///< The tile x-location of the column.
+	int y;						///< The tile y-location of the column.
+	int entryCount;				///< The number of entries in the column.
+	int* cells;					///< The index of the first entry of each cell, followed by #entryCount. [Size: cellsPerTile * cellsPerTile + 1]
+	dtPolyGridEntry* entries;	///< The entries, grouped by cell and by tile within a cell. [Size: #entryCount]
+	dtPolyGridColumn* next;		///< The next column in the spatial hash.
+};
+
+class dtNavMesh;
 
+/// Receives notifications when tiles are added to or removed from a navigation mesh.
+/// Used to keep data derived from the tiles up to date. (E.g. #dtTileGraph)
+/// @see dtNavMesh::setTileListener
+/// @ingroup detour
+class dtNavMeshTileListener
+{
+public:
+	virtual ~dtNavMeshTileListener() {}
+
+	/// Called by dtNavMesh::addTile once the tile is connected to its neighbours.
+	///  @param[in]	nav		The navigation mesh.
+	///  @param[in]	ref		The reference of the added tile.
+	virtual void tileAdded(const dtNavMesh* nav, dtTileRef ref) = 0;
+
+	/// Called by dtNavMesh::removeTile once the tile is disconnected from its neighbours.
+	/// The tile reference is no longer valid at that point.
+	///  @param[in]	nav		The navigation mesh.
+	///  @param[in]	ref		The reference the removed tile had.
+	///  @param[in]	tx		The x-location of the removed tile.
+	///  @param[in]	ty		The y-location of the removed tile.
+	virtual void tileRemoved(const dtNavMesh* nav, dtTileRef ref, int tx, int ty) = 0;
+};
+
+/// A function executed by #dtTaskScheduler::parallelFor for a range of items.
+///  @param[in]	userData	The user data passed to the scheduler.
+///  @param[in]	begin		The first item of the range.
+///  @param[in]	end			One past the last item of the range.
+typedef void (dtParallelForFunc)(void* userData, const int begin, const int end);
+
+/// Runs the work of the navigation mesh in parallel on the threads of the caller, e.g. on 
+/// the job system of an engine or an #rcTaskScheduler.
+/// @see dtNavMesh::addTiles
+/// @ingroup detour
+class dtTaskScheduler
+{
+public:
+	virtual ~dtTaskScheduler() {}
+
+	/// Runs @p func over the items [0, @p count) and blocks until all items are processed.
+	/// The items are passed in ranges of at most @p grain items, in no particular order.
+	///  @param[in]	count		The number of items.
+	///  @param[in]	grain		The maximum number of items per range. [Limit: > 0]
+	///  @param[in]	func		The function to run for each range.
+	///  @param[in]	userData	The user data passed to the function.
+	virtual void parallelFor(const int count, const int grain, dtParallelForFunc* func, void* userData) = 0;
 };
 
 /// A navigation mesh based on tiles of convex polygons.
@@ -378,6 +615,12 @@ public:
 	/// The navigation mesh initialization params.
 	const dtNavMeshParams* getParams() const;
 
+	/// Gets the bounds of the tiles in the navigation mesh.
+	///  @param[out]	bmin	The minimum bounds of the tiles. [(x, y, z)]
+	///  @param[out]	bmax	The maximum bounds of the tiles. [(x, y, z)]
+	/// @return False if the navigation mesh has no tiles.
+	bool getBounds(float* bmin, float* bmax) const;
+
 	/// Adds a tile to the navigation mesh.
 	///  @param[in]		data		Data for the new tile mesh. (See: #dtCreateNavMeshData)
 	///  @param[in]		dataSize	Data size of the new tile mesh.
@@ -386,6 +629,18 @@ public:
 	///  @param[out]	result		The tile reference. (If the tile was succesfully added.) [opt]
 	/// @return The status flags for the operation.
 	dtStatus addTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtTileRef* result);
+
+	/// Adds a set of tiles to the navigation mesh, linking them once all of them are in place.
+	///  @param[in]		data		Data for each new tile mesh. (See: #dtCreateNavMeshData) [Size: @p count]
+	///  @param[in]		dataSizes	Data size of each new tile mesh. [Size: @p count]
+	///  @param[in]		count		The number of tiles to add.
+	///  @param[in]		flags		Tile flags used for all the tiles. (See: #dtTileFlags)
+	///  @param[in]		lastRefs	The desired reference for each tile. (When reloading tiles.) [opt] [Size: @p count]
+	///  @param[in]		scheduler	The scheduler that links the tiles in parallel, or null to link them on the calling thread. [opt]
+	///  @param[out]	results		The tile reference of each tile, or zero if it could not be added. [opt] [Size: @p count]
+	/// @return The status flags for the operation.
+	dtStatus addTiles(unsigned char* const* data, const int* dataSizes, const int count, const int flags,
+					  const dtTileRef* lastRefs, dtTaskScheduler* scheduler, dtTileRef* results);
 	
 	/// Removes the specified tile from the navigation mesh.
 	///  @param[in]		ref			The reference of the tile to remove.
@@ -394,6 +649,25 @@ public:
 	/// @return The status flags for the operation.
 	dtStatus removeTile(dtTileRef ref, unsigned char** data, int* dataSize);
 
+	/// Sets the listener that is notified when tiles are added or removed.
+	///  @param[in]	listener	The listener, or null to remove the current listener.
+	void setTileListener(dtNavMeshTileListener* listener) { m_tileListener = listener; }
+
+	/// The listener that is notified when tiles are added or removed.
+	dtNavMeshTileListener* getTileListener() const { return m_tileListener; }
+
+	/// Builds the polygon grid, a spatial index of the polygons of all tiles that 
+	/// dtNavMeshQuery::queryPolygons and dtNavMeshQuery::findNearestPoly use for small 
+	/// query boxes when present.
+	/// The grid is kept up to date as tiles are added and removed.
+	///  @param[in]	cellsPerTile	The number of cells along each side of a tile, or zero to free the grid.
+	///  								[Limit: 0 <= value <= #DT_POLYGRID_MAX_CELLS_PER_TILE]
+	/// @return The status flags for the operation.
+	dtStatus initPolyGrid(const int cellsPerTile);
+
+	/// The number of polygon grid cells along each side of a tile, or zero if there is no grid.
+	int getPolyGridCellsPerTile() const { return m_polyGridCellsPerTile; }
+
 	/// @}
 
 	/// @{
@@ -428,6 +702,20 @@ public:
 	/// @return The tile reference of the tile, or 0 if there is none.
 	dtTileRef getTileRefAt(int x, int y, int layer) const;
 
+	/// Calculates the polygon grid cells that can hold polygons a query with the box returns.
+	/// The cells of tile (tx, ty) are [tx * cellsPerTile, (tx+1) * cellsPerTile) along x, likewise along y.
+	///  @param[in]		bmin	The minimum bounds of the box. [(x, y, z)]
+	///  @param[in]		bmax	The maximum bounds of the box. [(x, y, z)]
+	///  @param[out]	cmin	The first cell along each axis. [(x, y)]
+	///  @param[out]	cmax	The last cell along each axis. [(x, y)]
+	void calcPolyGridQueryCells(const float* bmin, const float* bmax, int* cmin, int* cmax) const;
+
+	/// Gets the polygon grid cells at the specified tile location.
+	///  @param[in]	x		The tile's x-location. (x, y)
+	///  @param[in]	y		The tile's y-location. (x, y)
+	/// @return The column, or null if there is no grid or no tile at the location.
+	const dtPolyGridColumn* getPolyGridColumn(const int x, const int y) const;
+
 	/// Gets the tile reference for the specified tile.
 	///  @param[in]	tile	The tile.
 	/// @return The tile reference of the tile.
@@ -514,6 +802,22 @@ public:
 	/// @return The status flags for the operation.
 	dtStatus getPolyArea(dtPolyRef ref, unsigned char* resultArea) const;
 
+	/// Sets the reachability tables of the navigation mesh.
+	///  @param[in]	data		The tables, as stored after the tiles of a navigation mesh set.
+	///  @param[in]	dataSize	The size of the table data. [Limit: >= reachabilityTableCount * reachabilityTableSize]
+	/// @return The status flags for the operation.
+	dtStatus setReachabilityTables(const unsigned int* data, const int dataSize);
+
+	/// Returns true if the navigation mesh has reachability tables.
+	bool hasReachabilityTables() const { return m_reachability != 0; }
+
+	/// Checks whether the goal polygon can be reached from the start polygon.
+	///  @param[in]	fromRef		The reference of the start polygon.
+	///  @param[in]	goalRef		The reference of the goal polygon.
+	///  @param[in]	tableIndex	The reachability table to use. [Limit: < reachabilityTableCount]
+	/// @return False only if the tables prove that the goal polygon cannot be reached.
+	bool isGoalPolyReachable(const dtPolyRef fromRef, const dtPolyRef goalRef, const int tableIndex) const;
+
 	/// Gets the size of the buffer required by #storeTileState to store the specified tile's state.
 	///  @param[in]	tile	The tile.
 	/// @return The size of the buffer required to store the state.
@@ -647,6 +951,13 @@ private:
 							const dtMeshTile* tile, int side,
 							dtPolyRef* con, float* conarea, int maxcon) const;
 	
+	/// Validates the tile data and inserts the tile into the position lookup, without linking it.
+	dtStatus insertTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtMeshTile** result);
+	/// Links the tiles [begin, end) of the tiles inserted by #addTiles. (See: #addTiles)
+	void connectBulkTiles(dtMeshTile* const* tiles, const int begin, const int end, const int pass);
+	/// Runs #connectBulkTiles for a range of tiles scheduled by #addTiles.
+	static void connectBulkTilesRange(void* userData, const int begin, const int end);
+
 	/// Builds internal polygons links for a tile.
 	void connectIntLinks(dtMeshTile* tile);
 	/// Builds internal polygons links for a tile.
@@ -659,6 +970,11 @@ private:
 	
 	/// Removes external links at specified side.
 	void unconnectLinks(dtMeshTile* tile, dtMeshTile* target);
+
+	/// Finds the polygons connecting to the segment through the portal edge index of the tile.
+	int findConnectingPortalPolys(const float* va, const float* vb,
+								  const dtMeshTile* tile, int side,
+								  dtPolyRef* con, float* conarea, int maxcon) const;
 	
 
 	// TODO: These methods are duplicates from dtNavMeshQuery, but are needed for off-mesh connection finding.
@@ -673,10 +989,19 @@ private:
 	bool getPolyHeight(const dtMeshTile* tile, const dtPoly* poly, const float* pos, float* height) const;
 	/// Returns closest point on polygon.
 	void closestPointOnPoly(dtPolyRef ref, const float* pos, float* closest, bool* posOverPoly) const;
+
+	/// Rebuilds the polygon grid column at the tile location from the tiles at it.
+	bool buildPolyGridColumn(const int x, const int y);
+	/// Frees the polygon grid.
+	void freePolyGrid();
+
+	/// Recomputes the bounds of the tiles from all the tiles.
+	void calcBounds();
 	
 	dtNavMeshParams m_params;			///< Current initialization params. TODO: do not store this info twice.
 	float m_orig[3];					///< Origin of the tile (0,0)
 	float m_tileWidth, m_tileHeight;	///< Dimensions of each tile.
+	float m_bmin[3], m_bmax[3];			///< Bounds of the tiles, empty if there are none. (See: #getBounds)
 	int m_maxTiles;						///< Max number of tiles.
 	int m_tileLutSize;					///< Tile hash lookup size (must be pot).
 	int m_tileLutMask;					///< Tile hash lookup mask.
@@ -684,6 +1009,18 @@ private:
 	dtMeshTile** m_posLookup;			///< Tile hash lookup.
 	dtMeshTile* m_nextFree;				///< Freelist of tiles.
 	dtMeshTile* m_tiles;				///< List of tiles.
+
+	unsigned int* m_reachability;		///< Reachability bit tables, one row per disjoint poly group. (See: #setReachabilityTables)
+	int m_reachabilityRowSize;			///< Number of words in a reachability table row.
+	int m_reachabilityTableStride;		///< Number of words in a reachability table.
+
+	dtNavMeshTileListener* m_tileListener;	///< Notified when tiles are added or removed. (See: #setTileListener)
+
+	dtPolyGridColumn** m_polyGridLookup;	///< Polygon grid columns, hashed like #m_posLookup. (See: #initPolyGrid)
+	int m_polyGridCellsPerTile;				///< Number of polygon grid cells along each side of a tile.
+	float m_polyGridCellWidth;				///< Width of a polygon grid cell.
+	float m_polyGridCellHeight;				///< Height of a polygon grid cell.
+	float m_polyGridMargin;					///< Distance quantized tree queries can reach past the polygon bounds in the grid.
 		
 #ifndef DT_POLYREF64
 	unsigned int m_saltBits;			///< Number of salt bits in the tile ID.
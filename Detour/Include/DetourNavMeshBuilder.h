@@ -21,6 +21,17 @@
 
 #include "DetourAlloc.h"
 
+struct dtBVNode;
+struct dtWideBVNode;
+
+/// The methods used to split the polygons when building the bounding volume tree of a tile.
+/// @see dtNavMeshCreateParams::bvTreeBuildMethod
+enum dtBVTreeBuildMethod
+{
+	DT_BVTREE_MEDIAN = 0,	///< Splits at the median of the longest axis of the node. (Default)
+	DT_BVTREE_SAH = 1,		///< Splits where the binned surface area heuristic is lowest.
+};
+
 /// Represents the source data used to build an navigation mesh tile.
 /// @ingroup detour
 struct dtNavMeshCreateParams
@@ -101,6 +112,9 @@ struct dtNavMeshCreateParams
 	/// @note The BVTree is not normally needed for layered navigation meshes.
 	bool buildBvTree;
 
+	/// The method used to build the bounding volume tree. (See: #dtBVTreeBuildMethod)
+	unsigned char bvTreeBuildMethod;
+
 	/// @}
 };
 
@@ -112,6 +126,26 @@ struct dtNavMeshCreateParams
 /// @return True if the tile data was successfully created.
 bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData, int* outDataSize);
 
+/// Builds a copy of the tile data that stores the detail mesh vertices quantized to 16 bits, which
+/// saves 6 bytes per detail vertex. The rest of the data is copied as is.
+/// The copy can be added to a navigation mesh like the original data. (See: #DT_NAVMESH_PACKED_DETAIL_MAGIC)
+///  @param[in]		data			The tile data, as built by #dtCreateNavMeshData.
+///  @param[in]		dataSize		The size of the tile data.
+///  @param[out]	outData			The packed tile data.
+///  @param[out]	outDataSize		The size of the packed tile data.
+/// @return True if the tile data was successfully packed.
+bool dtPackNavMeshDetailVerts(const unsigned char* data, const int dataSize, unsigned char** outData, int* outDataSize);
+
+/// Builds the wide bounding volume tree of a tile from its binary bounding volume tree.
+/// dtNavMesh::addTile calls this for every tile that has a bounding volume tree.
+///  @param[in]		nodes			The binary tree. (See: dtMeshTile::bvTree)
+///  @param[in]		nodeCount		The number of nodes in the binary tree.
+///  @param[out]	wideNodes		The wide tree.
+///  @param[in]		maxWideNodes	The maximum number of nodes the wide tree can hold. [Limit: >= @p nodeCount / 2]
+/// @return The number of nodes in the wide tree, or zero if the binary tree is malformed or
+/// deeper than #DT_WIDE_BVTREE_MAX_DEPTH.
+int dtCreateWideBVTree(const dtBVNode* nodes, const int nodeCount, dtWideBVNode* wideNodes, const int maxWideNodes);
+
 /// Swaps the endianess of the tile data's header (#dtMeshHeader).
 ///  @param[in,out]	data		The tile data array.
 ///  @param[in]		dataSize	The size of the data array.
@@ -145,5 +179,14 @@ function.
 
 @see dtCreateNavMeshData
 
+@var dtNavMeshCreateParams::bvTreeBuildMethod
+@par
+
+The median split gives balanced trees, but the boxes of its nodes can overlap a lot in elongated 
+or multi-storey tiles, so queries visit more nodes. The surface area heuristic bins the polygons 
+by their centers and picks the split with the smallest combined child area, and does not sort. 
+Splits that would make the tree deeper than #DT_WIDE_BVTREE_MAX_DEPTH fall back to the median 
+split. Both methods produce the same node count and encoding, so the tile data stays compatible.
+
 */
 
@@ -21,6 +21,7 @@
 
 #include "DetourNavMesh.h"
 #include "DetourStatus.h"
+#include "DetourCommon.h"
 
 
 // Define DT_VIRTUAL_QUERYFILTER if you wish to derive a custom filter from dtQueryFilter.
@@ -37,6 +38,7 @@ class dtQueryFilter
 	float m_areaCost[DT_MAX_AREAS];		///< Cost per area type. (Used by default implementation.)
 	unsigned short m_includeFlags;		///< Flags for polygons that can be visited. (Used by default implementation.)
 	unsigned short m_excludeFlags;		///< Flags for polygons that should not be visted. (Used by default implementation.)
+	int m_reachabilityTable;			///< The reachability table used to reject unreachable goals. (See: dtNavMesh::isGoalPolyReachable)
 	
 public:
 	dtQueryFilter();
@@ -115,10 +117,34 @@ public:
 	/// @param[in]		flags		The new flags.
 	inline void setExcludeFlags(const unsigned short flags) { m_excludeFlags = flags; }	
 
+	/// Returns the reachability table used by path queries with this filter.
+	inline int getReachabilityTable() const { return m_reachabilityTable; }
+
+	/// Sets the reachability table used by path queries with this filter.
+	/// @param[in]		table		The index of the table. (See: dtNavMeshParams::reachabilityTableCount)
+	inline void setReachabilityTable(const int table) { m_reachabilityTable = table; }
+
 	///@}
 
 };
 
+#ifndef DT_VIRTUAL_QUERYFILTER
+inline bool dtQueryFilter::passFilter(const dtPolyRef /*ref*/,
+									  const dtMeshTile* /*tile*/,
+									  const dtPoly* poly) const
+{
+	return (poly->flags & m_includeFlags) != 0 && (poly->flags & m_excludeFlags) == 0;
+}
+
+inline float dtQueryFilter::getCost(const float* pa, const float* pb,
+									const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
+									const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
+									const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+{
+	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
+}
+#endif
+
 /// Provides information about raycast hit
 /// filled by dtNavMeshQuery::raycast
 /// @ingroup detour
@@ -146,6 +172,26 @@ struct dtRaycastHit
 	float pathCost;
 };
 
+/// A single path request of dtNavMeshQuery::findPaths.
+/// @ingroup detour
+struct dtPathRequest
+{
+	dtPolyRef startRef;				///< The reference id of the start polygon.
+	dtPolyRef endRef;				///< The reference id of the end polygon.
+	float startPos[3];				///< A position within the start polygon. [(x, y, z)]
+	float endPos[3];				///< A position within the end polygon. [(x, y, z)]
+	const dtQueryFilter* filter;	///< The polygon filter to apply to the request.
+};
+
+/// The result of a single path request of dtNavMeshQuery::findPaths.
+/// @ingroup detour
+struct dtPathResult
+{
+	dtStatus status;				///< The status flags of the request.
+	int pathCount;					///< The number of polygons in the corridor of the request.
+	int straightPathCount;			///< The number of points in the straight path of the request.
+};
+
 /// Provides custom polygon query behavior.
 /// Used by dtNavMeshQuery::queryPolygons.
 /// @ingroup detour
@@ -159,6 +205,8 @@ public:
 	virtual void process(const dtMeshTile* tile, dtPoly** polys, dtPolyRef* refs, int count) = 0;
 };
 
+class dtFlowField;
+
 /// Provides the ability to perform pathfinding related queries against
 /// a navigation mesh.
 /// @ingroup detour
@@ -171,8 +219,11 @@ public:
 	/// Initializes the query object.
 	///  @param[in]		nav			Pointer to the dtNavMesh object to use for all queries.
 	///  @param[in]		maxNodes	Maximum number of search nodes. [Limits: 0 < value <= 65535]
+	///  @param[in]		poolType	The node lookup of the search node pool. (See: #dtNodePoolType)
+	///  @param[in]		queueType	The open list of the searches. (See: #dtNodeQueueType)
 	/// @returns The status flags for the query.
-	dtStatus init(const dtNavMesh* nav, const int maxNodes);
+	dtStatus init(const dtNavMesh* nav, const int maxNodes, const dtNodePoolType poolType = DT_NODE_POOL_HASH,
+				  const dtNodeQueueType queueType = DT_NODE_QUEUE_BINARY_HEAP);
 	
 	/// @name Standard Pathfinding Functions
 	// /@{
@@ -187,10 +238,28 @@ public:
 	///  							[(polyRef) * @p pathCount]
 	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
 	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	///  @param[in]		options		Query options. (See: #DT_FINDPATH_CLOSEST_REACHABLE)
 	dtStatus findPath(dtPolyRef startRef, dtPolyRef endRef,
 					  const float* startPos, const float* endPos,
 					  const dtQueryFilter* filter,
-					  dtPolyRef* path, int* pathCount, const int maxPath) const;
+					  dtPolyRef* path, int* pathCount, const int maxPath,
+					  const unsigned int options = 0) const;
+
+	/// Finds a path from the start polygon to the end polygon, visiting only polygons in the specified tiles.
+	///  @param[in]		startRef	The refrence id of the start polygon.
+	///  @param[in]		endRef		The reference id of the end polygon.
+	///  @param[in]		startPos	A position within the start polygon. [(x, y, z)]
+	///  @param[in]		endPos		A position within the end polygon. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[in]		tileMask	Non-zero for every tile index the path may visit. [Size: dtNavMesh::getMaxTiles()]
+	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to end.) 
+	///  							[(polyRef) * @p pathCount]
+	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
+	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	dtStatus findPathInTiles(dtPolyRef startRef, dtPolyRef endRef,
+							 const float* startPos, const float* endPos,
+							 const dtQueryFilter* filter, const unsigned char* tileMask,
+							 dtPolyRef* path, int* pathCount, const int maxPath) const;
 
 	/// Finds the straight path from the start to the end position within the polygon corridor.
 	///  @param[in]		startPos			Path start position. [(x, y, z)]
@@ -209,6 +278,34 @@ public:
 							  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 							  int* straightPathCount, const int maxStraightPath, const int options = 0) const;
 
+	/// Finds the corridors and straight paths of a batch of path requests.
+	///  @param[in]		requests			The path requests. [Size: @p requestCount]
+	///  @param[in]		requestCount		The number of path requests.
+	///  @param[out]	results				The result of each request. [Size: @p requestCount]
+	///  @param[out]	paths				The corridor of request i is stored at <tt>paths + i*maxPath</tt>.
+	///  									[(polyRef) * @p maxPath * @p requestCount]
+	///  @param[in]		maxPath				The maximum number of polygons per corridor. [Limit: >= 1]
+	///  @param[out]	straightPaths		The straight path of request i is stored at <tt>straightPaths + i*maxStraightPath*3</tt>.
+	///  									[(x, y, z) * @p maxStraightPath * @p requestCount] [opt]
+	///  @param[in]		maxStraightPath		The maximum number of points per straight path.
+	///  @param[in]		minSharedGoal		The number of requests that must share an end polygon and filter
+	///  									before they are served by a single search from the goal.
+	/// @returns The status flags for the batch. The status of each request is stored in @p results.
+	dtStatus findPaths(const dtPathRequest* requests, const int requestCount, dtPathResult* results,
+					   dtPolyRef* paths, const int maxPath,
+					   float* straightPaths, const int maxStraightPath,
+					   const int minSharedGoal = 4) const;
+
+	/// Finds the cost and next hop to the goal polygon of all polygons within a cost bound.
+	///  @param[in]		goalRef		The reference id of the goal polygon.
+	///  @param[in]		goalPos		A position within the goal polygon. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[in]		maxCost		The maximum cost to the goal of the polygons in the field.
+	///  @param[out]	field		The flow field to store the result in.
+	/// @returns The status flags for the query.
+	dtStatus buildFlowField(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter,
+							const float maxCost, dtFlowField* field) const;
+
 	///@}
 	/// @name Sliced Pathfinding Functions
 	/// Common use case:
@@ -422,6 +519,21 @@ public:
 					 const dtQueryFilter* filter, const unsigned int options,
 					 dtRaycastHit* hit, dtPolyRef prevRef = 0) const;
 
+	/// Casts a batch of 'walkability' rays from a common start polygon.
+	/// The rays share the polygon traversal: each polygon is fetched once for all the rays
+	/// inside it, and its edges are tested against four rays at a time. The result of
+	/// each ray matches #raycast with the same options.
+	///  @param[in]		startRef	The reference id of the start polygon.
+	///  @param[in]		startPos	The start positions of the rays, within the start polygon. [(x, y, z) * @p rayCount]
+	///  @param[in]		endPos		The positions to cast the rays toward. [(x, y, z) * @p rayCount]
+	///  @param[in]		rayCount	The number of rays.
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[in]		options		govern how the raycast behaves. See dtRaycastOptions
+	///  @param[out]	hits		The result of each ray. The @p path and @p maxPath members are used
+	///  							as in #raycast. [Size: @p rayCount]
+	/// @returns The status flags for the query.
+	dtStatus raycasts(dtPolyRef startRef, const float* startPos, const float* endPos, const int rayCount,
+					  const dtQueryFilter* filter, const unsigned int options, dtRaycastHit* hits) const;
 
 	/// Finds the distance from the specified position to the nearest polygon wall.
 	///  @param[in]		startRef		The reference id of the polygon containing @p centerPos.
@@ -490,6 +602,17 @@ public:
 	/// @returns The status flags for the query.
 	dtStatus closestPointOnPolyBoundary(dtPolyRef ref, const float* pos, float* closest) const;
 	
+	/// Gets the portal edge between two linked polygons, as used by #findStraightPath.
+	///  @param[in]		from		The reference id of the polygon the portal is left from.
+	///  @param[in]		to			The reference id of the polygon the portal leads to.
+	///  @param[out]	left		The left point of the portal, seen from @p from. [(x, y, z)]
+	///  @param[out]	right		The right point of the portal, seen from @p from. [(x, y, z)]
+	///  @param[out]	fromType	The type of the @p from polygon. (See: #dtPolyTypes)
+	///  @param[out]	toType		The type of the @p to polygon. (See: #dtPolyTypes)
+	/// @returns The status flags for the query. Fails if the polygons are not linked.
+	dtStatus getPortalPoints(dtPolyRef from, dtPolyRef to, float* left, float* right,
+							 unsigned char& fromType, unsigned char& toType) const;
+
 	/// Gets the height of the polygon at the provided position using the height detail. (Most accurate.)
 	///  @param[in]		ref			The reference id of the polygon.
 	///  @param[in]		pos			A position within the xz-bounds of the polygon. [(x, y, z)]
@@ -520,6 +643,66 @@ public:
 	const dtNavMesh* getAttachedNavMesh() const { return m_nav; }
 
 	/// @}
+	/// @name Templated Filter Functions
+	/// Overloads of the search functions that take the filter type as a template parameter, so that
+	/// the calls to its @p passFilter and @p getCost functions are resolved at compile time and can
+	/// be inlined. They are picked when the filter is passed as a pointer to a class derived from
+	/// dtQueryFilter, and work the same as the functions taking a dtQueryFilter.
+	///
+	/// The filter type must derive from dtQueryFilter and hide #dtQueryFilter::passFilter and
+	/// #dtQueryFilter::getCost with its own versions. It does not need #DT_VIRTUAL_QUERYFILTER.
+	/// Helper searches that are not templated, such as the nearest reachable goal lookup of
+	/// #DT_FINDPATH_CLOSEST_REACHABLE, see the filter as a dtQueryFilter.
+	/// @{
+
+	/// See the dtQueryFilter overload of #findPath.
+	template<class TFilter>
+	dtStatus findPath(dtPolyRef startRef, dtPolyRef endRef,
+					  const float* startPos, const float* endPos,
+					  const TFilter* filter,
+					  dtPolyRef* path, int* pathCount, const int maxPath,
+					  const unsigned int options = 0) const;
+
+	/// See the dtQueryFilter overload of #findPathInTiles.
+	template<class TFilter>
+	dtStatus findPathInTiles(dtPolyRef startRef, dtPolyRef endRef,
+							 const float* startPos, const float* endPos,
+							 const TFilter* filter, const unsigned char* tileMask,
+							 dtPolyRef* path, int* pathCount, const int maxPath) const;
+
+	/// See the dtQueryFilter overload of #initSlicedFindPath.
+	/// #updateSlicedFindPath keeps using the filter type of the call.
+	template<class TFilter>
+	dtStatus initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef,
+								const float* startPos, const float* endPos,
+								const TFilter* filter, const unsigned int options = 0);
+
+	/// See the dtQueryFilter overload of #moveAlongSurface.
+	template<class TFilter>
+	dtStatus moveAlongSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
+							  const TFilter* filter,
+							  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const;
+
+	/// See the dtQueryFilter overload of #raycast.
+	template<class TFilter>
+	dtStatus raycast(dtPolyRef startRef, const float* startPos, const float* endPos,
+					 const TFilter* filter,
+					 float* t, float* hitNormal, dtPolyRef* path, int* pathCount, const int maxPath) const;
+
+	/// See the dtQueryFilter overload of #raycast.
+	template<class TFilter>
+	dtStatus raycast(dtPolyRef startRef, const float* startPos, const float* endPos,
+					 const TFilter* filter, const unsigned int options,
+					 dtRaycastHit* hit, dtPolyRef prevRef = 0) const;
+
+	/// See the dtQueryFilter overload of #findPolysAroundCircle.
+	template<class TFilter>
+	dtStatus findPolysAroundCircle(dtPolyRef startRef, const float* centerPos, const float radius,
+								   const TFilter* filter,
+								   dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
+								   int* resultCount, const int maxResult) const;
+
+	/// @}
 	
 private:
 	// Explicitly disabled copy constructor and copy assignment operator
@@ -530,9 +713,12 @@ private:
 	void queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
 							 const dtQueryFilter* filter, dtPolyQuery* query) const;
 
-	/// Returns portal points between two polygons.
-	dtStatus getPortalPoints(dtPolyRef from, dtPolyRef to, float* left, float* right,
-							 unsigned char& fromType, unsigned char& toType) const;
+	/// Queries polygons through the polygon grid of the navigation mesh.
+	void queryPolygonsInGrid(const float* qmin, const float* qmax,
+							 const dtQueryFilter* filter, dtPolyQuery* query) const;
+
+	/// Returns portal points between two polygons whose tiles and polygons are already known.
+	/// (See: #getPortalPoints)
 	dtStatus getPortalPoints(dtPolyRef from, const dtPoly* fromPoly, const dtMeshTile* fromTile,
 							 dtPolyRef to, const dtPoly* toPoly, const dtMeshTile* toTile,
 							 float* left, float* right) const;
@@ -555,6 +741,46 @@ private:
 
 	// Gets the path leading to the specified end node.
 	dtStatus getPathToNode(struct dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const;
+
+	// Implements findPath and findPathInTiles. A null tileMask allows all tiles.
+	template<class TFilter>
+	dtStatus findPathInternal(dtPolyRef startRef, dtPolyRef endRef,
+							  const float* startPos, const float* endPos,
+							  const TFilter* filter, const unsigned char* tileMask,
+							  dtPolyRef* path, int* pathCount, const int maxPath,
+							  const unsigned int options) const;
+
+	// Implements updateSlicedFindPath for the filter type of initSlicedFindPath.
+	template<class TFilter>
+	dtStatus updateSlicedFindPathInternal(const int maxIter, int* doneIters);
+
+	// Continues a raycast from the specified polygon, with the position, path and hit
+	// parameter reached so far in curPos and hit.
+	template<class TFilter>
+	dtStatus continueRaycast(dtPolyRef curRef, dtPolyRef prevRef, const float* startPos, const float* endPos,
+							 const TFilter* filter, const unsigned int options,
+							 float* curPos, dtRaycastHit* hit) const;
+
+	// Finds the polygon a ray leaves to through the specified edge, or zero if it hits a wall.
+	template<class TFilter>
+	dtPolyRef getRaycastNeighbour(const dtMeshTile* tile, const dtPoly* poly, const int edge,
+								  const float* startPos, const float* endPos, const float t,
+								  const TFilter* filter, const dtMeshTile** nextTile, const dtPoly** nextPoly) const;
+
+	// Casts a ray with the filter of the sliced query.
+	template<class TFilter>
+	dtStatus raycastSliced(dtPolyRef startRef, const float* startPos, const float* endPos,
+						   float* t, float* hitNormal, dtPolyRef* path, int* pathCount, const int maxPath) const;
+
+	// Runs a search outwards from the goal polygon over the links which lead towards it. Stops
+	// once all pending start polygons are reached, or expands all polygons within maxCost if
+	// there are none.
+	dtStatus searchFromGoal(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter,
+							const float maxCost, struct dtPendingStart* pending, const int pendingCount) const;
+
+	// Finds the polygon nearest to the specified position that is reachable from the start polygon.
+	dtPolyRef findNearestReachablePoly(dtPolyRef startRef, const float* pos, const dtQueryFilter* filter,
+									   float* nearestPt) const;
 	
 	const dtNavMesh* m_nav;				///< Pointer to navmesh data.
 
@@ -568,6 +794,10 @@ private:
 		const dtQueryFilter* filter;
 		unsigned int options;
 		float raycastLimitSqr;
+		dtStatus (dtNavMeshQuery::*update)(const int maxIter, int* doneIters);
+		dtStatus (dtNavMeshQuery::*raycast)(dtPolyRef startRef, const float* startPos, const float* endPos,
+											float* t, float* hitNormal, dtPolyRef* path, int* pathCount,
+											const int maxPath) const;
 	};
 	dtQueryData m_query;				///< Sliced query state.
 
@@ -586,4 +816,6 @@ dtNavMeshQuery* dtAllocNavMeshQuery();
 /// @ingroup detour
 void dtFreeNavMeshQuery(dtNavMeshQuery* query);
 
+#include "DetourNavMeshQueryImpl.h"
+
 #endif // DETOURNAVMESHQUERY_H
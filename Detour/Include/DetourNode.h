@@ -35,13 +35,15 @@ static const int DT_NODE_PARENT_BITS = 24;
 static const int DT_NODE_STATE_BITS = 2;
 struct dtNode
 {
-	float pos[3];								///< Position of the node.
-	float cost;									///< Cost from previous node to current node.
+	// The fields read by the open list and the expansion loop come first.
 	float total;								///< Cost up to the node.
+	float cost;									///< Cost from previous node to current node.
+	dtPolyRef id;								///< Polygon ref the node corresponds to.
 	unsigned int pidx : DT_NODE_PARENT_BITS;	///< Index to parent node.
 	unsigned int state : DT_NODE_STATE_BITS;	///< extra state information. A polyRef can have multiple nodes with different extra info. see DT_MAX_STATES_PER_NODE
 	unsigned int flags : 3;						///< Node flags. A combination of dtNodeFlags.
-	dtPolyRef id;								///< Polygon ref the node corresponds to.
+	float pos[3];								///< Position of the node.
+	unsigned int heapIndex;						///< Open list entry of the node. (Used by the 4-ary and the radix heap.)
 };
 
 static const int DT_MAX_STATES_PER_NODE = 1 << DT_NODE_STATE_BITS;	// number of extra states per node. See dtNode::state
@@ -49,7 +51,14 @@ static const int DT_MAX_STATES_PER_NODE = 1 << DT_NODE_STATE_BITS;	// number of
 class dtNodePool
 {
 public:
+	/// Creates a pool that looks up nodes in a hash table.
 	dtNodePool(int maxNodes, int hashSize);
+
+	/// Creates a pool that looks up nodes in dense per tile arrays indexed by polygon index.
+	/// The arrays of a tile are allocated when a search first reaches the tile, and
+	/// #clear only advances a generation counter.
+	dtNodePool(int maxNodes, const dtNavMesh* nav);
+
 	~dtNodePool();
 	void clear();
 
@@ -77,15 +86,12 @@ public:
 		return &m_nodes[idx - 1];
 	}
 	
-	inline int getMemUsed() const
-	{
-		return sizeof(*this) +
-			sizeof(dtNode)*m_maxNodes +
-			sizeof(dtNodeIndex)*m_maxNodes +
-			sizeof(dtNodeIndex)*m_hashSize;
-	}
+	int getMemUsed() const;
 	
 	inline int getMaxNodes() const { return m_maxNodes; }
+
+	/// The navigation mesh of a tile indexed pool, or null if the pool uses a hash table.
+	inline const dtNavMesh* getTileIndexedNavMesh() const { return m_nav; }
 	
 	inline int getHashSize() const { return m_hashSize; }
 	inline dtNodeIndex getFirst(int bucket) const { return m_first[bucket]; }
@@ -96,6 +102,9 @@ private:
 	// Explicitly disabled copy constructor and copy assignment operator.
 	dtNodePool(const dtNodePool&);
 	dtNodePool& operator=(const dtNodePool&);
+
+	dtNode* allocNode(dtPolyRef id, unsigned char state);
+	dtNodeIndex* getTileSlot(dtPolyRef id, unsigned char state, bool create);
 	
 	dtNode* m_nodes;
 	dtNodeIndex* m_first;
@@ -103,34 +112,74 @@ private:
 	const int m_maxNodes;
 	const int m_hashSize;
 	int m_nodeCount;
+
+	// Tile indexed lookup.
+	const dtNavMesh* m_nav;
+	int m_maxTiles;
+	dtNodeIndex** m_tileSlots;			///< Node index per polygon and state, per tile.
+	int* m_tileSlotCount;				///< Number of valid slots in the current generation, per tile.
+	int* m_tileSlotCapacity;			///< Number of allocated slots, per tile.
+	unsigned int* m_tileGeneration;		///< The generation the slots of a tile were last cleared in.
+	unsigned int m_generation;
 };
 
 class dtNodeQueue
 {
 public:
-	dtNodeQueue(int n);
+	dtNodeQueue(int n, dtNodeQueueType type = DT_NODE_QUEUE_BINARY_HEAP);
 	~dtNodeQueue();
 	
-	inline void clear() { m_size = 0; }
+	inline void clear()
+	{
+		m_size = 0;
+		if (m_type == DT_NODE_QUEUE_RADIX_HEAP)
+			clearRadix();
+	}
 	
-	inline dtNode* top() { return m_heap[0]; }
+	inline dtNode* top()
+	{
+		if (m_type == DT_NODE_QUEUE_RADIX_HEAP)
+			return m_entryNodes[peekRadix()];
+		return m_heap[0];
+	}
 	
 	inline dtNode* pop()
 	{
+		if (m_type == DT_NODE_QUEUE_RADIX_HEAP)
+			return popRadix();
 		dtNode* result = m_heap[0];
 		m_size--;
-		trickleDown(0, m_heap[m_size]);
+		if (m_type == DT_NODE_QUEUE_QUATERNARY_HEAP)
+			trickleDown4(0, m_heap[m_size]);
+		else
+			trickleDown(0, m_heap[m_size]);
 		return result;
 	}
 	
 	inline void push(dtNode* node)
 	{
 		m_size++;
-		bubbleUp(m_size-1, node);
+		if (m_type == DT_NODE_QUEUE_RADIX_HEAP)
+			pushRadix(node);
+		else if (m_type == DT_NODE_QUEUE_QUATERNARY_HEAP)
+			bubbleUp4(m_size-1, node);
+		else
+			bubbleUp(m_size-1, node);
 	}
 	
 	inline void modify(dtNode* node)
 	{
+		if (m_type == DT_NODE_QUEUE_RADIX_HEAP)
+		{
+			// The previous entry of the node goes stale.
+			pushRadix(node);
+			return;
+		}
+		if (m_type == DT_NODE_QUEUE_QUATERNARY_HEAP)
+		{
+			bubbleUp4((int)node->heapIndex, node);
+			return;
+		}
 		for (int i = 0; i < m_size; ++i)
 		{
 			if (m_heap[i] == node)
@@ -143,13 +192,11 @@ public:
 	
 	inline bool empty() const { return m_size == 0; }
 	
-	inline int getMemUsed() const
-	{
-		return sizeof(*this) +
-		sizeof(dtNode*) * (m_capacity + 1);
-	}
+	int getMemUsed() const;
 	
 	inline int getCapacity() const { return m_capacity; }
+
+	inline dtNodeQueueType getType() const { return m_type; }
 	
 private:
 	// Explicitly disabled copy constructor and copy assignment operator.
@@ -158,10 +205,32 @@ private:
 
 	void bubbleUp(int i, dtNode* node);
 	void trickleDown(int i, dtNode* node);
+
+	void bubbleUp4(int i, dtNode* node);
+	void trickleDown4(int i, dtNode* node);
+
+	void clearRadix();
+	void pushRadix(dtNode* node);
+	int peekRadix();
+	dtNode* popRadix();
+	void compactRadix();
 	
+	static const int RADIX_BUCKETS = 33;
+
+	const dtNodeQueueType m_type;
 	dtNode** m_heap;
 	const int m_capacity;
 	int m_size;
+
+	// Radix heap. Entries are kept in singly linked lists per bucket.
+	unsigned int* m_entryKeys;
+	dtNode** m_entryNodes;
+	int* m_entryNext;
+	int m_entryCapacity;
+	int m_entryCount;				///< Number of entries handed out since the last clear.
+	int m_freeEntry;				///< First entry of the free list.
+	int m_buckets[RADIX_BUCKETS];	///< First entry per bucket.
+	unsigned int m_last;			///< The last popped key.
 };		
 
 
@@ -0,0 +1,203 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURQUERYSERVICE_H
+#define DETOURQUERYSERVICE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+class dtQueryService;
+
+/// Runs a job of the query service on the query of a worker thread.
+///  @param[in]		query		The query of the worker thread.
+///  @param[in]		userData	The user data the job was submitted with.
+/// @return The status of the job, passed to the future and the callback of the job.
+typedef dtStatus dtQueryJobFunc(dtNavMeshQuery& query, void* userData);
+
+/// Receives the status of a completed job. Called on the worker thread that ran the job.
+typedef void dtQueryCallback(dtStatus status, void* userData);
+
+/// Updates the navigation mesh while no jobs are running. (See: dtQueryService::updateNavMesh)
+typedef void dtNavMeshUpdateFunc(dtNavMesh& nav, void* userData);
+
+/// Tracks the completion of a job submitted to a #dtQueryService.
+/// The future must stay alive until the job has completed.
+/// @ingroup detour
+class dtQueryFuture
+{
+public:
+	dtQueryFuture() : m_service(0), m_ready(true), m_status(DT_FAILURE) {}
+
+	/// Returns true once the job has completed.
+	bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+	/// Blocks until the job has completed.
+	/// @return The status returned by the job.
+	dtStatus wait();
+
+	/// The status returned by the job. Only valid once #isReady returns true.
+	dtStatus getStatus() const { return m_status; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtQueryFuture(const dtQueryFuture&);
+	dtQueryFuture& operator=(const dtQueryFuture&);
+
+	friend class dtQueryService;
+
+	dtQueryService* m_service;
+	std::atomic<bool> m_ready;
+	dtStatus m_status;
+};
+
+/// A path request run by dtQueryService::submitPath.
+/// The job must stay alive until it has completed.
+/// @ingroup detour
+struct dtQueryPathJob
+{
+	dtPathRequest request;			///< The path request.
+	dtPathResult result;			///< The result of the request.
+	dtPolyRef* path;				///< The corridor of the request. [(polyRef) * #maxPath]
+	int maxPath;					///< The maximum number of polygons the corridor can hold.
+	float* straightPath;			///< The straight path of the request. [(x, y, z) * #maxStraightPath] [opt]
+	int maxStraightPath;			///< The maximum number of points the straight path can hold.
+};
+
+/// Runs navigation mesh queries on a fixed set of worker threads.
+///
+/// Every worker owns a #dtNavMeshQuery, so jobs never share search state. Jobs are submitted to
+/// a bounded lock-free queue and can be tracked with a #dtQueryFuture, a #dtQueryCallback or both.
+///
+/// Tiles must only be added or removed through #updateNavMesh. The update waits until the running
+/// jobs have completed and holds back new ones until it returns, so the jobs never observe a
+/// partially linked tile. Workers only touch shared state when they pick up a job, so queries
+/// run without locks in between updates.
+///
+/// The Detour allocator must be thread-safe while the service is in use.
+/// @ingroup detour
+class dtQueryService
+{
+public:
+	dtQueryService();
+	~dtQueryService();
+
+	/// Starts the worker threads.
+	///  @param[in]		nav				The navigation mesh the queries run on. Must outlive the service.
+	///  @param[in]		threadCount		The number of worker threads. Zero uses the number of hardware threads.
+	///  @param[in]		maxNodes		The maximum number of search nodes of each worker query. [Limits: 0 < value <= 65535]
+	///  @param[in]		maxJobs			The maximum number of jobs waiting in the queue.
+	/// @return The status flags for the operation.
+	dtStatus init(dtNavMesh* nav, const int threadCount, const int maxNodes, const int maxJobs);
+
+	/// Queues a job.
+	///  @param[in]		func		The job to run.
+	///  @param[in]		userData	The user data to pass to the job and the callback.
+	///  @param[out]	future		Becomes ready once the job has completed. [opt]
+	///  @param[in]		callback	Called on the worker thread once the job has completed. [opt]
+	/// @return The status flags for the operation. #DT_BUFFER_TOO_SMALL is returned if the queue is full.
+	dtStatus submit(dtQueryJobFunc* func, void* userData, dtQueryFuture* future = 0, dtQueryCallback* callback = 0);
+
+	/// Queues a path request. The corridor and straight path are found as by dtNavMeshQuery::findPaths.
+	///  @param[in,out]	job			The path request and its result buffers.
+	///  @param[out]	future		Becomes ready once the request has completed. [opt]
+	///  @param[in]		callback	Called with @p job as the user data once the request has completed. [opt]
+	/// @return The status flags for the operation.
+	dtStatus submitPath(dtQueryPathJob* job, dtQueryFuture* future = 0, dtQueryCallback* callback = 0);
+
+	/// Waits for the running jobs to complete, then calls @p func while no jobs run.
+	/// Must not be called from a job.
+	///  @param[in]		func		Adds or removes tiles of the navigation mesh.
+	///  @param[in]		userData	The user data to pass to @p func.
+	void updateNavMesh(dtNavMeshUpdateFunc* func, void* userData);
+
+	/// Blocks until all submitted jobs have completed.
+	void waitIdle();
+
+	/// The number of worker threads.
+	int getThreadCount() const { return m_workerCount; }
+
+	/// @name Internal
+	/// Used by the futures of the service.
+	/// @{
+
+	/// Blocks until the future is ready.
+	void waitFuture(const dtQueryFuture& future);
+
+	/// @}
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtQueryService(const dtQueryService&);
+	dtQueryService& operator=(const dtQueryService&);
+
+	struct Job
+	{
+		dtQueryJobFunc* func;
+		dtQueryCallback* callback;
+		void* userData;
+		dtQueryFuture* future;
+	};
+
+	struct Cell
+	{
+		std::atomic<unsigned int> sequence;
+		Job job;
+	};
+
+	struct Worker
+	{
+		std::thread thread;
+		dtNavMeshQuery query;
+		std::atomic<bool> active;	///< True while the worker runs a job.
+	};
+
+	void shutdown();
+	bool push(const Job& job);
+	bool pop(Job& job);
+	void run(Worker& worker, const Job& job);
+	static void workerMain(dtQueryService* service, Worker* worker);
+
+	dtNavMesh* m_nav;
+
+	// Bounded multi-producer multi-consumer queue.
+	Cell* m_cells;
+	unsigned int m_cellMask;
+	std::atomic<unsigned int> m_enqueuePos;
+	std::atomic<unsigned int> m_dequeuePos;
+
+	Worker* m_workers;
+	int m_workerCount;
+
+	std::atomic<int> m_pending;		///< The number of submitted jobs which have not completed.
+	std::atomic<int> m_sleeping;	///< The number of workers waiting for jobs.
+	std::atomic<bool> m_updating;	///< True while #updateNavMesh holds back the jobs.
+	std::atomic<bool> m_stop;
+
+	std::mutex m_mutex;
+	std::condition_variable m_workCond;
+	std::condition_variable m_doneCond;
+	std::mutex m_updateMutex;
+};
+
+#endif // DETOURQUERYSERVICE_H
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURTILEGRAPH_H
+#define DETOURTILEGRAPH_H
+
+#include "DetourNavMesh.h"
+
+class dtNavMeshQuery;
+class dtQueryFilter;
+
+/// A link between a polygon of a tile and a polygon of a neighbour tile.
+/// @note This structure is rarely if ever used by the end user.
+struct dtTileGraphPortal
+{
+	dtPolyRef poly;				///< The polygon inside the tile.
+	dtPolyRef neiPoly;			///< The linked polygon in the neighbour tile.
+	float pos[3];				///< The midpoint of the portal edge.
+};
+
+/// The portals through which a connected set of polygons of a tile leads to one neighbour tile.
+/// Clusters are the nodes of the abstract graph of #dtTileGraph.
+/// @note This structure is rarely if ever used by the end user.
+struct dtTileGraphCluster
+{
+	float pos[3];				///< The average of the portal positions.
+	unsigned int neiTile;		///< The index of the neighbour tile the portals lead to.
+	unsigned short group;		///< The connected polygon set the portals belong to.
+	int firstPortal;			///< The index of the first portal of the cluster in dtTileGraphTile::portals.
+	int portalCount;			///< The number of portals of the cluster.
+};
+
+/// Search state of a cluster.
+/// @note This structure is rarely if ever used by the end user.
+struct dtTileGraphNode
+{
+	float cost;					///< Cost from the start position to the cluster.
+	unsigned int searchId;		///< The search the state belongs to.
+	unsigned int parentTile;	///< The tile index of the parent cluster.
+	int parentCluster;			///< The parent cluster, or -1 for clusters reached from the start polygon.
+	unsigned char closed;		///< Non-zero once the cluster has been expanded.
+};
+
+/// The abstract graph data of a single tile.
+/// @note This structure is rarely if ever used by the end user.
+struct dtTileGraphTile
+{
+	dtTileRef ref;					///< The tile the data was built from, or zero if the slot is empty.
+	int polyCount;					///< The number of polygons in the tile.
+	int clusterCount;				///< The number of clusters in the tile.
+	int portalCount;				///< The number of portals in the tile.
+	unsigned short* polyGroups;		///< The connected polygon set of each polygon. [Size: #polyCount]
+	dtTileGraphCluster* clusters;	///< The clusters. [Size: #clusterCount]
+	dtTileGraphPortal* portals;		///< The portals, ordered by cluster. [Size: #portalCount]
+	float* costs;					///< Travel cost between clusters through the tile, FLT_MAX if not connected. [Size: #clusterCount * #clusterCount]
+	dtTileGraphNode* nodes;			///< The search state of the clusters. [Size: #clusterCount]
+};
+
+/// A coarse graph over the tiles of a navigation mesh, used to speed up long path queries.
+///
+/// Each tile is reduced to clusters of portal edges with precomputed travel costs between
+/// them. #findPath first searches the cluster graph, and then runs the polygon search only
+/// inside the tiles along the cluster path.
+///
+/// Register the graph with dtNavMesh::setTileListener to keep it up to date when tiles are
+/// added or removed. Only the affected tiles and their neighbours are rebuilt.
+/// @ingroup detour
+class dtTileGraph : public dtNavMeshTileListener
+{
+public:
+	dtTileGraph();
+	virtual ~dtTileGraph();
+
+	/// Builds the graph for all tiles of the navigation mesh.
+	///  @param[in]	nav		The navigation mesh to build the graph for. Must outlive the graph.
+	/// @return The status flags for the operation.
+	dtStatus init(const dtNavMesh* nav);
+
+	/// Rebuilds the tile and its neighbours. (See: dtNavMeshTileListener)
+	virtual void tileAdded(const dtNavMesh* nav, dtTileRef ref);
+
+	/// Clears the tile and rebuilds its neighbours. (See: dtNavMeshTileListener)
+	virtual void tileRemoved(const dtNavMesh* nav, dtTileRef ref, int tx, int ty);
+
+	/// Finds a path from the start polygon to the end polygon using the tile graph.
+	/// The parameters and results match dtNavMeshQuery::findPath.
+	///  @param[in]		query		The query used to refine the path. Must use the same navigation mesh.
+	///  @param[in]		startRef	The refrence id of the start polygon.
+	///  @param[in]		endRef		The reference id of the end polygon.
+	///  @param[in]		startPos	A position within the start polygon. [(x, y, z)]
+	///  @param[in]		endPos		A position within the end polygon. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to end.)
+	///  							[(polyRef) * @p pathCount]
+	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
+	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	/// @returns The status flags for the query.
+	dtStatus findPath(const dtNavMeshQuery* query, dtPolyRef startRef, dtPolyRef endRef,
+					  const float* startPos, const float* endPos,
+					  const dtQueryFilter* filter,
+					  dtPolyRef* path, int* pathCount, const int maxPath);
+
+	/// The number of tiles in the tile corridor of the last successful #findPath.
+	int getCorridorTileCount() const { return m_corridorCount; }
+
+	/// The maximum number of tiles the graph can hold.
+	int getMaxTiles() const { return m_maxTiles; }
+
+	/// Gets the graph data of the tile at the specified index.
+	///  @param[in]	i		The tile index. [Limit: 0 <= index < #getMaxTiles()]
+	const dtTileGraphTile* getTile(const int i) const { return &m_tiles[i]; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtTileGraph(const dtTileGraph&);
+	dtTileGraph& operator=(const dtTileGraph&);
+
+	void clearTile(dtTileGraphTile& gt);
+	bool buildTile(const dtMeshTile* tile);
+	void rebuildTilesAround(const int tx, const int ty);
+	bool isCurrent(const unsigned int tileIndex) const;
+
+	// Polygon costs inside a single tile.
+	bool reserveScratch(const int polyCount, const int heapSize, const int clusterCount);
+	bool beginPolyCosts(const dtMeshTile* tile, const int clusterCount);
+	void seedPolyCost(const int poly, const float cost);
+	void spreadPolyCosts(const dtMeshTile* tile, const unsigned int tileIndex);
+	float getClusterCost(const dtTileGraphTile& gt, const int cluster) const;
+
+	// Cluster search.
+	bool pushOpen(const float total, const unsigned int tile, const int cluster);
+	bool visitCluster(const unsigned int tile, const int cluster, const float cost,
+					  const unsigned int parentTile, const int parentCluster, const float* endPos);
+
+	const dtNavMesh* m_nav;
+	int m_maxTiles;
+	dtTileGraphTile* m_tiles;
+	unsigned char* m_corridor;			///< Non-zero for the tiles of the corridor being refined. [Size: #m_maxTiles]
+	int m_corridorCount;
+	unsigned int m_searchId;
+
+	float* m_polyCosts;
+	float* m_polyCenters;
+	int m_maxPolys;
+	struct dtTileGraphHeapItem* m_polyHeap;
+	int m_polyHeapCount;
+	int m_polyHeapCapacity;
+	float* m_goalCosts;
+	int m_maxClusters;
+	struct dtTileGraphHeapItem* m_open;
+	int m_openCount;
+	int m_openCapacity;
+};
+
+#endif // DETOURTILEGRAPH_H
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURTILESTREAMER_H
+#define DETOURTILESTREAMER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "DetourNavMesh.h"
+
+/// Describes a tile the streamer can load.
+/// @ingroup detour
+struct dtStreamTileInfo
+{
+	int x;						///< The x-location of the tile.
+	int y;						///< The y-location of the tile.
+	int dataSize;				///< The expected size of the tile data, reserved while the tile is read. The size read replaces it.
+	dtTileRef ref;				///< The reference the tile is added with, or zero to use the index of the tile.
+};
+
+/// The residency of a streamed tile.
+enum dtStreamTileState
+{
+	DT_STREAM_TILE_UNLOADED = 0,	///< The tile is not in the navigation mesh.
+	DT_STREAM_TILE_LOADING,			///< The tile data is being read by the worker thread.
+	DT_STREAM_TILE_RESIDENT,		///< The tile is in the navigation mesh.
+	DT_STREAM_TILE_FAILED,			///< The tile could not be read or added, or exceeds the budget. (See: dtTileStreamer::update)
+};
+
+/// Reads the data of streamed tiles. (See: dtTileStreamer)
+/// @ingroup detour
+class dtTileStreamSource
+{
+public:
+	virtual ~dtTileStreamSource() {}
+
+	/// Reads and, if needed, decompresses the data of a tile. Called on the worker thread of the streamer.
+	///  @param[in]		index		The index of the tile in the tiles the streamer was initialized with.
+	///  @param[out]	data		The tile data, allocated with dtAlloc. The navigation mesh takes ownership.
+	///  @param[out]	dataSize	The size of the tile data.
+	/// @return True if the tile data was read.
+	virtual bool readTile(const int index, unsigned char** data, int* dataSize) = 0;
+};
+
+/// Keeps the tiles near a set of positions resident in a navigation mesh, within a memory budget.
+///
+/// Tile data is read by a #dtTileStreamSource on a worker thread, while tiles are only added to 
+/// and removed from the navigation mesh in #update, on the thread that calls it. When the budget 
+/// is exceeded, the resident tiles that have gone the longest without being near a position are 
+/// removed first.
+///
+/// Every tile is always added with the same reference, so the salt of a tile is the same each 
+/// time it returns, and polygon references kept while it was away become valid again.
+///
+/// The Detour allocator must be thread-safe while the streamer is in use.
+/// @ingroup detour
+class dtTileStreamer
+{
+public:
+	dtTileStreamer();
+	~dtTileStreamer();
+
+	/// Starts the worker thread.
+	///  @param[in]	nav			The navigation mesh to stream tiles into. Must outlive the streamer.
+	///  @param[in]	source		The source that reads the tile data. Must outlive the streamer.
+	///  @param[in]	tiles		The tiles that can be streamed. [Size: @p tileCount]
+	///  @param[in]	tileCount	The number of tiles.
+	///  @param[in]	budget		The maximum total data size of the resident and loading tiles.
+	///  @param[in]	tileFlags	Flags used when adding the tiles, in addition to #DT_TILE_FREE_DATA. (See: #dtTileFlags)
+	/// @return The status flags for the operation.
+	dtStatus init(dtNavMesh* nav, dtTileStreamSource* source, const dtStreamTileInfo* tiles, const int tileCount,
+				  const int budget, const int tileFlags = 0);
+
+	/// Adds the tiles the worker has read, then requests the tiles within @p radius of the positions
+	/// and removes the least recently used tiles to make room for them.
+	///  @param[in]	positions		The positions to keep the tiles around. [(x, y, z) * @p positionCount]
+	///  @param[in]	positionCount	The number of positions.
+	///  @param[in]	radius			The distance from the positions within which tiles are kept.
+	void update(const float* positions, const int positionCount, const float radius);
+
+	/// Blocks until the requested tiles have been read, then adds them to the navigation mesh.
+	void flush();
+
+	/// The number of tiles the streamer was initialized with.
+	int getTileCount() const { return m_tileCount; }
+
+	/// The residency of the tile at the specified index. (See: #dtStreamTileState)
+	int getTileState(const int i) const { return m_tiles[i].state; }
+
+	/// The reference the tile at the specified index is added with.
+	dtTileRef getTileRef(const int i) const { return m_tiles[i].info.ref; }
+
+	/// The total data size of the resident tiles.
+	int getResidentBytes() const { return m_residentBytes; }
+
+	/// The total data size of the tiles being read.
+	int getLoadingBytes() const { return m_loadingBytes; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtTileStreamer(const dtTileStreamer&);
+	dtTileStreamer& operator=(const dtTileStreamer&);
+
+	struct Tile
+	{
+		dtStreamTileInfo info;
+		unsigned int lastWanted;	///< The last update the tile was near a position.
+		unsigned int retryFrame;	///< The update from which a failed tile is requested again.
+		int residentSize;			///< The size of the data of the resident tile.
+		unsigned char failures;		///< The number of times in a row the tile failed to load.
+		unsigned char state;
+	};
+
+	struct Loaded
+	{
+		int index;
+		unsigned char* data;
+		int dataSize;
+	};
+
+	void shutdown();
+	void addLoadedTiles();
+	bool evictTile();
+	static void workerMain(dtTileStreamer* streamer);
+
+	dtNavMesh* m_nav;
+	dtTileStreamSource* m_source;
+	Tile* m_tiles;
+	int m_tileCount;
+	int m_budget;
+	int m_tileFlags;
+	unsigned int m_frame;
+	int m_residentBytes;
+	int m_loadingBytes;
+	struct dtStreamTileOrder* m_order;	///< Scratch for sorting the requested tiles by distance. [Size: #m_tileCount]
+	Loaded* m_adding;					///< The loaded tiles being added to the navigation mesh. [Size: #m_tileCount]
+
+	// Requests and loaded tiles, shared with the worker. Each tile is in flight at most once.
+	int* m_requests;
+	int m_requestHead;
+	int m_requestCount;
+	Loaded* m_loaded;
+	int m_loadedCount;
+	int m_inFlight;
+	bool m_stop;
+
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_workCond;
+	std::condition_variable m_doneCond;
+};
+
+#endif // DETOURTILESTREAMER_H
@@ -0,0 +1,235 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <float.h>
+#include <string.h>
+#include "DetourFlowField.h"
+#include "DetourNode.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+dtFlowField::dtFlowField() :
+	m_nav(0),
+	m_goalRef(0),
+	m_tileSlots(0),
+	m_maxTiles(0),
+	m_tiles(0),
+	m_tileCount(0),
+	m_tileCapacity(0),
+	m_entries(0),
+	m_entryCount(0),
+	m_entryCapacity(0)
+{
+}
+
+dtFlowField::~dtFlowField()
+{
+	clear();
+}
+
+void dtFlowField::clear()
+{
+	dtFree(m_tileSlots);
+	dtFree(m_tiles);
+	dtFree(m_entries);
+	m_nav = 0;
+	m_goalRef = 0;
+	m_tileSlots = 0;
+	m_maxTiles = 0;
+	m_tiles = 0;
+	m_tileCount = 0;
+	m_tileCapacity = 0;
+	m_entries = 0;
+	m_entryCount = 0;
+	m_entryCapacity = 0;
+}
+
+/// @par
+///
+/// Only the closed nodes are stored, their costs are final. Polygons which were reached through
+/// more than one tile side keep the cheapest node.
+dtStatus dtFlowField::build(const dtNavMesh* nav, dtPolyRef goalRef, const dtNodePool& pool)
+{
+	dtAssert(nav);
+
+	if (m_nav != nav || m_maxTiles != nav->getMaxTiles())
+	{
+		dtFree(m_tileSlots);
+		m_maxTiles = nav->getMaxTiles();
+		m_tileSlots = (int*)dtAlloc(sizeof(int)*m_maxTiles, DT_ALLOC_PERM);
+		if (!m_tileSlots)
+		{
+			clear();
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+		memset(m_tileSlots, 0xff, sizeof(int)*m_maxTiles);
+	}
+	else
+	{
+		// Only the slots of the previous build are set.
+		for (int i = 0; i < m_tileCount; ++i)
+			m_tileSlots[nav->decodePolyIdTile((dtPolyRef)m_tiles[i].ref)] = -1;
+	}
+	m_nav = nav;
+	m_goalRef = goalRef;
+	m_tileCount = 0;
+	m_entryCount = 0;
+
+	// Assign entries to the tiles of the closed nodes.
+	const int nodeCount = pool.getNodeCount();
+	for (int i = 0; i < nodeCount; ++i)
+	{
+		const dtNode* node = pool.getNodeAtIdx(i+1);
+		if (!(node->flags & DT_NODE_CLOSED))
+			continue;
+		const unsigned int it = nav->decodePolyIdTile(node->id);
+		if (m_tileSlots[it] >= 0)
+			continue;
+
+		if (m_tileCount >= m_tileCapacity)
+		{
+			const int capacity = dtMax(16, m_tileCapacity*2);
+			dtFlowFieldTile* tiles = (dtFlowFieldTile*)dtAlloc(sizeof(dtFlowFieldTile)*capacity, DT_ALLOC_PERM);
+			if (!tiles)
+			{
+				clear();
+				return DT_FAILURE | DT_OUT_OF_MEMORY;
+			}
+			if (m_tileCount)
+				memcpy(tiles, m_tiles, sizeof(dtFlowFieldTile)*m_tileCount);
+			dtFree(m_tiles);
+			m_tiles = tiles;
+			m_tileCapacity = capacity;
+		}
+
+		const dtMeshTile* tile = nav->getTile((int)it);
+		dtFlowFieldTile& ft = m_tiles[m_tileCount];
+		ft.ref = nav->getTileRef(tile);
+		ft.firstEntry = m_entryCount;
+		ft.polyCount = tile->header->polyCount;
+		m_tileSlots[it] = m_tileCount++;
+		m_entryCount += ft.polyCount;
+	}
+
+	if (m_entryCount > m_entryCapacity)
+	{
+		dtFree(m_entries);
+		m_entryCapacity = dtMax(m_entryCount, m_entryCapacity*2);
+		m_entries = (dtFlowFieldEntry*)dtAlloc(sizeof(dtFlowFieldEntry)*m_entryCapacity, DT_ALLOC_PERM);
+		if (!m_entries)
+		{
+			clear();
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+	}
+	for (int i = 0; i < m_entryCount; ++i)
+	{
+		m_entries[i].next = 0;
+		m_entries[i].cost = FLT_MAX;
+	}
+
+	for (int i = 0; i < nodeCount; ++i)
+	{
+		const dtNode* node = pool.getNodeAtIdx(i+1);
+		if (!(node->flags & DT_NODE_CLOSED))
+			continue;
+		const dtFlowFieldTile& ft = m_tiles[m_tileSlots[nav->decodePolyIdTile(node->id)]];
+		dtFlowFieldEntry& entry = m_entries[ft.firstEntry + nav->decodePolyIdPoly(node->id)];
+		if (node->cost < entry.cost)
+		{
+			entry.cost = node->cost;
+			entry.next = node->pidx ? pool.getNodeAtIdx(node->pidx)->id : 0;
+		}
+	}
+
+	return DT_SUCCESS;
+}
+
+bool dtFlowField::isValid() const
+{
+	if (!m_nav)
+		return false;
+	for (int i = 0; i < m_tileCount; ++i)
+	{
+		const dtTileRef ref = m_tiles[i].ref;
+		if (m_nav->getTileRef(m_nav->getTile((int)m_nav->decodePolyIdTile((dtPolyRef)ref))) != ref)
+			return false;
+	}
+	return true;
+}
+
+const dtFlowFieldEntry* dtFlowField::getEntry(dtPolyRef ref) const
+{
+	if (!m_nav || !m_nav->isValidPolyRef(ref))
+		return 0;
+	const int slot = m_tileSlots[m_nav->decodePolyIdTile(ref)];
+	if (slot < 0)
+		return 0;
+	// The tile may have been replaced since the field was built.
+	const dtFlowFieldTile& ft = m_tiles[slot];
+	if (m_nav->decodePolyIdSalt(ref) != m_nav->decodePolyIdSalt((dtPolyRef)ft.ref))
+		return 0;
+	const dtFlowFieldEntry* entry = &m_entries[ft.firstEntry + m_nav->decodePolyIdPoly(ref)];
+	if (entry->cost == FLT_MAX)
+		return 0;
+	return entry;
+}
+
+bool dtFlowField::getNextHop(dtPolyRef ref, dtPolyRef* next, float* cost) const
+{
+	const dtFlowFieldEntry* entry = getEntry(ref);
+	if (!entry)
+		return false;
+	if (next)
+		*next = entry->next;
+	if (cost)
+		*cost = entry->cost;
+	return true;
+}
+
+/// @par
+///
+/// If the path does not fit into @p path, the part closest to the start is returned
+/// together with #DT_BUFFER_TOO_SMALL.
+dtStatus dtFlowField::getPath(dtPolyRef startRef, dtPolyRef* path, int* pathCount, const int maxPath) const
+{
+	if (!pathCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	*pathCount = 0;
+	if (!path || maxPath <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	dtPolyRef ref = startRef;
+	int count = 0;
+	while (ref)
+	{
+		const dtFlowFieldEntry* entry = getEntry(ref);
+		if (!entry)
+			return DT_FAILURE;
+		if (count >= maxPath)
+		{
+			*pathCount = count;
+			return DT_SUCCESS | DT_BUFFER_TOO_SMALL;
+		}
+		path[count++] = ref;
+		ref = entry->next;
+	}
+	*pathCount = count;
+	return DT_SUCCESS;
+}
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
 #include "DetourMath.h"
@@ -111,6 +112,234 @@ static void calcSlabEndPoints(const float* va, const float* vb, float* bmin, flo
 	}
 }
 
+static int comparePortalEdges(const void* va, const void* vb)
+{
+	const dtPortalEdge* a = (const dtPortalEdge*)va;
+	const dtPortalEdge* b = (const dtPortalEdge*)vb;
+	if (a->side != b->side)
+		return a->side < b->side ? -1 : 1;
+	if (a->smin != b->smin)
+		return a->smin < b->smin ? -1 : 1;
+	if (a->poly != b->poly)
+		return a->poly < b->poly ? -1 : 1;
+	return (int)a->edge - (int)b->edge;
+}
+
+// Builds the portal edge index of the tile. The index is incomplete if it could not be allocated.
+static void buildPortalEdges(dtMeshTile* tile)
+{
+	tile->portalEdges = 0;
+	memset(tile->portalEdgeSides, 0, sizeof(tile->portalEdgeSides));
+
+	int count = 0;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		for (int j = 0; j < poly->vertCount; ++j)
+		{
+			const unsigned short nei = poly->neis[j];
+			if ((nei & DT_EXT_LINK) && nei == (DT_EXT_LINK | (nei & 0x7)))
+				count++;
+		}
+	}
+	// An empty index is complete.
+	tile->portalEdgeSides[8] = count;
+	if (!count)
+		return;
+
+	tile->portalEdges = (dtPortalEdge*)dtAlloc(sizeof(dtPortalEdge)*count, DT_ALLOC_PERM);
+	if (!tile->portalEdges)
+		return;
+
+	int n = 0;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		const int nv = poly->vertCount;
+		for (int j = 0; j < nv; ++j)
+		{
+			const unsigned short nei = poly->neis[j];
+			if (!(nei & DT_EXT_LINK) || nei != (DT_EXT_LINK | (nei & 0x7)))
+				continue;
+			dtPortalEdge& edge = tile->portalEdges[n++];
+			edge.poly = (unsigned short)i;
+			edge.edge = (unsigned char)j;
+			edge.side = (unsigned char)(nei & 0x7);
+			// Diagonal sides have no slab, they are only kept to find the polygons with portals.
+			float bmin[2] = { 0, 0 }, bmax[2] = { 0, 0 };
+			calcSlabEndPoints(&tile->verts[poly->verts[j]*3], &tile->verts[poly->verts[(j+1) % nv]*3], bmin, bmax, edge.side);
+			edge.smin = bmin[0];
+			edge.smax = bmax[0];
+		}
+	}
+	qsort(tile->portalEdges, count, sizeof(dtPortalEdge), comparePortalEdges);
+
+	tile->portalEdgeSides[8] = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		dtPortalEdge& edge = tile->portalEdges[i];
+		const bool first = i == 0 || tile->portalEdges[i-1].side != edge.side;
+		edge.reach = first ? edge.smax : dtMax(edge.smax, tile->portalEdges[i-1].reach);
+		tile->portalEdgeSides[edge.side+1]++;
+	}
+	for (int i = 1; i < 9; ++i)
+		tile->portalEdgeSides[i] += tile->portalEdgeSides[i-1];
+}
+
+// Returns true if the portal edge index of the tile holds all of its portal edges.
+inline bool hasPortalEdgeIndex(const dtMeshTile* tile)
+{
+	return tile->portalEdges || tile->portalEdgeSides[8] == 0;
+}
+
+// Builds the off-mesh connection index of the tile. The tile has no index if it could not be allocated.
+static void buildOffMeshConSides(dtMeshTile* tile)
+{
+	tile->offMeshConsBySide = 0;
+	memset(tile->offMeshConSides, 0, sizeof(tile->offMeshConSides));
+
+	const int count = tile->header->offMeshConCount;
+	if (!count)
+		return;
+
+	tile->offMeshConsBySide = (unsigned short*)dtAlloc(sizeof(unsigned short)*count, DT_ALLOC_PERM);
+	if (!tile->offMeshConsBySide)
+		return;
+
+	// Connections with an invalid side are never linked, so they are left out.
+	for (int i = 0; i < count; ++i)
+	{
+		const unsigned char side = tile->offMeshCons[i].side;
+		if (side < 8 || side == 0xff)
+			tile->offMeshConSides[(side == 0xff ? 8 : side)+1]++;
+	}
+	for (int i = 1; i < 10; ++i)
+		tile->offMeshConSides[i] += tile->offMeshConSides[i-1];
+
+	int next[9];
+	memcpy(next, tile->offMeshConSides, sizeof(next));
+	for (int i = 0; i < count; ++i)
+	{
+		const unsigned char side = tile->offMeshCons[i].side;
+		if (side < 8 || side == 0xff)
+			tile->offMeshConsBySide[next[side == 0xff ? 8 : side]++] = (unsigned short)i;
+	}
+}
+
+// Returns true if off-mesh connections of the tile may land in the other tile.
+// Connections ending inside the tile can only land in the layers at the same location.
+inline bool mayLandOffMeshCons(const dtMeshTile* tile, const dtMeshTile* other)
+{
+	if (!tile->offMeshConsBySide)
+		return tile->header->offMeshConCount > 0;
+	if (tile->header->x == other->header->x && tile->header->y == other->header->y)
+		return tile->offMeshConSides[9] > tile->offMeshConSides[8];
+	return tile->offMeshConSides[8] > 0;
+}
+
+// Returns the vertex of the detail mesh of the polygon, unpacking it to tmp if needed.
+inline const float* getPolyDetailVert(const dtMeshTile* tile, const dtPoly* poly, const dtPolyDetail* pd,
+									   const unsigned char v, float* tmp)
+{
+	if (v < poly->vertCount)
+		return &tile->verts[poly->verts[v]*3];
+	return dtGetDetailVert(tile, pd->vertBase + (v - poly->vertCount), tmp);
+}
+
+// Builds the detail triangle and edge blocks of the tile. The tile has no blocks if they could not be allocated.
+static void buildDetailBlocks(dtMeshTile* tile)
+{
+	tile->detailTriBlocks = 0;
+	tile->detailEdgeBlocks = 0;
+	tile->detailBlocks = 0;
+
+	const int polyCount = tile->header->detailMeshCount;
+	if (!tile->header->detailTriCount || !polyCount)
+		return;
+
+	// The boundary edges are stored in the order closestPointOnDetailEdges visits them.
+	static const int edgeOrder[3] = { 2, 0, 1 };
+	int triBlockCount = 0;
+	int edgeBlockCount = 0;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPolyDetail* pd = &tile->detailMeshes[i];
+		int edgeCount = 0;
+		for (int j = 0; j < pd->triCount; ++j)
+		{
+			const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
+			for (int k = 0; k < 3; ++k)
+			{
+				if (dtGetDetailTriEdgeFlags(t[3], k) & DT_DETAIL_EDGE_BOUNDARY)
+					edgeCount++;
+			}
+		}
+		triBlockCount += (pd->triCount+3)/4;
+		edgeBlockCount += (edgeCount+3)/4;
+	}
+
+	const int triBlocksSize = sizeof(dtDetailTriBlock)*triBlockCount;
+	const int edgeBlocksSize = sizeof(dtDetailEdgeBlock)*edgeBlockCount;
+	const int blocksSize = sizeof(dtPolyDetailBlocks)*polyCount;
+	unsigned char* mem = (unsigned char*)dtAlloc(triBlocksSize + edgeBlocksSize + blocksSize, DT_ALLOC_PERM);
+	if (!mem)
+		return;
+	// Unused lanes stay zero, which makes their triangles degenerate.
+	memset(mem, 0, triBlocksSize + edgeBlocksSize + blocksSize);
+	tile->detailTriBlocks = (dtDetailTriBlock*)mem;
+	tile->detailEdgeBlocks = (dtDetailEdgeBlock*)(mem + triBlocksSize);
+	tile->detailBlocks = (dtPolyDetailBlocks*)(mem + triBlocksSize + edgeBlocksSize);
+
+	int triBase = 0;
+	int edgeBase = 0;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		const dtPolyDetail* pd = &tile->detailMeshes[i];
+		dtPolyDetailBlocks& pb = tile->detailBlocks[i];
+		pb.triBase = (unsigned int)triBase;
+		pb.edgeBase = (unsigned int)edgeBase;
+		pb.edgeCount = 0;
+
+		for (int j = 0; j < pd->triCount; ++j)
+		{
+			const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
+			float tmp[3*3];
+			const float* v[3];
+			for (int k = 0; k < 3; ++k)
+				v[k] = getPolyDetailVert(tile, poly, pd, t[k], &tmp[k*3]);
+
+			dtDetailTriBlock& tb = tile->detailTriBlocks[triBase + j/4];
+			const int lane = j & 3;
+			for (int k = 0; k < 3; ++k)
+			{
+				tb.a[k][lane] = v[0][k];
+				tb.ac[k][lane] = v[2][k] - v[0][k];
+				tb.ab[k][lane] = v[1][k] - v[0][k];
+			}
+
+			for (int e = 0; e < 3; ++e)
+			{
+				const int k = edgeOrder[e];
+				if ((dtGetDetailTriEdgeFlags(t[3], k) & DT_DETAIL_EDGE_BOUNDARY) == 0)
+					continue;
+				const float* ep = v[k];
+				const float* eq = v[(k+1) % 3];
+				dtDetailEdgeBlock& eb = tile->detailEdgeBlocks[edgeBase + pb.edgeCount/4];
+				const int edgeLane = pb.edgeCount & 3;
+				for (int c = 0; c < 3; ++c)
+				{
+					eb.p[c][edgeLane] = ep[c];
+					eb.pq[c][edgeLane] = eq[c] - ep[c];
+				}
+				pb.edgeCount++;
+			}
+		}
+		triBase += (pd->triCount+3)/4;
+		edgeBase += (pb.edgeCount+3)/4;
+	}
+}
+
 inline int computeTileHash(int x, int y, const int mask)
 {
 	const unsigned int h1 = 0x8da6b343; // Large multiplicative constants;
@@ -193,7 +422,16 @@ dtNavMesh::dtNavMesh() :
 	m_tileLutMask(0),
 	m_posLookup(0),
 	m_nextFree(0),
-	m_tiles(0)
+	m_tiles(0),
+	m_reachability(0),
+	m_reachabilityRowSize(0),
+	m_reachabilityTableStride(0),
+	m_tileListener(0),
+	m_polyGridLookup(0),
+	m_polyGridCellsPerTile(0),
+	m_polyGridCellWidth(0),
+	m_polyGridCellHeight(0),
+	m_polyGridMargin(0)
 {
 #ifndef DT_POLYREF64
 	m_saltBits = 0;
@@ -204,12 +442,19 @@ dtNavMesh::dtNavMesh() :
 	m_orig[0] = 0;
 	m_orig[1] = 0;
 	m_orig[2] = 0;
+	m_bmin[0] = m_bmin[1] = m_bmin[2] = FLT_MAX;
+	m_bmax[0] = m_bmax[1] = m_bmax[2] = -FLT_MAX;
 }
 
 dtNavMesh::~dtNavMesh()
 {
 	for (int i = 0; i < m_maxTiles; ++i)
 	{
+		dtFree(m_tiles[i].wideBvTree);
+		dtFree(m_tiles[i].portalEdges);
+		dtFree(m_tiles[i].offMeshConsBySide);
+		dtFree(m_tiles[i].detailTriBlocks);
+		dtFree(m_tiles[i].runtimeData);
 		if (m_tiles[i].flags & DT_TILE_FREE_DATA)
 		{
 			dtFree(m_tiles[i].data);
@@ -217,8 +462,10 @@ dtNavMesh::~dtNavMesh()
 			m_tiles[i].dataSize = 0;
 		}
 	}
+	freePolyGrid();
 	dtFree(m_posLookup);
 	dtFree(m_tiles);
+	dtFree(m_reachability);
 }
 		
 dtStatus dtNavMesh::init(const dtNavMeshParams* params)
@@ -268,7 +515,7 @@ dtStatus dtNavMesh::init(unsigned char* data, const int dataSize, const int flag
 {
 	// Make sure the data is in right format.
 	dtMeshHeader* header = (dtMeshHeader*)data;
-	if (header->magic != DT_NAVMESH_MAGIC)
+	if (header->magic != DT_NAVMESH_MAGIC && header->magic != DT_NAVMESH_PACKED_DETAIL_MAGIC)
 		return DT_FAILURE | DT_WRONG_MAGIC;
 	if (header->version != DT_NAVMESH_VERSION)
 		return DT_FAILURE | DT_WRONG_VERSION;
@@ -297,6 +544,29 @@ const dtNavMeshParams* dtNavMesh::getParams() const
 	return &m_params;
 }
 
+bool dtNavMesh::getBounds(float* bmin, float* bmax) const
+{
+	if (m_bmin[0] > m_bmax[0])
+		return false;
+	dtVcopy(bmin, m_bmin);
+	dtVcopy(bmax, m_bmax);
+	return true;
+}
+
+void dtNavMesh::calcBounds()
+{
+	m_bmin[0] = m_bmin[1] = m_bmin[2] = FLT_MAX;
+	m_bmax[0] = m_bmax[1] = m_bmax[2] = -FLT_MAX;
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshHeader* header = m_tiles[i].header;
+		if (!header)
+			continue;
+		dtVmin(m_bmin, header->bmin);
+		dtVmax(m_bmax, header->bmax);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 int dtNavMesh::findConnectingPolys(const float* va, const float* vb,
 								   const dtMeshTile* tile, int side,
@@ -353,38 +623,140 @@ int dtNavMesh::findConnectingPolys(const float* va, const float* vb,
 	return n;
 }
 
+// Removes the links of the polygon to the target tile.
+static void unconnectPolyLinks(const dtNavMesh* nav, dtMeshTile* tile, dtPoly* poly, const unsigned int targetNum)
+{
+	unsigned int j = poly->firstLink;
+	unsigned int pj = DT_NULL_LINK;
+	while (j != DT_NULL_LINK)
+	{
+		if (nav->decodePolyIdTile(tile->links[j].ref) == targetNum)
+		{
+			// Remove link.
+			unsigned int nj = tile->links[j].next;
+			if (pj == DT_NULL_LINK)
+				poly->firstLink = nj;
+			else
+				tile->links[pj].next = nj;
+			freeLink(tile, j);
+			j = nj;
+		}
+		else
+		{
+			// Advance
+			pj = j;
+			j = tile->links[j].next;
+		}
+	}
+}
+
 void dtNavMesh::unconnectLinks(dtMeshTile* tile, dtMeshTile* target)
 {
 	if (!tile || !target) return;
 
 	const unsigned int targetNum = decodePolyIdTile(getTileRef(target));
 
+	// Links to another tile start at portal edges and off-mesh connections, or at the
+	// polygons the off-mesh connections of the other tile land on.
+	if (hasPortalEdgeIndex(tile) && !mayLandOffMeshCons(target, tile))
+	{
+		for (int i = 0; i < tile->portalEdgeSides[8]; ++i)
+			unconnectPolyLinks(this, tile, &tile->polys[tile->portalEdges[i].poly], targetNum);
+		for (int i = tile->header->offMeshBase; i < tile->header->polyCount; ++i)
+			unconnectPolyLinks(this, tile, &tile->polys[i], targetNum);
+		return;
+	}
+
 	for (int i = 0; i < tile->header->polyCount; ++i)
+		unconnectPolyLinks(this, tile, &tile->polys[i], targetNum);
+}
+
+int dtNavMesh::findConnectingPortalPolys(const float* va, const float* vb,
+										 const dtMeshTile* tile, int side,
+										 dtPolyRef* con, float* conarea, int maxcon) const
+{
+	if (!tile) return 0;
+	if (!hasPortalEdgeIndex(tile) || side < 0 || side > 7 || (side & 1))
+		return findConnectingPolys(va, vb, tile, side, con, conarea, maxcon);
+
+	const float near_thresh = 0.01f;
+
+	float amin[2], amax[2];
+	calcSlabEndPoints(va, vb, amin, amax, side);
+	const float apos = getSlabCoord(va, side);
+
+	const dtPortalEdge* edges = &tile->portalEdges[tile->portalEdgeSides[side]];
+	const int count = tile->portalEdgeSides[side+1] - tile->portalEdgeSides[side];
+
+	// Skip the edges which all end before the segment starts.
+	int lo = 0;
+	int hi = count;
+	while (lo < hi)
 	{
-		dtPoly* poly = &tile->polys[i];
-		unsigned int j = poly->firstLink;
-		unsigned int pj = DT_NULL_LINK;
-		while (j != DT_NULL_LINK)
+		const int mid = (lo + hi) / 2;
+		if (edges[mid].reach < amin[0])
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+
+	// Collect the touching edges in polygon order, like findConnectingPolys finds them.
+	struct Candidate
+	{
+		unsigned short poly;
+		unsigned char edge;
+		float cmin, cmax;
+	};
+	static const int MAX_CANDIDATES = 32;
+	Candidate cands[MAX_CANDIDATES];
+	int ncands = 0;
+
+	float bmin[2], bmax[2];
+	for (int i = lo; i < count && edges[i].smin <= amax[0]; ++i)
+	{
+		const dtPortalEdge& edge = edges[i];
+		if (edge.smax < amin[0])
+			continue;
+
+		const dtPoly* poly = &tile->polys[edge.poly];
+		const float* vc = &tile->verts[poly->verts[edge.edge]*3];
+		const float* vd = &tile->verts[poly->verts[(edge.edge+1) % poly->vertCount]*3];
+
+		// Segments are not close enough.
+		if (dtAbs(apos-getSlabCoord(vc, side)) > near_thresh)
+			continue;
+
+		// Check if the segments touch.
+		calcSlabEndPoints(vc,vd, bmin,bmax, side);
+		if (!overlapSlabs(amin,amax, bmin,bmax, near_thresh, tile->header->walkableClimb)) continue;
+
+		if (ncands == MAX_CANDIDATES)
+			return findConnectingPolys(va, vb, tile, side, con, conarea, maxcon);
+		int k = ncands++;
+		while (k > 0 && (cands[k-1].poly > edge.poly || (cands[k-1].poly == edge.poly && cands[k-1].edge > edge.edge)))
 		{
-			if (decodePolyIdTile(tile->links[j].ref) == targetNum)
-			{
-				// Remove link.
-				unsigned int nj = tile->links[j].next;
-				if (pj == DT_NULL_LINK)
-					poly->firstLink = nj;
-				else
-					tile->links[pj].next = nj;
-				freeLink(tile, j);
-				j = nj;
-			}
-			else
-			{
-				// Advance
-				pj = j;
-				j = tile->links[j].next;
-			}
+			cands[k] = cands[k-1];
+			k--;
 		}
+		cands[k].poly = edge.poly;
+		cands[k].edge = edge.edge;
+		cands[k].cmin = dtMax(amin[0], bmin[0]);
+		cands[k].cmax = dtMin(amax[0], bmax[0]);
+	}
+
+	// Only the first touching edge of each polygon counts.
+	const dtPolyRef base = getPolyRefBase(tile);
+	int n = 0;
+	for (int i = 0; i < ncands && n < maxcon; ++i)
+	{
+		if (i > 0 && cands[i].poly == cands[i-1].poly)
+			continue;
+		conarea[n*2+0] = cands[i].cmin;
+		conarea[n*2+1] = cands[i].cmax;
+		con[n] = base | (dtPolyRef)cands[i].poly;
+		n++;
 	}
+	return n;
 }
 
 void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
@@ -415,7 +787,7 @@ void dtNavMesh::connectExtLinks(dtMeshTile* tile, dtMeshTile* target, int side)
 			const float* vb = &tile->verts[poly->verts[(j+1) % nv]*3];
 			dtPolyRef nei[4];
 			float neia[4*2];
-			int nnei = findConnectingPolys(va,vb, target, dtOppositeTile(dir), nei,neia,4);
+			int nnei = findConnectingPortalPolys(va,vb, target, dtOppositeTile(dir), nei,neia,4);
 			for (int k = 0; k < nnei; ++k)
 			{
 				unsigned int idx = allocLink(tile);
@@ -462,9 +834,21 @@ void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int
 	// Connect off-mesh links.
 	// We are interested on links which land from target tile to this tile.
 	const unsigned char oppositeSide = (side == -1) ? 0xff : (unsigned char)dtOppositeTile(side);
+
+	// Only visit the connections ending on the side of the target facing the tile.
+	int first = 0;
+	int last = target->header->offMeshConCount;
+	const unsigned short* order = target->offMeshConsBySide;
+	if (order)
+	{
+		const int bucket = side == -1 ? 8 : (int)oppositeSide;
+		first = target->offMeshConSides[bucket];
+		last = target->offMeshConSides[bucket+1];
+	}
 	
-	for (int i = 0; i < target->header->offMeshConCount; ++i)
+	for (int k = first; k < last; ++k)
 	{
+		const int i = order ? (int)order[k] : k;
 		dtOffMeshConnection* targetCon = &target->offMeshCons[i];
 		if (targetCon->side != oppositeSide)
 			continue;
@@ -473,11 +857,17 @@ void dtNavMesh::connectExtOffMeshLinks(dtMeshTile* tile, dtMeshTile* target, int
 		// Skip off-mesh connections which start location could not be connected at all.
 		if (targetPoly->firstLink == DT_NULL_LINK)
 			continue;
+
+		// Skip end points which are farther than the radius from the tile.
+		const float* p = &targetCon->pos[3];
+		const float rad = targetCon->rad;
+		if (p[0] < tile->header->bmin[0]-rad || p[0] > tile->header->bmax[0]+rad ||
+			p[1] < tile->header->bmin[1]-rad || p[1] > tile->header->bmax[1]+rad)
+			continue;
 		
 		const float halfExtents[3] = { targetCon->rad, targetCon->rad, target->header->walkableClimb };
 		
 		// Find polygon to connect to.
-		const float* p = &targetCon->pos[3];
 		float nearestPt[3];
 		dtPolyRef ref = findNearestPolyInTile(tile, p, halfExtents, nearestPt);
 		if (!ref)
@@ -634,8 +1024,9 @@ namespace
 
 		float dmin = FLT_MAX;
 		float tmin = 0;
-		const float* pmin = 0;
-		const float* pmax = 0;
+		float pmin[3] = { 0, 0, 0 };
+		float pmax[3] = { 0, 0, 0 };
+		float tmp[3*3];
 
 		for (int i = 0; i < pd->triCount; i++)
 		{
@@ -653,7 +1044,7 @@ namespace
 				if (tris[j] < poly->vertCount)
 					v[j] = &tile->verts[poly->verts[tris[j]] * 3];
 				else
-					v[j] = &tile->detailVerts[(pd->vertBase + (tris[j] - poly->vertCount)) * 3];
+					v[j] = dtGetDetailVert(tile, pd->vertBase + (tris[j] - poly->vertCount), &tmp[j*3]);
 			}
 
 			for (int k = 0, j = 2; k < 3; j = k++)
@@ -672,14 +1063,52 @@ namespace
 				{
 					dmin = d;
 					tmin = t;
-					pmin = v[j];
-					pmax = v[k];
+					dtVcopy(pmin, v[j]);
+					dtVcopy(pmax, v[k]);
 				}
 			}
 		}
 
 		dtVlerp(closest, pmin, pmax, tmin);
 	}
+
+	// Same as closestPointOnDetailEdges<true>, using the edge blocks of the tile.
+	void closestPointOnDetailEdgeBlocks(const dtMeshTile* tile, const dtPoly* poly, const float* pos, float* closest)
+	{
+		const unsigned int ip = (unsigned int)(poly - tile->polys);
+		const dtPolyDetailBlocks& pb = tile->detailBlocks[ip];
+		const dtDetailEdgeBlock* blocks = &tile->detailEdgeBlocks[pb.edgeBase];
+
+		float dmin = FLT_MAX;
+		float tmin = 0;
+		int imin = -1;
+		for (unsigned int i = 0; i < pb.edgeCount; i += 4)
+		{
+			const dtDetailEdgeBlock& eb = blocks[i/4];
+			float d[4], t[4];
+			dtDistancePtSegSqr2D4(pos, eb.p, eb.pq, d, t);
+			const unsigned int n = dtMin(pb.edgeCount - i, 4u);
+			for (unsigned int k = 0; k < n; ++k)
+			{
+				if (d[k] < dmin)
+				{
+					dmin = d[k];
+					tmin = t[k];
+					imin = (int)(i + k);
+				}
+			}
+		}
+
+		if (imin == -1)
+		{
+			dtVset(closest, 0, 0, 0);
+			return;
+		}
+		const dtDetailEdgeBlock& eb = blocks[imin/4];
+		const int lane = imin & 3;
+		for (int c = 0; c < 3; ++c)
+			closest[c] = eb.p[c][lane] + eb.pq[c][lane]*tmin;
+	}
 }
 
 bool dtNavMesh::getPolyHeight(const dtMeshTile* tile, const dtPoly* poly, const float* pos, float* height) const
@@ -704,22 +1133,45 @@ bool dtNavMesh::getPolyHeight(const dtMeshTile* tile, const dtPoly* poly, const
 		return true;
 	
 	// Find height at the location.
-	for (int j = 0; j < pd->triCount; ++j)
+	if (tile->detailBlocks)
 	{
-		const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
-		const float* v[3];
-		for (int k = 0; k < 3; ++k)
+		const dtDetailTriBlock* blocks = &tile->detailTriBlocks[tile->detailBlocks[ip].triBase];
+		for (int j = 0; j < pd->triCount; j += 4)
 		{
-			if (t[k] < poly->vertCount)
-				v[k] = &tile->verts[poly->verts[t[k]]*3];
-			else
-				v[k] = &tile->detailVerts[(pd->vertBase+(t[k]-poly->vertCount))*3];
+			const dtDetailTriBlock& tb = blocks[j/4];
+			float h[4];
+			const unsigned int mask = dtClosestHeightPointTriangle4(pos, tb.a, tb.ac, tb.ab, h);
+			if (mask)
+			{
+				// The first triangle containing the point, as in the loop below.
+				int k = 0;
+				while (!(mask & (1u << k)))
+					k++;
+				*height = h[k];
+				return true;
+			}
 		}
-		float h;
-		if (dtClosestHeightPointTriangle(pos, v[0], v[1], v[2], h))
+	}
+	else
+	{
+		float tmp[3*3];
+		for (int j = 0; j < pd->triCount; ++j)
 		{
-			*height = h;
-			return true;
+			const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
+			const float* v[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				if (t[k] < poly->vertCount)
+					v[k] = &tile->verts[poly->verts[t[k]]*3];
+				else
+					v[k] = dtGetDetailVert(tile, pd->vertBase+(t[k]-poly->vertCount), &tmp[k*3]);
+			}
+			float h;
+			if (dtClosestHeightPointTriangle(pos, v[0], v[1], v[2], h))
+			{
+				*height = h;
+				return true;
+			}
 		}
 	}
 
@@ -762,7 +1214,10 @@ void dtNavMesh::closestPointOnPoly(dtPolyRef ref, const float* pos, float* close
 	}
 
 	// Outside poly that is not an offmesh connection.
-	closestPointOnDetailEdges<true>(tile, poly, pos, closest);
+	if (tile->detailBlocks)
+		closestPointOnDetailEdgeBlocks(tile, poly, pos, closest);
+	else
+		closestPointOnDetailEdges<true>(tile, poly, pos, closest);
 }
 
 dtPolyRef dtNavMesh::findNearestPolyInTile(const dtMeshTile* tile,
@@ -841,9 +1296,34 @@ int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, co
 		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
 		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
 		
-		// Traverse tree
 		dtPolyRef base = getPolyRefBase(tile);
 		int n = 0;
+
+		if (tile->wideBvTree)
+		{
+			// Traverse wide tree, testing all children of a node at once.
+			int stack[DT_WIDE_BVTREE_MAX_DEPTH*(DT_WIDE_BVNODE_WIDTH-1)+1];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0)
+			{
+				const dtWideBVNode& wideNode = tile->wideBvTree[stack[--top]];
+				unsigned int overlap = dtOverlapQuantBounds4(bmin, bmax, wideNode.bmin, wideNode.bmax);
+				for (int i = 0; overlap; ++i, overlap >>= 1)
+				{
+					const int child = wideNode.child[i];
+					if (!(overlap & 1) || !child)
+						continue;
+					if (child > 0)
+						stack[top++] = child;
+					else if (n < maxPolys)
+						polys[n++] = base | (dtPolyRef)(-child-1);
+				}
+			}
+			return n;
+		}
+
+		// Traverse tree
 		while (node < end)
 		{
 			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
@@ -910,15 +1390,76 @@ int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, co
 /// The nav mesh assumes exclusive access to the data passed and will make
 /// changes to the dynamic portion of the data. For that reason the data
 /// should not be reused in other nav meshes until the tile has been successfully
-/// removed from this nav mesh.
+/// removed from this nav mesh. Tiles added with #DT_TILE_READ_ONLY_DATA are the 
+/// exception: the nav mesh copies the dynamic portion and leaves the data untouched,
+/// so the same data can be added to any number of nav meshes.
 ///
 /// @see dtCreateNavMeshData, #removeTile
 dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 							dtTileRef lastRef, dtTileRef* result)
+{
+	dtMeshTile* tile = 0;
+	dtStatus status = insertTile(data, dataSize, flags, lastRef, &tile);
+	if (dtStatusFailed(status))
+		return status;
+	const dtMeshHeader* header = tile->header;
+
+	connectIntLinks(tile);
+
+	// Base off-mesh connections to their starting polygons and connect connections inside the tile.
+	baseOffMeshLinks(tile);
+	connectExtOffMeshLinks(tile, tile, -1);
+
+	// Create connections with neighbour tiles.
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	int nneis;
+	
+	// Connect with layers in current tile.
+	nneis = getTilesAt(header->x, header->y, neis, MAX_NEIS);
+	for (int j = 0; j < nneis; ++j)
+	{
+		if (neis[j] == tile)
+			continue;
+	
+		connectExtLinks(tile, neis[j], -1);
+		connectExtLinks(neis[j], tile, -1);
+		connectExtOffMeshLinks(tile, neis[j], -1);
+		connectExtOffMeshLinks(neis[j], tile, -1);
+	}
+	
+	// Connect with neighbour tiles.
+	for (int i = 0; i < 8; ++i)
+	{
+		nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
+		{
+			connectExtLinks(tile, neis[j], i);
+			connectExtLinks(neis[j], tile, dtOppositeTile(i));
+			connectExtOffMeshLinks(tile, neis[j], i);
+			connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+		}
+	}
+	
+	if (result)
+		*result = getTileRef(tile);
+
+	// A stale grid would miss polygons, drop it if it cannot be updated.
+	if (m_polyGridLookup && !buildPolyGridColumn(header->x, header->y))
+		freePolyGrid();
+
+	if (m_tileListener)
+		m_tileListener->tileAdded(this, getTileRef(tile));
+	
+	return DT_SUCCESS;
+}
+
+dtStatus dtNavMesh::insertTile(unsigned char* data, int dataSize, int flags,
+							   dtTileRef lastRef, dtMeshTile** result)
 {
 	// Make sure the data is in right format.
 	dtMeshHeader* header = (dtMeshHeader*)data;
-	if (header->magic != DT_NAVMESH_MAGIC)
+	if (header->magic != DT_NAVMESH_MAGIC && header->magic != DT_NAVMESH_PACKED_DETAIL_MAGIC)
 		return DT_FAILURE | DT_WRONG_MAGIC;
 	if (header->version != DT_NAVMESH_VERSION)
 		return DT_FAILURE | DT_WRONG_VERSION;
@@ -933,6 +1474,29 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	// Make sure the location is free.
 	if (getTileAt(header->x, header->y, header->layer))
 		return DT_FAILURE | DT_ALREADY_OCCUPIED;
+
+	// Sizes of the tile data sections.
+	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
+	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
+	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
+	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
+	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
+	const bool packed = header->magic == DT_NAVMESH_PACKED_DETAIL_MAGIC;
+	const int detailVertsSize = packed ? dtAlign4(sizeof(float)*6 + sizeof(unsigned short)*3*header->detailVertCount) :
+		dtAlign4(sizeof(float)*3*header->detailVertCount);
+	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
+	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
+	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
+
+	// Linking snaps the off-mesh connection end points, so their vertices must be writable too.
+	unsigned char* runtimeData = 0;
+	if (flags & DT_TILE_READ_ONLY_DATA)
+	{
+		const int runtimeVertsSize = header->offMeshConCount ? vertsSize : 0;
+		runtimeData = (unsigned char*)dtAlloc(polysSize + linksSize + runtimeVertsSize, DT_ALLOC_PERM);
+		if (!runtimeData)
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
 		
 	// Allocate a tile.
 	dtMeshTile* tile = 0;
@@ -950,7 +1514,10 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		// Try to relocate the tile to specific index with same salt.
 		int tileIndex = (int)decodePolyIdTile((dtPolyRef)lastRef);
 		if (tileIndex >= m_maxTiles)
+		{
+			dtFree(runtimeData);
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
 		// Try to find the specific tile id from the free list.
 		dtMeshTile* target = &m_tiles[tileIndex];
 		dtMeshTile* prev = 0;
@@ -962,7 +1529,10 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		}
 		// Could not find the correct location.
 		if (tile != target)
+		{
+			dtFree(runtimeData);
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
 		// Remove from freelist
 		if (!prev)
 			m_nextFree = tile->next;
@@ -975,7 +1545,10 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 
 	// Make sure we could allocate a tile.
 	if (!tile)
+	{
+		dtFree(runtimeData);
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
 	
 	// Insert tile into the position lut.
 	int h = computeTileHash(header->x, header->y, m_tileLutMask);
@@ -983,23 +1556,26 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	m_posLookup[h] = tile;
 	
 	// Patch header pointers.
-	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
-	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
-	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
-	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
-	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
-	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
-	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
-	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
-	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
-	
 	unsigned char* d = data + headerSize;
 	tile->verts = dtGetThenAdvanceBufferPointer<float>(d, vertsSize);
 	tile->polys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
 	d += header->sth_per_poly*header->polyCount * 4;
 	tile->links = dtGetThenAdvanceBufferPointer<dtLink>(d, linksSize);
 	tile->detailMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
-	tile->detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+	if (packed)
+	{
+		// Packed detail vertices: origin, step size and the quantized vertices.
+		const float* quant = dtGetThenAdvanceBufferPointer<float>(d, sizeof(float)*6);
+		dtVcopy(tile->packedDetailOrig, &quant[0]);
+		dtVcopy(tile->packedDetailScale, &quant[3]);
+		tile->packedDetailVerts = dtGetThenAdvanceBufferPointer<unsigned short>(d, detailVertsSize - (int)sizeof(float)*6);
+		tile->detailVerts = 0;
+	}
+	else
+	{
+		tile->detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+		tile->packedDetailVerts = 0;
+	}
 	tile->detailTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
 	tile->bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvtreeSize);
 	tile->offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshLinksSize);
@@ -1008,6 +1584,39 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	if (!bvtreeSize)
 		tile->bvTree = 0;
 
+	// Redirect the writable sections to the copy of the tile.
+	tile->runtimeData = runtimeData;
+	if (runtimeData)
+	{
+		unsigned char* rd = runtimeData;
+		memcpy(rd, tile->polys, polysSize);
+		tile->polys = dtGetThenAdvanceBufferPointer<dtPoly>(rd, polysSize);
+		tile->links = dtGetThenAdvanceBufferPointer<dtLink>(rd, linksSize);
+		if (header->offMeshConCount)
+		{
+			memcpy(rd, tile->verts, vertsSize);
+			tile->verts = dtGetThenAdvanceBufferPointer<float>(rd, vertsSize);
+		}
+	}
+
+	// Build the wide tree used by the queries. Tiles without it fall back to the binary tree.
+	tile->wideBvTree = 0;
+	tile->wideBvNodeCount = 0;
+	if (tile->bvTree && !(flags & DT_TILE_NO_WIDE_BVTREE))
+	{
+		const int maxWideNodes = dtMax(header->bvNodeCount/2, 1);
+		tile->wideBvTree = (dtWideBVNode*)dtAlloc(sizeof(dtWideBVNode)*maxWideNodes, DT_ALLOC_PERM);
+		if (tile->wideBvTree)
+		{
+			tile->wideBvNodeCount = dtCreateWideBVTree(tile->bvTree, header->bvNodeCount, tile->wideBvTree, maxWideNodes);
+			if (!tile->wideBvNodeCount)
+			{
+				dtFree(tile->wideBvTree);
+				tile->wideBvTree = 0;
+			}
+		}
+	}
+
 	// Build links freelist
 	tile->linksFreeList = 0;
 	tile->links[header->maxLinkCount-1].next = DT_NULL_LINK;
@@ -1020,47 +1629,192 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	tile->dataSize = dataSize;
 	tile->flags = flags;
 
-	connectIntLinks(tile);
+	dtVmin(m_bmin, header->bmin);
+	dtVmax(m_bmax, header->bmax);
 
-	// Base off-mesh connections to their starting polygons and connect connections inside the tile.
-	baseOffMeshLinks(tile);
-	connectExtOffMeshLinks(tile, tile, -1);
+	// Index the portal edges, so that neighbour tiles can find their links without scanning all polygons.
+	buildPortalEdges(tile);
+	// Index the off-mesh connections, so that neighbour tiles only visit the ones landing on them.
+	buildOffMeshConSides(tile);
+	// Lay out the detail triangles and boundary edges in blocks for the height and closest point queries.
+	if (flags & DT_TILE_DETAIL_BLOCKS)
+	{
+		buildDetailBlocks(tile);
+	}
+	else
+	{
+		tile->detailTriBlocks = 0;
+		tile->detailEdgeBlocks = 0;
+		tile->detailBlocks = 0;
+	}
 
-	// Create connections with neighbour tiles.
+	*result = tile;
+	return DT_SUCCESS;
+}
+
+// A linking pass of dtNavMesh::addTiles, run on the scheduler.
+struct dtBulkLinkPass
+{
+	dtNavMesh* nav;
+	dtMeshTile* const* tiles;
+	int pass;
+};
+
+/// @par
+///
+/// Equivalent to calling #addTile for each tile, but the tiles are linked only after 
+/// all of them have been inserted. Internal links and the links between the new tiles 
+/// are built in parallel on @p scheduler, each range of tiles writing only the links of 
+/// its own tiles. Off-mesh connections crossing tiles and links into tiles that were already 
+/// in the mesh write both tiles and are built afterwards on the calling thread.
+///
+/// The link pool of each tile is dtMeshHeader::maxLinkCount, as computed when the 
+/// tile was baked, so nothing is reallocated while linking.
+///
+/// Tiles that cannot be added are skipped and their result is set to zero; the call 
+/// then returns #DT_PARTIAL_RESULT. Their data is not owned by the mesh even when 
+/// #DT_TILE_FREE_DATA is set. The tile listener is notified once per tile after all 
+/// the tiles are linked.
+///
+/// @see #addTile
+dtStatus dtNavMesh::addTiles(unsigned char* const* data, const int* dataSizes, const int count, const int flags,
+							 const dtTileRef* lastRefs, dtTaskScheduler* scheduler, dtTileRef* results)
+{
+	if (!data || !dataSizes || count < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (!count)
+		return DT_SUCCESS;
+
+	dtMeshTile** tiles = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*count, DT_ALLOC_TEMP);
+	unsigned char* added = (unsigned char*)dtAlloc(sizeof(unsigned char)*m_maxTiles, DT_ALLOC_TEMP);
+	if (!tiles || !added)
+	{
+		dtFree(tiles);
+		dtFree(added);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	memset(added, 0, sizeof(unsigned char)*m_maxTiles);
+
+	// Insert all tiles first, so that every tile sees all of its neighbours when linking.
+	int ntiles = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		dtMeshTile* tile = 0;
+		dtStatus status = insertTile(data[i], dataSizes[i], flags, lastRefs ? lastRefs[i] : 0, &tile);
+		if (results)
+			results[i] = dtStatusSucceed(status) ? getTileRef(tile) : 0;
+		if (dtStatusFailed(status))
+			continue;
+		tiles[ntiles++] = tile;
+		added[tile - m_tiles] = 1;
+	}
+
+	// Internal links, then the links from each tile to its neighbours.
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		if (!scheduler || ntiles < 2)
+		{
+			connectBulkTiles(tiles, 0, ntiles, pass);
+			continue;
+		}
+		dtBulkLinkPass linkPass = { this, tiles, pass };
+		scheduler->parallelFor(ntiles, 1, connectBulkTilesRange, &linkPass);
+	}
+
+	// Off-mesh connections and links into tiles that were in the mesh before write 
+	// the neighbour tile too, connect them serially.
 	static const int MAX_NEIS = 32;
 	dtMeshTile* neis[MAX_NEIS];
-	int nneis;
-	
-	// Connect with layers in current tile.
-	nneis = getTilesAt(header->x, header->y, neis, MAX_NEIS);
-	for (int j = 0; j < nneis; ++j)
+	for (int t = 0; t < ntiles; ++t)
 	{
-		if (neis[j] == tile)
-			continue;
-	
-		connectExtLinks(tile, neis[j], -1);
-		connectExtLinks(neis[j], tile, -1);
-		connectExtOffMeshLinks(tile, neis[j], -1);
-		connectExtOffMeshLinks(neis[j], tile, -1);
+		dtMeshTile* tile = tiles[t];
+		const dtMeshHeader* header = tile->header;
+
+		const int nlayers = getTilesAt(header->x, header->y, neis, MAX_NEIS);
+		for (int j = 0; j < nlayers; ++j)
+		{
+			if (neis[j] == tile)
+				continue;
+			connectExtOffMeshLinks(tile, neis[j], -1);
+			if (!added[neis[j] - m_tiles])
+			{
+				connectExtLinks(neis[j], tile, -1);
+				connectExtOffMeshLinks(neis[j], tile, -1);
+			}
+		}
+
+		for (int i = 0; i < 8; ++i)
+		{
+			const int nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
+			for (int j = 0; j < nneis; ++j)
+			{
+				connectExtOffMeshLinks(tile, neis[j], i);
+				if (!added[neis[j] - m_tiles])
+				{
+					connectExtLinks(neis[j], tile, dtOppositeTile(i));
+					connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+				}
+			}
+		}
 	}
-	
-	// Connect with neighbour tiles.
-	for (int i = 0; i < 8; ++i)
+
+	for (int t = 0; t < ntiles; ++t)
 	{
-		nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
-		for (int j = 0; j < nneis; ++j)
+		// A stale grid would miss polygons, drop it if it cannot be updated.
+		if (m_polyGridLookup && !buildPolyGridColumn(tiles[t]->header->x, tiles[t]->header->y))
+			freePolyGrid();
+	}
+
+	if (m_tileListener)
+	{
+		for (int t = 0; t < ntiles; ++t)
+			m_tileListener->tileAdded(this, getTileRef(tiles[t]));
+	}
+
+	dtFree(tiles);
+	dtFree(added);
+
+	return ntiles < count ? (DT_SUCCESS | DT_PARTIAL_RESULT) : DT_SUCCESS;
+}
+
+void dtNavMesh::connectBulkTilesRange(void* userData, const int begin, const int end)
+{
+	const dtBulkLinkPass* linkPass = (const dtBulkLinkPass*)userData;
+	linkPass->nav->connectBulkTiles(linkPass->tiles, begin, end, linkPass->pass);
+}
+
+void dtNavMesh::connectBulkTiles(dtMeshTile* const* tiles, const int begin, const int end, const int pass)
+{
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+
+	for (int t = begin; t < end; ++t)
+	{
+		dtMeshTile* tile = tiles[t];
+		const dtMeshHeader* header = tile->header;
+
+		if (pass == 0)
 		{
-			connectExtLinks(tile, neis[j], i);
-			connectExtLinks(neis[j], tile, dtOppositeTile(i));
-			connectExtOffMeshLinks(tile, neis[j], i);
-			connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+			connectIntLinks(tile);
+			baseOffMeshLinks(tile);
+			connectExtOffMeshLinks(tile, tile, -1);
+			continue;
+		}
+
+		// Only the links of the tile itself are written, the neighbours link back from their own side.
+		const int nlayers = getTilesAt(header->x, header->y, neis, MAX_NEIS);
+		for (int j = 0; j < nlayers; ++j)
+		{
+			if (neis[j] != tile)
+				connectExtLinks(tile, neis[j], -1);
+		}
+		for (int i = 0; i < 8; ++i)
+		{
+			const int nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
+			for (int j = 0; j < nneis; ++j)
+				connectExtLinks(tile, neis[j], i);
 		}
 	}
-	
-	if (result)
-		*result = getTileRef(tile);
-	
-	return DT_SUCCESS;
 }
 
 const dtMeshTile* dtNavMesh::getTileAt(const int x, const int y, const int layer) const
@@ -1269,6 +2023,8 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	dtMeshTile* tile = &m_tiles[tileIndex];
 	if (tile->salt != tileSalt)
 		return DT_FAILURE | DT_INVALID_PARAM;
+	const int tx = tile->header->x;
+	const int ty = tile->header->y;
 	
 	// Remove tile from hash lookup.
 	int h = computeTileHash(tile->header->x,tile->header->y,m_tileLutMask);
@@ -1309,6 +2065,14 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 			unconnectLinks(neis[j], tile);
 	}
 		
+	// Only tiles on the boundary of the mesh bounds can shrink them.
+	bool boundary = false;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (tile->header->bmin[i] <= m_bmin[i] || tile->header->bmax[i] >= m_bmax[i])
+			boundary = true;
+	}
+
 	// Reset tile.
 	if (tile->flags & DT_TILE_FREE_DATA)
 	{
@@ -1325,6 +2089,9 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 		if (dataSize) *dataSize = tile->dataSize;
 	}
 
+	dtFree(tile->runtimeData);
+	tile->runtimeData = 0;
+
 	tile->header = 0;
 	tile->flags = 0;
 	tile->linksFreeList = 0;
@@ -1333,8 +2100,22 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->links = 0;
 	tile->detailMeshes = 0;
 	tile->detailVerts = 0;
+	tile->packedDetailVerts = 0;
 	tile->detailTris = 0;
 	tile->bvTree = 0;
+	dtFree(tile->wideBvTree);
+	tile->wideBvTree = 0;
+	tile->wideBvNodeCount = 0;
+	dtFree(tile->portalEdges);
+	tile->portalEdges = 0;
+	memset(tile->portalEdgeSides, 0, sizeof(tile->portalEdgeSides));
+	dtFree(tile->offMeshConsBySide);
+	tile->offMeshConsBySide = 0;
+	dtFree(tile->detailTriBlocks);
+	tile->detailTriBlocks = 0;
+	tile->detailEdgeBlocks = 0;
+	tile->detailBlocks = 0;
+	memset(tile->offMeshConSides, 0, sizeof(tile->offMeshConSides));
 	tile->offMeshCons = 0;
 
 	// Update salt, salt should never be zero.
@@ -1350,6 +2131,15 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->next = m_nextFree;
 	m_nextFree = tile;
 
+	if (boundary)
+		calcBounds();
+
+	if (m_polyGridLookup && !buildPolyGridColumn(tx, ty))
+		freePolyGrid();
+
+	if (m_tileListener)
+		m_tileListener->tileRemoved(this, ref, tx, ty);
+
 	return DT_SUCCESS;
 }
 
@@ -1610,3 +2400,350 @@ dtStatus dtNavMesh::getPolyArea(dtPolyRef ref, unsigned char* resultArea) const
 	return DT_SUCCESS;
 }
 
+/// @par
+///
+/// The layout of the tables is described by dtNavMeshParams::disjointPolyGroupCount, 
+/// dtNavMeshParams::reachabilityTableSize and dtNavMeshParams::reachabilityTableCount.
+/// Bit @p b of row @p a is set if group @p b can be reached from group @p a.
+/// The data is copied. The tables are only valid for the tiles they were built for,
+/// call this function again with null data to clear them after the tiles change.
+dtStatus dtNavMesh::setReachabilityTables(const unsigned int* data, const int dataSize)
+{
+	dtFree(m_reachability);
+	m_reachability = 0;
+	m_reachabilityRowSize = 0;
+	m_reachabilityTableStride = 0;
+
+	if (!data)
+		return DT_SUCCESS;
+
+	const int groupCount = m_params.disjointPolyGroupCount;
+	const int rowSize = (groupCount + 31) / 32;
+	const int tableStride = m_params.reachabilityTableSize / (int)sizeof(unsigned int);
+	const int tableCount = m_params.reachabilityTableCount;
+	if (groupCount <= 0 || tableCount <= 0 || tableStride < rowSize*groupCount ||
+		dataSize < tableCount*tableStride*(int)sizeof(unsigned int))
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	m_reachability = (unsigned int*)dtAlloc(sizeof(unsigned int)*tableCount*tableStride, DT_ALLOC_PERM);
+	if (!m_reachability)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	memcpy(m_reachability, data, sizeof(unsigned int)*tableCount*tableStride);
+	m_reachabilityRowSize = rowSize;
+	m_reachabilityTableStride = tableStride;
+
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// Polygons whose group is not covered by the tables are treated as reachable. The tables
+/// only describe the links of the navigation mesh, a query filter may still prevent the
+/// goal from being reached.
+bool dtNavMesh::isGoalPolyReachable(const dtPolyRef fromRef, const dtPolyRef goalRef, const int tableIndex) const
+{
+	if (!m_reachability || tableIndex < 0 || tableIndex >= m_params.reachabilityTableCount)
+		return true;
+
+	const dtMeshTile* fromTile = 0;
+	const dtPoly* fromPoly = 0;
+	const dtMeshTile* goalTile = 0;
+	const dtPoly* goalPoly = 0;
+	if (dtStatusFailed(getTileAndPolyByRef(fromRef, &fromTile, &fromPoly)) ||
+		dtStatusFailed(getTileAndPolyByRef(goalRef, &goalTile, &goalPoly)))
+		return true;
+
+	const int fromGroup = fromPoly->disjointSetId;
+	const int goalGroup = goalPoly->disjointSetId;
+	if (fromGroup == goalGroup)
+		return true;
+	if (fromGroup >= m_params.disjointPolyGroupCount || goalGroup >= m_params.disjointPolyGroupCount)
+		return true;
+
+	const unsigned int* row = &m_reachability[tableIndex*m_reachabilityTableStride + fromGroup*m_reachabilityRowSize];
+	return (row[goalGroup >> 5] & (1u << (goalGroup & 31))) != 0;
+}
+
+
+/// @par
+///
+/// The grid splits every tile location into @p cellsPerTile * @p cellsPerTile cells, and stores 
+/// the bounds and references of the polygons overlapping each cell, for all layers of the location. 
+/// Queries whose box spans about one cell or less then visit the cells their box overlaps, 
+/// instead of looking up each tile and traversing its bounding volume tree. Larger boxes are 
+/// faster through the trees, and still use them.
+///
+/// The entries keep the quantized bounds of the polygons' tree leaves, and queries test them 
+/// like the trees do, so the grid returns the same polygons as the tiles. Polygons of tiles 
+/// without a tree use their vertex bounds instead.
+///
+/// Off-mesh connection polygons are not in the grid, as they are never returned by queries.
+/// If the grid cannot be updated when a tile is added or removed, it is freed and queries 
+/// fall back to the tiles.
+dtStatus dtNavMesh::initPolyGrid(const int cellsPerTile)
+{
+	if (cellsPerTile < 0 || cellsPerTile > DT_POLYGRID_MAX_CELLS_PER_TILE || !m_posLookup)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	freePolyGrid();
+	if (cellsPerTile == 0)
+		return DT_SUCCESS;
+
+	m_polyGridLookup = (dtPolyGridColumn**)dtAlloc(sizeof(dtPolyGridColumn*)*m_tileLutSize, DT_ALLOC_PERM);
+	if (!m_polyGridLookup)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	memset(m_polyGridLookup, 0, sizeof(dtPolyGridColumn*)*m_tileLutSize);
+	m_polyGridCellsPerTile = cellsPerTile;
+	m_polyGridCellWidth = m_tileWidth / (float)cellsPerTile;
+	m_polyGridCellHeight = m_tileHeight / (float)cellsPerTile;
+
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshHeader* header = m_tiles[i].header;
+		if (!header || getPolyGridColumn(header->x, header->y))
+			continue;
+		if (!buildPolyGridColumn(header->x, header->y))
+		{
+			freePolyGrid();
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
+	}
+
+	return DT_SUCCESS;
+}
+
+// Converts the box to polygon grid cell units. The grid grows along -x, like the tiles.
+static void calcPolyGridCoords(const float* orig, const float cellWidth, const float cellHeight,
+							   const float* bmin, const float* bmax, float* umin, float* umax)
+{
+	umin[0] = (orig[0]-bmax[0]) / cellWidth;
+	umax[0] = (orig[0]-bmin[0]) / cellWidth;
+	umin[1] = (bmin[1]-orig[1]) / cellHeight;
+	umax[1] = (bmax[1]-orig[1]) / cellHeight;
+}
+
+/// @par
+///
+/// Polygons are stored in the cells their bounds overlap, except for the cells they only touch 
+/// at their maximum edge. A query box that only touches such a polygon at a cell boundary 
+/// therefore also covers the cell before the boundary.
+///
+/// Queries quantize their box outwards by up to two units before testing it against the 
+/// tree leaves, so the box is grown by a bit more than that first. The grown box then 
+/// overlaps the polygons it only touched, and does not need the cell before the boundary.
+void dtNavMesh::calcPolyGridQueryCells(const float* bmin, const float* bmax, int* cmin, int* cmax) const
+{
+	float qmin[3], qmax[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		qmin[i] = bmin[i] - m_polyGridMargin;
+		qmax[i] = bmax[i] + m_polyGridMargin;
+	}
+	float umin[2], umax[2];
+	calcPolyGridCoords(m_orig, m_polyGridCellWidth, m_polyGridCellHeight, qmin, qmax, umin, umax);
+	for (int i = 0; i < 2; ++i)
+	{
+		cmin[i] = m_polyGridMargin > 0 ? (int)floorf(umin[i]) : (int)ceilf(umin[i]) - 1;
+		cmax[i] = (int)floorf(umax[i]);
+	}
+}
+
+const dtPolyGridColumn* dtNavMesh::getPolyGridColumn(const int x, const int y) const
+{
+	if (!m_polyGridLookup)
+		return 0;
+	const dtPolyGridColumn* column = m_polyGridLookup[computeTileHash(x, y, m_tileLutMask)];
+	while (column)
+	{
+		if (column->x == x && column->y == y)
+			return column;
+		column = column->next;
+	}
+	return 0;
+}
+
+// Calculates the bounds of the polygon vertices.
+static void calcPolyBounds(const dtMeshTile* tile, const int ip, float* bmin, float* bmax)
+{
+	const dtPoly* p = &tile->polys[ip];
+	dtVcopy(bmin, &tile->verts[p->verts[0]*3]);
+	dtVcopy(bmax, bmin);
+	for (int j = 1; j < p->vertCount; ++j)
+	{
+		const float* v = &tile->verts[p->verts[j]*3];
+		dtVmin(bmin, v);
+		dtVmax(bmax, v);
+	}
+}
+
+// Calculates the bounds of the bounding volume tree leaf.
+static void calcPolyLeafBounds(const dtMeshTile* tile, const dtBVNode* node, float* bmin, float* bmax)
+{
+	const float* tbmin = tile->header->bmin;
+	const float qfac = tile->header->bvQuantFactor;
+	for (int i = 0; i < 3; ++i)
+	{
+		bmin[i] = tbmin[i] + (float)node->bmin[i] / qfac;
+		bmax[i] = tbmin[i] + (float)node->bmax[i] / qfac;
+	}
+}
+
+bool dtNavMesh::buildPolyGridColumn(const int x, const int y)
+{
+	// Remove the old column.
+	const int h = computeTileHash(x, y, m_tileLutMask);
+	dtPolyGridColumn* prev = 0;
+	dtPolyGridColumn* cur = m_polyGridLookup[h];
+	while (cur)
+	{
+		if (cur->x == x && cur->y == y)
+		{
+			if (prev)
+				prev->next = cur->next;
+			else
+				m_polyGridLookup[h] = cur->next;
+			dtFree(cur);
+			break;
+		}
+		prev = cur;
+		cur = cur->next;
+	}
+
+	static const int MAX_NEIS = 32;
+	dtMeshTile* tiles[MAX_NEIS];
+	const int ntiles = getTilesAt(x, y, tiles, MAX_NEIS);
+	if (!ntiles)
+		return true;
+
+	const int cpt = m_polyGridCellsPerTile;
+	const int cellCount = cpt*cpt;
+	int* counts = (int*)dtAlloc(sizeof(int)*cellCount, DT_ALLOC_TEMP);
+	if (!counts)
+		return false;
+	memset(counts, 0, sizeof(int)*cellCount);
+
+	// The first pass counts the entries of each cell, the second one stores them.
+	dtPolyGridColumn* column = 0;
+	int entryCount = 0;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (int i = 0; i < ntiles; ++i)
+		{
+			const dtMeshTile* tile = tiles[i];
+			const dtPolyRef base = getPolyRefBase(tile);
+			// Tiles with a tree add the polygons of its leaves, which leave out off-mesh connections.
+			// The escape index of the root gives the size of the tree, which can be less than the node count.
+			int count = tile->header->polyCount;
+			if (tile->bvTree)
+				count = tile->bvTree[0].i >= 0 ? 1 : -tile->bvTree[0].i;
+			for (int k = 0; k < count; ++k)
+			{
+				const dtBVNode* node = tile->bvTree ? &tile->bvTree[k] : 0;
+				if (node ? node->i < 0 : tile->polys[k].getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+					continue;
+				const int ip = node ? node->i : k;
+				if (node)
+					m_polyGridMargin = dtMax(m_polyGridMargin, 2.01f / tile->header->bvQuantFactor);
+				float bmin[3], bmax[3];
+				if (node)
+					calcPolyLeafBounds(tile, node, bmin, bmax);
+				else
+					calcPolyBounds(tile, ip, bmin, bmax);
+
+				// Leave out the cells the polygon only touches at its maximum edge.
+				float umin[2], umax[2];
+				calcPolyGridCoords(m_orig, m_polyGridCellWidth, m_polyGridCellHeight, bmin, bmax, umin, umax);
+				int x0 = (int)floorf(umin[0]);
+				int y0 = (int)floorf(umin[1]);
+				int x1 = dtMax(x0, (int)ceilf(umax[0]) - 1);
+				int y1 = dtMax(y0, (int)ceilf(umax[1]) - 1);
+				x0 = dtClamp(x0 - x*cpt, 0, cpt-1);
+				x1 = dtClamp(x1 - x*cpt, 0, cpt-1);
+				y0 = dtClamp(y0 - y*cpt, 0, cpt-1);
+				y1 = dtClamp(y1 - y*cpt, 0, cpt-1);
+
+				for (int cy = y0; cy <= y1; ++cy)
+				{
+					for (int cx = x0; cx <= x1; ++cx)
+					{
+						const int cell = cy*cpt + cx;
+						if (pass == 0)
+						{
+							counts[cell]++;
+							entryCount++;
+							continue;
+						}
+						dtPolyGridEntry& entry = column->entries[column->cells[cell] + counts[cell]++];
+						dtVcopy(entry.bmin, bmin);
+						dtVcopy(entry.bmax, bmax);
+						for (int j = 0; j < 3; ++j)
+						{
+							entry.qbmin[j] = node ? node->bmin[j] : 0;
+							entry.qbmax[j] = node ? node->bmax[j] : 0;
+						}
+						entry.ref = base | (dtPolyRef)ip;
+						entry.cellX = (unsigned char)cx;
+						entry.cellY = (unsigned char)cy;
+						entry.firstCellX = (unsigned char)x0;
+						entry.firstCellY = (unsigned char)y0;
+					}
+				}
+			}
+		}
+
+		if (pass == 1)
+			break;
+
+		// Allocate the column and turn the counts into the first entry of each cell.
+		const int headerSize = dtAlign4(sizeof(dtPolyGridColumn));
+		const int entriesSize = dtAlign4(sizeof(dtPolyGridEntry)*entryCount);
+		const int cellsSize = dtAlign4(sizeof(int)*(cellCount+1));
+		unsigned char* data = (unsigned char*)dtAlloc(headerSize + entriesSize + cellsSize, DT_ALLOC_PERM);
+		if (!data)
+		{
+			dtFree(counts);
+			return false;
+		}
+		column = (dtPolyGridColumn*)data;
+		column->x = x;
+		column->y = y;
+		column->entryCount = entryCount;
+		column->entries = (dtPolyGridEntry*)(data + headerSize);
+		column->cells = (int*)(data + headerSize + entriesSize);
+		int first = 0;
+		for (int i = 0; i < cellCount; ++i)
+		{
+			column->cells[i] = first;
+			first += counts[i];
+			counts[i] = 0;
+		}
+		column->cells[cellCount] = first;
+	}
+	dtFree(counts);
+
+	column->next = m_polyGridLookup[h];
+	m_polyGridLookup[h] = column;
+	return true;
+}
+
+void dtNavMesh::freePolyGrid()
+{
+	if (m_polyGridLookup)
+	{
+		for (int i = 0; i < m_tileLutSize; ++i)
+		{
+			dtPolyGridColumn* column = m_polyGridLookup[i];
+			while (column)
+			{
+				dtPolyGridColumn* next = column->next;
+				dtFree(column);
+				column = next;
+			}
+		}
+	}
+	dtFree(m_polyGridLookup);
+	m_polyGridLookup = 0;
+	m_polyGridCellsPerTile = 0;
+	m_polyGridCellWidth = 0;
+	m_polyGridCellHeight = 0;
+	m_polyGridMargin = 0;
+}
@@ -168,6 +168,214 @@ static void subdivide(BVItem* items, int nitems, int imin, int imax, int& curNod
 	}
 }
 
+static const int BV_SAH_BIN_COUNT = 16;
+
+// Returns the surface area of the quantized box, or a half of it to be exact.
+inline float bvHalfArea(const unsigned short* bmin, const unsigned short* bmax)
+{
+	const float dx = (float)(bmax[0] - bmin[0]);
+	const float dy = (float)(bmax[1] - bmin[1]);
+	const float dz = (float)(bmax[2] - bmin[2]);
+	return dx*dy + dy*dz + dz*dx;
+}
+
+// Returns the depth of a median split tree with the specified number of leaves.
+inline int bvMedianDepth(int inum)
+{
+	int depth = 1;
+	while (inum > 1)
+	{
+		inum = (inum+1)/2;
+		depth++;
+	}
+	return depth;
+}
+
+// Moves the items so that item k has the k-th smallest minimum on the axis, with smaller or
+// equal items before it and larger or equal items after it.
+static void selectItems(BVItem* items, int imin, int imax, const int k, const int axis)
+{
+	while (imax - imin > 1)
+	{
+		const unsigned short pivot = items[imin + (imax-imin)/2].bmin[axis];
+		int i = imin;
+		int j = imax-1;
+		while (i <= j)
+		{
+			while (items[i].bmin[axis] < pivot) i++;
+			while (items[j].bmin[axis] > pivot) j--;
+			if (i <= j)
+			{
+				dtSwap(items[i], items[j]);
+				i++;
+				j--;
+			}
+		}
+		if (k <= j)
+			imax = j+1;
+		else if (k >= i)
+			imin = i;
+		else
+			return;
+	}
+}
+
+// Finds the binned split with the lowest surface area cost.
+// Returns the number of items left of the split, or zero if the centroids cannot be split.
+static int splitItemsSAH(BVItem* items, const int imin, const int imax)
+{
+	// Centroids are kept doubled, so that they stay integers.
+	int cmin[3], cmax[3];
+	for (int j = 0; j < 3; ++j)
+		cmin[j] = cmax[j] = items[imin].bmin[j] + items[imin].bmax[j];
+	for (int i = imin+1; i < imax; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			const int c = items[i].bmin[j] + items[i].bmax[j];
+			cmin[j] = dtMin(cmin[j], c);
+			cmax[j] = dtMax(cmax[j], c);
+		}
+	}
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const int range = cmax[axis] - cmin[axis] + 1;
+		if (range <= 1)
+			continue;
+
+		unsigned short binMin[BV_SAH_BIN_COUNT][3];
+		unsigned short binMax[BV_SAH_BIN_COUNT][3];
+		int binCount[BV_SAH_BIN_COUNT];
+		for (int b = 0; b < BV_SAH_BIN_COUNT; ++b)
+		{
+			binMin[b][0] = binMin[b][1] = binMin[b][2] = 0xffff;
+			binMax[b][0] = binMax[b][1] = binMax[b][2] = 0;
+			binCount[b] = 0;
+		}
+		for (int i = imin; i < imax; ++i)
+		{
+			const BVItem& it = items[i];
+			const int b = (it.bmin[axis] + it.bmax[axis] - cmin[axis]) * BV_SAH_BIN_COUNT / range;
+			for (int j = 0; j < 3; ++j)
+			{
+				binMin[b][j] = dtMin(binMin[b][j], it.bmin[j]);
+				binMax[b][j] = dtMax(binMax[b][j], it.bmax[j]);
+			}
+			binCount[b]++;
+		}
+
+		// Sweep from the right to get the cost of the items right of each split.
+		float rightCost[BV_SAH_BIN_COUNT];
+		unsigned short bmin[3] = { 0xffff, 0xffff, 0xffff };
+		unsigned short bmax[3] = { 0, 0, 0 };
+		int count = 0;
+		for (int b = BV_SAH_BIN_COUNT-1; b > 0; --b)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				bmin[j] = dtMin(bmin[j], binMin[b][j]);
+				bmax[j] = dtMax(bmax[j], binMax[b][j]);
+			}
+			count += binCount[b];
+			rightCost[b] = count ? bvHalfArea(bmin, bmax) * (float)count : -1.0f;
+		}
+
+		// Sweep from the left and combine.
+		bmin[0] = bmin[1] = bmin[2] = 0xffff;
+		bmax[0] = bmax[1] = bmax[2] = 0;
+		count = 0;
+		for (int b = 0; b < BV_SAH_BIN_COUNT-1; ++b)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				bmin[j] = dtMin(bmin[j], binMin[b][j]);
+				bmax[j] = dtMax(bmax[j], binMax[b][j]);
+			}
+			count += binCount[b];
+			if (!count || rightCost[b+1] < 0.0f)
+				continue;
+			const float cost = bvHalfArea(bmin, bmax) * (float)count + rightCost[b+1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+		return 0;
+
+	// Partition the items at the split.
+	const int range = cmax[bestAxis] - cmin[bestAxis] + 1;
+	int i = imin;
+	int j = imax-1;
+	while (i <= j)
+	{
+		const int b = (items[i].bmin[bestAxis] + items[i].bmax[bestAxis] - cmin[bestAxis]) * BV_SAH_BIN_COUNT / range;
+		if (b <= bestBin)
+			i++;
+		else
+			dtSwap(items[i], items[j--]);
+	}
+	return i - imin;
+}
+
+static void subdivideSAH(BVItem* items, int imin, int imax, int depth, int& curNode, dtBVNode* nodes)
+{
+	int inum = imax - imin;
+	int icur = curNode;
+	
+	dtBVNode& node = nodes[curNode++];
+	
+	if (inum == 1)
+	{
+		// Leaf
+		node.bmin[0] = items[imin].bmin[0];
+		node.bmin[1] = items[imin].bmin[1];
+		node.bmin[2] = items[imin].bmin[2];
+		
+		node.bmax[0] = items[imin].bmax[0];
+		node.bmax[1] = items[imin].bmax[1];
+		node.bmax[2] = items[imin].bmax[2];
+		
+		node.i = items[imin].i;
+		return;
+	}
+
+	calcExtends(items, inum, imin, imax, node.bmin, node.bmax);
+
+	// Keep the tree shallow enough for the wide tree, falling back to
+	// the median split when an uneven split would make it too deep.
+	int nleft = splitItemsSAH(items, imin, imax);
+	if (nleft > 0 && depth + bvMedianDepth(dtMax(nleft, inum-nleft)) > DT_WIDE_BVTREE_MAX_DEPTH)
+		nleft = 0;
+	if (nleft == 0)
+	{
+		const int axis = longestAxis(node.bmax[0] - node.bmin[0],
+									 node.bmax[1] - node.bmin[1],
+									 node.bmax[2] - node.bmin[2]);
+		nleft = inum/2;
+		selectItems(items, imin, imax, imin+nleft, axis);
+	}
+
+	const int isplit = imin+nleft;
+	
+	// Left
+	subdivideSAH(items, imin, isplit, depth+1, curNode, nodes);
+	// Right
+	subdivideSAH(items, isplit, imax, depth+1, curNode, nodes);
+	
+	int iescape = curNode - icur;
+	// Negative index means escape.
+	node.i = -iescape;
+}
+
 static int createBVTree(dtNavMeshCreateParams* params, dtBVNode* nodes, int /*nnodes*/)
 {
 	// Build tree
@@ -233,13 +441,132 @@ static int createBVTree(dtNavMeshCreateParams* params, dtBVNode* nodes, int /*nn
 	}
 	
 	int curNode = 0;
-	subdivide(items, params->polyCount, 0, params->polyCount, curNode, nodes);
+	if (params->bvTreeBuildMethod == DT_BVTREE_SAH)
+		subdivideSAH(items, 0, params->polyCount, 1, curNode, nodes);
+	else
+		subdivide(items, params->polyCount, 0, params->polyCount, curNode, nodes);
 	
 	dtFree(items);
 	
 	return curNode;
 }
 
+// Returns the number of nodes in the binary subtree at the node, or zero if it is out of range.
+static int bvSubtreeSize(const dtBVNode* nodes, const int nodeCount, const int n)
+{
+	if (n >= nodeCount)
+		return 0;
+	const int size = nodes[n].i >= 0 ? 1 : -nodes[n].i;
+	return n + size <= nodeCount ? size : 0;
+}
+
+// Collapses the children and grandchildren of an internal binary node into one wide node.
+static int buildWideNode(const dtBVNode* nodes, const int nodeCount, const int root, const int depth,
+						 dtWideBVNode* wideNodes, int& wideCount, const int maxWideNodes)
+{
+	if (wideCount >= maxWideNodes || depth > DT_WIDE_BVTREE_MAX_DEPTH)
+		return -1;
+	const int index = wideCount++;
+
+	int lanes[DT_WIDE_BVNODE_WIDTH];
+	int laneSizes[DT_WIDE_BVNODE_WIDTH];
+	int n = 0;
+	if (nodes[root].i >= 0)
+	{
+		// A single leaf.
+		lanes[n] = root;
+		laneSizes[n++] = 1;
+	}
+	else
+	{
+		const int left = root+1;
+		const int leftSize = bvSubtreeSize(nodes, nodeCount, left);
+		const int right = left + leftSize;
+		const int rightSize = bvSubtreeSize(nodes, nodeCount, right);
+		if (!leftSize || !rightSize)
+			return -1;
+		lanes[n] = left;
+		laneSizes[n++] = leftSize;
+		lanes[n] = right;
+		laneSizes[n++] = rightSize;
+
+		// Open the largest internal children until the node is full.
+		while (n < DT_WIDE_BVNODE_WIDTH)
+		{
+			int best = -1;
+			for (int i = 0; i < n; ++i)
+			{
+				if (laneSizes[i] > 1 && (best < 0 || laneSizes[i] > laneSizes[best]))
+					best = i;
+			}
+			if (best < 0)
+				break;
+			const int c = lanes[best];
+			const int childLeft = c+1;
+			const int childLeftSize = bvSubtreeSize(nodes, nodeCount, childLeft);
+			const int childRight = childLeft + childLeftSize;
+			const int childRightSize = bvSubtreeSize(nodes, nodeCount, childRight);
+			if (!childLeftSize || !childRightSize)
+				return -1;
+			lanes[best] = childLeft;
+			laneSizes[best] = childLeftSize;
+			lanes[n] = childRight;
+			laneSizes[n++] = childRightSize;
+		}
+	}
+
+	for (int i = 0; i < DT_WIDE_BVNODE_WIDTH; ++i)
+	{
+		dtWideBVNode& node = wideNodes[index];
+		if (i >= n)
+		{
+			// Unused children never overlap a query box that is not the whole tile.
+			for (int j = 0; j < 3; ++j)
+			{
+				node.bmin[j][i] = 0xffff;
+				node.bmax[j][i] = 0;
+			}
+			node.child[i] = 0;
+			continue;
+		}
+		const dtBVNode& bv = nodes[lanes[i]];
+		for (int j = 0; j < 3; ++j)
+		{
+			node.bmin[j][i] = bv.bmin[j];
+			node.bmax[j][i] = bv.bmax[j];
+		}
+		if (bv.i >= 0)
+		{
+			node.child[i] = -(bv.i+1);
+		}
+		else
+		{
+			const int child = buildWideNode(nodes, nodeCount, lanes[i], depth+1, wideNodes, wideCount, maxWideNodes);
+			if (child < 0)
+				return -1;
+			wideNodes[index].child[i] = child;
+		}
+	}
+	return index;
+}
+
+/// @par
+///
+/// Each wide node collapses up to three levels of the binary tree. Children are opened largest
+/// first, so the wide tree stays as balanced as the binary tree. The leaves and their bounds
+/// are the same as in the binary tree, so queries return the same polygons from either tree.
+int dtCreateWideBVTree(const dtBVNode* nodes, const int nodeCount, dtWideBVNode* wideNodes, const int maxWideNodes)
+{
+	if (!nodes || nodeCount <= 0 || !wideNodes || maxWideNodes <= 0)
+		return 0;
+	if (!bvSubtreeSize(nodes, nodeCount, 0))
+		return 0;
+	int wideCount = 0;
+	if (buildWideNode(nodes, nodeCount, 0, 1, wideNodes, wideCount, maxWideNodes) < 0)
+		return 0;
+	return wideCount;
+}
+
 static unsigned char classifyOffMeshPoint(const float* pt, const float* bmin, const float* bmax)
 {
 	static const unsigned char XP = 1<<0;
@@ -679,6 +1006,84 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	return true;
 }
 
+/// @par
+///
+/// Polygon vertices are kept as floats, so the border vertices shared with neighbour tiles still
+/// match exactly when the tiles are linked. Only the detail mesh vertices are quantized, to 16 bits
+/// per axis over the bounds of the detail vertices, so their error is at most half a step of
+/// (bounds size / 65535).
+///
+/// The packed data is meant to be added to a navigation mesh and cannot be endian swapped.
+/// @see dtCreateNavMeshData, dtGetDetailVert
+bool dtPackNavMeshDetailVerts(const unsigned char* data, const int dataSize, unsigned char** outData, int* outDataSize)
+{
+	const dtMeshHeader* header = (const dtMeshHeader*)data;
+	if (header->magic != DT_NAVMESH_MAGIC)
+		return false;
+	if (header->version != DT_NAVMESH_VERSION)
+		return false;
+
+	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
+	const int vertsSize = dtAlign4(sizeof(float)*3*header->vertCount);
+	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
+	const int sthSize = header->sth_per_poly*header->polyCount*4;
+	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
+	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
+	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
+	const int packedVertsSize = dtAlign4(sizeof(float)*6 + sizeof(unsigned short)*3*header->detailVertCount);
+
+	const int prefixSize = headerSize + vertsSize + polysSize + sthSize + linksSize + detailMeshesSize;
+	const int suffixSize = dataSize - prefixSize - detailVertsSize;
+	if (suffixSize < 0)
+		return false;
+
+	const int packedSize = prefixSize + packedVertsSize + suffixSize;
+	unsigned char* packed = (unsigned char*)dtAlloc(sizeof(unsigned char)*packedSize, DT_ALLOC_PERM);
+	if (!packed)
+		return false;
+	memset(packed, 0, packedSize);
+
+	memcpy(packed, data, prefixSize);
+	memcpy(packed + prefixSize + packedVertsSize, data + prefixSize + detailVertsSize, suffixSize);
+	((dtMeshHeader*)packed)->magic = DT_NAVMESH_PACKED_DETAIL_MAGIC;
+
+	// Quantize the detail vertices over their bounds.
+	const float* verts = (const float*)(data + prefixSize);
+	float* quant = (float*)(packed + prefixSize);
+	unsigned short* q = (unsigned short*)(quant + 6);
+	float bmin[3] = { 0, 0, 0 };
+	float bmax[3] = { 0, 0, 0 };
+	if (header->detailVertCount > 0)
+	{
+		dtVcopy(bmin, verts);
+		dtVcopy(bmax, verts);
+		for (int i = 1; i < header->detailVertCount; ++i)
+		{
+			dtVmin(bmin, &verts[i*3]);
+			dtVmax(bmax, &verts[i*3]);
+		}
+	}
+	for (int j = 0; j < 3; ++j)
+	{
+		quant[j] = bmin[j];
+		quant[3+j] = (bmax[j] - bmin[j]) / 65535.0f;
+	}
+	for (int i = 0; i < header->detailVertCount; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			const float step = quant[3+j];
+			const float t = step > 0 ? (verts[i*3+j] - bmin[j]) / step + 0.5f : 0.0f;
+			q[i*3+j] = (unsigned short)dtClamp((int)t, 0, 0xffff);
+		}
+	}
+
+	*outData = packed;
+	*outDataSize = packedSize;
+
+	return true;
+}
+
 bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int /*dataSize*/)
 {
 	dtMeshHeader* header = (dtMeshHeader*)data;
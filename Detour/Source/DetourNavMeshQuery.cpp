@@ -18,9 +18,11 @@
 
 #include <float.h>
 #include <string.h>
+#include <stdlib.h>
 #include "DetourNavMeshQuery.h"
 #include "DetourNavMesh.h"
 #include "DetourNode.h"
+#include "DetourFlowField.h"
 #include "DetourCommon.h"
 #include "DetourMath.h"
 #include "DetourAlloc.h"
@@ -62,7 +64,8 @@
 
 dtQueryFilter::dtQueryFilter() :
 	m_includeFlags(0xffff),
-	m_excludeFlags(0)
+	m_excludeFlags(0),
+	m_reachabilityTable(0)
 {
 	for (int i = 0; i < DT_MAX_AREAS; ++i)
 		m_areaCost[i] = 1.0f;
@@ -83,24 +86,7 @@ float dtQueryFilter::getCost(const float* pa, const float* pb,
 {
 	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
 }
-#else
-inline bool dtQueryFilter::passFilter(const dtPolyRef /*ref*/,
-									  const dtMeshTile* /*tile*/,
-									  const dtPoly* poly) const
-{
-	return (poly->flags & m_includeFlags) != 0 && (poly->flags & m_excludeFlags) == 0;
-}
-
-inline float dtQueryFilter::getCost(const float* pa, const float* pb,
-									const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
-									const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
-									const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
-{
-	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
-}
-#endif	
-	
-static const float H_SCALE = 0.999f; // Search heuristic scale.
+#endif
 
 
 dtNavMeshQuery* dtAllocNavMeshQuery()
@@ -163,14 +149,27 @@ dtNavMeshQuery::~dtNavMeshQuery()
 /// functions are used.
 ///
 /// This function can be used multiple times.
-dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
+///
+/// #DT_NODE_POOL_TILE_INDEXED avoids hashing polygon references and clearing the
+/// hash table before every search, which pays off with many short searches. It keeps
+/// a node index per polygon and state for every tile a search has visited.
+///
+/// #DT_NODE_QUEUE_QUATERNARY_HEAP and #DT_NODE_QUEUE_RADIX_HEAP make decreasing the
+/// cost of an open node cheap. The radix heap expects the total cost of the popped
+/// nodes to never decrease, which holds for filters whose costs are at least the
+/// distance traveled, such as the default filter with area costs of one or more.
+dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes, const dtNodePoolType poolType,
+							  const dtNodeQueueType queueType)
 {
 	if (maxNodes > DT_NULL_IDX || maxNodes > (1 << DT_NODE_PARENT_BITS) - 1)
 		return DT_FAILURE | DT_INVALID_PARAM;
+	if (poolType == DT_NODE_POOL_TILE_INDEXED && !nav)
+		return DT_FAILURE | DT_INVALID_PARAM;
 
 	m_nav = nav;
-	
-	if (!m_nodePool || m_nodePool->getMaxNodes() < maxNodes)
+
+	const dtNavMesh* poolNav = poolType == DT_NODE_POOL_TILE_INDEXED ? nav : 0;
+	if (!m_nodePool || m_nodePool->getMaxNodes() < maxNodes || m_nodePool->getTileIndexedNavMesh() != poolNav)
 	{
 		if (m_nodePool)
 		{
@@ -178,9 +177,13 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 			dtFree(m_nodePool);
 			m_nodePool = 0;
 		}
-		m_nodePool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM)) dtNodePool(maxNodes, dtNextPow2(maxNodes/4));
-		if (!m_nodePool)
+		void* mem = dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM);
+		if (!mem)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		if (poolNav)
+			m_nodePool = new (mem) dtNodePool(maxNodes, poolNav);
+		else
+			m_nodePool = new (mem) dtNodePool(maxNodes, dtNextPow2(maxNodes/4));
 	}
 	else
 	{
@@ -198,7 +201,7 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 		m_tinyNodePool->clear();
 	}
 	
-	if (!m_openList || m_openList->getCapacity() < maxNodes)
+	if (!m_openList || m_openList->getCapacity() < maxNodes || m_openList->getType() != queueType)
 	{
 		if (m_openList)
 		{
@@ -206,9 +209,10 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 			dtFree(m_openList);
 			m_openList = 0;
 		}
-		m_openList = new (dtAlloc(sizeof(dtNodeQueue), DT_ALLOC_PERM)) dtNodeQueue(maxNodes);
-		if (!m_openList)
+		void* mem = dtAlloc(sizeof(dtNodeQueue), DT_ALLOC_PERM);
+		if (!mem)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		m_openList = new (mem) dtNodeQueue(maxNodes, queueType);
 	}
 	else
 	{
@@ -680,6 +684,47 @@ public:
 	}
 };
 
+class dtFindNearestReachablePolyQuery : public dtPolyQuery
+{
+	const dtNavMesh* m_nav;
+	dtPolyRef m_startRef;
+	int m_table;
+	dtFindNearestPolyQuery m_nearest;
+
+public:
+	dtFindNearestReachablePolyQuery(const dtNavMeshQuery* query, const dtNavMesh* nav, const float* center,
+									dtPolyRef startRef, int table)
+		: m_nav(nav), m_startRef(startRef), m_table(table), m_nearest(query, center)
+	{
+	}
+
+	dtPolyRef nearestRef() const { return m_nearest.nearestRef(); }
+	const float* nearestPoint() const { return m_nearest.nearestPoint(); }
+
+	void process(const dtMeshTile* tile, dtPoly** polys, dtPolyRef* refs, int count)
+	{
+		static const int batchSize = 32;
+		dtPoly* reachablePolys[batchSize];
+		dtPolyRef reachableRefs[batchSize];
+		int n = 0;
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (!m_nav->isGoalPolyReachable(m_startRef, refs[i], m_table))
+				continue;
+			reachablePolys[n] = polys[i];
+			reachableRefs[n] = refs[i];
+			if (++n == batchSize)
+			{
+				m_nearest.process(tile, reachablePolys, reachableRefs, n);
+				n = 0;
+			}
+		}
+		if (n > 0)
+			m_nearest.process(tile, reachablePolys, reachableRefs, n);
+	}
+};
+
 /// @par 
 ///
 /// @note If the search box does not intersect any polygons the search will 
@@ -725,6 +770,30 @@ dtStatus dtNavMeshQuery::findNearestPoly(const float* center, const float* halfE
 	return DT_SUCCESS;
 }
 
+// Quantizes the query box, clamped to the tile bounds, like the bounding volume tree of the tile.
+static void quantizeQueryBounds(const dtMeshTile* tile, const float* qmin, const float* qmax,
+								unsigned short* bmin, unsigned short* bmax)
+{
+	const float* tbmin = tile->header->bmin;
+	const float* tbmax = tile->header->bmax;
+	const float qfac = tile->header->bvQuantFactor;
+
+	// dtClamp query box to world box.
+	float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
+	float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
+	float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
+	float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
+	float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
+	float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
+	// Quantize
+	bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
+	bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
+	bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
+	bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
+	bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
+	bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
+}
+
 void dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
 										 const dtQueryFilter* filter, dtPolyQuery* query) const
 {
@@ -738,60 +807,88 @@ void dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qm
 	{
 		const dtBVNode* node = &tile->bvTree[0];
 		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
-		const float* tbmin = tile->header->bmin;
-		const float* tbmax = tile->header->bmax;
-		const float qfac = tile->header->bvQuantFactor;
 
 		// Calculate quantized box
 		unsigned short bmin[3], bmax[3];
-		// dtClamp query box to world box.
-		float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
-		float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
-		// Quantize
-		bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
-		bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
-		bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
-		bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
-		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
-		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
-
-		// Traverse tree
+		quantizeQueryBounds(tile, qmin, qmax, bmin, bmax);
+
 		const dtPolyRef base = m_nav->getPolyRefBase(tile);
-		while (node < end)
+		if (tile->wideBvTree)
 		{
-			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
-			const bool isLeafNode = node->i >= 0;
-
-			if (isLeafNode && overlap)
-			{
-				dtPolyRef ref = base | (dtPolyRef)node->i;
-				if (filter->passFilter(ref, tile, &tile->polys[node->i]))
+			// Traverse wide tree, testing all children of a node at once.
+			int stack[DT_WIDE_BVTREE_MAX_DEPTH*(DT_WIDE_BVNODE_WIDTH-1)+1];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0)
+			{
+				const dtWideBVNode& wideNode = tile->wideBvTree[stack[--top]];
+				unsigned int overlap = dtOverlapQuantBounds4(bmin, bmax, wideNode.bmin, wideNode.bmax);
+				for (int i = 0; overlap; ++i, overlap >>= 1)
 				{
-					polyRefs[n] = ref;
-					polys[n] = &tile->polys[node->i];
-
-					if (n == batchSize - 1)
+					const int child = wideNode.child[i];
+					if (!(overlap & 1) || !child)
+						continue;
+					if (child > 0)
 					{
-						query->process(tile, polys, polyRefs, batchSize);
-						n = 0;
+						stack[top++] = child;
+						continue;
 					}
-					else
+
+					const int ip = -child-1;
+					dtPolyRef ref = base | (dtPolyRef)ip;
+					if (filter->passFilter(ref, tile, &tile->polys[ip]))
 					{
-						n++;
+						polyRefs[n] = ref;
+						polys[n] = &tile->polys[ip];
+
+						if (n == batchSize - 1)
+						{
+							query->process(tile, polys, polyRefs, batchSize);
+							n = 0;
+						}
+						else
+						{
+							n++;
+						}
 					}
 				}
 			}
-
-			if (overlap || isLeafNode)
-				node++;
-			else
+		}
+		else
+		{
+			// Traverse tree
+			while (node < end)
 			{
-				const int escapeIndex = -node->i;
-				node += escapeIndex;
+				const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
+				const bool isLeafNode = node->i >= 0;
+
+				if (isLeafNode && overlap)
+				{
+					dtPolyRef ref = base | (dtPolyRef)node->i;
+					if (filter->passFilter(ref, tile, &tile->polys[node->i]))
+					{
+						polyRefs[n] = ref;
+						polys[n] = &tile->polys[node->i];
+
+						if (n == batchSize - 1)
+						{
+							query->process(tile, polys, polyRefs, batchSize);
+							n = 0;
+						}
+						else
+						{
+							n++;
+						}
+					}
+				}
+
+				if (overlap || isLeafNode)
+					node++;
+				else
+				{
+					const int escapeIndex = -node->i;
+					node += escapeIndex;
+				}
 			}
 		}
 	}
@@ -902,6 +999,105 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 	return collector.overflowed() ? DT_SUCCESS | DT_BUFFER_TOO_SMALL : DT_SUCCESS;
 }
 
+// Returns a / b rounded towards negative infinity.
+inline int floorDiv(const int a, const int b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void dtNavMeshQuery::queryPolygonsInGrid(const float* qmin, const float* qmax,
+										 const dtQueryFilter* filter, dtPolyQuery* query) const
+{
+	static const int batchSize = 32;
+	dtPolyRef polyRefs[batchSize];
+	dtPoly* polys[batchSize];
+	const dtMeshTile* batchTile = 0;
+	int n = 0;
+
+	// Polygons are only returned from the tiles the query touches, like in queryPolygons().
+	int tminx, tminy, tmaxx, tmaxy;
+	m_nav->calcTileLoc(qmin, &tminx, &tminy);
+	m_nav->calcTileLoc(qmax, &tmaxx, &tmaxy);
+	if (tminx > tmaxx)
+		dtSwap(tminx, tmaxx);
+	const dtMeshTile* boundsTile = 0;
+	bool tileTouched = false;
+	unsigned short quantMin[3], quantMax[3];
+
+	// Find cells the query touches.
+	const int cpt = m_nav->getPolyGridCellsPerTile();
+	int cmin[2], cmax[2];
+	m_nav->calcPolyGridQueryCells(qmin, qmax, cmin, cmax);
+	const int minx = cmin[0], miny = cmin[1];
+	const int maxx = cmax[0], maxy = cmax[1];
+
+	for (int ty = floorDiv(miny, cpt); ty <= floorDiv(maxy, cpt); ++ty)
+	{
+		for (int tx = floorDiv(minx, cpt); tx <= floorDiv(maxx, cpt); ++tx)
+		{
+			const dtPolyGridColumn* column = m_nav->getPolyGridColumn(tx, ty);
+			if (!column)
+				continue;
+			const int x0 = dtMax(minx - tx*cpt, 0);
+			const int x1 = dtMin(maxx - tx*cpt, cpt-1);
+			const int y0 = dtMax(miny - ty*cpt, 0);
+			const int y1 = dtMin(maxy - ty*cpt, cpt-1);
+			for (int cy = y0; cy <= y1; ++cy)
+			{
+				// The cells of a row are next to each other.
+				const int* row = &column->cells[cy*cpt];
+				for (int i = row[x0]; i < row[x1+1]; ++i)
+				{
+					const dtPolyGridEntry& entry = column->entries[i];
+					// Polygons in several cells are only reported from the first cell the query touches.
+					if (dtMax((int)entry.firstCellX, x0) != entry.cellX || dtMax((int)entry.firstCellY, y0) != cy)
+						continue;
+
+					// Test the bounds like queryPolygonsInTile() does.
+					const dtMeshTile* tile = &m_nav->m_tiles[m_nav->decodePolyIdTile(entry.ref)];
+					if (tile != boundsTile)
+					{
+						boundsTile = tile;
+						const dtMeshHeader* header = tile->header;
+						tileTouched = header->x >= tminx && header->x <= tmaxx && header->y >= tminy && header->y <= tmaxy;
+						if (tile->bvTree)
+							quantizeQueryBounds(tile, qmin, qmax, quantMin, quantMax);
+					}
+					if (!tileTouched)
+						continue;
+					if (tile->bvTree ? !dtOverlapQuantBounds(quantMin, quantMax, entry.qbmin, entry.qbmax)
+									 : !dtOverlapBounds(qmin, qmax, entry.bmin, entry.bmax))
+						continue;
+
+					// Batches only hold polygons of one tile.
+					if (tile != batchTile)
+					{
+						if (n > 0)
+							query->process(batchTile, polys, polyRefs, n);
+						n = 0;
+						batchTile = tile;
+					}
+					dtPoly* poly = &tile->polys[m_nav->decodePolyIdPoly(entry.ref)];
+					if (!filter->passFilter(entry.ref, tile, poly))
+						continue;
+
+					polyRefs[n] = entry.ref;
+					polys[n] = poly;
+					if (++n == batchSize)
+					{
+						query->process(batchTile, polys, polyRefs, n);
+						n = 0;
+					}
+				}
+			}
+		}
+	}
+
+	// Process the last polygons that didn't make a full batch.
+	if (n > 0)
+		query->process(batchTile, polys, polyRefs, n);
+}
+
 /// @par 
 ///
 /// The query will be invoked with batches of polygons. Polygons passed
@@ -909,6 +1105,10 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 /// passed to this function. The dtPolyQuery::process function is invoked multiple
 /// times until all overlapping polygons have been processed.
 ///
+/// If the navigation mesh has a polygon grid and the box spans at most one grid cell 
+/// along x and y, the polygons are found through the grid instead of the tiles. Both 
+/// return the same polygons. (See: dtNavMesh::initPolyGrid)
+///
 dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExtents,
 									   const dtQueryFilter* filter, dtPolyQuery* query) const
 {
@@ -924,11 +1124,24 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 	float bmin[3], bmax[3];
 	dtVsub(bmin, center, halfExtents);
 	dtVadd(bmax, center, halfExtents);
+
+	// Larger boxes visit many cells, and are faster through the trees of the tiles.
+	const int cellsPerTile = m_nav->getPolyGridCellsPerTile();
+	if (cellsPerTile &&
+		bmax[0]-bmin[0] <= m_nav->getParams()->tileWidth / (float)cellsPerTile &&
+		bmax[1]-bmin[1] <= m_nav->getParams()->tileHeight / (float)cellsPerTile)
+	{
+		queryPolygonsInGrid(bmin, bmax, filter, query);
+		return DT_SUCCESS;
+	}
 	
 	// Find tiles the query touches.
 	int minx, miny, maxx, maxy;
 	m_nav->calcTileLoc(bmin, &minx, &miny);
 	m_nav->calcTileLoc(bmax, &maxx, &maxy);
+	// The tile grid grows along -x, so the x-range of the box is reversed.
+	if (minx > maxx)
+		dtSwap(minx, maxx);
 
 	static const int MAX_NEIS = 32;
 	const dtMeshTile* neis[MAX_NEIS];
@@ -953,6 +1166,11 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 /// If the end polygon cannot be reached through the navigation graph,
 /// the last polygon in the path will be the nearest the end polygon.
 ///
+/// If the navigation mesh has reachability tables and they show that the end
+/// polygon cannot be reached, no search is done and the path only contains the
+/// start polygon. With #DT_FINDPATH_CLOSEST_REACHABLE the path leads to the reachable
+/// polygon nearest to the end position instead. Both cases return #DT_PARTIAL_RESULT.
+///
 /// If the path array is to small to hold the full result, it will be filled as 
 /// far as possible from the start polygon toward the end polygon.
 ///
@@ -962,195 +1180,30 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 								  const float* startPos, const float* endPos,
 								  const dtQueryFilter* filter,
-								  dtPolyRef* path, int* pathCount, const int maxPath) const
+								  dtPolyRef* path, int* pathCount, const int maxPath,
+								  const unsigned int options) const
 {
-	dtAssert(m_nav);
-	dtAssert(m_nodePool);
-	dtAssert(m_openList);
-
-	if (!pathCount)
-		return DT_FAILURE | DT_INVALID_PARAM;
+	return findPathInternal(startRef, endRef, startPos, endPos, filter, 0, path, pathCount, maxPath, options);
+}
 
-	*pathCount = 0;
-	
-	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter || !path || maxPath <= 0)
-	{
+/// @par
+///
+/// Works like #findPath, except that the search never expands into polygons of tiles
+/// whose entry in @p tileMask is zero. The mask is indexed by the tile index of the
+/// polygon references. (See: dtNavMesh::decodePolyIdTile)
+///
+/// Used to refine a path inside a corridor of tiles found by a coarser search. (See: #dtTileGraph)
+/// If the end polygon cannot be reached within the tiles, the path leads to the
+/// polygon nearest to it and #DT_PARTIAL_RESULT is returned.
+///
+dtStatus dtNavMeshQuery::findPathInTiles(dtPolyRef startRef, dtPolyRef endRef,
+										 const float* startPos, const float* endPos,
+										 const dtQueryFilter* filter, const unsigned char* tileMask,
+										 dtPolyRef* path, int* pathCount, const int maxPath) const
+{
+	if (!tileMask)
 		return DT_FAILURE | DT_INVALID_PARAM;
-	}
-
-	if (startRef == endRef)
-	{
-		path[0] = startRef;
-		*pathCount = 1;
-		return DT_SUCCESS;
-	}
-	
-	m_nodePool->clear();
-	m_openList->clear();
-	
-	dtNode* startNode = m_nodePool->getNode(startRef);
-	dtVcopy(startNode->pos, startPos);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_OPEN;
-	m_openList->push(startNode);
-	
-	dtNode* lastBestNode = startNode;
-	float lastBestNodeCost = startNode->total;
-	
-	bool outOfNodes = false;
-	
-	while (!m_openList->empty())
-	{
-		// Remove node from open list and put it in closed list.
-		dtNode* bestNode = m_openList->pop();
-		bestNode->flags &= ~DT_NODE_OPEN;
-		bestNode->flags |= DT_NODE_CLOSED;
-		
-		// Reached the goal, stop searching.
-		if (bestNode->id == endRef)
-		{
-			lastBestNode = bestNode;
-			break;
-		}
-		
-		// Get current poly and tile.
-		// The API input has been cheked already, skip checking internal data.
-		const dtPolyRef bestRef = bestNode->id;
-		const dtMeshTile* bestTile = 0;
-		const dtPoly* bestPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
-		
-		// Get parent poly and tile.
-		dtPolyRef parentRef = 0;
-		const dtMeshTile* parentTile = 0;
-		const dtPoly* parentPoly = 0;
-		if (bestNode->pidx)
-			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
-		if (parentRef)
-			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
-		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
-		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
-			
-			// Skip invalid ids and do not expand back to where we came from.
-			if (!neighbourRef || neighbourRef == parentRef)
-				continue;
-			
-			// Get neighbour poly and tile.
-			// The API input has been cheked already, skip checking internal data.
-			const dtMeshTile* neighbourTile = 0;
-			const dtPoly* neighbourPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);			
-			
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
-				continue;
-
-			// deal explicitly with crossing tile boundaries
-			unsigned char crossSide = 0;
-			if (bestTile->links[i].side != 0xff)
-				crossSide = bestTile->links[i].side >> 1;
-
-			// get the node
-			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
-			if (!neighbourNode)
-			{
-				outOfNodes = true;
-				continue;
-			}
-			
-			// If the node is visited the first time, calculate node position.
-			if (neighbourNode->flags == 0)
-			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
-			}
-
-			// Calculate cost and heuristic.
-			float cost = 0;
-			float heuristic = 0;
-			
-			// Special case for last node.
-			if (neighbourRef == endRef)
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				const float endCost = filter->getCost(neighbourNode->pos, endPos,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly,
-													  0, 0, 0);
-				
-				cost = bestNode->cost + curCost + endCost;
-				heuristic = 0;
-			}
-			else
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				cost = bestNode->cost + curCost;
-				heuristic = dtVdist(neighbourNode->pos, endPos)*H_SCALE;
-			}
-
-			const float total = cost + heuristic;
-			
-			// The node is already in open list and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
-				continue;
-			// The node is already visited and process, and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_CLOSED) && total >= neighbourNode->total)
-				continue;
-			
-			// Add or update the node.
-			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
-			neighbourNode->id = neighbourRef;
-			neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
-			neighbourNode->cost = cost;
-			neighbourNode->total = total;
-			
-			if (neighbourNode->flags & DT_NODE_OPEN)
-			{
-				// Already in open, update node location.
-				m_openList->modify(neighbourNode);
-			}
-			else
-			{
-				// Put the node in open list.
-				neighbourNode->flags |= DT_NODE_OPEN;
-				m_openList->push(neighbourNode);
-			}
-			
-			// Update nearest node to target so far.
-			if (heuristic < lastBestNodeCost)
-			{
-				lastBestNodeCost = heuristic;
-				lastBestNode = neighbourNode;
-			}
-		}
-	}
-
-	dtStatus status = getPathToNode(lastBestNode, path, pathCount, maxPath);
-
-	if (lastBestNode->id != endRef)
-		status |= DT_PARTIAL_RESULT;
-
-	if (outOfNodes)
-		status |= DT_OUT_OF_NODES;
-	
-	return status;
+	return findPathInternal(startRef, endRef, startPos, endPos, filter, tileMask, path, pathCount, maxPath, 0);
 }
 
 dtStatus dtNavMeshQuery::getPathToNode(dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const
@@ -1193,6 +1246,45 @@ dtStatus dtNavMeshQuery::getPathToNode(dtNode* endNode, dtPolyRef* path, int* pa
 	return DT_SUCCESS;
 }
 
+dtPolyRef dtNavMeshQuery::findNearestReachablePoly(dtPolyRef startRef, const float* pos, const dtQueryFilter* filter,
+												   float* nearestPt) const
+{
+	// The search box grows until it finds a polygon or covers the whole navigation mesh.
+	float meshMin[3], meshMax[3];
+	if (!m_nav->getBounds(meshMin, meshMax))
+		return 0;
+	float maxExtent = 0;
+	for (int j = 0; j < 3; ++j)
+		maxExtent = dtMax(maxExtent, dtMax(pos[j] - meshMin[j], meshMax[j] - pos[j]));
+
+	const dtNavMeshParams* params = m_nav->getParams();
+	float extent = dtMax(dtMax(params->tileWidth, params->tileHeight) * 0.5f, 1.0f);
+	bool refined = false;
+	for (;;)
+	{
+		const float halfExtents[3] = { extent, extent, extent };
+		dtFindNearestReachablePolyQuery query(this, m_nav, pos, startRef, filter->getReachabilityTable());
+		queryPolygons(pos, halfExtents, filter, &query);
+		if (query.nearestRef())
+		{
+			// Polygons outside of the box may still be nearer, search once more
+			// with a box that contains the nearest point found.
+			const float dist = dtVdist(pos, query.nearestPoint());
+			if (dist <= extent || refined)
+			{
+				dtVcopy(nearestPt, query.nearestPoint());
+				return query.nearestRef();
+			}
+			extent = dist;
+			refined = true;
+			continue;
+		}
+		if (extent >= maxExtent)
+			return 0;
+		extent *= 2.0f;
+	}
+}
+
 
 /// @par
 ///
@@ -1202,285 +1294,22 @@ dtStatus dtNavMeshQuery::getPathToNode(dtNode* endNode, dtPolyRef* path, int* pa
 /// The @p filter pointer is stored and used for the duration of the sliced
 /// path query.
 ///
+/// Like #findPath, the query completes immediately with #DT_PARTIAL_RESULT if the
+/// reachability tables show that the end polygon cannot be reached, unless
+/// #DT_FINDPATH_CLOSEST_REACHABLE redirects it to the nearest reachable polygon.
+///
 dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef,
 											const float* startPos, const float* endPos,
 											const dtQueryFilter* filter, const unsigned int options)
 {
-	dtAssert(m_nav);
-	dtAssert(m_nodePool);
-	dtAssert(m_openList);
-
-	// Init path state.
-	memset(&m_query, 0, sizeof(dtQueryData));
-	m_query.status = DT_FAILURE;
-	m_query.startRef = startRef;
-	m_query.endRef = endRef;
-	if (startPos)
-		dtVcopy(m_query.startPos, startPos);
-	if (endPos)
-		dtVcopy(m_query.endPos, endPos);
-	m_query.filter = filter;
-	m_query.options = options;
-	m_query.raycastLimitSqr = FLT_MAX;
-	
-	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) || !filter)
-	{
-		return DT_FAILURE | DT_INVALID_PARAM;
-	}
-
-	// trade quality with performance?
-	if (options & DT_FINDPATH_ANY_ANGLE)
-	{
-		// limiting to several times the character radius yields nice results. It is not sensitive 
-		// so it is enough to compute it from the first tile.
-		const dtMeshTile* tile = m_nav->getTileByRef(startRef);
-		float agentRadius = tile->header->walkableRadius;
-		m_query.raycastLimitSqr = dtSqr(agentRadius * DT_RAY_CAST_LIMIT_PROPORTIONS);
-	}
-
-	if (startRef == endRef)
-	{
-		m_query.status = DT_SUCCESS;
-		return DT_SUCCESS;
-	}
-	
-	m_nodePool->clear();
-	m_openList->clear();
-	
-	dtNode* startNode = m_nodePool->getNode(startRef);
-	dtVcopy(startNode->pos, startPos);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_OPEN;
-	m_openList->push(startNode);
-	
-	m_query.status = DT_IN_PROGRESS;
-	m_query.lastBestNode = startNode;
-	m_query.lastBestNodeCost = startNode->total;
-	
-	return m_query.status;
-}
+	return initSlicedFindPath<dtQueryFilter>(startRef, endRef, startPos, endPos, filter, options);
+}
 	
 dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 {
 	if (!dtStatusInProgress(m_query.status))
 		return m_query.status;
-
-	// Make sure the request is still valid.
-	if (!m_nav->isValidPolyRef(m_query.startRef) || !m_nav->isValidPolyRef(m_query.endRef))
-	{
-		m_query.status = DT_FAILURE;
-		return DT_FAILURE;
-	}
-
-	dtRaycastHit rayHit;
-	rayHit.maxPath = 0;
-		
-	int iter = 0;
-	while (iter < maxIter && !m_openList->empty())
-	{
-		iter++;
-		
-		// Remove node from open list and put it in closed list.
-		dtNode* bestNode = m_openList->pop();
-		bestNode->flags &= ~DT_NODE_OPEN;
-		bestNode->flags |= DT_NODE_CLOSED;
-		
-		// Reached the goal, stop searching.
-		if (bestNode->id == m_query.endRef)
-		{
-			m_query.lastBestNode = bestNode;
-			const dtStatus details = m_query.status & DT_STATUS_DETAIL_MASK;
-			m_query.status = DT_SUCCESS | details;
-			if (doneIters)
-				*doneIters = iter;
-			return m_query.status;
-		}
-		
-		// Get current poly and tile.
-		// The API input has been cheked already, skip checking internal data.
-		const dtPolyRef bestRef = bestNode->id;
-		const dtMeshTile* bestTile = 0;
-		const dtPoly* bestPoly = 0;
-		if (dtStatusFailed(m_nav->getTileAndPolyByRef(bestRef, &bestTile, &bestPoly)))
-		{
-			// The polygon has disappeared during the sliced query, fail.
-			m_query.status = DT_FAILURE;
-			if (doneIters)
-				*doneIters = iter;
-			return m_query.status;
-		}
-		
-		// Get parent and grand parent poly and tile.
-		dtPolyRef parentRef = 0, grandpaRef = 0;
-		const dtMeshTile* parentTile = 0;
-		const dtPoly* parentPoly = 0;
-		dtNode* parentNode = 0;
-		if (bestNode->pidx)
-		{
-			parentNode = m_nodePool->getNodeAtIdx(bestNode->pidx);
-			parentRef = parentNode->id;
-			if (parentNode->pidx)
-				grandpaRef = m_nodePool->getNodeAtIdx(parentNode->pidx)->id;
-		}
-		if (parentRef)
-		{
-			bool invalidParent = dtStatusFailed(m_nav->getTileAndPolyByRef(parentRef, &parentTile, &parentPoly));
-			if (invalidParent || (grandpaRef && !m_nav->isValidPolyRef(grandpaRef)) )
-			{
-				// The polygon has disappeared during the sliced query, fail.
-				m_query.status = DT_FAILURE;
-				if (doneIters)
-					*doneIters = iter;
-				return m_query.status;
-			}
-		}
-
-		// decide whether to test raycast to previous nodes
-		bool tryLOS = false;
-		if (m_query.options & DT_FINDPATH_ANY_ANGLE)
-		{
-			if ((parentRef != 0) && (dtVdistSqr(parentNode->pos, bestNode->pos) < m_query.raycastLimitSqr))
-				tryLOS = true;
-		}
-		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
-		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
-			
-			// Skip invalid ids and do not expand back to where we came from.
-			if (!neighbourRef || neighbourRef == parentRef)
-				continue;
-			
-			// Get neighbour poly and tile.
-			// The API input has been cheked already, skip checking internal data.
-			const dtMeshTile* neighbourTile = 0;
-			const dtPoly* neighbourPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);			
-			
-			if (!m_query.filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
-				continue;
-			
-			// get the neighbor node
-			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, 0);
-			if (!neighbourNode)
-			{
-				m_query.status |= DT_OUT_OF_NODES;
-				continue;
-			}
-			
-			// do not expand to nodes that were already visited from the same parent
-			if (neighbourNode->pidx != 0 && neighbourNode->pidx == bestNode->pidx)
-				continue;
-
-			// If the node is visited the first time, calculate node position.
-			if (neighbourNode->flags == 0)
-			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
-			}
-			
-			// Calculate cost and heuristic.
-			float cost = 0;
-			float heuristic = 0;
-			
-			// raycast parent
-			bool foundShortCut = false;
-			rayHit.pathCost = rayHit.t = 0;
-			if (tryLOS)
-			{
-				raycast(parentRef, parentNode->pos, neighbourNode->pos, m_query.filter, DT_RAYCAST_USE_COSTS, &rayHit, grandpaRef);
-				foundShortCut = rayHit.t >= 1.0f;
-			}
-
-			// update move cost
-			if (foundShortCut)
-			{
-				// shortcut found using raycast. Using shorter cost instead
-				cost = parentNode->cost + rayHit.pathCost;
-			}
-			else
-			{
-				// No shortcut found.
-				const float curCost = m_query.filter->getCost(bestNode->pos, neighbourNode->pos,
-															  parentRef, parentTile, parentPoly,
-															bestRef, bestTile, bestPoly,
-															neighbourRef, neighbourTile, neighbourPoly);
-				cost = bestNode->cost + curCost;
-			}
-
-			// Special case for last node.
-			if (neighbourRef == m_query.endRef)
-			{
-				const float endCost = m_query.filter->getCost(neighbourNode->pos, m_query.endPos,
-															  bestRef, bestTile, bestPoly,
-															  neighbourRef, neighbourTile, neighbourPoly,
-															  0, 0, 0);
-				
-				cost = cost + endCost;
-				heuristic = 0;
-			}
-			else
-			{
-				heuristic = dtVdist(neighbourNode->pos, m_query.endPos)*H_SCALE;
-			}
-			
-			const float total = cost + heuristic;
-			
-			// The node is already in open list and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
-				continue;
-			// The node is already visited and process, and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_CLOSED) && total >= neighbourNode->total)
-				continue;
-			
-			// Add or update the node.
-			neighbourNode->pidx = foundShortCut ? bestNode->pidx : m_nodePool->getNodeIdx(bestNode);
-			neighbourNode->id = neighbourRef;
-			neighbourNode->flags = (neighbourNode->flags & ~(DT_NODE_CLOSED | DT_NODE_PARENT_DETACHED));
-			neighbourNode->cost = cost;
-			neighbourNode->total = total;
-			if (foundShortCut)
-				neighbourNode->flags = (neighbourNode->flags | DT_NODE_PARENT_DETACHED);
-			
-			if (neighbourNode->flags & DT_NODE_OPEN)
-			{
-				// Already in open, update node location.
-				m_openList->modify(neighbourNode);
-			}
-			else
-			{
-				// Put the node in open list.
-				neighbourNode->flags |= DT_NODE_OPEN;
-				m_openList->push(neighbourNode);
-			}
-			
-			// Update nearest node to target so far.
-			if (heuristic < m_query.lastBestNodeCost)
-			{
-				m_query.lastBestNodeCost = heuristic;
-				m_query.lastBestNode = neighbourNode;
-			}
-		}
-	}
-	
-	// Exhausted all nodes, but could not find path.
-	if (m_openList->empty())
-	{
-		const dtStatus details = m_query.status & DT_STATUS_DETAIL_MASK;
-		m_query.status = DT_SUCCESS | details;
-	}
-
-	if (doneIters)
-		*doneIters = iter;
-
-	return m_query.status;
+	return (this->*m_query.update)(maxIter, doneIters);
 }
 
 dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount, const int maxPath)
@@ -1540,7 +1369,7 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount,
 			{
 				float t, normal[3];
 				int m;
-				status = raycast(node->id, node->pos, next->pos, m_query.filter, &t, normal, path+n, &m, maxPath-n);
+				status = (this->*m_query.raycast)(node->id, node->pos, next->pos, &t, normal, path+n, &m, maxPath-n);
 				n += m;
 				// raycast ends on poly boundary and the path might include the next poly boundary.
 				if (path[n-1] == next->id)
@@ -1641,7 +1470,7 @@ dtStatus dtNavMeshQuery::finalizeSlicedFindPathPartial(const dtPolyRef* existing
 			{
 				float t, normal[3];
 				int m;
-				status = raycast(node->id, node->pos, next->pos, m_query.filter, &t, normal, path+n, &m, maxPath-n);
+				status = (this->*m_query.raycast)(node->id, node->pos, next->pos, &t, normal, path+n, &m, maxPath-n);
 				n += m;
 				// raycast ends on poly boundary and the path might include the next poly boundary.
 				if (path[n-1] == next->id)
@@ -2010,227 +1839,396 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 	return DT_SUCCESS | ((*straightPathCount >= maxStraightPath) ? DT_BUFFER_TOO_SMALL : 0);
 }
 
+struct dtPendingStart
+{
+	dtPolyRef ref;			// The start polygon of one or more requests.
+	unsigned int nodeIdx;	// The node the search from the goal reached the polygon with, or 0.
+};
+
+struct dtPathRequestOrder
+{
+	dtPolyRef endRef;
+	const dtQueryFilter* filter;
+	unsigned int startTile;
+	dtPolyRef startRef;
+	int index;
+};
+
+static int comparePathRequestOrder(const void* va, const void* vb)
+{
+	const dtPathRequestOrder* a = (const dtPathRequestOrder*)va;
+	const dtPathRequestOrder* b = (const dtPathRequestOrder*)vb;
+	if (a->endRef != b->endRef)
+		return a->endRef < b->endRef ? -1 : 1;
+	if (a->filter != b->filter)
+		return a->filter < b->filter ? -1 : 1;
+	if (a->startTile != b->startTile)
+		return a->startTile < b->startTile ? -1 : 1;
+	if (a->startRef != b->startRef)
+		return a->startRef < b->startRef ? -1 : 1;
+	return a->index - b->index;
+}
+
+static int comparePendingStart(const void* va, const void* vb)
+{
+	const dtPendingStart* a = (const dtPendingStart*)va;
+	const dtPendingStart* b = (const dtPendingStart*)vb;
+	if (a->ref != b->ref)
+		return a->ref < b->ref ? -1 : 1;
+	return 0;
+}
+
+static dtPendingStart* findPendingStart(dtPendingStart* pending, const int count, const dtPolyRef ref)
+{
+	int lo = 0;
+	int hi = count-1;
+	while (lo <= hi)
+	{
+		const int mid = (lo+hi)/2;
+		if (pending[mid].ref == ref)
+			return &pending[mid];
+		if (pending[mid].ref < ref)
+			lo = mid+1;
+		else
+			hi = mid-1;
+	}
+	return 0;
+}
+
+static bool hasLinkTo(const dtMeshTile* tile, const dtPoly* poly, const dtPolyRef ref)
+{
+	for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+	{
+		if (tile->links[i].ref == ref)
+			return true;
+	}
+	return false;
+}
+
 /// @par
 ///
-/// This method is optimized for small delta movement and a small number of 
-/// polygons. If used for too great a distance, the result set will form an 
-/// incomplete path.
+/// The requests are sorted by goal, filter and start tile before they are processed, so that
+/// consecutive searches touch nearby tiles. When at least @p minSharedGoal requests share the
+/// same end polygon and filter, their corridors are read from a single search that expands
+/// outwards from the goal until all their start polygons are reached. The search starts from the
+/// end position of one of the requests. Requests that this search does not reach, for example
+/// because it ran out of nodes, fall back to #findPath.
 ///
-/// @p resultPos will equal the @p endPos if the end is reached. 
-/// Otherwise the closest reachable position will be returned.
-/// 
-/// @p resultPos is not projected onto the surface of the navigation 
-/// mesh. Use #getPolyHeight if this is needed.
+/// The straight paths are found with #findStraightPath and the default options. Pass a null
+/// @p straightPaths to only find the corridors. The straight path status details are merged
+/// into the status of the request.
 ///
-/// This method treats the end position in the same manner as 
-/// the #raycast method. (As a 2D point.) See that method's documentation 
-/// for details.
-/// 
-/// If the @p visited array is too small to hold the entire result set, it will 
-/// be filled as far as possible from the start position toward the end 
-/// position.
+/// This method uses the search node pool of the query, so the state of an in-progress sliced
+/// path query is lost.
 ///
-dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
-										  const dtQueryFilter* filter,
-										  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const
+dtStatus dtNavMeshQuery::findPaths(const dtPathRequest* requests, const int requestCount, dtPathResult* results,
+								   dtPolyRef* paths, const int maxPath,
+								   float* straightPaths, const int maxStraightPath,
+								   const int minSharedGoal) const
 {
 	dtAssert(m_nav);
-	dtAssert(m_tinyNodePool);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
 
-	if (!visitedCount)
+	if (!requests || requestCount < 0 || !results || !paths || maxPath <= 0 ||
+		(straightPaths && maxStraightPath <= 0))
+	{
 		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	if (requestCount == 0)
+		return DT_SUCCESS;
 
-	*visitedCount = 0;
+	dtPathRequestOrder* order = (dtPathRequestOrder*)dtAlloc(sizeof(dtPathRequestOrder)*requestCount, DT_ALLOC_TEMP);
+	dtPendingStart* pending = (dtPendingStart*)dtAlloc(sizeof(dtPendingStart)*requestCount, DT_ALLOC_TEMP);
+	if (!order || !pending)
+	{
+		dtFree(order);
+		dtFree(pending);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
 
-	if (!m_nav->isValidPolyRef(startRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter || !resultPos || !visited ||
-		maxVisitedSize <= 0)
+	for (int i = 0; i < requestCount; ++i)
 	{
-		return DT_FAILURE | DT_INVALID_PARAM;
+		order[i].endRef = requests[i].endRef;
+		order[i].filter = requests[i].filter;
+		order[i].startTile = m_nav->decodePolyIdTile(requests[i].startRef);
+		order[i].startRef = requests[i].startRef;
+		order[i].index = i;
+		results[i].status = DT_FAILURE;
+		results[i].pathCount = 0;
+		results[i].straightPathCount = 0;
 	}
-	
-	dtStatus status = DT_SUCCESS;
-	
-	static const int MAX_STACK = 48;
-	dtNode* stack[MAX_STACK];
-	int nstack = 0;
-	
-	m_tinyNodePool->clear();
-	
-	dtNode* startNode = m_tinyNodePool->getNode(startRef);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = 0;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_CLOSED;
-	stack[nstack++] = startNode;
-	
-	float bestPos[3];
-	float bestDist = FLT_MAX;
-	dtNode* bestNode = 0;
-	dtVcopy(bestPos, startPos);
-	
-	// Search constraints
-	float searchPos[3], searchRadSqr;
-	dtVlerp(searchPos, startPos, endPos, 0.5f);
-	searchRadSqr = dtSqr(dtVdist(startPos, endPos)/2.0f + 0.001f);
-	
-	float verts[DT_VERTS_PER_POLYGON*3];
-	
-	while (nstack)
+	qsort(order, requestCount, sizeof(dtPathRequestOrder), comparePathRequestOrder);
+
+	int first = 0;
+	while (first < requestCount)
 	{
-		// Pop front.
-		dtNode* curNode = stack[0];
-		for (int i = 0; i < nstack-1; ++i)
-			stack[i] = stack[i+1];
-		nstack--;
-		
-		// Get poly and tile.
-		// The API input has been cheked already, skip checking internal data.
-		const dtPolyRef curRef = curNode->id;
-		const dtMeshTile* curTile = 0;
-		const dtPoly* curPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(curRef, &curTile, &curPoly);			
-		
-		// Collect vertices.
-		const int nverts = curPoly->vertCount;
-		for (int i = 0; i < nverts; ++i)
-			dtVcopy(&verts[i*3], &curTile->verts[curPoly->verts[i]*3]);
-		
-		// If target is inside the poly, stop search.
-		if (dtPointInPolygon(endPos, verts, nverts))
+		// Collect the requests which share the goal.
+		int last = first+1;
+		while (last < requestCount && order[last].endRef == order[first].endRef && order[last].filter == order[first].filter)
+			last++;
+
+		const dtPathRequest& goal = requests[order[first].index];
+		int pendingCount = 0;
+		if (last - first >= minSharedGoal && m_nav->isValidPolyRef(goal.endRef) && dtVisfinite(goal.endPos) && goal.filter)
 		{
-			bestNode = curNode;
-			dtVcopy(bestPos, endPos);
-			break;
+			for (int i = first; i < last; ++i)
+			{
+				const dtPathRequest& req = requests[order[i].index];
+				// Leave invalid requests and the ones the reachability tables rule out to findPath.
+				if (!m_nav->isValidPolyRef(req.startRef) || !dtVisfinite(req.startPos) || !dtVisfinite(req.endPos) ||
+					!m_nav->isGoalPolyReachable(req.startRef, req.endRef, req.filter->getReachabilityTable()))
+					continue;
+				// Requests with the same start polygon are adjacent after sorting.
+				if (pendingCount > 0 && pending[pendingCount-1].ref == req.startRef)
+					continue;
+				pending[pendingCount].ref = req.startRef;
+				pending[pendingCount].nodeIdx = 0;
+				pendingCount++;
+			}
 		}
-		
-		// Find wall edges and find nearest point inside the walls.
-		for (int i = 0, j = (int)curPoly->vertCount-1; i < (int)curPoly->vertCount; j = i++)
+
+		if (pendingCount > 0)
 		{
-			// Find links to neighbours.
-			static const int MAX_NEIS = 8;
-			int nneis = 0;
-			dtPolyRef neis[MAX_NEIS];
-			
-			if (curPoly->neis[j] & DT_EXT_LINK)
+			qsort(pending, pendingCount, sizeof(dtPendingStart), comparePendingStart);
+			searchFromGoal(goal.endRef, goal.endPos, goal.filter, FLT_MAX, pending, pendingCount);
+
+			// Read the corridors before findPath reuses the node pool.
+			for (int i = first; i < last; ++i)
 			{
-				// Tile border.
-				for (unsigned int k = curPoly->firstLink; k != DT_NULL_LINK; k = curTile->links[k].next)
+				const int index = order[i].index;
+				const dtPendingStart* start = findPendingStart(pending, pendingCount, requests[index].startRef);
+				if (!start || !start->nodeIdx)
+					continue;
+
+				dtPathResult& result = results[index];
+				dtPolyRef* path = paths + index*maxPath;
+				result.status = DT_SUCCESS;
+				for (const dtNode* node = m_nodePool->getNodeAtIdx(start->nodeIdx); node; node = m_nodePool->getNodeAtIdx(node->pidx))
 				{
-					const dtLink* link = &curTile->links[k];
-					if (link->edge == j)
+					if (result.pathCount >= maxPath)
 					{
-						if (link->ref != 0)
-						{
-							const dtMeshTile* neiTile = 0;
-							const dtPoly* neiPoly = 0;
-							m_nav->getTileAndPolyByRefUnsafe(link->ref, &neiTile, &neiPoly);
-							if (filter->passFilter(link->ref, neiTile, neiPoly))
-							{
-								if (nneis < MAX_NEIS)
-									neis[nneis++] = link->ref;
-							}
-						}
+						result.status |= DT_BUFFER_TOO_SMALL;
+						break;
 					}
+					path[result.pathCount++] = node->id;
 				}
 			}
-			else if (curPoly->neis[j])
+		}
+
+		for (int i = first; i < last; ++i)
+		{
+			const int index = order[i].index;
+			const dtPathRequest& req = requests[index];
+			dtPathResult& result = results[index];
+			dtPolyRef* path = paths + index*maxPath;
+
+			if (result.pathCount == 0)
 			{
-				const unsigned int idx = (unsigned int)(curPoly->neis[j]-1);
-				const dtPolyRef ref = m_nav->getPolyRefBase(curTile) | idx;
-				if (filter->passFilter(ref, curTile, &curTile->polys[idx]))
-				{
-					// Internal edge, encode id.
-					neis[nneis++] = ref;
-				}
+				result.status = findPath(req.startRef, req.endRef, req.startPos, req.endPos, req.filter,
+										 path, &result.pathCount, maxPath);
 			}
-			
-			if (!nneis)
+
+			if (straightPaths && result.pathCount > 0)
 			{
-				// Wall edge, calc distance.
-				const float* vj = &verts[j*3];
-				const float* vi = &verts[i*3];
-				float tseg;
-				const float distSqr = dtDistancePtSegSqr2D(endPos, vj, vi, tseg);
-				if (distSqr < bestDist)
-				{
-                    // Update nearest distance.
-					dtVlerp(bestPos, vj,vi, tseg);
-					bestDist = distSqr;
-					bestNode = curNode;
-				}
-			}
-			else
-			{
-				for (int k = 0; k < nneis; ++k)
-				{
-					// Skip if no node can be allocated.
-					dtNode* neighbourNode = m_tinyNodePool->getNode(neis[k]);
-					if (!neighbourNode)
-						continue;
-					// Skip if already visited.
-					if (neighbourNode->flags & DT_NODE_CLOSED)
-						continue;
-					
-					// Skip the link if it is too far from search constraint.
-					// TODO: Maybe should use getPortalPoints(), but this one is way faster.
-					const float* vj = &verts[j*3];
-					const float* vi = &verts[i*3];
-					float tseg;
-					float distSqr = dtDistancePtSegSqr2D(searchPos, vj, vi, tseg);
-					if (distSqr > searchRadSqr)
-						continue;
-					
-					// Mark as the node as visited and push to queue.
-					if (nstack < MAX_STACK)
-					{
-						neighbourNode->pidx = m_tinyNodePool->getNodeIdx(curNode);
-						neighbourNode->flags |= DT_NODE_CLOSED;
-						stack[nstack++] = neighbourNode;
-					}
-				}
+				const dtStatus straightStatus = findStraightPath(req.startPos, req.endPos, path, result.pathCount,
+																 straightPaths + index*maxStraightPath*3, 0, 0,
+																 &result.straightPathCount, maxStraightPath);
+				if (dtStatusFailed(straightStatus))
+					result.straightPathCount = 0;
+				result.status |= straightStatus & DT_STATUS_DETAIL_MASK;
 			}
 		}
+
+		first = last;
 	}
-	
-	int n = 0;
-	if (bestNode)
+
+	dtFree(order);
+	dtFree(pending);
+
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// The field covers the goal polygon and every polygon from which the goal can be reached at
+/// a cost of at most @p maxCost, as far as the search node pool allows. #DT_OUT_OF_NODES is
+/// returned if the pool ran out before the cost bound was reached.
+///
+/// Like #findPath, costs are measured between the edge midpoints of the polygons, so agents
+/// should use #findStraightPath on the path returned by dtFlowField::getPath to move.
+///
+/// This method uses the search node pool of the query, so the state of an in-progress sliced
+/// path query is lost.
+///
+dtStatus dtNavMeshQuery::buildFlowField(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter,
+										const float maxCost, dtFlowField* field) const
+{
+	dtAssert(m_nav);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
+
+	if (!m_nav->isValidPolyRef(goalRef) || !goalPos || !dtVisfinite(goalPos) ||
+		!filter || !field || !(maxCost >= 0))
 	{
-		// Reverse the path.
-		dtNode* prev = 0;
-		dtNode* node = bestNode;
-		do
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	const dtStatus searchStatus = searchFromGoal(goalRef, goalPos, filter, maxCost, 0, 0);
+	const dtStatus status = field->build(m_nav, goalRef, *m_nodePool);
+	if (dtStatusFailed(status))
+		return status;
+	return status | (searchStatus & DT_STATUS_DETAIL_MASK);
+}
+
+dtStatus dtNavMeshQuery::searchFromGoal(dtPolyRef goalRef, const float* goalPos, const dtQueryFilter* filter,
+										const float maxCost, dtPendingStart* pending, const int pendingCount) const
+{
+	m_nodePool->clear();
+	m_openList->clear();
+
+	dtNode* goalNode = m_nodePool->getNode(goalRef);
+	dtVcopy(goalNode->pos, goalPos);
+	goalNode->pidx = 0;
+	goalNode->cost = 0;
+	goalNode->total = 0;
+	goalNode->id = goalRef;
+	goalNode->flags = DT_NODE_OPEN;
+	m_openList->push(goalNode);
+
+	bool outOfNodes = false;
+	int remaining = pendingCount;
+	while ((!pending || remaining > 0) && !m_openList->empty())
+	{
+		dtNode* bestNode = m_openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+
+		// The first node popped for a start polygon has its lowest cost to the goal.
+		dtPendingStart* start = pending ? findPendingStart(pending, pendingCount, bestNode->id) : 0;
+		if (start && !start->nodeIdx)
 		{
-			dtNode* next = m_tinyNodePool->getNodeAtIdx(node->pidx);
-			node->pidx = m_tinyNodePool->getNodeIdx(prev);
-			prev = node;
-			node = next;
+			start->nodeIdx = m_nodePool->getNodeIdx(bestNode);
+			remaining--;
 		}
-		while (node);
-		
-		// Store result
-		node = prev;
-		do
+
+		const dtPolyRef bestRef = bestNode->id;
+		const dtMeshTile* bestTile = 0;
+		const dtPoly* bestPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+
+		// The parent is the next polygon towards the goal.
+		dtPolyRef nextRef = 0;
+		const dtMeshTile* nextTile = 0;
+		const dtPoly* nextPoly = 0;
+		if (bestNode->pidx)
+			nextRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		if (nextRef)
+			m_nav->getTileAndPolyByRefUnsafe(nextRef, &nextTile, &nextPoly);
+
+		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
 		{
-			visited[n++] = node->id;
-			if (n >= maxVisitedSize)
+			const dtPolyRef neighbourRef = bestTile->links[i].ref;
+			if (!neighbourRef || neighbourRef == nextRef)
+				continue;
+
+			const dtMeshTile* neighbourTile = 0;
+			const dtPoly* neighbourPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+
+			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+				continue;
+
+			// Links are followed backwards, so skip one-way links which lead away from the goal.
+			if (!hasLinkTo(neighbourTile, neighbourPoly, bestRef))
+				continue;
+
+			unsigned char crossSide = 0;
+			if (bestTile->links[i].side != 0xff)
+				crossSide = bestTile->links[i].side >> 1;
+
+			// Reject neighbours beyond the cost bound before allocating a node for them.
+			dtNode* neighbourNode = m_nodePool->findNode(neighbourRef, crossSide);
+			float neighbourPos[3];
+			if (neighbourNode)
 			{
-				status |= DT_BUFFER_TOO_SMALL;
-				break;
+				dtVcopy(neighbourPos, neighbourNode->pos);
+			}
+			else
+			{
+				getEdgeMidPoint(bestRef, bestPoly, bestTile,
+								neighbourRef, neighbourPoly, neighbourTile,
+								neighbourPos);
+			}
+
+			// The agent travels through the best polygon on its way from the neighbour to the goal.
+			const float cost = bestNode->cost + filter->getCost(neighbourPos, bestNode->pos,
+																neighbourRef, neighbourTile, neighbourPoly,
+																bestRef, bestTile, bestPoly,
+																nextRef, nextTile, nextPoly);
+			if (cost > maxCost)
+				continue;
+
+			if (!neighbourNode)
+			{
+				neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
+				if (!neighbourNode)
+				{
+					outOfNodes = true;
+					continue;
+				}
+				dtVcopy(neighbourNode->pos, neighbourPos);
+			}
+
+			if ((neighbourNode->flags & (DT_NODE_OPEN | DT_NODE_CLOSED)) && cost >= neighbourNode->total)
+				continue;
+
+			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->id = neighbourRef;
+			neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
+			neighbourNode->cost = cost;
+			neighbourNode->total = cost;
+
+			if (neighbourNode->flags & DT_NODE_OPEN)
+			{
+				m_openList->modify(neighbourNode);
+			}
+			else
+			{
+				neighbourNode->flags |= DT_NODE_OPEN;
+				m_openList->push(neighbourNode);
 			}
-			node = m_tinyNodePool->getNodeAtIdx(node->pidx);
 		}
-		while (node);
 	}
-	
-	dtVcopy(resultPos, bestPos);
-	
-	*visitedCount = n;
-	
-	return status;
+
+	return outOfNodes ? (DT_SUCCESS | DT_OUT_OF_NODES) : DT_SUCCESS;
+}
+
+/// @par
+///
+/// This method is optimized for small delta movement and a small number of 
+/// polygons. If used for too great a distance, the result set will form an 
+/// incomplete path.
+///
+/// @p resultPos will equal the @p endPos if the end is reached. 
+/// Otherwise the closest reachable position will be returned.
+/// 
+/// @p resultPos is not projected onto the surface of the navigation 
+/// mesh. Use #getPolyHeight if this is needed.
+///
+/// This method treats the end position in the same manner as 
+/// the #raycast method. (As a 2D point.) See that method's documentation 
+/// for details.
+/// 
+/// If the @p visited array is too small to hold the entire result set, it will 
+/// be filled as far as possible from the start position toward the end 
+/// position.
+///
+dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* startPos, const float* endPos,
+										  const dtQueryFilter* filter,
+										  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const
+{
+	return moveAlongSurface<dtQueryFilter>(startRef, startPos, endPos, filter, resultPos, visited, visitedCount, maxVisitedSize);
 }
 
 
@@ -2455,225 +2453,267 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, const float* endPos,
 								 const dtQueryFilter* filter, const unsigned int options,
 								 dtRaycastHit* hit, dtPolyRef prevRef) const
+{
+	return raycast<dtQueryFilter>(startRef, startPos, endPos, filter, options, hit, prevRef);
+}
+
+/// @par
+///
+/// Meant for many short rays from the same place, such as line of sight checks from an
+/// agent to a group of targets. Rays that leave a polygon through different edges continue
+/// as separate groups, and a ray that is left alone continues as a single raycast. The rays
+/// are processed #DT_MAX_RAYCAST_BATCH at a time, so there is no limit on @p rayCount.
+///
+/// The query fails with #DT_INVALID_PARAM if any of the rays is invalid, and reports
+/// #DT_BUFFER_TOO_SMALL if the path of any ray was truncated.
+///
+/// @see raycast
+dtStatus dtNavMeshQuery::raycasts(dtPolyRef startRef, const float* startPos, const float* endPos, const int rayCount,
+								  const dtQueryFilter* filter, const unsigned int options, dtRaycastHit* hits) const
 {
 	dtAssert(m_nav);
 
-	if (!hit)
+	if (!m_nav->isValidPolyRef(startRef) || !startPos || !endPos || rayCount < 0 || !filter || !hits)
 		return DT_FAILURE | DT_INVALID_PARAM;
 
-	hit->t = 0;
-	hit->pathCount = 0;
-	hit->pathCost = 0;
-
-	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) ||
-		!startPos || !dtVisfinite(startPos) ||
-		!endPos || !dtVisfinite(endPos) ||
-		!filter ||
-		(prevRef && !m_nav->isValidPolyRef(prevRef)))
+	for (int i = 0; i < rayCount; ++i)
 	{
-		return DT_FAILURE | DT_INVALID_PARAM;
+		hits[i].t = 0;
+		hits[i].pathCount = 0;
+		hits[i].pathCost = 0;
+		dtVset(hits[i].hitNormal, 0, 0, 0);
+		if (!dtVisfinite(&startPos[i*3]) || !dtVisfinite(&endPos[i*3]))
+			return DT_FAILURE | DT_INVALID_PARAM;
 	}
-	
-	float dir[3], curPos[3], lastPos[3];
-	float verts[DT_VERTS_PER_POLYGON*3+3];	
-	int n = 0;
 
-	dtVcopy(curPos, startPos);
-	dtVsub(dir, endPos, startPos);
-	dtVset(hit->hitNormal, 0, 0, 0);
+	const dtMeshTile* startTile = 0;
+	const dtPoly* startPoly = 0;
+	m_nav->getTileAndPolyByRefUnsafe(startRef, &startTile, &startPoly);
 
 	dtStatus status = DT_SUCCESS;
 
-	const dtMeshTile* prevTile, *tile, *nextTile;
-	const dtPoly* prevPoly, *poly, *nextPoly;
-	dtPolyRef curRef;
-
-	// The API input has been checked already, skip checking internal data.
-	curRef = startRef;
-	tile = 0;
-	poly = 0;
-	m_nav->getTileAndPolyByRefUnsafe(curRef, &tile, &poly);
-	nextTile = prevTile = tile;
-	nextPoly = prevPoly = poly;
-	if (prevRef)
-		m_nav->getTileAndPolyByRefUnsafe(prevRef, &prevTile, &prevPoly);
-
-	while (curRef)
+	for (int base = 0; base < rayCount; base += DT_MAX_RAYCAST_BATCH)
 	{
-		// Cast ray against current polygon.
-		
-		// Collect vertices.
-		int nv = 0;
-		for (int i = 0; i < (int)poly->vertCount; ++i)
-		{
-			dtVcopy(&verts[nv*3], &tile->verts[poly->verts[i]*3]);
-			nv++;
-		}
-		
-		float tmin, tmax;
-		int segMin, segMax;
-		if (!dtIntersectSegmentPoly2D(startPos, endPos, verts, nv, tmin, tmax, segMin, segMax))
-		{
-			// Could not hit the polygon, keep the old t and report hit.
-			hit->pathCount = n;
-			return status;
-		}
+		const int count = dtMin(rayCount - base, DT_MAX_RAYCAST_BATCH);
+		const float* rayStart = &startPos[base*3];
+		const float* rayEnd = &endPos[base*3];
+		dtRaycastHit* rayHits = &hits[base];
 
-		hit->hitEdgeIndex = segMax;
+		// Per ray state, as in raycast.
+		float curPos[DT_MAX_RAYCAST_BATCH][3];
+		dtPolyRef prevRef[DT_MAX_RAYCAST_BATCH];
+		const dtMeshTile* prevTile[DT_MAX_RAYCAST_BATCH];
+		const dtPoly* prevPoly[DT_MAX_RAYCAST_BATCH];
+		int next[DT_MAX_RAYCAST_BATCH];
 
-		// Keep track of furthest t so far.
-		if (tmax > hit->t)
-			hit->t = tmax;
-		
-		// Store visited polygons.
-		if (n < hit->maxPath)
-			hit->path[n++] = curRef;
-		else
-			status |= DT_BUFFER_TOO_SMALL;
+		// Groups of rays waiting to be cast against a polygon, linked through next.
+		dtPolyRef groupRef[DT_MAX_RAYCAST_BATCH];
+		const dtMeshTile* groupTile[DT_MAX_RAYCAST_BATCH];
+		const dtPoly* groupPoly[DT_MAX_RAYCAST_BATCH];
+		int groupHead[DT_MAX_RAYCAST_BATCH];
+		int groupCount = 1;
 
-		// Ray end is completely inside the polygon.
-		if (segMax == -1)
+		for (int i = 0; i < count; ++i)
 		{
-			hit->t = FLT_MAX;
-			hit->pathCount = n;
-			
-			// add the cost
-			if (options & DT_RAYCAST_USE_COSTS)
-				hit->pathCost += filter->getCost(curPos, endPos, prevRef, prevTile, prevPoly, curRef, tile, poly, curRef, tile, poly);
-			return status;
+			dtVcopy(curPos[i], &rayStart[i*3]);
+			prevRef[i] = 0;
+			prevTile[i] = startTile;
+			prevPoly[i] = startPoly;
+			next[i] = i+1 < count ? i+1 : -1;
 		}
+		groupRef[0] = startRef;
+		groupTile[0] = startTile;
+		groupPoly[0] = startPoly;
+		groupHead[0] = count > 0 ? 0 : -1;
 
-		// Follow neighbours.
-		dtPolyRef nextRef = 0;
-		
-		for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+		while (groupCount > 0)
 		{
-			const dtLink* link = &tile->links[i];
-			
-			// Find link which contains this edge.
-			if ((int)link->edge != segMax)
-				continue;
-			
-			// Get pointer to the next polygon.
-			nextTile = 0;
-			nextPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(link->ref, &nextTile, &nextPoly);
-			
-			// Skip off-mesh connections.
-			if (nextPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
-				continue;
-			
-			// Skip links based on filter.
-			if (!filter->passFilter(link->ref, nextTile, nextPoly))
+			groupCount--;
+			const dtPolyRef curRef = groupRef[groupCount];
+			const dtMeshTile* tile = groupTile[groupCount];
+			const dtPoly* poly = groupPoly[groupCount];
+
+			int rays[DT_MAX_RAYCAST_BATCH];
+			int nrays = 0;
+			for (int r = groupHead[groupCount]; r != -1; r = next[r])
+				rays[nrays++] = r;
+
+			// A ray that is left alone in a polygon continues as a single raycast.
+			if (nrays == 1)
+			{
+				const int r = rays[0];
+				status |= continueRaycast<dtQueryFilter>(curRef, prevRef[r], &rayStart[r*3], &rayEnd[r*3], filter, options, curPos[r], &rayHits[r]);
 				continue;
-			
-			// If the link is internal, just return the ref.
-			if (link->side == 0xff)
+			}
+
+			// Collect vertices.
+			float verts[DT_VERTS_PER_POLYGON*3];
+			const int nv = (int)poly->vertCount;
+			for (int i = 0; i < nv; ++i)
+				dtVcopy(&verts[i*3], &tile->verts[poly->verts[i]*3]);
+
+			// Cast the rays against the polygon, four at a time.
+			float tmax[DT_MAX_RAYCAST_BATCH];
+			int segMax[DT_MAX_RAYCAST_BATCH];
+			bool inside[DT_MAX_RAYCAST_BATCH];
+			for (int k = 0; k < nrays; k += 4)
 			{
-				nextRef = link->ref;
-				break;
+				float tmin4[4], tmax4[4];
+				int segMin4[4], segMax4[4];
+				unsigned int mask;
+				if (k+1 == nrays)
+				{
+					const int r = rays[k];
+					mask = dtIntersectSegmentPoly2D(&rayStart[r*3], &rayEnd[r*3], verts, nv, tmin4[0], tmax4[0], segMin4[0], segMax4[0]) ? 1 : 0;
+				}
+				else
+				{
+					// Unused lanes repeat the first ray of the block.
+					const int r0 = rays[k];
+					const int r1 = rays[k+1];
+					const int r2 = rays[k+2 < nrays ? k+2 : k];
+					const int r3 = rays[k+3 < nrays ? k+3 : k];
+					float p0[3][4], p1[3][4];
+					dtVgather4(p0, &rayStart[r0*3], &rayStart[r1*3], &rayStart[r2*3], &rayStart[r3*3]);
+					dtVgather4(p1, &rayEnd[r0*3], &rayEnd[r1*3], &rayEnd[r2*3], &rayEnd[r3*3]);
+					mask = dtIntersectSegmentPoly2D4(p0, p1, verts, nv, tmin4, tmax4, segMin4, segMax4);
+				}
+				for (int lane = 0; lane < 4 && k+lane < nrays; ++lane)
+				{
+					tmax[k+lane] = tmax4[lane];
+					segMax[k+lane] = segMax4[lane];
+					inside[k+lane] = (mask & (1u << lane)) != 0;
+				}
 			}
-			
-			// If the link is at tile boundary,
-			
-			// Check if the link spans the whole edge, and accept.
-			if (link->bmin == 0 && link->bmax == 255)
+
+			// The neighbour across an edge only depends on the ray if the edge has partial
+			// portal links. Look up the other edges once for the whole group.
+			unsigned int sharedEdges = (1u << nv) - 1;
+			unsigned int resolvedEdges = 0;
+			dtPolyRef edgeRef[DT_VERTS_PER_POLYGON];
+			const dtMeshTile* edgeTile[DT_VERTS_PER_POLYGON];
+			const dtPoly* edgePoly[DT_VERTS_PER_POLYGON];
+			int edgeGroup[DT_VERTS_PER_POLYGON];
+			for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
 			{
-				nextRef = link->ref;
-				break;
+				const dtLink* link = &tile->links[i];
+				if (link->side != 0xff && (link->bmin != 0 || link->bmax != 255))
+					sharedEdges &= ~(1u << link->edge);
 			}
-			
-			// Check for partial edge links.
-			const int v0 = poly->verts[link->edge];
-			const int v1 = poly->verts[(link->edge+1) % poly->vertCount];
-			const float* left = &tile->verts[v0*3];
-			const float* right = &tile->verts[v1*3];
-			
-			// Check that the intersection lies inside the link portal.
-			if (link->side == 0 || link->side == 4)
+
+			for (int i = 0; i < nrays; ++i)
 			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[1] + (right[1] - left[1])*(link->bmin*s);
-				float lmax = left[1] + (right[1] - left[1])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
-				
-				// Find y intersection.
-				float y = startPos[1] + (endPos[1]-startPos[1])*tmax;
-				if (y >= lmin && y <= lmax)
+				const int r = rays[i];
+				const int seg = segMax[i];
+				const float* sp = &rayStart[r*3];
+				const float* ep = &rayEnd[r*3];
+				dtRaycastHit* hit = &rayHits[r];
+
+				// Could not hit the polygon, keep the old t and report hit.
+				if (!inside[i])
+					continue;
+
+				hit->hitEdgeIndex = seg;
+
+				// Keep track of furthest t so far.
+				if (tmax[i] > hit->t)
+					hit->t = tmax[i];
+
+				// Store visited polygons.
+				if (hit->pathCount < hit->maxPath)
+					hit->path[hit->pathCount++] = curRef;
+				else
+					status |= DT_BUFFER_TOO_SMALL;
+
+				// Ray end is completely inside the polygon.
+				if (seg == -1)
 				{
-					nextRef = link->ref;
-					break;
+					hit->t = FLT_MAX;
+					if (options & DT_RAYCAST_USE_COSTS)
+						hit->pathCost += filter->getCost(curPos[r], ep, prevRef[r], prevTile[r], prevPoly[r], curRef, tile, poly, curRef, tile, poly);
+					continue;
 				}
-			}
-			else if (link->side == 2 || link->side == 6)
-			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[0] + (right[0] - left[0])*(link->bmin*s);
-				float lmax = left[0] + (right[0] - left[0])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
-				
-				// Find X intersection.
-				float x = startPos[0] + (endPos[0]-startPos[0])*tmax;
-				if (x >= lmin && x <= lmax)
+
+				// Follow neighbours.
+				const unsigned int edgeBit = 1u << seg;
+				dtPolyRef nextRef;
+				const dtMeshTile* nextTile = tile;
+				const dtPoly* nextPoly = poly;
+				if (resolvedEdges & edgeBit)
 				{
-					nextRef = link->ref;
-					break;
+					nextRef = edgeRef[seg];
+					nextTile = edgeTile[seg];
+					nextPoly = edgePoly[seg];
+				}
+				else
+				{
+					nextRef = getRaycastNeighbour<dtQueryFilter>(tile, poly, seg, sp, ep, tmax[i], filter, &nextTile, &nextPoly);
+					if (sharedEdges & edgeBit)
+					{
+						resolvedEdges |= edgeBit;
+						edgeRef[seg] = nextRef;
+						edgeTile[seg] = nextTile;
+						edgePoly[seg] = nextPoly;
+						edgeGroup[seg] = -1;
+					}
 				}
-			}
-		}
-		
-		// add the cost
-		if (options & DT_RAYCAST_USE_COSTS)
-		{
-			// compute the intersection point at the furthest end of the polygon
-			// and correct the height (since the raycast moves in 2d)
-			dtVcopy(lastPos, curPos);
-			dtVmad(curPos, startPos, dir, hit->t);
-			float* e1 = &verts[segMax*3];
-			float* e2 = &verts[((segMax+1)%nv)*3];
-			float eDir[3], diff[3];
-			dtVsub(eDir, e2, e1);
-			dtVsub(diff, curPos, e1);
-			float s = dtSqr(eDir[0]) > dtSqr(eDir[1]) ? diff[0] / eDir[0] : diff[1] / eDir[1];
-			curPos[2] = e1[2] + eDir[2] * s;
-
-			hit->pathCost += filter->getCost(lastPos, curPos, prevRef, prevTile, prevPoly, curRef, tile, poly, nextRef, nextTile, nextPoly);
-		}
 
-		if (!nextRef)
-		{
-			// No neighbour, we hit a wall.
-			
-			// Calculate hit normal.
-			const int a = segMax;
-			const int b = segMax+1 < nv ? segMax+1 : 0;
-			const float* va = &verts[a*3];
-			const float* vb = &verts[b*3];
-			const float dx = vb[0] - va[0];
-			const float dy = vb[1] - va[1];
-			hit->hitNormal[0] = -dy;
-			hit->hitNormal[1] = dx;
-			hit->hitNormal[2] = 0;
-			dtVnormalize(hit->hitNormal);
-			
-			hit->pathCount = n;
-			return status;
-		}
+				const float* va = &verts[seg*3];
+				const float* vb = &verts[(seg+1 < nv ? seg+1 : 0)*3];
 
-		// No hit, advance to neighbour polygon.
-		prevRef = curRef;
-		curRef = nextRef;
-		prevTile = tile;
-		tile = nextTile;
-		prevPoly = poly;
-		poly = nextPoly;
+				if (options & DT_RAYCAST_USE_COSTS)
+				{
+					// Compute the intersection point at the furthest end of the polygon
+					// and correct the height, as in raycast.
+					float lastPos[3], dir[3], eDir[3], diff[3];
+					dtVcopy(lastPos, curPos[r]);
+					dtVsub(dir, ep, sp);
+					dtVmad(curPos[r], sp, dir, hit->t);
+					dtVsub(eDir, vb, va);
+					dtVsub(diff, curPos[r], va);
+					const float s = dtSqr(eDir[0]) > dtSqr(eDir[1]) ? diff[0] / eDir[0] : diff[1] / eDir[1];
+					curPos[r][2] = va[2] + eDir[2] * s;
+
+					hit->pathCost += filter->getCost(lastPos, curPos[r], prevRef[r], prevTile[r], prevPoly[r], curRef, tile, poly, nextRef, nextTile, nextPoly);
+				}
+
+				if (!nextRef)
+				{
+					// No neighbour, we hit a wall.
+					hit->hitNormal[0] = -(vb[1] - va[1]);
+					hit->hitNormal[1] = vb[0] - va[0];
+					hit->hitNormal[2] = 0;
+					dtVnormalize(hit->hitNormal);
+					continue;
+				}
+
+				// No hit, move the ray to the group of the neighbour polygon.
+				prevRef[r] = curRef;
+				prevTile[r] = tile;
+				prevPoly[r] = poly;
+				int g = (sharedEdges & edgeBit) ? edgeGroup[seg] : -1;
+				if (g == -1)
+				{
+					g = 0;
+					while (g < groupCount && groupRef[g] != nextRef)
+						g++;
+					if (g == groupCount)
+					{
+						groupRef[g] = nextRef;
+						groupTile[g] = nextTile;
+						groupPoly[g] = nextPoly;
+						groupHead[g] = -1;
+						groupCount++;
+					}
+					if (sharedEdges & edgeBit)
+						edgeGroup[seg] = g;
+				}
+				next[r] = groupHead[g];
+				groupHead[g] = r;
+			}
+		}
 	}
-	
-	hit->pathCount = n;
-	
+
 	return status;
 }
 
@@ -2711,151 +2751,8 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 											   dtPolyRef* resultRef, dtPolyRef* resultParent, float* resultCost,
 											   int* resultCount, const int maxResult) const
 {
-	dtAssert(m_nav);
-	dtAssert(m_nodePool);
-	dtAssert(m_openList);
-
-	if (!resultCount)
-		return DT_FAILURE | DT_INVALID_PARAM;
-
-	*resultCount = 0;
-
-	if (!m_nav->isValidPolyRef(startRef) ||
-		!centerPos || !dtVisfinite(centerPos) ||
-		radius < 0 || !dtMathIsfinite(radius) ||
-		!filter || maxResult < 0)
-	{
-		return DT_FAILURE | DT_INVALID_PARAM;
-	}
-	
-	m_nodePool->clear();
-	m_openList->clear();
-	
-	dtNode* startNode = m_nodePool->getNode(startRef);
-	dtVcopy(startNode->pos, centerPos);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = 0;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_OPEN;
-	m_openList->push(startNode);
-	
-	dtStatus status = DT_SUCCESS;
-	
-	int n = 0;
-	
-	const float radiusSqr = dtSqr(radius);
-	
-	while (!m_openList->empty())
-	{
-		dtNode* bestNode = m_openList->pop();
-		bestNode->flags &= ~DT_NODE_OPEN;
-		bestNode->flags |= DT_NODE_CLOSED;
-		
-		// Get poly and tile.
-		// The API input has been cheked already, skip checking internal data.
-		const dtPolyRef bestRef = bestNode->id;
-		const dtMeshTile* bestTile = 0;
-		const dtPoly* bestPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
-		
-		// Get parent poly and tile.
-		dtPolyRef parentRef = 0;
-		const dtMeshTile* parentTile = 0;
-		const dtPoly* parentPoly = 0;
-		if (bestNode->pidx)
-			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
-		if (parentRef)
-			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
-
-		if (n < maxResult)
-		{
-			if (resultRef)
-				resultRef[n] = bestRef;
-			if (resultParent)
-				resultParent[n] = parentRef;
-			if (resultCost)
-				resultCost[n] = bestNode->total;
-			++n;
-		}
-		else
-		{
-			status |= DT_BUFFER_TOO_SMALL;
-		}
-		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
-		{
-			const dtLink* link = &bestTile->links[i];
-			dtPolyRef neighbourRef = link->ref;
-			// Skip invalid neighbours and do not follow back to parent.
-			if (!neighbourRef || neighbourRef == parentRef)
-				continue;
-			
-			// Expand to neighbour
-			const dtMeshTile* neighbourTile = 0;
-			const dtPoly* neighbourPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
-		
-			// Do not advance if the polygon is excluded by the filter.
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
-				continue;
-			
-			// Find edge and calc distance to the edge.
-			float va[3], vb[3];
-			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
-				continue;
-			
-			// If the circle is not touching the next polygon, skip it.
-			float tseg;
-			float distSqr = dtDistancePtSegSqr2D(centerPos, va, vb, tseg);
-			if (distSqr > radiusSqr)
-				continue;
-			
-			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
-			if (!neighbourNode)
-			{
-				status |= DT_OUT_OF_NODES;
-				continue;
-			}
-				
-			if (neighbourNode->flags & DT_NODE_CLOSED)
-				continue;
-			
-			// Cost
-			if (neighbourNode->flags == 0)
-				dtVlerp(neighbourNode->pos, va, vb, 0.5f);
-			
-			float cost = filter->getCost(
-				bestNode->pos, neighbourNode->pos,
-				parentRef, parentTile, parentPoly,
-				bestRef, bestTile, bestPoly,
-				neighbourRef, neighbourTile, neighbourPoly);
-
-			const float total = bestNode->total + cost;
-			
-			// The node is already in open list and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
-				continue;
-			
-			neighbourNode->id = neighbourRef;
-			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
-			neighbourNode->total = total;
-			
-			if (neighbourNode->flags & DT_NODE_OPEN)
-			{
-				m_openList->modify(neighbourNode);
-			}
-			else
-			{
-				neighbourNode->flags = DT_NODE_OPEN;
-				m_openList->push(neighbourNode);
-			}
-		}
-	}
-	
-	*resultCount = n;
-	
-	return status;
+	return findPolysAroundCircle<dtQueryFilter>(startRef, centerPos, radius, filter, resultRef, resultParent, resultCost,
+												resultCount, maxResult);
 }
 
 /// @par
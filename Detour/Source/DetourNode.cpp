@@ -54,7 +54,14 @@ dtNodePool::dtNodePool(int maxNodes, int hashSize) :
 	m_next(0),
 	m_maxNodes(maxNodes),
 	m_hashSize(hashSize),
-	m_nodeCount(0)
+	m_nodeCount(0),
+	m_nav(0),
+	m_maxTiles(0),
+	m_tileSlots(0),
+	m_tileSlotCount(0),
+	m_tileSlotCapacity(0),
+	m_tileGeneration(0),
+	m_generation(1)
 {
 	dtAssert(dtNextPow2(m_hashSize) == (unsigned int)m_hashSize);
 	// pidx is special as 0 means "none" and 1 is the first node. For that reason
@@ -73,22 +80,130 @@ dtNodePool::dtNodePool(int maxNodes, int hashSize) :
 	memset(m_next, 0xff, sizeof(dtNodeIndex)*m_maxNodes);
 }
 
+dtNodePool::dtNodePool(int maxNodes, const dtNavMesh* nav) :
+	m_nodes(0),
+	m_first(0),
+	m_next(0),
+	m_maxNodes(maxNodes),
+	m_hashSize(0),
+	m_nodeCount(0),
+	m_nav(nav),
+	m_maxTiles(nav->getMaxTiles()),
+	m_tileSlots(0),
+	m_tileSlotCount(0),
+	m_tileSlotCapacity(0),
+	m_tileGeneration(0),
+	m_generation(1)
+{
+	dtAssert(m_maxNodes > 0 && m_maxNodes <= DT_NULL_IDX && m_maxNodes <= (1 << DT_NODE_PARENT_BITS) - 1);
+
+	m_nodes = (dtNode*)dtAlloc(sizeof(dtNode)*m_maxNodes, DT_ALLOC_PERM);
+	m_tileSlots = (dtNodeIndex**)dtAlloc(sizeof(dtNodeIndex*)*m_maxTiles, DT_ALLOC_PERM);
+	m_tileSlotCount = (int*)dtAlloc(sizeof(int)*m_maxTiles, DT_ALLOC_PERM);
+	m_tileSlotCapacity = (int*)dtAlloc(sizeof(int)*m_maxTiles, DT_ALLOC_PERM);
+	m_tileGeneration = (unsigned int*)dtAlloc(sizeof(unsigned int)*m_maxTiles, DT_ALLOC_PERM);
+
+	dtAssert(m_nodes);
+	dtAssert(m_tileSlots && m_tileSlotCount && m_tileSlotCapacity && m_tileGeneration);
+
+	memset(m_tileSlots, 0, sizeof(dtNodeIndex*)*m_maxTiles);
+	memset(m_tileSlotCount, 0, sizeof(int)*m_maxTiles);
+	memset(m_tileSlotCapacity, 0, sizeof(int)*m_maxTiles);
+	memset(m_tileGeneration, 0, sizeof(unsigned int)*m_maxTiles);
+}
+
 dtNodePool::~dtNodePool()
 {
 	dtFree(m_nodes);
 	dtFree(m_next);
 	dtFree(m_first);
+	for (int i = 0; i < m_maxTiles; ++i)
+		dtFree(m_tileSlots[i]);
+	dtFree(m_tileSlots);
+	dtFree(m_tileSlotCount);
+	dtFree(m_tileSlotCapacity);
+	dtFree(m_tileGeneration);
 }
 
 void dtNodePool::clear()
 {
-	memset(m_first, 0xff, sizeof(dtNodeIndex)*m_hashSize);
 	m_nodeCount = 0;
+	if (m_nav)
+	{
+		// The slots of a tile are reset the first time the tile is used after a clear.
+		if (++m_generation == 0)
+		{
+			memset(m_tileGeneration, 0, sizeof(unsigned int)*m_maxTiles);
+			m_generation = 1;
+		}
+		return;
+	}
+	memset(m_first, 0xff, sizeof(dtNodeIndex)*m_hashSize);
+}
+
+int dtNodePool::getMemUsed() const
+{
+	int size = sizeof(*this) +
+		sizeof(dtNode)*m_maxNodes +
+		sizeof(dtNodeIndex)*(m_next ? m_maxNodes : 0) +
+		sizeof(dtNodeIndex)*m_hashSize;
+	if (m_nav)
+	{
+		size += (sizeof(dtNodeIndex*) + sizeof(int)*2 + sizeof(unsigned int))*m_maxTiles;
+		for (int i = 0; i < m_maxTiles; ++i)
+			size += sizeof(dtNodeIndex)*m_tileSlotCapacity[i];
+	}
+	return size;
+}
+
+dtNodeIndex* dtNodePool::getTileSlot(dtPolyRef id, unsigned char state, bool create)
+{
+	const unsigned int it = m_nav->decodePolyIdTile(id);
+	if ((int)it >= m_maxTiles)
+		return 0;
+
+	if (m_tileGeneration[it] != m_generation)
+	{
+		if (!create)
+			return 0;
+		const dtMeshTile* tile = m_nav->getTile((int)it);
+		const int count = tile->header ? tile->header->polyCount*DT_MAX_STATES_PER_NODE : 0;
+		if (count > m_tileSlotCapacity[it])
+		{
+			dtFree(m_tileSlots[it]);
+			m_tileSlots[it] = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*count, DT_ALLOC_PERM);
+			m_tileSlotCapacity[it] = m_tileSlots[it] ? count : 0;
+			if (!m_tileSlots[it])
+				return 0;
+		}
+		memset(m_tileSlots[it], 0xff, sizeof(dtNodeIndex)*count);
+		m_tileSlotCount[it] = count;
+		m_tileGeneration[it] = m_generation;
+	}
+
+	const int slot = (int)m_nav->decodePolyIdPoly(id)*DT_MAX_STATES_PER_NODE + state;
+	if (slot >= m_tileSlotCount[it])
+		return 0;
+	return &m_tileSlots[it][slot];
 }
 
 unsigned int dtNodePool::findNodes(dtPolyRef id, dtNode** nodes, const int maxNodes)
 {
 	int n = 0;
+	if (m_nav)
+	{
+		for (unsigned char state = 0; state < DT_MAX_STATES_PER_NODE; ++state)
+		{
+			const dtNodeIndex* slot = getTileSlot(id, state, false);
+			if (!slot || *slot == DT_NULL_IDX)
+				continue;
+			if (n >= maxNodes)
+				return n;
+			nodes[n++] = &m_nodes[*slot];
+		}
+		return n;
+	}
+
 	unsigned int bucket = dtHashRef(id) & (m_hashSize-1);
 	dtNodeIndex i = m_first[bucket];
 	while (i != DT_NULL_IDX)
@@ -107,6 +222,12 @@ unsigned int dtNodePool::findNodes(dtPolyRef id, dtNode** nodes, const int maxNo
 
 dtNode* dtNodePool::findNode(dtPolyRef id, unsigned char state)
 {
+	if (m_nav)
+	{
+		const dtNodeIndex* slot = getTileSlot(id, state, false);
+		return slot && *slot != DT_NULL_IDX ? &m_nodes[*slot] : 0;
+	}
+
 	unsigned int bucket = dtHashRef(id) & (m_hashSize-1);
 	dtNodeIndex i = m_first[bucket];
 	while (i != DT_NULL_IDX)
@@ -118,11 +239,38 @@ dtNode* dtNodePool::findNode(dtPolyRef id, unsigned char state)
 	return 0;
 }
 
+dtNode* dtNodePool::allocNode(dtPolyRef id, unsigned char state)
+{
+	if (m_nodeCount >= m_maxNodes)
+		return 0;
+	
+	dtNode* node = &m_nodes[m_nodeCount++];
+	node->pidx = 0;
+	node->cost = 0;
+	node->total = 0;
+	node->id = id;
+	node->state = state;
+	node->flags = 0;
+	return node;
+}
+
 dtNode* dtNodePool::getNode(dtPolyRef id, unsigned char state)
 {
+	if (m_nav)
+	{
+		dtNodeIndex* slot = getTileSlot(id, state, true);
+		if (!slot)
+			return 0;
+		if (*slot != DT_NULL_IDX)
+			return &m_nodes[*slot];
+		dtNode* node = allocNode(id, state);
+		if (node)
+			*slot = (dtNodeIndex)(m_nodeCount-1);
+		return node;
+	}
+
 	unsigned int bucket = dtHashRef(id) & (m_hashSize-1);
 	dtNodeIndex i = m_first[bucket];
-	dtNode* node = 0;
 	while (i != DT_NULL_IDX)
 	{
 		if (m_nodes[i].id == id && m_nodes[i].state == state)
@@ -130,21 +278,11 @@ dtNode* dtNodePool::getNode(dtPolyRef id, unsigned char state)
 		i = m_next[i];
 	}
 	
-	if (m_nodeCount >= m_maxNodes)
+	dtNode* node = allocNode(id, state);
+	if (!node)
 		return 0;
-	
-	i = (dtNodeIndex)m_nodeCount;
-	m_nodeCount++;
-	
-	// Init node
-	node = &m_nodes[i];
-	node->pidx = 0;
-	node->cost = 0;
-	node->total = 0;
-	node->id = id;
-	node->state = state;
-	node->flags = 0;
-	
+
+	i = (dtNodeIndex)(m_nodeCount-1);
 	m_next[i] = m_first[bucket];
 	m_first[bucket] = i;
 	
@@ -153,20 +291,51 @@ dtNode* dtNodePool::getNode(dtPolyRef id, unsigned char state)
 
 
 //////////////////////////////////////////////////////////////////////////////////////////
-dtNodeQueue::dtNodeQueue(int n) :
+dtNodeQueue::dtNodeQueue(int n, dtNodeQueueType type) :
+	m_type(type),
 	m_heap(0),
 	m_capacity(n),
-	m_size(0)
+	m_size(0),
+	m_entryKeys(0),
+	m_entryNodes(0),
+	m_entryNext(0),
+	m_entryCapacity(0),
+	m_entryCount(0),
+	m_freeEntry(-1),
+	m_last(0)
 {
 	dtAssert(m_capacity > 0);
 	
-	m_heap = (dtNode**)dtAlloc(sizeof(dtNode*)*(m_capacity+1), DT_ALLOC_PERM);
-	dtAssert(m_heap);
+	if (m_type == DT_NODE_QUEUE_RADIX_HEAP)
+	{
+		// Each open node has one valid entry, the rest are stale entries left by modify().
+		m_entryCapacity = m_capacity*2;
+		m_entryKeys = (unsigned int*)dtAlloc(sizeof(unsigned int)*m_entryCapacity, DT_ALLOC_PERM);
+		m_entryNodes = (dtNode**)dtAlloc(sizeof(dtNode*)*m_entryCapacity, DT_ALLOC_PERM);
+		m_entryNext = (int*)dtAlloc(sizeof(int)*m_entryCapacity, DT_ALLOC_PERM);
+		dtAssert(m_entryKeys && m_entryNodes && m_entryNext);
+		clearRadix();
+	}
+	else
+	{
+		m_heap = (dtNode**)dtAlloc(sizeof(dtNode*)*(m_capacity+1), DT_ALLOC_PERM);
+		dtAssert(m_heap);
+	}
 }
 
 dtNodeQueue::~dtNodeQueue()
 {
 	dtFree(m_heap);
+	dtFree(m_entryKeys);
+	dtFree(m_entryNodes);
+	dtFree(m_entryNext);
+}
+
+int dtNodeQueue::getMemUsed() const
+{
+	return sizeof(*this) +
+		sizeof(dtNode*) * (m_heap ? m_capacity + 1 : 0) +
+		(sizeof(unsigned int) + sizeof(dtNode*) + sizeof(int)) * m_entryCapacity;
 }
 
 void dtNodeQueue::bubbleUp(int i, dtNode* node)
@@ -198,3 +367,192 @@ void dtNodeQueue::trickleDown(int i, dtNode* node)
 	}
 	bubbleUp(i, node);
 }
+
+void dtNodeQueue::bubbleUp4(int i, dtNode* node)
+{
+	while (i > 0)
+	{
+		const int parent = (i-1)/4;
+		if (m_heap[parent]->total <= node->total)
+			break;
+		m_heap[i] = m_heap[parent];
+		m_heap[i]->heapIndex = (unsigned int)i;
+		i = parent;
+	}
+	m_heap[i] = node;
+	node->heapIndex = (unsigned int)i;
+}
+
+void dtNodeQueue::trickleDown4(int i, dtNode* node)
+{
+	for (;;)
+	{
+		const int first = i*4+1;
+		if (first >= m_size)
+			break;
+		const int last = dtMin(first+4, m_size);
+		int child = first;
+		for (int j = first+1; j < last; ++j)
+		{
+			if (m_heap[j]->total < m_heap[child]->total)
+				child = j;
+		}
+		if (node->total <= m_heap[child]->total)
+			break;
+		m_heap[i] = m_heap[child];
+		m_heap[i]->heapIndex = (unsigned int)i;
+		i = child;
+	}
+	m_heap[i] = node;
+	node->heapIndex = (unsigned int)i;
+}
+
+// Non-negative floats keep their order when their bits are compared as integers.
+inline unsigned int dtRadixKey(const float total)
+{
+	if (!(total > 0.0f))
+		return 0;
+	unsigned int key;
+	memcpy(&key, &total, sizeof(key));
+	return key;
+}
+
+// Entries equal to the last popped key go to bucket 0, the others to the bucket of
+// the highest bit they differ in.
+inline int dtRadixBucket(const unsigned int key, const unsigned int last)
+{
+	unsigned int diff = key ^ last;
+	int bucket = 0;
+	while (diff)
+	{
+		diff >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void dtNodeQueue::clearRadix()
+{
+	for (int i = 0; i < RADIX_BUCKETS; ++i)
+		m_buckets[i] = -1;
+	m_entryCount = 0;
+	m_freeEntry = -1;
+	m_last = 0;
+}
+
+/// @par
+///
+/// Keys smaller than the last popped key are raised to it, so a filter with
+/// non-monotone costs still gets a valid, if not exactly ordered, search.
+void dtNodeQueue::pushRadix(dtNode* node)
+{
+	int e;
+	if (m_freeEntry == -1 && m_entryCount >= m_entryCapacity)
+		compactRadix();
+	if (m_freeEntry != -1)
+	{
+		e = m_freeEntry;
+		m_freeEntry = m_entryNext[e];
+	}
+	else
+	{
+		e = m_entryCount++;
+	}
+
+	const unsigned int key = dtMax(dtRadixKey(node->total), m_last);
+	const int bucket = dtRadixBucket(key, m_last);
+	m_entryKeys[e] = key;
+	m_entryNodes[e] = node;
+	m_entryNext[e] = m_buckets[bucket];
+	m_buckets[bucket] = e;
+	node->heapIndex = (unsigned int)e;
+}
+
+void dtNodeQueue::compactRadix()
+{
+	// Drop the entries that were replaced by modify().
+	for (int i = 0; i < RADIX_BUCKETS; ++i)
+	{
+		int* prev = &m_buckets[i];
+		while (*prev != -1)
+		{
+			const int e = *prev;
+			if (m_entryNodes[e]->heapIndex != (unsigned int)e)
+			{
+				*prev = m_entryNext[e];
+				m_entryNext[e] = m_freeEntry;
+				m_freeEntry = e;
+			}
+			else
+			{
+				prev = &m_entryNext[e];
+			}
+		}
+	}
+}
+
+int dtNodeQueue::peekRadix()
+{
+	for (;;)
+	{
+		// Drop stale entries from the front of bucket 0.
+		while (m_buckets[0] != -1)
+		{
+			const int e = m_buckets[0];
+			if (m_entryNodes[e]->heapIndex == (unsigned int)e)
+				return e;
+			m_buckets[0] = m_entryNext[e];
+			m_entryNext[e] = m_freeEntry;
+			m_freeEntry = e;
+		}
+
+		// Find the smallest key of the first non-empty bucket and redistribute
+		// the bucket around it.
+		int bucket = 1;
+		while (bucket < RADIX_BUCKETS && m_buckets[bucket] == -1)
+			bucket++;
+		dtAssert(bucket < RADIX_BUCKETS);
+		if (bucket >= RADIX_BUCKETS)
+			return -1;
+
+		unsigned int minKey = 0xffffffff;
+		for (int e = m_buckets[bucket]; e != -1; e = m_entryNext[e])
+		{
+			if (m_entryNodes[e]->heapIndex == (unsigned int)e)
+				minKey = dtMin(minKey, m_entryKeys[e]);
+		}
+
+		int e = m_buckets[bucket];
+		m_buckets[bucket] = -1;
+		if (minKey != 0xffffffff)
+			m_last = minKey;
+		while (e != -1)
+		{
+			const int next = m_entryNext[e];
+			if (m_entryNodes[e]->heapIndex == (unsigned int)e)
+			{
+				const int b = dtRadixBucket(m_entryKeys[e], m_last);
+				m_entryNext[e] = m_buckets[b];
+				m_buckets[b] = e;
+			}
+			else
+			{
+				m_entryNext[e] = m_freeEntry;
+				m_freeEntry = e;
+			}
+			e = next;
+		}
+	}
+}
+
+dtNode* dtNodeQueue::popRadix()
+{
+	const int e = peekRadix();
+	dtNode* node = m_entryNodes[e];
+	m_buckets[0] = m_entryNext[e];
+	m_entryNext[e] = m_freeEntry;
+	m_freeEntry = e;
+	node->heapIndex = ~0u;
+	m_size--;
+	return node;
+}
@@ -0,0 +1,358 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <new>
+#include "DetourQueryService.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+static dtStatus runPathJob(dtNavMeshQuery& query, void* userData)
+{
+	dtQueryPathJob* job = (dtQueryPathJob*)userData;
+	const dtStatus status = query.findPaths(&job->request, 1, &job->result, job->path, job->maxPath,
+											job->straightPath, job->maxStraightPath);
+	if (dtStatusFailed(status))
+	{
+		job->result.status = status;
+		job->result.pathCount = 0;
+		job->result.straightPathCount = 0;
+	}
+	return job->result.status;
+}
+
+dtStatus dtQueryFuture::wait()
+{
+	if (!isReady() && m_service)
+		m_service->waitFuture(*this);
+	return m_status;
+}
+
+dtQueryService::dtQueryService() :
+	m_nav(0),
+	m_cells(0),
+	m_cellMask(0),
+	m_enqueuePos(0),
+	m_dequeuePos(0),
+	m_workers(0),
+	m_workerCount(0),
+	m_pending(0),
+	m_sleeping(0),
+	m_updating(false),
+	m_stop(false)
+{
+}
+
+dtQueryService::~dtQueryService()
+{
+	shutdown();
+}
+
+/// @par
+///
+/// Calling init again waits for the queued jobs, stops the workers and starts new ones.
+dtStatus dtQueryService::init(dtNavMesh* nav, const int threadCount, const int maxNodes, const int maxJobs)
+{
+	shutdown();
+
+	if (!nav || maxNodes <= 0 || maxJobs <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	m_nav = nav;
+
+	const unsigned int cellCount = dtNextPow2((unsigned int)maxJobs);
+	m_cells = (Cell*)dtAlloc(sizeof(Cell)*cellCount, DT_ALLOC_PERM);
+	if (!m_cells)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	for (unsigned int i = 0; i < cellCount; ++i)
+	{
+		new (&m_cells[i]) Cell;
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	m_cellMask = cellCount - 1;
+	m_enqueuePos.store(0);
+	m_dequeuePos.store(0);
+
+	int count = threadCount > 0 ? threadCount : (int)std::thread::hardware_concurrency();
+	count = dtMax(count, 1);
+	m_workers = (Worker*)dtAlloc(sizeof(Worker)*count, DT_ALLOC_PERM);
+	if (!m_workers)
+	{
+		shutdown();
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	for (m_workerCount = 0; m_workerCount < count; ++m_workerCount)
+	{
+		Worker& worker = m_workers[m_workerCount];
+		new (&worker) Worker;
+		worker.active.store(false);
+		const dtStatus status = worker.query.init(nav, maxNodes);
+		if (dtStatusFailed(status))
+		{
+			// Count the worker, so that shutdown destroys it.
+			m_workerCount++;
+			shutdown();
+			return status;
+		}
+	}
+
+	m_stop.store(false);
+	for (int i = 0; i < m_workerCount; ++i)
+		m_workers[i].thread = std::thread(workerMain, this, &m_workers[i]);
+
+	return DT_SUCCESS;
+}
+
+void dtQueryService::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop.store(true);
+	}
+	m_workCond.notify_all();
+
+	for (int i = 0; i < m_workerCount; ++i)
+	{
+		if (m_workers[i].thread.joinable())
+			m_workers[i].thread.join();
+		m_workers[i].~Worker();
+	}
+	dtFree(m_workers);
+	m_workers = 0;
+	m_workerCount = 0;
+
+	if (m_cells)
+	{
+		for (unsigned int i = 0; i <= m_cellMask; ++i)
+			m_cells[i].~Cell();
+		dtFree(m_cells);
+		m_cells = 0;
+	}
+	m_cellMask = 0;
+	m_nav = 0;
+}
+
+dtStatus dtQueryService::submit(dtQueryJobFunc* func, void* userData, dtQueryFuture* future, dtQueryCallback* callback)
+{
+	if (!func)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (!m_workers)
+		return DT_FAILURE;
+
+	if (future)
+	{
+		future->m_service = this;
+		future->m_status = DT_FAILURE;
+		future->m_ready.store(false, std::memory_order_relaxed);
+	}
+
+	Job job;
+	job.func = func;
+	job.callback = callback;
+	job.userData = userData;
+	job.future = future;
+
+	m_pending.fetch_add(1);
+	if (!push(job))
+	{
+		m_pending.fetch_sub(1);
+		if (future)
+			future->m_ready.store(true, std::memory_order_release);
+		return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+	}
+
+	// Pairs with the fence of the worker that goes to sleep: either the worker finds the job,
+	// or the submitter finds the worker sleeping.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sleeping.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_workCond.notify_one();
+	}
+	return DT_SUCCESS;
+}
+
+dtStatus dtQueryService::submitPath(dtQueryPathJob* job, dtQueryFuture* future, dtQueryCallback* callback)
+{
+	if (!job)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	return submit(runPathJob, job, future, callback);
+}
+
+/// @par
+///
+/// Jobs which are queued during the update start once @p func has returned. Only one update
+/// runs at a time.
+void dtQueryService::updateNavMesh(dtNavMeshUpdateFunc* func, void* userData)
+{
+	std::lock_guard<std::mutex> updateLock(m_updateMutex);
+
+	// Workers check the flag after they flag themselves active, and the update checks the
+	// workers after it sets the flag, so a job is either held back or waited for.
+	m_updating.store(true);
+	for (int i = 0; i < m_workerCount; ++i)
+	{
+		while (m_workers[i].active.load())
+			std::this_thread::yield();
+	}
+
+	func(*m_nav, userData);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_updating.store(false);
+	}
+	m_doneCond.notify_all();
+}
+
+void dtQueryService::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_pending.load() > 0)
+		m_doneCond.wait(lock);
+}
+
+void dtQueryService::waitFuture(const dtQueryFuture& future)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!future.isReady())
+		m_doneCond.wait(lock);
+}
+
+// Bounded queue after Dmitry Vyukov. Each cell holds a sequence number that tells producers
+// and consumers whose turn it is, so both ends only contend on their own position counter.
+bool dtQueryService::push(const Job& job)
+{
+	unsigned int pos = m_enqueuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = m_cells[pos & m_cellMask];
+		const unsigned int seq = cell.sequence.load(std::memory_order_acquire);
+		const int diff = (int)(seq - pos);
+		if (diff == 0)
+		{
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell.job = job;
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0)
+		{
+			// The queue is full.
+			return false;
+		}
+		else
+		{
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool dtQueryService::pop(Job& job)
+{
+	unsigned int pos = m_dequeuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = m_cells[pos & m_cellMask];
+		const unsigned int seq = cell.sequence.load(std::memory_order_acquire);
+		const int diff = (int)(seq - (pos + 1));
+		if (diff == 0)
+		{
+			if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				job = cell.job;
+				cell.sequence.store(pos + m_cellMask + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0)
+		{
+			// The queue is empty.
+			return false;
+		}
+		else
+		{
+			pos = m_dequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void dtQueryService::run(Worker& worker, const Job& job)
+{
+	// Hold the job back while the navigation mesh is updated.
+	worker.active.store(true);
+	while (m_updating.load())
+	{
+		worker.active.store(false);
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (m_updating.load())
+				m_doneCond.wait(lock);
+		}
+		worker.active.store(true);
+	}
+
+	const dtStatus status = job.func(worker.query, job.userData);
+	// The callback may still read the navigation mesh, so it runs before the worker goes idle.
+	if (job.callback)
+		job.callback(status, job.userData);
+
+	worker.active.store(false);
+
+	if (job.future)
+	{
+		job.future->m_status = status;
+		job.future->m_ready.store(true, std::memory_order_release);
+	}
+	const bool idle = m_pending.fetch_sub(1) == 1;
+	if (job.future || idle)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_doneCond.notify_all();
+	}
+}
+
+void dtQueryService::workerMain(dtQueryService* service, Worker* worker)
+{
+	Job job;
+	for (;;)
+	{
+		if (service->pop(job))
+		{
+			service->run(*worker, job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(service->m_mutex);
+		service->m_sleeping.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		// Check again, the job may have been queued before the worker was counted as sleeping.
+		const bool found = service->pop(job);
+		if (!found && !service->m_stop.load())
+			service->m_workCond.wait(lock);
+		service->m_sleeping.fetch_sub(1);
+		lock.unlock();
+
+		if (found)
+			service->run(*worker, job);
+		else if (service->m_stop.load())
+			return;
+	}
+}
@@ -0,0 +1,704 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <float.h>
+#include <string.h>
+#include "DetourTileGraph.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+struct dtTileGraphHeapItem
+{
+	float cost;
+	unsigned int tile;
+	int index;
+};
+
+static void heapPush(dtTileGraphHeapItem* heap, int& count, const dtTileGraphHeapItem& item)
+{
+	int i = count++;
+	while (i > 0)
+	{
+		const int parent = (i-1)/2;
+		if (heap[parent].cost <= item.cost)
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = item;
+}
+
+static dtTileGraphHeapItem heapPop(dtTileGraphHeapItem* heap, int& count)
+{
+	const dtTileGraphHeapItem result = heap[0];
+	const dtTileGraphHeapItem last = heap[--count];
+	int i = 0;
+	for (;;)
+	{
+		int child = i*2+1;
+		if (child >= count)
+			break;
+		if (child+1 < count && heap[child+1].cost < heap[child].cost)
+			child++;
+		if (last.cost <= heap[child].cost)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	if (count > 0)
+		heap[i] = last;
+	return result;
+}
+
+static void calcPolyCenter(const dtMeshTile* tile, const dtPoly* poly, float* center)
+{
+	dtVset(center, 0, 0, 0);
+	for (int i = 0; i < (int)poly->vertCount; ++i)
+		dtVadd(center, center, &tile->verts[poly->verts[i]*3]);
+	dtVscale(center, center, 1.0f / (float)poly->vertCount);
+}
+
+static void calcPortalPos(const dtMeshTile* tile, const dtPoly* poly, const dtLink& link, float* pos)
+{
+	const int nv = (int)poly->vertCount;
+	if (link.edge >= nv)
+	{
+		calcPolyCenter(tile, poly, pos);
+	}
+	else if (poly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+	{
+		// Off-mesh connections are linked at their end points.
+		dtVcopy(pos, &tile->verts[poly->verts[link.edge]*3]);
+	}
+	else
+	{
+		const float* va = &tile->verts[poly->verts[link.edge]*3];
+		const float* vb = &tile->verts[poly->verts[(link.edge+1) % nv]*3];
+		dtVlerp(pos, va, vb, 0.5f);
+	}
+}
+
+static int findRoot(int* parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+dtTileGraph::dtTileGraph() :
+	m_nav(0),
+	m_maxTiles(0),
+	m_tiles(0),
+	m_corridor(0),
+	m_corridorCount(0),
+	m_searchId(0),
+	m_polyCosts(0),
+	m_polyCenters(0),
+	m_maxPolys(0),
+	m_polyHeap(0),
+	m_polyHeapCount(0),
+	m_polyHeapCapacity(0),
+	m_goalCosts(0),
+	m_maxClusters(0),
+	m_open(0),
+	m_openCount(0),
+	m_openCapacity(0)
+{
+}
+
+dtTileGraph::~dtTileGraph()
+{
+	for (int i = 0; i < m_maxTiles; ++i)
+		clearTile(m_tiles[i]);
+	dtFree(m_tiles);
+	dtFree(m_corridor);
+	dtFree(m_polyCosts);
+	dtFree(m_polyCenters);
+	dtFree(m_polyHeap);
+	dtFree(m_goalCosts);
+	dtFree(m_open);
+}
+
+void dtTileGraph::clearTile(dtTileGraphTile& gt)
+{
+	dtFree(gt.polyGroups);
+	dtFree(gt.clusters);
+	dtFree(gt.portals);
+	dtFree(gt.costs);
+	dtFree(gt.nodes);
+	memset(&gt, 0, sizeof(dtTileGraphTile));
+}
+
+/// @par
+///
+/// The graph keeps a pointer to the navigation mesh, but does not register itself
+/// as its tile listener. Call dtNavMesh::setTileListener for that.
+dtStatus dtTileGraph::init(const dtNavMesh* nav)
+{
+	if (!nav)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	for (int i = 0; i < m_maxTiles; ++i)
+		clearTile(m_tiles[i]);
+	dtFree(m_tiles);
+	dtFree(m_corridor);
+	m_tiles = 0;
+	m_corridor = 0;
+	m_corridorCount = 0;
+	m_searchId = 0;
+
+	m_nav = nav;
+	m_maxTiles = nav->getMaxTiles();
+	m_tiles = (dtTileGraphTile*)dtAlloc(sizeof(dtTileGraphTile)*m_maxTiles, DT_ALLOC_PERM);
+	m_corridor = (unsigned char*)dtAlloc(sizeof(unsigned char)*m_maxTiles, DT_ALLOC_PERM);
+	if (!m_tiles || !m_corridor)
+	{
+		m_maxTiles = 0;
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	memset(m_tiles, 0, sizeof(dtTileGraphTile)*m_maxTiles);
+	memset(m_corridor, 0, sizeof(unsigned char)*m_maxTiles);
+
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshTile* tile = nav->getTile(i);
+		if (tile->header && !buildTile(tile))
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	return DT_SUCCESS;
+}
+
+void dtTileGraph::tileAdded(const dtNavMesh* nav, dtTileRef ref)
+{
+	if (nav != m_nav || !m_tiles)
+		return;
+	const dtMeshTile* tile = nav->getTile((int)nav->decodePolyIdTile((dtPolyRef)ref));
+	if (!tile->header)
+		return;
+	// The new tile is rebuilt with its neighbours, their portals changed as well.
+	rebuildTilesAround(tile->header->x, tile->header->y);
+}
+
+void dtTileGraph::tileRemoved(const dtNavMesh* nav, dtTileRef ref, int tx, int ty)
+{
+	if (nav != m_nav || !m_tiles)
+		return;
+	const unsigned int it = nav->decodePolyIdTile((dtPolyRef)ref);
+	if ((int)it < m_maxTiles)
+		clearTile(m_tiles[it]);
+	rebuildTilesAround(tx, ty);
+}
+
+void dtTileGraph::rebuildTilesAround(const int tx, const int ty)
+{
+	static const int MAX_NEIS = 32;
+	const dtMeshTile* neis[MAX_NEIS];
+	for (int y = ty-1; y <= ty+1; ++y)
+	{
+		for (int x = tx-1; x <= tx+1; ++x)
+		{
+			const int nneis = m_nav->getTilesAt(x, y, neis, MAX_NEIS);
+			for (int i = 0; i < nneis; ++i)
+				buildTile(neis[i]);
+		}
+	}
+}
+
+bool dtTileGraph::isCurrent(const unsigned int tileIndex) const
+{
+	if ((int)tileIndex >= m_maxTiles || !m_tiles[tileIndex].ref)
+		return false;
+	return m_tiles[tileIndex].ref == m_nav->getTileRef(m_nav->getTile((int)tileIndex));
+}
+
+bool dtTileGraph::reserveScratch(const int polyCount, const int heapSize, const int clusterCount)
+{
+	if (polyCount > m_maxPolys)
+	{
+		dtFree(m_polyCosts);
+		dtFree(m_polyCenters);
+		m_polyCosts = (float*)dtAlloc(sizeof(float)*polyCount, DT_ALLOC_PERM);
+		m_polyCenters = (float*)dtAlloc(sizeof(float)*polyCount*3, DT_ALLOC_PERM);
+		m_maxPolys = (m_polyCosts && m_polyCenters) ? polyCount : 0;
+		if (!m_maxPolys)
+			return false;
+	}
+	if (heapSize > m_polyHeapCapacity)
+	{
+		dtFree(m_polyHeap);
+		m_polyHeap = (dtTileGraphHeapItem*)dtAlloc(sizeof(dtTileGraphHeapItem)*heapSize, DT_ALLOC_PERM);
+		m_polyHeapCapacity = m_polyHeap ? heapSize : 0;
+		if (!m_polyHeap)
+			return false;
+	}
+	if (clusterCount > m_maxClusters)
+	{
+		dtFree(m_goalCosts);
+		m_goalCosts = (float*)dtAlloc(sizeof(float)*clusterCount, DT_ALLOC_PERM);
+		m_maxClusters = m_goalCosts ? clusterCount : 0;
+		if (!m_goalCosts)
+			return false;
+	}
+	return true;
+}
+
+bool dtTileGraph::beginPolyCosts(const dtMeshTile* tile, const int clusterCount)
+{
+	const int polyCount = tile->header->polyCount;
+	if (!reserveScratch(polyCount, polyCount + tile->header->maxLinkCount, clusterCount))
+		return false;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		calcPolyCenter(tile, &tile->polys[i], &m_polyCenters[i*3]);
+		m_polyCosts[i] = FLT_MAX;
+	}
+	m_polyHeapCount = 0;
+	return true;
+}
+
+void dtTileGraph::seedPolyCost(const int poly, const float cost)
+{
+	if (cost >= m_polyCosts[poly] || m_polyHeapCount >= m_polyHeapCapacity)
+		return;
+	m_polyCosts[poly] = cost;
+	dtTileGraphHeapItem item;
+	item.cost = cost;
+	item.tile = 0;
+	item.index = poly;
+	heapPush(m_polyHeap, m_polyHeapCount, item);
+}
+
+void dtTileGraph::spreadPolyCosts(const dtMeshTile* tile, const unsigned int tileIndex)
+{
+	// Dijkstra over the links inside the tile.
+	while (m_polyHeapCount > 0)
+	{
+		const dtTileGraphHeapItem top = heapPop(m_polyHeap, m_polyHeapCount);
+		if (top.cost > m_polyCosts[top.index])
+			continue;
+		const dtPoly* poly = &tile->polys[top.index];
+		for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+		{
+			const dtPolyRef ref = tile->links[i].ref;
+			if (!ref || m_nav->decodePolyIdTile(ref) != tileIndex)
+				continue;
+			const int nei = (int)m_nav->decodePolyIdPoly(ref);
+			seedPolyCost(nei, top.cost + dtVdist(&m_polyCenters[top.index*3], &m_polyCenters[nei*3]));
+		}
+	}
+}
+
+float dtTileGraph::getClusterCost(const dtTileGraphTile& gt, const int cluster) const
+{
+	const dtTileGraphCluster& c = gt.clusters[cluster];
+	float best = FLT_MAX;
+	for (int i = 0; i < c.portalCount; ++i)
+	{
+		const dtTileGraphPortal& p = gt.portals[c.firstPortal + i];
+		const int poly = (int)m_nav->decodePolyIdPoly(p.poly);
+		if (m_polyCosts[poly] == FLT_MAX)
+			continue;
+		const float cost = m_polyCosts[poly] + dtVdist(&m_polyCenters[poly*3], p.pos) + dtVdist(p.pos, c.pos);
+		best = dtMin(best, cost);
+	}
+	return best;
+}
+
+/// @par
+///
+/// Polygons are grouped into sets connected by the links inside the tile. The portals of
+/// a set that lead to the same neighbour tile form a cluster. The cost between two clusters
+/// is the shortest distance between them through the polygon centers of the tile. It does
+/// not depend on the query filter.
+bool dtTileGraph::buildTile(const dtMeshTile* tile)
+{
+	const unsigned int it = m_nav->decodePolyIdTile((dtPolyRef)m_nav->getTileRef(tile));
+	dtTileGraphTile& gt = m_tiles[it];
+	clearTile(gt);
+	if (!tile->header)
+		return true;
+
+	const int polyCount = tile->header->polyCount;
+	gt.polyGroups = (unsigned short*)dtAlloc(sizeof(unsigned short)*polyCount, DT_ALLOC_PERM);
+	int* parent = (int*)dtAlloc(sizeof(int)*polyCount, DT_ALLOC_TEMP);
+	if (!gt.polyGroups || !parent)
+	{
+		dtFree(parent);
+		clearTile(gt);
+		return false;
+	}
+
+	// Union the polygons linked inside the tile, and count the portals.
+	for (int i = 0; i < polyCount; ++i)
+		parent[i] = i;
+	int portalCount = 0;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		for (unsigned int j = poly->firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
+		{
+			const dtPolyRef ref = tile->links[j].ref;
+			if (!ref)
+				continue;
+			if (m_nav->decodePolyIdTile(ref) != it)
+			{
+				portalCount++;
+				continue;
+			}
+			const int a = findRoot(parent, i);
+			const int b = findRoot(parent, (int)m_nav->decodePolyIdPoly(ref));
+			if (a != b)
+				parent[a] = b;
+		}
+	}
+	int groupCount = 0;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		if (findRoot(parent, i) == i)
+			gt.polyGroups[i] = (unsigned short)groupCount++;
+	}
+	for (int i = 0; i < polyCount; ++i)
+		gt.polyGroups[i] = gt.polyGroups[findRoot(parent, i)];
+	dtFree(parent);
+
+	gt.ref = m_nav->getTileRef(tile);
+	gt.polyCount = polyCount;
+	if (!portalCount)
+		return true;
+
+	// Collect the portals and group them into clusters.
+	dtTileGraphPortal* portals = (dtTileGraphPortal*)dtAlloc(sizeof(dtTileGraphPortal)*portalCount, DT_ALLOC_TEMP);
+	int* portalClusters = (int*)dtAlloc(sizeof(int)*portalCount, DT_ALLOC_TEMP);
+	dtTileGraphCluster* clusters = (dtTileGraphCluster*)dtAlloc(sizeof(dtTileGraphCluster)*portalCount, DT_ALLOC_TEMP);
+	if (!portals || !portalClusters || !clusters)
+	{
+		dtFree(portals);
+		dtFree(portalClusters);
+		dtFree(clusters);
+		clearTile(gt);
+		return false;
+	}
+
+	const dtPolyRef base = m_nav->getPolyRefBase(tile);
+	int clusterCount = 0;
+	int n = 0;
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		for (unsigned int j = poly->firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
+		{
+			const dtLink& link = tile->links[j];
+			if (!link.ref)
+				continue;
+			const unsigned int neiTile = m_nav->decodePolyIdTile(link.ref);
+			if (neiTile == it)
+				continue;
+
+			dtTileGraphPortal& p = portals[n];
+			p.poly = base | (dtPolyRef)i;
+			p.neiPoly = link.ref;
+			calcPortalPos(tile, poly, link, p.pos);
+
+			int c = 0;
+			while (c < clusterCount && (clusters[c].group != gt.polyGroups[i] || clusters[c].neiTile != neiTile))
+				c++;
+			if (c == clusterCount)
+			{
+				memset(&clusters[c], 0, sizeof(dtTileGraphCluster));
+				clusters[c].group = gt.polyGroups[i];
+				clusters[c].neiTile = neiTile;
+				clusterCount++;
+			}
+			dtVadd(clusters[c].pos, clusters[c].pos, p.pos);
+			clusters[c].portalCount++;
+			portalClusters[n++] = c;
+		}
+	}
+
+	gt.clusters = (dtTileGraphCluster*)dtAlloc(sizeof(dtTileGraphCluster)*clusterCount, DT_ALLOC_PERM);
+	gt.portals = (dtTileGraphPortal*)dtAlloc(sizeof(dtTileGraphPortal)*portalCount, DT_ALLOC_PERM);
+	gt.costs = (float*)dtAlloc(sizeof(float)*clusterCount*clusterCount, DT_ALLOC_PERM);
+	gt.nodes = (dtTileGraphNode*)dtAlloc(sizeof(dtTileGraphNode)*clusterCount, DT_ALLOC_PERM);
+	if (!gt.clusters || !gt.portals || !gt.costs || !gt.nodes)
+	{
+		dtFree(portals);
+		dtFree(portalClusters);
+		dtFree(clusters);
+		clearTile(gt);
+		return false;
+	}
+	memset(gt.nodes, 0, sizeof(dtTileGraphNode)*clusterCount);
+
+	// Store the portals ordered by cluster.
+	int first = 0;
+	for (int c = 0; c < clusterCount; ++c)
+	{
+		dtVscale(clusters[c].pos, clusters[c].pos, 1.0f / (float)clusters[c].portalCount);
+		clusters[c].firstPortal = first;
+		first += clusters[c].portalCount;
+		clusters[c].portalCount = 0;
+	}
+	for (int i = 0; i < portalCount; ++i)
+	{
+		dtTileGraphCluster& c = clusters[portalClusters[i]];
+		gt.portals[c.firstPortal + c.portalCount++] = portals[i];
+	}
+	memcpy(gt.clusters, clusters, sizeof(dtTileGraphCluster)*clusterCount);
+	gt.clusterCount = clusterCount;
+	gt.portalCount = portalCount;
+	dtFree(portals);
+	dtFree(portalClusters);
+	dtFree(clusters);
+
+	// Travel costs between the clusters.
+	if (!beginPolyCosts(tile, 0))
+	{
+		clearTile(gt);
+		return false;
+	}
+	for (int i = 0; i < clusterCount; ++i)
+	{
+		const dtTileGraphCluster& c = gt.clusters[i];
+		for (int j = 0; j < polyCount; ++j)
+			m_polyCosts[j] = FLT_MAX;
+		for (int j = 0; j < c.portalCount; ++j)
+		{
+			const dtTileGraphPortal& p = gt.portals[c.firstPortal + j];
+			const int poly = (int)m_nav->decodePolyIdPoly(p.poly);
+			seedPolyCost(poly, dtVdist(c.pos, p.pos) + dtVdist(p.pos, &m_polyCenters[poly*3]));
+		}
+		spreadPolyCosts(tile, it);
+		for (int j = 0; j < clusterCount; ++j)
+			gt.costs[i*clusterCount + j] = i == j ? 0.0f : getClusterCost(gt, j);
+	}
+
+	return true;
+}
+
+bool dtTileGraph::pushOpen(const float total, const unsigned int tile, const int cluster)
+{
+	if (m_openCount >= m_openCapacity)
+	{
+		const int capacity = m_openCapacity ? m_openCapacity*2 : 256;
+		dtTileGraphHeapItem* open = (dtTileGraphHeapItem*)dtAlloc(sizeof(dtTileGraphHeapItem)*capacity, DT_ALLOC_PERM);
+		if (!open)
+			return false;
+		if (m_openCount)
+			memcpy(open, m_open, sizeof(dtTileGraphHeapItem)*m_openCount);
+		dtFree(m_open);
+		m_open = open;
+		m_openCapacity = capacity;
+	}
+	dtTileGraphHeapItem item;
+	item.cost = total;
+	item.tile = tile;
+	item.index = cluster;
+	heapPush(m_open, m_openCount, item);
+	return true;
+}
+
+bool dtTileGraph::visitCluster(const unsigned int tile, const int cluster, const float cost,
+							   const unsigned int parentTile, const int parentCluster, const float* endPos)
+{
+	const dtTileGraphTile& gt = m_tiles[tile];
+	dtTileGraphNode& node = gt.nodes[cluster];
+	if (node.searchId == m_searchId && cost >= node.cost)
+		return true;
+	node.searchId = m_searchId;
+	node.cost = cost;
+	node.parentTile = parentTile;
+	node.parentCluster = parentCluster;
+	node.closed = 0;
+	return pushOpen(cost + dtVdist(gt.clusters[cluster].pos, endPos), tile, cluster);
+}
+
+/// @par
+///
+/// The cluster path is searched with A*. The travel costs of the clusters are distances
+/// and do not depend on the filter, the filter is only applied while refining the path with
+/// dtNavMeshQuery::findPathInTiles. The costs of reaching the end polygon from the clusters
+/// of its tile are approximated by the costs from the end polygon to the clusters.
+///
+/// The search falls back to dtNavMeshQuery::findPath when the start and end polygons are
+/// in the same tile, when the cluster search fails, or when the end polygon cannot be
+/// reached inside the tile corridor. In that case the result matches dtNavMeshQuery::findPath.
+///
+/// The graph holds the search state, so a graph must not be searched from multiple
+/// threads at the same time.
+dtStatus dtTileGraph::findPath(const dtNavMeshQuery* query, dtPolyRef startRef, dtPolyRef endRef,
+							   const float* startPos, const float* endPos,
+							   const dtQueryFilter* filter,
+							   dtPolyRef* path, int* pathCount, const int maxPath)
+{
+	if (!query || !m_nav || query->getAttachedNavMesh() != m_nav)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	m_corridorCount = 0;
+
+	// Leave input validation and short paths to the polygon search.
+	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef) ||
+		!startPos || !dtVisfinite(startPos) || !endPos || !dtVisfinite(endPos))
+	{
+		return query->findPath(startRef, endRef, startPos, endPos, filter, path, pathCount, maxPath);
+	}
+	const unsigned int startTile = m_nav->decodePolyIdTile(startRef);
+	const unsigned int endTile = m_nav->decodePolyIdTile(endRef);
+	if (startTile == endTile || !isCurrent(startTile) || !isCurrent(endTile) ||
+		!m_tiles[startTile].clusterCount || !m_tiles[endTile].clusterCount)
+	{
+		return query->findPath(startRef, endRef, startPos, endPos, filter, path, pathCount, maxPath);
+	}
+
+	if (++m_searchId == 0)
+	{
+		for (int i = 0; i < m_maxTiles; ++i)
+		{
+			for (int j = 0; j < m_tiles[i].clusterCount; ++j)
+				m_tiles[i].nodes[j].searchId = 0;
+		}
+		m_searchId = 1;
+	}
+	m_openCount = 0;
+
+	// Costs between the end polygon and the clusters of its tile.
+	const dtTileGraphTile& goal = m_tiles[endTile];
+	const dtMeshTile* tile = m_nav->getTile((int)endTile);
+	if (!beginPolyCosts(tile, goal.clusterCount))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	const int endPoly = (int)m_nav->decodePolyIdPoly(endRef);
+	seedPolyCost(endPoly, dtVdist(endPos, &m_polyCenters[endPoly*3]));
+	spreadPolyCosts(tile, endTile);
+	for (int i = 0; i < goal.clusterCount; ++i)
+		m_goalCosts[i] = getClusterCost(goal, i);
+
+	// Costs from the start polygon to the clusters of its tile.
+	const dtTileGraphTile& start = m_tiles[startTile];
+	tile = m_nav->getTile((int)startTile);
+	if (!beginPolyCosts(tile, goal.clusterCount))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	const int startPoly = (int)m_nav->decodePolyIdPoly(startRef);
+	seedPolyCost(startPoly, dtVdist(startPos, &m_polyCenters[startPoly*3]));
+	spreadPolyCosts(tile, startTile);
+	bool outOfMemory = false;
+	for (int i = 0; i < start.clusterCount; ++i)
+	{
+		const float cost = getClusterCost(start, i);
+		if (cost != FLT_MAX && !visitCluster(startTile, i, cost, startTile, -1, endPos))
+			outOfMemory = true;
+	}
+
+	// A* over the clusters.
+	float bestCost = FLT_MAX;
+	int bestCluster = -1;
+	while (m_openCount > 0 && !outOfMemory)
+	{
+		const dtTileGraphHeapItem top = heapPop(m_open, m_openCount);
+		if (top.cost >= bestCost)
+			break;
+		const dtTileGraphTile& gt = m_tiles[top.tile];
+		dtTileGraphNode& node = gt.nodes[top.index];
+		if (node.closed)
+			continue;
+		node.closed = 1;
+
+		if (top.tile == endTile && m_goalCosts[top.index] != FLT_MAX && node.cost + m_goalCosts[top.index] < bestCost)
+		{
+			bestCost = node.cost + m_goalCosts[top.index];
+			bestCluster = top.index;
+		}
+
+		// Move through the tile to its other clusters.
+		const float* costs = &gt.costs[top.index*gt.clusterCount];
+		for (int i = 0; i < gt.clusterCount; ++i)
+		{
+			if (i == top.index || costs[i] == FLT_MAX)
+				continue;
+			if (!visitCluster(top.tile, i, node.cost + costs[i], top.tile, top.index, endPos))
+				outOfMemory = true;
+		}
+
+		// Cross the portals to the clusters leading back in the neighbour tile.
+		const dtTileGraphCluster& c = gt.clusters[top.index];
+		if (!isCurrent(c.neiTile))
+			continue;
+		const dtTileGraphTile& nt = m_tiles[c.neiTile];
+		for (int i = 0; i < c.portalCount; ++i)
+		{
+			const unsigned int neiPoly = m_nav->decodePolyIdPoly(gt.portals[c.firstPortal + i].neiPoly);
+			if ((int)neiPoly >= nt.polyCount)
+				continue;
+			const unsigned short group = nt.polyGroups[neiPoly];
+			for (int j = 0; j < nt.clusterCount; ++j)
+			{
+				const dtTileGraphCluster& nc = nt.clusters[j];
+				if (nc.group != group || nc.neiTile != top.tile)
+					continue;
+				if (!visitCluster(c.neiTile, j, node.cost + dtVdist(c.pos, nc.pos), top.tile, top.index, endPos))
+					outOfMemory = true;
+				break;
+			}
+		}
+	}
+
+	if (bestCluster == -1)
+		return query->findPath(startRef, endRef, startPos, endPos, filter, path, pathCount, maxPath);
+
+	// Refine the path inside the tiles of the cluster path.
+	m_corridor[startTile] = 1;
+	m_corridorCount = 1;
+	unsigned int curTile = endTile;
+	int curCluster = bestCluster;
+	while (curCluster != -1)
+	{
+		if (!m_corridor[curTile])
+		{
+			m_corridor[curTile] = 1;
+			m_corridorCount++;
+		}
+		const dtTileGraphNode& node = m_tiles[curTile].nodes[curCluster];
+		curTile = node.parentTile;
+		curCluster = node.parentCluster;
+	}
+
+	dtStatus status = query->findPathInTiles(startRef, endRef, startPos, endPos, filter, m_corridor, path, pathCount, maxPath);
+
+	m_corridor[startTile] = 0;
+	curTile = endTile;
+	curCluster = bestCluster;
+	while (curCluster != -1)
+	{
+		m_corridor[curTile] = 0;
+		const dtTileGraphNode& node = m_tiles[curTile].nodes[curCluster];
+		curTile = node.parentTile;
+		curCluster = node.parentCluster;
+	}
+
+	if (dtStatusFailed(status) || dtStatusDetail(status, DT_PARTIAL_RESULT))
+	{
+		m_corridorCount = 0;
+		return query->findPath(startRef, endRef, startPos, endPos, filter, path, pathCount, maxPath);
+	}
+
+	return status;
+}
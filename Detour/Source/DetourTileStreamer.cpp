@@ -0,0 +1,359 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DetourTileStreamer.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+// Failed tiles are requested again after 2^(failures-1) updates, up to this many doublings.
+static const int MAX_RETRY_SHIFT = 6;
+
+struct dtStreamTileOrder
+{
+	float dist;
+	int index;
+};
+
+static int compareStreamTileOrder(const void* va, const void* vb)
+{
+	const dtStreamTileOrder* a = (const dtStreamTileOrder*)va;
+	const dtStreamTileOrder* b = (const dtStreamTileOrder*)vb;
+	if (a->dist != b->dist)
+		return a->dist < b->dist ? -1 : 1;
+	return a->index - b->index;
+}
+
+dtTileStreamer::dtTileStreamer() :
+	m_nav(0),
+	m_source(0),
+	m_tiles(0),
+	m_tileCount(0),
+	m_budget(0),
+	m_tileFlags(0),
+	m_frame(0),
+	m_residentBytes(0),
+	m_loadingBytes(0),
+	m_order(0),
+	m_adding(0),
+	m_requests(0),
+	m_requestHead(0),
+	m_requestCount(0),
+	m_loaded(0),
+	m_loadedCount(0),
+	m_inFlight(0),
+	m_stop(false)
+{
+}
+
+dtTileStreamer::~dtTileStreamer()
+{
+	shutdown();
+}
+
+/// @par
+///
+/// The tiles must not be in the navigation mesh, and their references must be free. Tiles without 
+/// a reference are added at the tile index that matches their index in @p tiles, so the mesh must 
+/// then have at least @p tileCount tiles.
+///
+/// Calling init again stops the worker and forgets the tiles of the previous init. Tiles that are
+/// resident stay in the navigation mesh.
+dtStatus dtTileStreamer::init(dtNavMesh* nav, dtTileStreamSource* source, const dtStreamTileInfo* tiles, const int tileCount,
+							  const int budget, const int tileFlags)
+{
+	shutdown();
+
+	if (!nav || !source || !tiles || tileCount <= 0 || budget <= 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	m_tiles = (Tile*)dtAlloc(sizeof(Tile)*tileCount, DT_ALLOC_PERM);
+	m_order = (dtStreamTileOrder*)dtAlloc(sizeof(dtStreamTileOrder)*tileCount, DT_ALLOC_PERM);
+	m_requests = (int*)dtAlloc(sizeof(int)*tileCount, DT_ALLOC_PERM);
+	m_loaded = (Loaded*)dtAlloc(sizeof(Loaded)*tileCount, DT_ALLOC_PERM);
+	m_adding = (Loaded*)dtAlloc(sizeof(Loaded)*tileCount, DT_ALLOC_PERM);
+	if (!m_tiles || !m_order || !m_requests || !m_loaded || !m_adding)
+	{
+		shutdown();
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	for (int i = 0; i < tileCount; ++i)
+	{
+		Tile& tile = m_tiles[i];
+		tile.info = tiles[i];
+		if (!tile.info.ref)
+		{
+			if (i >= nav->getMaxTiles())
+			{
+				shutdown();
+				return DT_FAILURE | DT_INVALID_PARAM;
+			}
+			tile.info.ref = (dtTileRef)nav->encodePolyId(1, (unsigned int)i, 0);
+		}
+		tile.lastWanted = 0;
+		tile.retryFrame = 0;
+		tile.residentSize = 0;
+		tile.failures = 0;
+		tile.state = DT_STREAM_TILE_UNLOADED;
+	}
+
+	m_nav = nav;
+	m_source = source;
+	m_tileCount = tileCount;
+	m_budget = budget;
+	m_tileFlags = tileFlags;
+	m_frame = 0;
+	m_residentBytes = 0;
+	m_loadingBytes = 0;
+	m_stop = false;
+	m_worker = std::thread(workerMain, this);
+
+	return DT_SUCCESS;
+}
+
+void dtTileStreamer::shutdown()
+{
+	if (m_worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_workCond.notify_all();
+		m_worker.join();
+	}
+
+	// Loaded tiles that were never added are still owned by the streamer.
+	for (int i = 0; i < m_loadedCount; ++i)
+		dtFree(m_loaded[i].data);
+
+	dtFree(m_tiles);
+	dtFree(m_order);
+	dtFree(m_requests);
+	dtFree(m_loaded);
+	dtFree(m_adding);
+	m_tiles = 0;
+	m_order = 0;
+	m_requests = 0;
+	m_loaded = 0;
+	m_adding = 0;
+	m_tileCount = 0;
+	m_requestHead = 0;
+	m_requestCount = 0;
+	m_loadedCount = 0;
+	m_inFlight = 0;
+	m_residentBytes = 0;
+	m_loadingBytes = 0;
+	m_nav = 0;
+	m_source = 0;
+}
+
+void dtTileStreamer::workerMain(dtTileStreamer* streamer)
+{
+	std::unique_lock<std::mutex> lock(streamer->m_mutex);
+	for (;;)
+	{
+		while (!streamer->m_stop && streamer->m_requestCount == 0)
+			streamer->m_workCond.wait(lock);
+		if (streamer->m_stop)
+			return;
+
+		const int index = streamer->m_requests[streamer->m_requestHead];
+		streamer->m_requestHead = (streamer->m_requestHead + 1) % streamer->m_tileCount;
+		streamer->m_requestCount--;
+
+		// Read without holding the lock, so that the main thread never waits for the source.
+		lock.unlock();
+		unsigned char* data = 0;
+		int dataSize = 0;
+		if (!streamer->m_source->readTile(index, &data, &dataSize))
+		{
+			dtFree(data);
+			data = 0;
+			dataSize = 0;
+		}
+		lock.lock();
+
+		Loaded& loaded = streamer->m_loaded[streamer->m_loadedCount++];
+		loaded.index = index;
+		loaded.data = data;
+		loaded.dataSize = dataSize;
+		streamer->m_inFlight--;
+		streamer->m_doneCond.notify_all();
+	}
+}
+
+void dtTileStreamer::addLoadedTiles()
+{
+	// Take the loaded tiles, so that the worker can go on while they are added.
+	int count = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		memcpy(m_adding, m_loaded, sizeof(Loaded)*m_loadedCount);
+		count = m_loadedCount;
+		m_loadedCount = 0;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		const Loaded& loaded = m_adding[i];
+		Tile& tile = m_tiles[loaded.index];
+		// Release the reservation the tile was requested with.
+		m_loadingBytes -= tile.info.dataSize;
+
+		dtStatus status = DT_FAILURE;
+		if (loaded.data)
+		{
+			status = m_nav->addTile(loaded.data, loaded.dataSize, DT_TILE_FREE_DATA | m_tileFlags, tile.info.ref, 0);
+			if (dtStatusFailed(status))
+				dtFree(loaded.data);
+		}
+		if (dtStatusFailed(status))
+		{
+			// Back off before requesting the tile again, the read error may be transient.
+			tile.state = DT_STREAM_TILE_FAILED;
+			tile.failures = (unsigned char)dtMin((int)tile.failures + 1, MAX_RETRY_SHIFT + 1);
+			tile.retryFrame = m_frame + (1u << (tile.failures - 1));
+			continue;
+		}
+
+		// Reserve the size that was read from now on, and charge the same size while resident.
+		tile.info.dataSize = loaded.dataSize;
+		tile.state = DT_STREAM_TILE_RESIDENT;
+		tile.failures = 0;
+		tile.residentSize = loaded.dataSize;
+		m_residentBytes += loaded.dataSize;
+	}
+
+	// A tile that turned out larger than expected can leave the budget exceeded.
+	while (m_residentBytes + m_loadingBytes > m_budget && evictTile()) {}
+}
+
+// Removes the resident tile that has gone the longest without being requested.
+bool dtTileStreamer::evictTile()
+{
+	int oldest = -1;
+	for (int i = 0; i < m_tileCount; ++i)
+	{
+		const Tile& tile = m_tiles[i];
+		if (tile.state != DT_STREAM_TILE_RESIDENT || tile.lastWanted == m_frame)
+			continue;
+		if (oldest == -1 || tile.lastWanted < m_tiles[oldest].lastWanted)
+			oldest = i;
+	}
+	if (oldest == -1)
+		return false;
+
+	Tile& tile = m_tiles[oldest];
+	m_nav->removeTile(tile.info.ref, 0, 0);
+	m_residentBytes -= tile.residentSize;
+	tile.residentSize = 0;
+	tile.state = DT_STREAM_TILE_UNLOADED;
+	return true;
+}
+
+/// @par
+///
+/// Tiles are requested nearest first. A tile that does not fit the budget once all the tiles
+/// that are not near a position have been removed is requested again on a later update.
+///
+/// A tile that could not be read or added is requested again once it is near a position after
+/// 1, 2, 4 and so on updates, up to 64. A tile whose size exceeds the whole budget is not
+/// requested again.
+void dtTileStreamer::update(const float* positions, const int positionCount, const float radius)
+{
+	if (!m_nav)
+		return;
+
+	addLoadedTiles();
+	m_frame++;
+
+	const dtNavMeshParams* params = m_nav->getParams();
+	const float tileWidth = params->tileWidth;
+	const float tileHeight = params->tileHeight;
+
+	// Find the tiles near the positions. The tile grid grows along -x.
+	int orderCount = 0;
+	for (int i = 0; i < m_tileCount; ++i)
+	{
+		Tile& tile = m_tiles[i];
+		const float bmin[2] = { params->orig[0] - (tile.info.x+1)*tileWidth, params->orig[1] + tile.info.y*tileHeight };
+		const float bmax[2] = { bmin[0] + tileWidth, bmin[1] + tileHeight };
+		float dist = FLT_MAX;
+		for (int j = 0; j < positionCount; ++j)
+		{
+			const float* p = &positions[j*3];
+			const float dx = dtMax(dtMax(bmin[0] - p[0], p[0] - bmax[0]), 0.0f);
+			const float dy = dtMax(dtMax(bmin[1] - p[1], p[1] - bmax[1]), 0.0f);
+			dist = dtMin(dist, dtSqr(dx) + dtSqr(dy));
+		}
+		if (dist > dtSqr(radius))
+			continue;
+		tile.lastWanted = m_frame;
+		if (tile.state == DT_STREAM_TILE_FAILED && tile.info.dataSize <= m_budget && m_frame >= tile.retryFrame)
+			tile.state = DT_STREAM_TILE_UNLOADED;
+		if (tile.state == DT_STREAM_TILE_UNLOADED)
+		{
+			m_order[orderCount].dist = dist;
+			m_order[orderCount].index = i;
+			orderCount++;
+		}
+	}
+	qsort(m_order, orderCount, sizeof(dtStreamTileOrder), compareStreamTileOrder);
+
+	for (int i = 0; i < orderCount; ++i)
+	{
+		Tile& tile = m_tiles[m_order[i].index];
+		if (tile.info.dataSize > m_budget)
+		{
+			tile.state = DT_STREAM_TILE_FAILED;
+			continue;
+		}
+		bool fits = true;
+		while (fits && m_residentBytes + m_loadingBytes + tile.info.dataSize > m_budget)
+			fits = evictTile();
+		if (!fits)
+			break;
+
+		m_loadingBytes += tile.info.dataSize;
+		tile.state = DT_STREAM_TILE_LOADING;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_requests[(m_requestHead + m_requestCount) % m_tileCount] = m_order[i].index;
+			m_requestCount++;
+			m_inFlight++;
+		}
+		m_workCond.notify_one();
+	}
+}
+
+void dtTileStreamer::flush()
+{
+	if (!m_nav)
+		return;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (m_inFlight > 0)
+			m_doneCond.wait(lock);
+	}
+	addLoadedTiles();
+}
@@ -31,6 +31,10 @@ class dtPathCorridor
 	dtPolyRef* m_path;
 	int m_npath;
 	int m_maxPath;
+
+	float* m_portals;				///< The left and right point of the portal after each path polygon. [(x, y, z) * 2 * m_maxPath]
+	dtPolyRef* m_portalRefs;		///< The polygon pair each portal was fetched for, zero if none. [(from, to) * m_maxPath]
+	unsigned char* m_portalTypes;	///< The type of the polygon each portal leads to. [Size: m_maxPath]
 	
 public:
 	dtPathCorridor();
@@ -137,6 +141,11 @@ private:
 	// Explicitly disabled copy constructor and copy assignment operator.
 	dtPathCorridor(const dtPathCorridor&);
 	dtPathCorridor& operator=(const dtPathCorridor&);
+
+	const float* getPortal(const int i, const dtNavMeshQuery* navquery, unsigned char& toType);
+	void shiftPortals(const int oldPath, const int newPath);
+	int findStraightCorners(float* cornerVerts, unsigned char* cornerFlags, dtPolyRef* cornerPolys,
+							const int maxCorners, const dtNavMeshQuery* navquery);
 };
 
 int dtMergeCorridorStartMoved(dtPolyRef* path, const int npath, const int maxPath,
@@ -200,13 +200,19 @@ may be needed.  E.g. If you move the target, check #getLastPoly() to see if it i
 dtPathCorridor::dtPathCorridor() :
 	m_path(0),
 	m_npath(0),
-	m_maxPath(0)
+	m_maxPath(0),
+	m_portals(0),
+	m_portalRefs(0),
+	m_portalTypes(0)
 {
 }
 
 dtPathCorridor::~dtPathCorridor()
 {
 	dtFree(m_path);
+	dtFree(m_portals);
+	dtFree(m_portalRefs);
+	dtFree(m_portalTypes);
 }
 
 /// @par
@@ -218,6 +224,16 @@ bool dtPathCorridor::init(const int maxPath)
 	m_path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*maxPath, DT_ALLOC_PERM);
 	if (!m_path)
 		return false;
+	m_portals = (float*)dtAlloc(sizeof(float)*6*maxPath, DT_ALLOC_PERM);
+	if (!m_portals)
+		return false;
+	m_portalRefs = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*2*maxPath, DT_ALLOC_PERM);
+	if (!m_portalRefs)
+		return false;
+	memset(m_portalRefs, 0, sizeof(dtPolyRef)*2*maxPath);
+	m_portalTypes = (unsigned char*)dtAlloc(sizeof(unsigned char)*maxPath, DT_ALLOC_PERM);
+	if (!m_portalTypes)
+		return false;
 	m_npath = 0;
 	m_maxPath = maxPath;
 	return true;
@@ -247,6 +263,10 @@ For example: If the buffers are sized to hold 10 corners, the function will neve
 So if 10 corners are needed, the buffers should be sized for 11 corners.
 
 If the target is within range, it will be the last corner and have a polygon reference id of zero.
+
+The portal edges between the corridor polygons are cached, and survive the path changes done by the 
+corridor itself. Only the portals of new polygon pairs are fetched from the navigation mesh, so following 
+an unchanged corridor runs the funnel algorithm over cached points only.
 */
 int dtPathCorridor::findCorners(float* cornerVerts, unsigned char* cornerFlags,
 							  dtPolyRef* cornerPolys, const int maxCorners,
@@ -257,9 +277,7 @@ int dtPathCorridor::findCorners(float* cornerVerts, unsigned char* cornerFlags,
 	
 	static const float MIN_TARGET_DIST = 0.01f;
 	
-	int ncorners = 0;
-	navquery->findStraightPath(m_pos, m_target, m_path, m_npath,
-							   cornerVerts, cornerFlags, cornerPolys, &ncorners, maxCorners);
+	int ncorners = findStraightCorners(cornerVerts, cornerFlags, cornerPolys, maxCorners, navquery);
 	
 	// Prune points in the beginning of the path which are too close.
 	while (ncorners)
@@ -289,6 +307,224 @@ int dtPathCorridor::findCorners(float* cornerVerts, unsigned char* cornerFlags,
 	return ncorners;
 }
 
+// Returns the cached portal between path[i] and path[i+1] as left and right point, fetching it
+// on a miss. Returns null if the polygons are not linked.
+const float* dtPathCorridor::getPortal(const int i, const dtNavMeshQuery* navquery, unsigned char& toType)
+{
+	const dtPolyRef from = m_path[i];
+	const dtPolyRef to = m_path[i+1];
+	dtPolyRef* refs = &m_portalRefs[i*2];
+	float* portal = &m_portals[i*6];
+
+	if (refs[0] == from && refs[1] == to)
+	{
+		// The portal only depends on the polygon pair as long as both polygons are valid.
+		// The funnel visits the path in order and starts from a valid polygon, so only
+		// a move to another tile needs to be checked.
+		const dtNavMesh* nav = navquery->getAttachedNavMesh();
+		if (from - nav->decodePolyIdPoly(from) == to - nav->decodePolyIdPoly(to) || nav->isValidPolyRef(to))
+		{
+			toType = m_portalTypes[i];
+			return portal;
+		}
+	}
+
+	unsigned char fromType;
+	if (dtStatusFailed(navquery->getPortalPoints(from, to, portal, portal+3, fromType, toType)))
+	{
+		refs[0] = refs[1] = 0;
+		return 0;
+	}
+	refs[0] = from;
+	refs[1] = to;
+	m_portalTypes[i] = toType;
+	return portal;
+}
+
+// Moves the cached portals along with the path, after the polygons at the start of the path
+// were replaced and the rest of the path moved from oldPath to newPath polygons.
+void dtPathCorridor::shiftPortals(const int oldPath, const int newPath)
+{
+	const int shift = newPath - oldPath;
+	if (!shift)
+		return;
+	const int src = dtMax(0, -shift);
+	const int dst = dtMax(0, shift);
+	const int count = dtMin(oldPath-1 - src, m_maxPath-1 - dst);
+	if (count <= 0)
+		return;
+	memmove(&m_portals[dst*6], &m_portals[src*6], sizeof(float)*6*count);
+	memmove(&m_portalRefs[dst*2], &m_portalRefs[src*2], sizeof(dtPolyRef)*2*count);
+	memmove(&m_portalTypes[dst], &m_portalTypes[src], sizeof(unsigned char)*count);
+}
+
+static bool appendCorner(const float* pos, const unsigned char flags, const dtPolyRef ref,
+						 float* cornerVerts, unsigned char* cornerFlags, dtPolyRef* cornerPolys,
+						 int& ncorners, const int maxCorners)
+{
+	if (ncorners > 0 && dtVequal(&cornerVerts[(ncorners-1)*3], pos))
+	{
+		// The vertices are equal, update flags and poly.
+		cornerFlags[ncorners-1] = flags;
+		cornerPolys[ncorners-1] = ref;
+		return false;
+	}
+	dtVcopy(&cornerVerts[ncorners*3], pos);
+	cornerFlags[ncorners] = flags;
+	cornerPolys[ncorners] = ref;
+	ncorners++;
+	return ncorners >= maxCorners || flags == DT_STRAIGHTPATH_END;
+}
+
+// Same as dtNavMeshQuery::findStraightPath() without options, over the cached portals.
+int dtPathCorridor::findStraightCorners(float* cornerVerts, unsigned char* cornerFlags, dtPolyRef* cornerPolys,
+										const int maxCorners, const dtNavMeshQuery* navquery)
+{
+	int ncorners = 0;
+	if (maxCorners <= 0 || !m_path[0] || !dtVisfinite(m_pos) || !dtVisfinite(m_target))
+		return 0;
+
+	float closestStartPos[3];
+	if (dtStatusFailed(navquery->closestPointOnPolyBoundary(m_path[0], m_pos, closestStartPos)))
+		return 0;
+
+	float closestEndPos[3];
+	if (dtStatusFailed(navquery->closestPointOnPolyBoundary(m_path[m_npath-1], m_target, closestEndPos)))
+		return 0;
+
+	if (appendCorner(closestStartPos, DT_STRAIGHTPATH_START, m_path[0],
+					 cornerVerts, cornerFlags, cornerPolys, ncorners, maxCorners))
+		return ncorners;
+
+	if (m_npath > 1)
+	{
+		float portalApex[3], portalLeft[3], portalRight[3];
+		dtVcopy(portalApex, closestStartPos);
+		dtVcopy(portalLeft, portalApex);
+		dtVcopy(portalRight, portalApex);
+		int apexIndex = 0;
+		int leftIndex = 0;
+		int rightIndex = 0;
+
+		unsigned char leftPolyType = 0;
+		unsigned char rightPolyType = 0;
+
+		dtPolyRef leftPolyRef = m_path[0];
+		dtPolyRef rightPolyRef = m_path[0];
+
+		for (int i = 0; i < m_npath; ++i)
+		{
+			const float* left;
+			const float* right;
+			unsigned char toType;
+
+			if (i+1 < m_npath)
+			{
+				const float* portal = getPortal(i, navquery, toType);
+				if (!portal)
+				{
+					// Clamp the end point to path[i], and return the path so far.
+					if (dtStatusSucceed(navquery->closestPointOnPolyBoundary(m_path[i], m_target, closestEndPos)))
+						appendCorner(closestEndPos, 0, m_path[i], cornerVerts, cornerFlags, cornerPolys, ncorners, maxCorners);
+					return ncorners;
+				}
+				left = portal;
+				right = portal+3;
+
+				// If starting really close the portal, advance.
+				if (i == 0)
+				{
+					float t;
+					if (dtDistancePtSegSqr2D(portalApex, left, right, t) < dtSqr(0.001f))
+						continue;
+				}
+			}
+			else
+			{
+				// End of the path.
+				left = closestEndPos;
+				right = closestEndPos;
+				toType = DT_POLYTYPE_GROUND;
+			}
+
+			// Right vertex.
+			if (dtTriArea2D(portalApex, portalRight, right) <= 0.0f)
+			{
+				if (dtVequal(portalApex, portalRight) || dtTriArea2D(portalApex, portalLeft, right) > 0.0f)
+				{
+					dtVcopy(portalRight, right);
+					rightPolyRef = (i+1 < m_npath) ? m_path[i+1] : 0;
+					rightPolyType = toType;
+					rightIndex = i;
+				}
+				else
+				{
+					dtVcopy(portalApex, portalLeft);
+					apexIndex = leftIndex;
+
+					unsigned char flags = 0;
+					if (!leftPolyRef)
+						flags = DT_STRAIGHTPATH_END;
+					else if (leftPolyType == DT_POLYTYPE_OFFMESH_CONNECTION)
+						flags = DT_STRAIGHTPATH_OFFMESH_CONNECTION;
+
+					if (appendCorner(portalApex, flags, leftPolyRef,
+									 cornerVerts, cornerFlags, cornerPolys, ncorners, maxCorners))
+						return ncorners;
+
+					dtVcopy(portalLeft, portalApex);
+					dtVcopy(portalRight, portalApex);
+					leftIndex = apexIndex;
+					rightIndex = apexIndex;
+
+					// Restart
+					i = apexIndex;
+					continue;
+				}
+			}
+
+			// Left vertex.
+			if (dtTriArea2D(portalApex, portalLeft, left) >= 0.0f)
+			{
+				if (dtVequal(portalApex, portalLeft) || dtTriArea2D(portalApex, portalRight, left) < 0.0f)
+				{
+					dtVcopy(portalLeft, left);
+					leftPolyRef = (i+1 < m_npath) ? m_path[i+1] : 0;
+					leftPolyType = toType;
+					leftIndex = i;
+				}
+				else
+				{
+					dtVcopy(portalApex, portalRight);
+					apexIndex = rightIndex;
+
+					unsigned char flags = 0;
+					if (!rightPolyRef)
+						flags = DT_STRAIGHTPATH_END;
+					else if (rightPolyType == DT_POLYTYPE_OFFMESH_CONNECTION)
+						flags = DT_STRAIGHTPATH_OFFMESH_CONNECTION;
+
+					if (appendCorner(portalApex, flags, rightPolyRef,
+									 cornerVerts, cornerFlags, cornerPolys, ncorners, maxCorners))
+						return ncorners;
+
+					dtVcopy(portalLeft, portalApex);
+					dtVcopy(portalRight, portalApex);
+					leftIndex = apexIndex;
+					rightIndex = apexIndex;
+
+					// Restart
+					i = apexIndex;
+					continue;
+				}
+			}
+		}
+	}
+
+	appendCorner(closestEndPos, DT_STRAIGHTPATH_END, 0, cornerVerts, cornerFlags, cornerPolys, ncorners, maxCorners);
+	return ncorners;
+}
+
 /** 
 @par
 
@@ -336,7 +572,9 @@ void dtPathCorridor::optimizePathVisibility(const float* next, const float pathO
 	navquery->raycast(m_path[0], m_pos, goal, filter, &t, norm, res, &nres, MAX_RES);
 	if (nres > 1 && t > 0.99f)
 	{
+		const int npath = m_npath;
 		m_npath = dtMergeCorridorStartShortcut(m_path, m_npath, m_maxPath, res, nres);
+		shiftPortals(npath, m_npath);
 	}
 }
 
@@ -370,7 +608,9 @@ bool dtPathCorridor::optimizePathTopology(dtNavMeshQuery* navquery, const dtQuer
 	
 	if (dtStatusSucceed(status) && nres > 0)
 	{
+		const int npath = m_npath;
 		m_npath = dtMergeCorridorStartShortcut(m_path, m_npath, m_maxPath, res, nres);
+		shiftPortals(npath, m_npath);
 		return true;
 	}
 	
@@ -403,6 +643,7 @@ bool dtPathCorridor::moveOverOffmeshConnection(dtPolyRef offMeshConRef, dtPolyRe
 	// Prune path
 	for (int i = npos; i < m_npath; ++i)
 		m_path[i-npos] = m_path[i];
+	shiftPortals(m_npath, m_npath - npos);
 	m_npath -= npos;
 
 	refs[0] = prevRef;
@@ -449,7 +690,9 @@ bool dtPathCorridor::movePosition(const float* npos, dtNavMeshQuery* navquery, c
 	dtStatus status = navquery->moveAlongSurface(m_path[0], m_pos, npos, filter,
 												 result, visited, &nvisited, MAX_VISITED);
 	if (dtStatusSucceed(status)) {
+		const int npath = m_npath;
 		m_npath = dtMergeCorridorStartMoved(m_path, m_npath, m_maxPath, visited, nvisited);
+		shiftPortals(npath, m_npath);
 		
 		// Adjust the position to stay on top of the navmesh.
 		float h = m_pos[2];
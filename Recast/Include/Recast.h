@@ -95,6 +95,103 @@ enum rcTimerLabel
 	RC_MAX_TIMERS
 };
 
+/// Recast build telemetry counters.
+/// @see rcContext::addCount, rcBuildTelemetry
+enum rcTelemetryCounter
+{
+	/// The number of spans in the source heightfield. (See: #rcBuildCompactHeightfield)
+	RC_COUNTER_SPANS,
+	/// The number of spans in the compact heightfield. (See: #rcBuildCompactHeightfield)
+	RC_COUNTER_COMPACT_SPANS,
+	/// The number of regions. (See: #rcBuildRegions, #rcBuildRegionsMonotone, #rcBuildLayerRegions)
+	RC_COUNTER_REGIONS,
+	/// The number of heightfield layers. (See: #rcBuildHeightfieldLayers)
+	RC_COUNTER_LAYERS,
+	/// The number of contours. (See: #rcBuildContours)
+	RC_COUNTER_CONTOURS,
+	/// The number of simplified contour vertices. (See: #rcBuildContours)
+	RC_COUNTER_CONTOUR_VERTS,
+	/// The number of polygons. (See: #rcBuildPolyMesh, #rcMergePolyMeshes)
+	RC_COUNTER_POLYS,
+	/// The number of polygon mesh vertices. (See: #rcBuildPolyMesh, #rcMergePolyMeshes)
+	RC_COUNTER_POLY_VERTS,
+	/// The number of detail mesh vertices. (See: #rcBuildPolyMeshDetail, #rcMergePolyMeshDetails)
+	RC_COUNTER_DETAIL_VERTS,
+	/// The number of detail mesh triangles. (See: #rcBuildPolyMeshDetail, #rcMergePolyMeshDetails)
+	RC_COUNTER_DETAIL_TRIS,
+	/// The maximum number of counters.  (Used for iterating counters.)
+	RC_MAX_COUNTERS
+};
+
+class rcBuildTelemetry;
+
+/// A function executed by #rcTaskScheduler::parallelFor for a range of items.
+///  @param[in]		userData	The user data passed to the scheduler.
+///  @param[in]		begin		The first item of the range.
+///  @param[in]		end			One past the last item of the range.
+typedef void (rcParallelForFunc)(void* userData, const int begin, const int end);
+
+/// Adapts a function object with an <tt>operator()(int begin, int end)</tt> to #rcParallelForFunc.
+/// The user data must point to the function object.
+template<class Body> void rcParallelForBody(void* userData, const int begin, const int end)
+{
+	(*(Body*)userData)(begin, end);
+}
+
+/// A function executed as a task by #rcTaskGroup::run.
+///  @param[in]		userData	The user data passed to the task group.
+typedef void (rcTaskFunc)(void* userData);
+
+/// A set of tasks that can be waited on together.
+/// @see rcTaskScheduler::createTaskGroup
+class rcTaskGroup
+{
+public:
+	virtual ~rcTaskGroup() {}
+
+	/// Schedules a task to run asynchronously as part of the group.
+	///  @param[in]		func		The task function.
+	///  @param[in]		userData	The user data passed to the task function.
+	virtual void run(rcTaskFunc* func, void* userData) = 0;
+
+	/// Blocks until all tasks of the group have completed.
+	/// The calling thread may execute pending tasks while waiting.
+	virtual void wait() = 0;
+};
+
+/// Provides the threads the Recast build functions use to parallelize their work.
+///
+/// Assign an implementation to the build context with rcContext::setTaskScheduler. 
+/// #rcThreadPool (RecastThreadPool.h) is the default implementation, an engine can route 
+/// the work to its own job system by implementing this interface instead.
+///
+/// The functions may be called from tasks that are already running on the scheduler.
+/// @see rcContext::setTaskScheduler
+class rcTaskScheduler
+{
+public:
+	virtual ~rcTaskScheduler() {}
+
+	/// Returns the number of threads that may execute work concurrently, including the caller.
+	virtual int getThreadCount() const = 0;
+
+	/// Runs @p func over the items [0, @p count) and blocks until all items are processed.
+	/// The items are passed in ranges of at most @p grain items, in no particular order.
+	///  @param[in]		count		The number of items.
+	///  @param[in]		grain		The maximum number of items per range. [Limit: > 0]
+	///  @param[in]		func		The function to run for each range.
+	///  @param[in]		userData	The user data passed to the function.
+	virtual void parallelFor(const int count, const int grain, rcParallelForFunc* func, void* userData) = 0;
+
+	/// Creates a task group.
+	///  @return The task group, or null on failure.
+	virtual rcTaskGroup* createTaskGroup() = 0;
+
+	/// Destroys a task group created with #createTaskGroup. Waits for its tasks to complete.
+	///  @param[in]		group	The task group to destroy.
+	virtual void destroyTaskGroup(rcTaskGroup* group) = 0;
+};
+
 /// Provides an interface for optional logging and performance tracking of the Recast 
 /// build process.
 /// @ingroup recast
@@ -104,7 +201,7 @@ public:
 
 	/// Contructor.
 	///  @param[in]		state	TRUE if the logging and performance timers should be enabled.  [Default: true]
-	inline rcContext(bool state = true) : m_logEnabled(state), m_timerEnabled(state) {}
+	inline rcContext(bool state = true) : m_logEnabled(state), m_timerEnabled(state), m_telemetry(0), m_tileX(0), m_tileY(0), m_tileLayer(0), m_scheduler(0) {}
 	virtual ~rcContext() {}
 
 	/// Enables or disables logging.
@@ -128,17 +225,61 @@ public:
 
 	/// Starts the specified performance timer.
 	///  @param	label	The category of the timer.
-	inline void startTimer(const rcTimerLabel label) { if (m_timerEnabled) doStartTimer(label); }
+	inline void startTimer(const rcTimerLabel label) { if (m_timerEnabled) doStartTimer(label); if (m_telemetry) beginTelemetrySample(label); }
 
 	/// Stops the specified performance timer.
 	///  @param	label	The category of the timer.
-	inline void stopTimer(const rcTimerLabel label) { if (m_timerEnabled) doStopTimer(label); }
+	inline void stopTimer(const rcTimerLabel label) { if (m_timerEnabled) doStopTimer(label); if (m_telemetry) endTelemetrySample(label); }
 
 	/// Returns the total accumulated time of the specified performance timer.
 	///  @param	label	The category of the timer.
 	///  @return The accumulated time of the timer, or -1 if timers are disabled or the timer has never been started.
 	inline int getAccumulatedTime(const rcTimerLabel label) const { return m_timerEnabled ? doGetAccumulatedTime(label) : -1; }
 
+	/// Sets the telemetry that records a sample for every started timer, or null to disable telemetry.
+	/// Telemetry is recorded regardless of whether the timers are enabled.
+	///  @param[in]		telemetry	The telemetry to record into. (May be shared between contexts.)
+	inline void setTelemetry(rcBuildTelemetry* telemetry) { m_telemetry = telemetry; }
+
+	/// Returns the telemetry assigned to the context, or null if there is none.
+	inline rcBuildTelemetry* getTelemetry() const { return m_telemetry; }
+
+	/// Sets the tile that subsequent telemetry samples are recorded for.
+	///  @param[in]		tx		The x-coordinate of the tile.
+	///  @param[in]		ty		The y-coordinate of the tile.
+	///  @param[in]		layer	The layer of the tile.
+	inline void setTelemetryTile(const int tx, const int ty, const int layer = 0) { m_tileX = tx; m_tileY = ty; m_tileLayer = layer; }
+
+	/// Adds to the specified build counter of the innermost open telemetry sample.
+	///  @param[in]		counter		The counter to add to.
+	///  @param[in]		value		The value to add.
+	inline void addCount(const rcTelemetryCounter counter, const int value) { if (m_telemetry) addTelemetryCount(counter, value); }
+
+	/// Sets the task scheduler the build functions use to run work in parallel, or null to 
+	/// build on the calling thread only. The build results do not depend on the scheduler.
+	/// The Recast allocator must be thread-safe when a scheduler is set.
+	///  @param[in]		scheduler	The task scheduler to use.
+	inline void setTaskScheduler(rcTaskScheduler* scheduler) { m_scheduler = scheduler; }
+
+	/// Returns the task scheduler assigned to the context, or null if there is none.
+	inline rcTaskScheduler* getTaskScheduler() const { return m_scheduler; }
+
+	/// Runs @p func over the items [0, @p count) on the task scheduler, or on the calling 
+	/// thread if the context has no scheduler.
+	///  @param[in]		count		The number of items.
+	///  @param[in]		grain		The maximum number of items per range. [Limit: > 0]
+	///  @param[in]		func		The function to run for each range.
+	///  @param[in]		userData	The user data passed to the function.
+	inline void parallelFor(const int count, const int grain, rcParallelForFunc* func, void* userData)
+	{
+		if (m_scheduler && count > grain && m_telemetry)
+			telemetryParallelFor(count, grain, func, userData);
+		else if (m_scheduler && count > grain)
+			m_scheduler->parallelFor(count, grain, func, userData);
+		else if (count > 0)
+			func(userData, 0, count);
+	}
+
 protected:
 
 	/// Clears all log entries.
@@ -171,6 +312,21 @@ protected:
 
 	/// True if the performance timers are enabled.
 	bool m_timerEnabled;
+
+	/// The telemetry to record samples into, or null if disabled.
+	rcBuildTelemetry* m_telemetry;
+
+	/// The tile that telemetry samples are recorded for.
+	int m_tileX, m_tileY, m_tileLayer;
+
+	/// The task scheduler used to run work in parallel, or null if disabled.
+	rcTaskScheduler* m_scheduler;
+
+private:
+	void beginTelemetrySample(const rcTimerLabel label);
+	void endTelemetrySample(const rcTimerLabel label);
+	void addTelemetryCount(const rcTelemetryCounter counter, const int value);
+	void telemetryParallelFor(const int count, const int grain, rcParallelForFunc* func, void* userData);
 };
 
 /// A helper to first start a timer and then stop it when this helper goes out of scope.
@@ -328,7 +484,20 @@ struct rcCompactSpan
 	unsigned int h : 8;			///< The height of the span.  (Measured from #y.)
 };
 
+/// The memory layout of the span data of a compact heightfield.
+/// @see rcCompactHeightfield, rcSetCompactHeightfieldLayout
+enum rcCompactSpanLayout
+{
+	/// The spans are stored as records in rcCompactHeightfield::spans.
+	RC_COMPACT_SPANS_AOS = 0,
+	/// Each span field is stored in its own array. (rcCompactHeightfield::spanZ, etc.)
+	RC_COMPACT_SPANS_SOA = 1,
+};
+
 /// A compact, static heightfield representing unobstructed space.
+/// 
+/// The span data is either stored in #spans, or in the #spanZ, #spanH, #spanReg and #spanCon arrays, 
+/// depending on the #layout. The other arrays are null. (See: RecastCompactSpans.h)
 /// @ingroup recast
 struct rcCompactHeightfield
 {
@@ -350,6 +519,11 @@ struct rcCompactHeightfield
 	rcCompactSpan* spans;		///< Array of spans. [Size: #spanCount]
 	unsigned short* dist;		///< Array containing border distance data. [Size: #spanCount]
 	unsigned char* areas;		///< Array containing area id data. [Size: #spanCount]
+	int layout;					///< The layout of the span data. (See: #rcCompactSpanLayout)
+	unsigned short* spanZ;		///< The lower extent of each span, if #layout is #RC_COMPACT_SPANS_SOA. [Size: #spanCount]
+	unsigned char* spanH;		///< The height of each span, if #layout is #RC_COMPACT_SPANS_SOA. [Size: #spanCount]
+	unsigned short* spanReg;	///< The region id of each span, if #layout is #RC_COMPACT_SPANS_SOA. [Size: #spanCount]
+	unsigned int* spanCon;		///< The packed neighbor connection data of each span, if #layout is #RC_COMPACT_SPANS_SOA. [Size: #spanCount]
 };
 
 /// Represents a heightfield layer within a layer set.
@@ -954,6 +1128,14 @@ int rcGetHeightFieldSpanCount(rcContext* ctx, rcHeightfield& hf);
 bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const int walkableClimb,
 							   rcHeightfield& hf, rcCompactHeightfield& chf);
 
+/// Converts the span data of a compact heightfield to the specified layout.
+///  @ingroup recast
+///  @param[in,out]	ctx		The build context to use during the operation.
+///  @param[in,out]	chf		A populated compact heightfield.
+///  @param[in]		layout	The new layout of the span data. (See: #rcCompactSpanLayout)
+///  @returns True if the operation completed successfully.
+bool rcSetCompactHeightfieldLayout(rcContext* ctx, rcCompactHeightfield& chf, const rcCompactSpanLayout layout);
+
 /// Erodes the walkable area within the heightfield by the specified radius. 
 ///  @ingroup recast
 ///  @param[in,out]	ctx		The build context to use during the operation.
@@ -1147,6 +1329,24 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 					 const float maxError, const int maxEdgeLen,
 					 rcContourSet& cset, const int buildFlags = RC_CONTOUR_TESS_WALL_EDGES);
 
+/// Builds a contour set from the region outlines in the provided compact heightfield, tracing 
+/// and simplifying the regions on the task scheduler of the build context.
+/// The resulting contour set is identical to the one built by #rcBuildContours.
+/// (See: rcContext::setTaskScheduler)
+///  @ingroup recast
+///  @param[in,out]	ctx			The build context to use during the operation.
+///  @param[in]		chf			A fully built compact heightfield.
+///  @param[in]		maxError	The maximum distance a simplfied contour's border edges should deviate 
+///  							the original raw contour. [Limit: >=0] [Units: wu]
+///  @param[in]		maxEdgeLen	The maximum allowed length for contour edges along the border of the mesh. 
+///  							[Limit: >=0] [Units: vx]
+///  @param[out]	cset		The resulting contour set. (Must be pre-allocated.)
+///  @param[in]		buildFlags	The build flags. (See: #rcBuildContoursFlags)
+///  @returns True if the operation completed successfully.
+bool rcBuildContoursParallel(rcContext* ctx, rcCompactHeightfield& chf,
+							 const float maxError, const int maxEdgeLen,
+							 rcContourSet& cset, const int buildFlags = RC_CONTOUR_TESS_WALL_EDGES);
+
 /// Builds a polygon mesh from the provided contours.
 ///  @ingroup recast
 ///  @param[in,out]	ctx		The build context to use during the operation.
@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef RECASTCOMPACTSPANS_H
+#define RECASTCOMPACTSPANS_H
+
+#include "Recast.h"
+#include "RecastAssert.h"
+
+/// @name Compact Span Accessors
+/// Accessors that let the same code read and write the spans of a compact heightfield in either 
+/// layout. Code that walks the spans is written as a template over the accessor type, and the 
+/// caller picks the instantiation that matches rcCompactHeightfield::layout:
+/// @code
+/// if (chf.layout == RC_COMPACT_SPANS_SOA)
+/// 	walk(rcCompactSpansSoA(chf), chf);
+/// else
+/// 	walk(rcCompactSpansAoS(chf), chf);
+/// @endcode
+/// 
+/// Hot loops should read single fields through #z, #h, #reg and #con, so that the 
+/// structure-of-arrays accessor only touches the arrays the loop actually uses. The indexing 
+/// operator is meant for code that needs the whole span.
+/// @see rcCompactSpanLayout, rcSetCompactHeightfieldLayout
+/// @{
+
+/// Accesses the spans of a compact heightfield in the #RC_COMPACT_SPANS_AOS layout.
+class rcCompactSpansAoS
+{
+public:
+	explicit rcCompactSpansAoS(const rcCompactHeightfield& chf) : m_spans(chf.spans) { rcAssert(chf.layout == RC_COMPACT_SPANS_AOS); }
+
+	/// Returns the span at the specified index.
+	inline const rcCompactSpan& operator[](const int i) const { return m_spans[i]; }
+
+	/// Returns the lower extent of the span.
+	inline unsigned short z(const int i) const { return m_spans[i].z; }
+
+	/// Returns the height of the span.
+	inline unsigned char h(const int i) const { return (unsigned char)m_spans[i].h; }
+
+	/// Returns the region id of the span.
+	inline unsigned short reg(const int i) const { return m_spans[i].reg; }
+
+	/// Returns the connection of the span in the specified direction. (See: #rcGetCon)
+	inline int con(const int i, const int dir) const { return rcGetCon(m_spans[i], dir); }
+
+	/// Sets the region id of the span.
+	inline void setReg(const int i, const unsigned short reg) const { m_spans[i].reg = reg; }
+
+private:
+	rcCompactSpan* m_spans;
+};
+
+/// Accesses the spans of a compact heightfield in the #RC_COMPACT_SPANS_SOA layout.
+class rcCompactSpansSoA
+{
+public:
+	explicit rcCompactSpansSoA(const rcCompactHeightfield& chf) :
+		m_z(chf.spanZ), m_h(chf.spanH), m_reg(chf.spanReg), m_con(chf.spanCon) { rcAssert(chf.layout == RC_COMPACT_SPANS_SOA); }
+
+	/// Returns a copy of the span at the specified index.
+	inline rcCompactSpan operator[](const int i) const
+	{
+		rcCompactSpan s;
+		s.z = m_z[i];
+		s.reg = m_reg[i];
+		s.con = m_con[i];
+		s.h = m_h[i];
+		return s;
+	}
+
+	/// Returns the lower extent of the span.
+	inline unsigned short z(const int i) const { return m_z[i]; }
+
+	/// Returns the height of the span.
+	inline unsigned char h(const int i) const { return m_h[i]; }
+
+	/// Returns the region id of the span.
+	inline unsigned short reg(const int i) const { return m_reg[i]; }
+
+	/// Returns the connection of the span in the specified direction. (See: #rcGetCon)
+	inline int con(const int i, const int dir) const
+	{
+		const unsigned int shift = (unsigned int)dir*6;
+		return (m_con[i] >> shift) & 0x3f;
+	}
+
+	/// Sets the region id of the span.
+	inline void setReg(const int i, const unsigned short reg) const { m_reg[i] = reg; }
+
+private:
+	const unsigned short* m_z;
+	const unsigned char* m_h;
+	unsigned short* m_reg;
+	const unsigned int* m_con;
+};
+
+/// @}
+
+#endif // RECASTCOMPACTSPANS_H
@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef RECASTTELEMETRY_H
+#define RECASTTELEMETRY_H
+
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+
+#include "Recast.h"
+#include "RecastAlloc.h"
+
+/// A single telemetry sample recorded between a start and stop of a build timer.
+/// Samples with the same label and parent on the same thread are merged into one sample.
+/// (E.g. The per contour trace and simplify timers in #rcBuildContours.)
+/// @see rcBuildTelemetry
+struct rcTelemetrySample
+{
+	rcTimerLabel label;						///< The timer label of the sample.
+	int tileX;								///< The x-coordinate of the tile being built. (See: rcContext::setTelemetryTile)
+	int tileY;								///< The y-coordinate of the tile being built.
+	int tileLayer;							///< The layer of the tile being built.
+	int thread;								///< The index of the thread that recorded the sample, in order of first use.
+	int parent;								///< The index of the enclosing sample, or -1 if this is a root sample.
+	int depth;								///< The nesting depth of the sample. (Root samples are at depth zero.)
+	int calls;								///< The number of merged samples.
+	long long startUsec;					///< The start time of the first merged sample. [Units: us, relative to the last reset]
+	long long durationUsec;					///< The accumulated wall time of the merged samples. [Units: us]
+	long long peakTempBytes;				///< The peak temporary memory allocated within the sample. [Units: bytes]
+	long long counters[RC_MAX_COUNTERS];	///< The accumulated build counters. (See: #rcTelemetryCounter)
+};
+
+/// Collects nested, per tile and per stage build samples from one or more build contexts.
+///
+/// Assign it to every #rcContext that should be profiled with rcContext::setTelemetry. A single
+/// instance can be shared by contexts that build tiles on different threads.
+///
+/// The samples must only be read once no context is recording into the telemetry.
+/// @see rcContext::setTelemetry, duDumpBuildTelemetryJson, duDumpBuildTelemetryChromeTrace
+class rcBuildTelemetry
+{
+public:
+	rcBuildTelemetry();
+	~rcBuildTelemetry();
+
+	/// Clears all samples and restarts the telemetry clock.
+	void reset();
+
+	/// Opens a sample on the calling thread. Samples must be closed in reverse order.
+	///  @param[in]		label		The timer label of the sample.
+	///  @param[in]		tileX		The x-coordinate of the tile being built.
+	///  @param[in]		tileY		The y-coordinate of the tile being built.
+	///  @param[in]		tileLayer	The layer of the tile being built.
+	void beginSample(const rcTimerLabel label, const int tileX, const int tileY, const int tileLayer);
+
+	/// Closes the innermost open sample on the calling thread.
+	///  @param[in]		label		The timer label of the sample. (Must match the open sample.)
+	void endSample(const rcTimerLabel label);
+
+	/// Adds to a counter of the innermost open sample on the calling thread.
+	/// Does nothing if the thread has no open sample.
+	///  @param[in]		counter		The counter to add to.
+	///  @param[in]		value		The value to add.
+	void addCount(const rcTelemetryCounter counter, const long long value);
+
+	/// The number of recorded samples.
+	int getSampleCount() const { return (int)m_samples.size(); }
+
+	/// Gets the sample at the specified index. Samples are ordered by the time they were opened.
+	///  @param[in]		i	The index of the sample. [Limits: 0 <= value < #getSampleCount]
+	const rcTelemetrySample& getSample(const int i) const { return m_samples[i]; }
+
+	/// Installs a Recast allocator that tracks the temporary memory in use per thread, so that
+	/// rcTelemetrySample::peakTempBytes is filled in. The blocks of the tracking allocator and
+	/// of the default allocator can be freed by either of them.
+	/// @see rcAllocSetCustom
+	static void installAllocTracking();
+
+	/// Restores the default Recast allocator.
+	/// Fails while temporary blocks allocated by the tracking allocator are live, so that 
+	/// their sizes are not lost.
+	/// @return True if the default allocator was restored.
+	static bool uninstallAllocTracking();
+
+	/// Runs a parallel loop on the scheduler, charging the temporary memory allocated by 
+	/// its ranges to the calling thread.
+	/// @see rcContext::parallelFor
+	///  @param[in]		scheduler	The scheduler to run the loop on.
+	///  @param[in]		count		The number of items.
+	///  @param[in]		grain		The maximum number of items per range. [Limit: > 0]
+	///  @param[in]		func		The function to run for each range.
+	///  @param[in]		userData	The user data passed to the function.
+	static void parallelFor(rcTaskScheduler* scheduler, const int count, const int grain,
+							rcParallelForFunc* func, void* userData);
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	rcBuildTelemetry(const rcBuildTelemetry&);
+	rcBuildTelemetry& operator=(const rcBuildTelemetry&);
+
+	long long nowUsec() const;
+
+	std::mutex m_mutex;
+	rcPermVector<rcTelemetrySample> m_samples;
+	std::atomic<int> m_threadCount;
+	int m_generation;
+	long long m_epochUsec;
+};
+
+#endif // RECASTTELEMETRY_H
@@ -0,0 +1,93 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef RECASTTHREADPOOL_H
+#define RECASTTHREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Recast.h"
+#include "RecastAlloc.h"
+
+/// The default #rcTaskScheduler, backed by a fixed set of std::thread workers.
+///
+/// Tasks are kept in a shared queue. A parallel-for splits its items into one contiguous range 
+/// per thread, and threads that run out of items steal half of the remaining range of another 
+/// thread. Threads that wait for a task group or a parallel-for execute queued tasks in the 
+/// meantime, so the scheduler can be used from within its own tasks.
+///
+/// The Recast allocator must be thread-safe while the pool is in use.
+/// @see rcContext::setTaskScheduler
+class rcThreadPool : public rcTaskScheduler
+{
+public:
+	/// Starts the worker threads.
+	///  @param[in]		threadCount		The number of threads that execute work, including the 
+	///  								calling thread. Zero uses the number of hardware threads.
+	explicit rcThreadPool(const int threadCount = 0);
+
+	/// Waits for the queued tasks to complete and stops the worker threads.
+	virtual ~rcThreadPool();
+
+	virtual int getThreadCount() const { return m_threadCount; }
+	virtual void parallelFor(const int count, const int grain, rcParallelForFunc* func, void* userData);
+	virtual rcTaskGroup* createTaskGroup();
+	virtual void destroyTaskGroup(rcTaskGroup* group);
+
+	/// @name Internal
+	/// Used by the task groups and parallel-for jobs of the pool.
+	/// @{
+
+	/// A queued task.
+	struct Task
+	{
+		rcTaskFunc* func;
+		void* userData;
+		std::atomic<int>* pending;	///< Decremented once the task has completed.
+	};
+
+	/// Queues a task and increments its pending counter.
+	void push(const Task& task);
+
+	/// Executes queued tasks until the pending counter reaches zero.
+	void waitPending(std::atomic<int>& pending);
+
+	/// @}
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	rcThreadPool(const rcThreadPool&);
+	rcThreadPool& operator=(const rcThreadPool&);
+
+	static void workerMain(rcThreadPool* pool);
+
+	bool tryRunTask(std::unique_lock<std::mutex>& lock);
+
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	rcPermVector<Task> m_tasks;
+	bool m_stop;
+	int m_threadCount;
+	std::thread* m_workers;
+	int m_workerCount;
+};
+
+#endif // RECASTTHREADPOOL_H
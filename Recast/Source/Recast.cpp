@@ -23,9 +23,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <atomic>
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastTelemetry.h"
 
 namespace
 {
@@ -68,6 +70,10 @@ float rcSqrt(float x)
 /// If no logging or timers are required, just pass an instance of this 
 /// class through the Recast build process.
 ///
+/// Structured per stage telemetry can be collected by assigning a #rcBuildTelemetry 
+/// with #setTelemetry. Every started timer then records a nested sample with its wall 
+/// time, peak temporary memory and build counters.
+///
 
 /// @par
 ///
@@ -94,6 +100,26 @@ void rcContext::log(const rcLogCategory category, const char* format, ...)
 	doLog(category, msg, len);
 }
 
+void rcContext::beginTelemetrySample(const rcTimerLabel label)
+{
+	m_telemetry->beginSample(label, m_tileX, m_tileY, m_tileLayer);
+}
+
+void rcContext::endTelemetrySample(const rcTimerLabel label)
+{
+	m_telemetry->endSample(label);
+}
+
+void rcContext::addTelemetryCount(const rcTelemetryCounter counter, const int value)
+{
+	m_telemetry->addCount(counter, value);
+}
+
+void rcContext::telemetryParallelFor(const int count, const int grain, rcParallelForFunc* func, void* userData)
+{
+	rcBuildTelemetry::parallelFor(m_scheduler, count, grain, func, userData);
+}
+
 rcHeightfield* rcAllocHeightfield()
 {
 	return rcNew<rcHeightfield>(RC_ALLOC_PERM);
@@ -155,7 +181,12 @@ rcCompactHeightfield::rcCompactHeightfield()
 	cells(),
 	spans(),
 	dist(),
-	areas()
+	areas(),
+	layout(RC_COMPACT_SPANS_AOS),
+	spanZ(),
+	spanH(),
+	spanReg(),
+	spanCon()
 {
 }
 rcCompactHeightfield::~rcCompactHeightfield()
@@ -164,6 +195,10 @@ rcCompactHeightfield::~rcCompactHeightfield()
 	rcFree(spans);
 	rcFree(dist);
 	rcFree(areas);
+	rcFree(spanZ);
+	rcFree(spanH);
+	rcFree(spanReg);
+	rcFree(spanCon);
 }
 
 rcHeightfieldLayerSet* rcAllocHeightfieldLayerSet()
@@ -403,6 +438,83 @@ int rcGetHeightFieldSpanCount(rcContext* ctx, rcHeightfield& hf)
 	return spanCount;
 }
 
+// Finds the neighbour connections of the spans in the rows [miny, maxy) and stores them in cons.
+static int connectSpanRows(const rcCompactHeightfield& chf, const int walkableHeight, const int walkableClimb,
+						   const int miny, const int maxy, unsigned int* cons)
+{
+	const int w = chf.width;
+	const int h = chf.height;
+	const int MAX_LAYERS = RC_NOT_CONNECTED-1;
+	int tooHighNeighbour = 0;
+	for (int y = miny; y < maxy; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			{
+				const rcCompactSpan& s = chf.spans[i];
+				// Connections are built on a local copy, the span itself is only read.
+				rcCompactSpan out = s;
+				
+				for (int dir = 0; dir < 4; ++dir)
+				{
+					rcSetCon(out, dir, RC_NOT_CONNECTED);
+					const int nx = x + rcGetDirOffsetX(dir);
+					const int ny = y + rcGetDirOffsetY(dir);
+					// First check that the neighbour cell is in bounds.
+					if (nx < 0 || ny < 0 || nx >= w || ny >= h)
+						continue;
+						
+					// Iterate over all neighbour spans and check if any of the is
+					// accessible from current cell.
+					const rcCompactCell& nc = chf.cells[nx+ny*w];
+					for (int k = (int)nc.index, nk = (int)(nc.index+nc.count); k < nk; ++k)
+					{
+						const rcCompactSpan& ns = chf.spans[k];
+						const int bot = rcMax(s.z, ns.z);
+						const int top = rcMin(s.z+s.h, ns.z+ns.h);
+
+						// Check that the gap between the spans is walkable,
+						// and that the climb height between the gaps is not too high.
+						if ((top - bot) >= walkableHeight && rcAbs((int)ns.z - (int)s.z) <= walkableClimb)
+						{
+							// Mark direction as walkable.
+							const int lidx = k - (int)nc.index;
+							if (lidx < 0 || lidx > MAX_LAYERS)
+							{
+								tooHighNeighbour = rcMax(tooHighNeighbour, lidx);
+								continue;
+							}
+							rcSetCon(out, dir, lidx);
+							break;
+						}
+					}
+					
+				}
+				cons[i] = out.con;
+			}
+		}
+	}
+	return tooHighNeighbour;
+}
+
+struct rcConnectSpansBody
+{
+	const rcCompactHeightfield* chf;
+	int walkableHeight;
+	int walkableClimb;
+	unsigned int* cons;
+	std::atomic<int>* tooHighNeighbour;
+
+	void operator()(const int begin, const int end) const
+	{
+		const int tooHigh = connectSpanRows(*chf, walkableHeight, walkableClimb, begin, end, cons);
+		int cur = tooHighNeighbour->load();
+		while (tooHigh > cur && !tooHighNeighbour->compare_exchange_weak(cur, tooHigh)) {}
+	}
+};
+
 /// @par
 ///
 /// This is just the beginning of the process of fully building a compact heightfield.
@@ -430,6 +542,7 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 	chf.walkableHeight = walkableHeight;
 	chf.walkableClimb = walkableClimb;
 	chf.maxRegions = 0;
+	chf.layout = RC_COMPACT_SPANS_AOS;
 	rcVcopy(chf.bmin, hf.bmin);
 	rcVcopy(chf.bmax, hf.bmax);
 	chf.bmax[2] += walkableHeight*hf.ch;
@@ -461,6 +574,7 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 	
 	// Fill in cells and spans.
 	int idx = 0;
+	int nspans = 0;
 	for (int y = 0; y < h; ++y)
 	{
 		for (int x = 0; x < w; ++x)
@@ -473,6 +587,7 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 			c.count = 0;
 			while (s)
 			{
+				nspans++;
 				if (s->area != RC_NULL_AREA)
 				{
 					const int bot = (int)s->smax;
@@ -488,56 +603,21 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 		}
 	}
 
-	// Find neighbour connections.
+	// Find neighbour connections. The connections share a memory location with the span heights the 
+	// neighbouring rows read, so the rows are connected in parallel into a separate array first.
 	const int MAX_LAYERS = RC_NOT_CONNECTED-1;
-	int tooHighNeighbour = 0;
-	for (int y = 0; y < h; ++y)
+	rcScopedDelete<unsigned int> cons((unsigned int*)rcAlloc(sizeof(unsigned int)*rcMax(spanCount, 1), RC_ALLOC_TEMP));
+	if (!cons)
 	{
-		for (int x = 0; x < w; ++x)
-		{
-			const rcCompactCell& c = chf.cells[x+y*w];
-			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
-			{
-				rcCompactSpan& s = chf.spans[i];
-				
-				for (int dir = 0; dir < 4; ++dir)
-				{
-					rcSetCon(s, dir, RC_NOT_CONNECTED);
-					const int nx = x + rcGetDirOffsetX(dir);
-					const int ny = y + rcGetDirOffsetY(dir);
-					// First check that the neighbour cell is in bounds.
-					if (nx < 0 || ny < 0 || nx >= w || ny >= h)
-						continue;
-						
-					// Iterate over all neighbour spans and check if any of the is
-					// accessible from current cell.
-					const rcCompactCell& nc = chf.cells[nx+ny*w];
-					for (int k = (int)nc.index, nk = (int)(nc.index+nc.count); k < nk; ++k)
-					{
-						const rcCompactSpan& ns = chf.spans[k];
-						const int bot = rcMax(s.z, ns.z);
-						const int top = rcMin(s.z+s.h, ns.z+ns.h);
-
-						// Check that the gap between the spans is walkable,
-						// and that the climb height between the gaps is not too high.
-						if ((top - bot) >= walkableHeight && rcAbs((int)ns.z - (int)s.z) <= walkableClimb)
-						{
-							// Mark direction as walkable.
-							const int lidx = k - (int)nc.index;
-							if (lidx < 0 || lidx > MAX_LAYERS)
-							{
-								tooHighNeighbour = rcMax(tooHighNeighbour, lidx);
-								continue;
-							}
-							rcSetCon(s, dir, lidx);
-							break;
-						}
-					}
-					
-				}
-			}
-		}
+		ctx->log(RC_LOG_ERROR, "rcBuildCompactHeightfield: Out of memory 'cons' (%d)", spanCount);
+		return false;
 	}
+	std::atomic<int> tooHighNeighbourShared(0);
+	rcConnectSpansBody body = { &chf, walkableHeight, walkableClimb, cons, &tooHighNeighbourShared };
+	ctx->parallelFor(h, 16, rcParallelForBody<rcConnectSpansBody>, &body);
+	const int tooHighNeighbour = tooHighNeighbourShared.load();
+	for (int i = 0; i < spanCount; ++i)
+		chf.spans[i].con = cons[i];
 	
 	if (tooHighNeighbour > MAX_LAYERS)
 	{
@@ -545,6 +625,86 @@ bool rcBuildCompactHeightfield(rcContext* ctx, const int walkableHeight, const i
 				 tooHighNeighbour, MAX_LAYERS);
 	}
 	
+	ctx->addCount(RC_COUNTER_SPANS, nspans);
+	ctx->addCount(RC_COUNTER_COMPACT_SPANS, spanCount);
+	
+	return true;
+}
+
+/// @par
+///
+/// The structure-of-arrays layout stores each span field in its own array, so that stages which 
+/// only read some of the fields, such as the connections, move less memory. All build functions 
+/// accept both layouts and produce the same results. (See: RecastCompactSpans.h)
+///
+/// @see rcCompactHeightfield, rcCompactSpanLayout
+bool rcSetCompactHeightfieldLayout(rcContext* ctx, rcCompactHeightfield& chf, const rcCompactSpanLayout layout)
+{
+	rcAssert(ctx);
+	
+	if (chf.layout == layout)
+		return true;
+	
+	const int spanCount = chf.spanCount;
+	
+	if (layout == RC_COMPACT_SPANS_SOA)
+	{
+		unsigned short* spanZ = (unsigned short*)rcAlloc(sizeof(unsigned short)*rcMax(spanCount, 1), RC_ALLOC_PERM);
+		unsigned char* spanH = (unsigned char*)rcAlloc(sizeof(unsigned char)*rcMax(spanCount, 1), RC_ALLOC_PERM);
+		unsigned short* spanReg = (unsigned short*)rcAlloc(sizeof(unsigned short)*rcMax(spanCount, 1), RC_ALLOC_PERM);
+		unsigned int* spanCon = (unsigned int*)rcAlloc(sizeof(unsigned int)*rcMax(spanCount, 1), RC_ALLOC_PERM);
+		if (!spanZ || !spanH || !spanReg || !spanCon)
+		{
+			ctx->log(RC_LOG_ERROR, "rcSetCompactHeightfieldLayout: Out of memory 'spans' (%d).", spanCount);
+			rcFree(spanZ);
+			rcFree(spanH);
+			rcFree(spanReg);
+			rcFree(spanCon);
+			return false;
+		}
+		for (int i = 0; i < spanCount; ++i)
+		{
+			const rcCompactSpan& s = chf.spans[i];
+			spanZ[i] = s.z;
+			spanH[i] = (unsigned char)s.h;
+			spanReg[i] = s.reg;
+			spanCon[i] = s.con;
+		}
+		rcFree(chf.spans);
+		chf.spans = 0;
+		chf.spanZ = spanZ;
+		chf.spanH = spanH;
+		chf.spanReg = spanReg;
+		chf.spanCon = spanCon;
+	}
+	else
+	{
+		rcCompactSpan* spans = (rcCompactSpan*)rcAlloc(sizeof(rcCompactSpan)*rcMax(spanCount, 1), RC_ALLOC_PERM);
+		if (!spans)
+		{
+			ctx->log(RC_LOG_ERROR, "rcSetCompactHeightfieldLayout: Out of memory 'spans' (%d).", spanCount);
+			return false;
+		}
+		for (int i = 0; i < spanCount; ++i)
+		{
+			rcCompactSpan& s = spans[i];
+			s.z = chf.spanZ[i];
+			s.h = chf.spanH[i];
+			s.reg = chf.spanReg[i];
+			s.con = chf.spanCon[i];
+		}
+		rcFree(chf.spanZ);
+		rcFree(chf.spanH);
+		rcFree(chf.spanReg);
+		rcFree(chf.spanCon);
+		chf.spanZ = 0;
+		chf.spanH = 0;
+		chf.spanReg = 0;
+		chf.spanCon = 0;
+		chf.spans = spans;
+	}
+	chf.layout = layout;
+	
 	return true;
 }
 
@@ -25,16 +25,10 @@
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastCompactSpans.h"
 
-/// @par 
-/// 
-/// Basically, any spans that are closer to a boundary or obstruction than the specified radius 
-/// are marked as unwalkable.
-///
-/// This method is usually called immediately after the heightfield has been built.
-///
-/// @see rcCompactHeightfield, rcBuildCompactHeightfield, rcConfig::walkableRadius
-bool rcErodeWalkableArea(rcContext* ctx, int radius, rcCompactHeightfield& chf)
+template<class Spans>
+static bool erodeWalkableArea(rcContext* ctx, int radius, rcCompactHeightfield& chf, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -67,15 +61,14 @@ bool rcErodeWalkableArea(rcContext* ctx, int radius, rcCompactHeightfield& chf)
 				}
 				else
 				{
-					const rcCompactSpan& s = chf.spans[i];
 					int nc = 0;
 					for (int dir = 0; dir < 4; ++dir)
 					{
-						if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+						if (spans.con(i, dir) != RC_NOT_CONNECTED)
 						{
 							const int nx = x + rcGetDirOffsetX(dir);
 							const int ny = y + rcGetDirOffsetY(dir);
-							const int nidx = (int)chf.cells[nx+ny*w].index + rcGetCon(s, dir);
+							const int nidx = (int)chf.cells[nx+ny*w].index + spans.con(i, dir);
 							if (chf.areas[nidx] != RC_NULL_AREA)
 							{
 								nc++;
@@ -100,47 +93,44 @@ bool rcErodeWalkableArea(rcContext* ctx, int radius, rcCompactHeightfield& chf)
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				
-				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
+				if (spans.con(i, 0) != RC_NOT_CONNECTED)
 				{
 					// (-1,0)
 					const int ax = x + rcGetDirOffsetX(0);
 					const int ay = y + rcGetDirOffsetY(0);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 0);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 0);
 					nd = (unsigned char)rcMin((int)dist[ai]+2, 255);
 					if (nd < dist[i])
 						dist[i] = nd;
 					
 					// (-1,-1)
-					if (rcGetCon(as, 3) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 3) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(3);
 						const int aay = ay + rcGetDirOffsetY(3);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 3);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 3);
 						nd = (unsigned char)rcMin((int)dist[aai]+3, 255);
 						if (nd < dist[i])
 							dist[i] = nd;
 					}
 				}
-				if (rcGetCon(s, 3) != RC_NOT_CONNECTED)
+				if (spans.con(i, 3) != RC_NOT_CONNECTED)
 				{
 					// (0,-1)
 					const int ax = x + rcGetDirOffsetX(3);
 					const int ay = y + rcGetDirOffsetY(3);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 3);
 					nd = (unsigned char)rcMin((int)dist[ai]+2, 255);
 					if (nd < dist[i])
 						dist[i] = nd;
 					
 					// (1,-1)
-					if (rcGetCon(as, 2) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 2) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(2);
 						const int aay = ay + rcGetDirOffsetY(2);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 2);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 2);
 						nd = (unsigned char)rcMin((int)dist[aai]+3, 255);
 						if (nd < dist[i])
 							dist[i] = nd;
@@ -158,47 +148,44 @@ bool rcErodeWalkableArea(rcContext* ctx, int radius, rcCompactHeightfield& chf)
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				
-				if (rcGetCon(s, 2) != RC_NOT_CONNECTED)
+				if (spans.con(i, 2) != RC_NOT_CONNECTED)
 				{
 					// (1,0)
 					const int ax = x + rcGetDirOffsetX(2);
 					const int ay = y + rcGetDirOffsetY(2);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 2);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 2);
 					nd = (unsigned char)rcMin((int)dist[ai]+2, 255);
 					if (nd < dist[i])
 						dist[i] = nd;
 					
 					// (1,1)
-					if (rcGetCon(as, 1) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 1) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(1);
 						const int aay = ay + rcGetDirOffsetY(1);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 1);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 1);
 						nd = (unsigned char)rcMin((int)dist[aai]+3, 255);
 						if (nd < dist[i])
 							dist[i] = nd;
 					}
 				}
-				if (rcGetCon(s, 1) != RC_NOT_CONNECTED)
+				if (spans.con(i, 1) != RC_NOT_CONNECTED)
 				{
 					// (0,1)
 					const int ax = x + rcGetDirOffsetX(1);
 					const int ay = y + rcGetDirOffsetY(1);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 1);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 1);
 					nd = (unsigned char)rcMin((int)dist[ai]+2, 255);
 					if (nd < dist[i])
 						dist[i] = nd;
 					
 					// (-1,1)
-					if (rcGetCon(as, 0) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 0) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(0);
 						const int aay = ay + rcGetDirOffsetY(0);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 0);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 0);
 						nd = (unsigned char)rcMin((int)dist[aai]+3, 255);
 						if (nd < dist[i])
 							dist[i] = nd;
@@ -218,6 +205,21 @@ bool rcErodeWalkableArea(rcContext* ctx, int radius, rcCompactHeightfield& chf)
 	return true;
 }
 
+/// @par 
+/// 
+/// Basically, any spans that are closer to a boundary or obstruction than the specified radius 
+/// are marked as unwalkable.
+///
+/// This method is usually called immediately after the heightfield has been built.
+///
+/// @see rcCompactHeightfield, rcBuildCompactHeightfield, rcConfig::walkableRadius
+bool rcErodeWalkableArea(rcContext* ctx, int radius, rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return erodeWalkableArea(ctx, radius, chf, rcCompactSpansSoA(chf));
+	return erodeWalkableArea(ctx, radius, chf, rcCompactSpansAoS(chf));
+}
+
 static void insertSort(unsigned char* a, const int n)
 {
 	int i, j;
@@ -230,39 +232,19 @@ static void insertSort(unsigned char* a, const int n)
 	}
 }
 
-/// @par
-///
-/// This filter is usually applied after applying area id's using functions
-/// such as #rcMarkBoxArea, #rcMarkConvexPolyArea, and #rcMarkCylinderArea.
-/// 
-/// @see rcCompactHeightfield
-bool rcMedianFilterWalkableArea(rcContext* ctx, rcCompactHeightfield& chf)
+template<class Spans>
+static void medianFilterRows(const rcCompactHeightfield& chf, unsigned char* areas,
+							 const int miny, const int maxy, const Spans& spans)
 {
-	rcAssert(ctx);
-	
 	const int w = chf.width;
-	const int h = chf.height;
-	
-	rcScopedTimer timer(ctx, RC_TIMER_MEDIAN_AREA);
-	
-	unsigned char* areas = (unsigned char*)rcAlloc(sizeof(unsigned char)*chf.spanCount, RC_ALLOC_TEMP);
-	if (!areas)
-	{
-		ctx->log(RC_LOG_ERROR, "medianFilterWalkableArea: Out of memory 'areas' (%d).", chf.spanCount);
-		return false;
-	}
 	
-	// Init distance.
-	memset(areas, 0xff, sizeof(unsigned char)*chf.spanCount);
-	
-	for (int y = 0; y < h; ++y)
+	for (int y = miny; y < maxy; ++y)
 	{
 		for (int x = 0; x < w; ++x)
 		{
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				if (chf.areas[i] == RC_NULL_AREA)
 				{
 					areas[i] = chf.areas[i];
@@ -275,21 +257,20 @@ bool rcMedianFilterWalkableArea(rcContext* ctx, rcCompactHeightfield& chf)
 				
 				for (int dir = 0; dir < 4; ++dir)
 				{
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					if (spans.con(i, dir) != RC_NOT_CONNECTED)
 					{
 						const int ax = x + rcGetDirOffsetX(dir);
 						const int ay = y + rcGetDirOffsetY(dir);
-						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
+						const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, dir);
 						if (chf.areas[ai] != RC_NULL_AREA)
 							nei[dir*2+0] = chf.areas[ai];
 						
-						const rcCompactSpan& as = chf.spans[ai];
 						const int dir2 = (dir+1) & 0x3;
-						if (rcGetCon(as, dir2) != RC_NOT_CONNECTED)
+						if (spans.con(ai, dir2) != RC_NOT_CONNECTED)
 						{
 							const int ax2 = ax + rcGetDirOffsetX(dir2);
 							const int ay2 = ay + rcGetDirOffsetY(dir2);
-							const int ai2 = (int)chf.cells[ax2+ay2*w].index + rcGetCon(as, dir2);
+							const int ai2 = (int)chf.cells[ax2+ay2*w].index + spans.con(ai, dir2);
 							if (chf.areas[ai2] != RC_NULL_AREA)
 								nei[dir*2+1] = chf.areas[ai2];
 						}
@@ -300,6 +281,56 @@ bool rcMedianFilterWalkableArea(rcContext* ctx, rcCompactHeightfield& chf)
 			}
 		}
 	}
+}
+
+template<class Spans>
+struct rcMedianFilterBody
+{
+	const rcCompactHeightfield* chf;
+	unsigned char* areas;
+	Spans spans;
+
+	void operator()(const int begin, const int end) const
+	{
+		medianFilterRows(*chf, areas, begin, end, spans);
+	}
+};
+
+/// @par
+///
+/// This filter is usually applied after applying area id's using functions
+/// such as #rcMarkBoxArea, #rcMarkConvexPolyArea, and #rcMarkCylinderArea.
+/// 
+/// @see rcCompactHeightfield
+bool rcMedianFilterWalkableArea(rcContext* ctx, rcCompactHeightfield& chf)
+{
+	rcAssert(ctx);
+	
+	const int h = chf.height;
+	
+	rcScopedTimer timer(ctx, RC_TIMER_MEDIAN_AREA);
+	
+	unsigned char* areas = (unsigned char*)rcAlloc(sizeof(unsigned char)*chf.spanCount, RC_ALLOC_TEMP);
+	if (!areas)
+	{
+		ctx->log(RC_LOG_ERROR, "medianFilterWalkableArea: Out of memory 'areas' (%d).", chf.spanCount);
+		return false;
+	}
+	
+	// Init distance.
+	memset(areas, 0xff, sizeof(unsigned char)*chf.spanCount);
+	
+	// Each row only reads from chf.areas, so the rows are filtered in parallel.
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+	{
+		rcMedianFilterBody<rcCompactSpansSoA> body = { &chf, areas, rcCompactSpansSoA(chf) };
+		ctx->parallelFor(h, 16, rcParallelForBody<rcMedianFilterBody<rcCompactSpansSoA> >, &body);
+	}
+	else
+	{
+		rcMedianFilterBody<rcCompactSpansAoS> body = { &chf, areas, rcCompactSpansAoS(chf) };
+		ctx->parallelFor(h, 16, rcParallelForBody<rcMedianFilterBody<rcCompactSpansAoS> >, &body);
+	}
 	
 	memcpy(chf.areas, areas, sizeof(unsigned char)*chf.spanCount);
 	
@@ -308,13 +339,9 @@ bool rcMedianFilterWalkableArea(rcContext* ctx, rcCompactHeightfield& chf)
 	return true;
 }
 
-/// @par
-///
-/// The value of spacial parameters are in world units.
-/// 
-/// @see rcCompactHeightfield, rcMedianFilterWalkableArea
-void rcMarkBoxArea(rcContext* ctx, const float* bmin, const float* bmax, unsigned char areaId,
-				   rcCompactHeightfield& chf)
+template<class Spans>
+static void markBoxArea(rcContext* ctx, const float* bmin, const float* bmax, unsigned char areaId,
+						rcCompactHeightfield& chf, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -344,8 +371,7 @@ void rcMarkBoxArea(rcContext* ctx, const float* bmin, const float* bmax, unsigne
 			const rcCompactCell& c = chf.cells[x+y*chf.width];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				rcCompactSpan& s = chf.spans[i];
-				if ((int)s.z >= minz && (int)s.z <= maxz)
+				if ((int)spans.z(i) >= minz && (int)spans.z(i) <= maxz)
 				{
 					if (chf.areas[i] != RC_NULL_AREA)
 						chf.areas[i] = areaId;
@@ -355,6 +381,20 @@ void rcMarkBoxArea(rcContext* ctx, const float* bmin, const float* bmax, unsigne
 	}
 }
 
+/// @par
+///
+/// The value of spacial parameters are in world units.
+/// 
+/// @see rcCompactHeightfield, rcMedianFilterWalkableArea
+void rcMarkBoxArea(rcContext* ctx, const float* bmin, const float* bmax, unsigned char areaId,
+				   rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		markBoxArea(ctx, bmin, bmax, areaId, chf, rcCompactSpansSoA(chf));
+	else
+		markBoxArea(ctx, bmin, bmax, areaId, chf, rcCompactSpansAoS(chf));
+}
+
 
 static int pointInPoly(int nvert, const float* verts, const float* p)
 {
@@ -370,17 +410,10 @@ static int pointInPoly(int nvert, const float* verts, const float* p)
 	return c;
 }
 
-/// @par
-///
-/// The value of spacial parameters are in world units.
-/// 
-/// The y-values of the polygon vertices are ignored. So the polygon is effectively 
-/// projected onto the xy-plane at @p hmin, then extruded to @p hmax.
-/// 
-/// @see rcCompactHeightfield, rcMedianFilterWalkableArea
-void rcMarkConvexPolyArea(rcContext* ctx, const float* verts, const int nverts,
-						  const float hmin, const float hmax, unsigned char areaId,
-						  rcCompactHeightfield& chf)
+template<class Spans>
+static void markConvexPolyArea(rcContext* ctx, const float* verts, const int nverts,
+							   const float hmin, const float hmax, unsigned char areaId,
+							   rcCompactHeightfield& chf, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -423,10 +456,9 @@ void rcMarkConvexPolyArea(rcContext* ctx, const float* verts, const int nverts,
 			const rcCompactCell& c = chf.cells[x+y*chf.width];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				rcCompactSpan& s = chf.spans[i];
 				if (chf.areas[i] == RC_NULL_AREA)
 					continue;
-				if ((int)s.z >= minz && (int)s.z <= maxz)
+				if ((int)spans.z(i) >= minz && (int)spans.z(i) <= maxz)
 				{
 					float p[3];
 					p[0] = chf.bmin[0] + (x+0.5f)*chf.cs;
@@ -443,6 +475,24 @@ void rcMarkConvexPolyArea(rcContext* ctx, const float* verts, const int nverts,
 	}
 }
 
+/// @par
+///
+/// The value of spacial parameters are in world units.
+/// 
+/// The y-values of the polygon vertices are ignored. So the polygon is effectively 
+/// projected onto the xy-plane at @p hmin, then extruded to @p hmax.
+/// 
+/// @see rcCompactHeightfield, rcMedianFilterWalkableArea
+void rcMarkConvexPolyArea(rcContext* ctx, const float* verts, const int nverts,
+						  const float hmin, const float hmax, unsigned char areaId,
+						  rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		markConvexPolyArea(ctx, verts, nverts, hmin, hmax, areaId, chf, rcCompactSpansSoA(chf));
+	else
+		markConvexPolyArea(ctx, verts, nverts, hmin, hmax, areaId, chf, rcCompactSpansAoS(chf));
+}
+
 int rcOffsetPoly(const float* verts, const int nverts, const float offset,
 				 float* outVerts, const int maxOutVerts)
 {
@@ -521,14 +571,10 @@ int rcOffsetPoly(const float* verts, const int nverts, const float offset,
 }
 
 
-/// @par
-///
-/// The value of spacial parameters are in world units.
-/// 
-/// @see rcCompactHeightfield, rcMedianFilterWalkableArea
-void rcMarkCylinderArea(rcContext* ctx, const float* pos,
-						const float r, const float h, unsigned char areaId,
-						rcCompactHeightfield& chf)
+template<class Spans>
+static void markCylinderArea(rcContext* ctx, const float* pos,
+							 const float r, const float h, unsigned char areaId,
+							 rcCompactHeightfield& chf, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -568,12 +614,11 @@ void rcMarkCylinderArea(rcContext* ctx, const float* pos,
 			const rcCompactCell& c = chf.cells[x+y*chf.width];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				rcCompactSpan& s = chf.spans[i];
 				
 				if (chf.areas[i] == RC_NULL_AREA)
 					continue;
 				
-				if ((int)s.z >= minz && (int)s.z <= maxz)
+				if ((int)spans.z(i) >= minz && (int)spans.z(i) <= maxz)
 				{
 					const float sx = chf.bmin[0] + (x+0.5f)*chf.cs; 
 					const float sy = chf.bmin[1] + (y+0.5f)*chf.cs; 
@@ -589,3 +634,18 @@ void rcMarkCylinderArea(rcContext* ctx, const float* pos,
 		}
 	}
 }
+
+/// @par
+///
+/// The value of spacial parameters are in world units.
+/// 
+/// @see rcCompactHeightfield, rcMedianFilterWalkableArea
+void rcMarkCylinderArea(rcContext* ctx, const float* pos,
+						const float r, const float h, unsigned char areaId,
+						rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		markCylinderArea(ctx, pos, r, h, areaId, chf, rcCompactSpansSoA(chf));
+	else
+		markCylinderArea(ctx, pos, r, h, areaId, chf, rcCompactSpansAoS(chf));
+}
@@ -21,59 +21,57 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <atomic>
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastCompactSpans.h"
 
 
+template<class Spans>
 static int getCornerHeight(int x, int y, int i, int dir,
 						   const rcCompactHeightfield& chf,
-						   bool& isBorderVertex)
+						   bool& isBorderVertex, const Spans& spans)
 {
-	const rcCompactSpan& s = chf.spans[i];
-	int ch = (int)s.z;
+	int ch = (int)spans.z(i);
 	int dirp = (dir+1) & 0x3;
 	
 	unsigned int regs[4] = {0,0,0,0};
 	
 	// Combine region and area codes in order to prevent
 	// border vertices which are in between two areas to be removed.
-	regs[0] = chf.spans[i].reg | (chf.areas[i] << 16);
+	regs[0] = spans.reg(i) | (chf.areas[i] << 16);
 	
-	if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+	if (spans.con(i, dir) != RC_NOT_CONNECTED)
 	{
 		const int ax = x + rcGetDirOffsetX(dir);
 		const int ay = y + rcGetDirOffsetY(dir);
-		const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dir);
-		const rcCompactSpan& as = chf.spans[ai];
-		ch = rcMax(ch, (int)as.z);
-		regs[1] = chf.spans[ai].reg | (chf.areas[ai] << 16);
-		if (rcGetCon(as, dirp) != RC_NOT_CONNECTED)
+		const int ai = (int)chf.cells[ax+ay*chf.width].index + spans.con(i, dir);
+		ch = rcMax(ch, (int)spans.z(ai));
+		regs[1] = spans.reg(ai) | (chf.areas[ai] << 16);
+		if (spans.con(ai, dirp) != RC_NOT_CONNECTED)
 		{
 			const int ax2 = ax + rcGetDirOffsetX(dirp);
 			const int ay2 = ay + rcGetDirOffsetY(dirp);
-			const int ai2 = (int)chf.cells[ax2+ay2*chf.width].index + rcGetCon(as, dirp);
-			const rcCompactSpan& as2 = chf.spans[ai2];
-			ch = rcMax(ch, (int)as2.z);
-			regs[2] = chf.spans[ai2].reg | (chf.areas[ai2] << 16);
+			const int ai2 = (int)chf.cells[ax2+ay2*chf.width].index + spans.con(ai, dirp);
+			ch = rcMax(ch, (int)spans.z(ai2));
+			regs[2] = spans.reg(ai2) | (chf.areas[ai2] << 16);
 		}
 	}
-	if (rcGetCon(s, dirp) != RC_NOT_CONNECTED)
+	if (spans.con(i, dirp) != RC_NOT_CONNECTED)
 	{
 		const int ax = x + rcGetDirOffsetX(dirp);
 		const int ay = y + rcGetDirOffsetY(dirp);
-		const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dirp);
-		const rcCompactSpan& as = chf.spans[ai];
-		ch = rcMax(ch, (int)as.z);
-		regs[3] = chf.spans[ai].reg | (chf.areas[ai] << 16);
-		if (rcGetCon(as, dir) != RC_NOT_CONNECTED)
+		const int ai = (int)chf.cells[ax+ay*chf.width].index + spans.con(i, dirp);
+		ch = rcMax(ch, (int)spans.z(ai));
+		regs[3] = spans.reg(ai) | (chf.areas[ai] << 16);
+		if (spans.con(ai, dir) != RC_NOT_CONNECTED)
 		{
 			const int ax2 = ax + rcGetDirOffsetX(dir);
 			const int ay2 = ay + rcGetDirOffsetY(dir);
-			const int ai2 = (int)chf.cells[ax2+ay2*chf.width].index + rcGetCon(as, dir);
-			const rcCompactSpan& as2 = chf.spans[ai2];
-			ch = rcMax(ch, (int)as2.z);
-			regs[2] = chf.spans[ai2].reg | (chf.areas[ai2] << 16);
+			const int ai2 = (int)chf.cells[ax2+ay2*chf.width].index + spans.con(ai, dir);
+			ch = rcMax(ch, (int)spans.z(ai2));
+			regs[2] = spans.reg(ai2) | (chf.areas[ai2] << 16);
 		}
 	}
 
@@ -101,9 +99,10 @@ static int getCornerHeight(int x, int y, int i, int dir,
 	return ch;
 }
 
+template<class Spans>
 static void walkContour(int x, int y, int i,
 						rcCompactHeightfield& chf,
-						unsigned char* flags, rcIntArray& points)
+						unsigned char* flags, rcIntArray& points, const Spans& spans)
 {
 	// Choose the first non-connected edge
 	unsigned char dir = 0;
@@ -125,7 +124,7 @@ static void walkContour(int x, int y, int i,
 			bool isAreaBorder = false;
 			int px = x;
 			int py = y;
-			int pz = getCornerHeight(x, y, i, dir, chf, isBorderVertex); 
+			int pz = getCornerHeight(x, y, i, dir, chf, isBorderVertex, spans); 
 			switch(dir)
 			{
 				case 0: py++; break;
@@ -133,13 +132,12 @@ static void walkContour(int x, int y, int i,
 				case 2: px++; break;
 			}
 			int r = 0;
-			const rcCompactSpan& s = chf.spans[i];
-			if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+			if (spans.con(i, dir) != RC_NOT_CONNECTED)
 			{
 				const int ax = x + rcGetDirOffsetX(dir);
 				const int ay = y + rcGetDirOffsetY(dir);
-				const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dir);
-				r = (int)chf.spans[ai].reg;
+				const int ai = (int)chf.cells[ax+ay*chf.width].index + spans.con(i, dir);
+				r = (int)spans.reg(ai);
 				if (area != chf.areas[ai])
 					isAreaBorder = true;
 			}
@@ -160,11 +158,10 @@ static void walkContour(int x, int y, int i,
 			int ni = -1;
 			const int nx = x + rcGetDirOffsetX(dir);
 			const int ny = y + rcGetDirOffsetY(dir);
-			const rcCompactSpan& s = chf.spans[i];
-			if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+			if (spans.con(i, dir) != RC_NOT_CONNECTED)
 			{
 				const rcCompactCell& nc = chf.cells[nx+ny*chf.width];
-				ni = (int)nc.index + rcGetCon(s, dir);
+				ni = (int)nc.index + spans.con(i, dir);
 			}
 			if (ni == -1)
 			{
@@ -808,37 +805,14 @@ static void mergeRegionHoles(rcContext* ctx, rcContourRegion& region)
 }
 
 
-/// @par
-///
-/// The raw contours will match the region outlines exactly. The @p maxError and @p maxEdgeLen
-/// parameters control how closely the simplified contours will match the raw contours.
-///
-/// Simplified contours are generated such that the vertices for portals between areas match up.
-/// (They are considered mandatory vertices.)
-///
-/// Setting @p maxEdgeLength to zero will disabled the edge length feature.
-///
-/// See the #rcConfig documentation for more information on the configuration parameters.
-///
-/// @see rcAllocContourSet, rcCompactHeightfield, rcContourSet, rcConfig
-bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
-					 const float maxError, const int maxEdgeLen,
-					 rcContourSet& cset, const int buildFlags)
+static void initContourSet(const rcCompactHeightfield& chf, const float maxError, rcContourSet& cset)
 {
-	rcAssert(ctx);
-	
-	const int w = chf.width;
-	const int h = chf.height;
-	const int borderSize = chf.borderSize;
-	
-	rcScopedTimer timer(ctx, RC_TIMER_BUILD_CONTOURS);
-	
 	rcVcopy(cset.bmin, chf.bmin);
 	rcVcopy(cset.bmax, chf.bmax);
-	if (borderSize > 0)
+	if (chf.borderSize > 0)
 	{
 		// If the heightfield was build with bordersize, remove the offset.
-		const float pad = borderSize*chf.cs;
+		const float pad = chf.borderSize*chf.cs;
 		cset.bmin[0] += pad;
 		cset.bmin[1] += pad;
 		cset.bmax[0] -= pad;
@@ -850,6 +824,186 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 	cset.height = chf.height - chf.borderSize*2;
 	cset.borderSize = chf.borderSize;
 	cset.maxError = maxError;
+}
+
+// Marks the edges of each span in row y that are not connected to a span of the same region.
+// Only writes the flags of spans in that row, so rows can be processed independently.
+template<class Spans>
+static void markBoundaryRow(const rcCompactHeightfield& chf, const int y, unsigned char* flags, const Spans& spans)
+{
+	const int w = chf.width;
+	for (int x = 0; x < w; ++x)
+	{
+		const rcCompactCell& c = chf.cells[x+y*w];
+		for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+		{
+			unsigned char res = 0;
+			if (!spans.reg(i) || (spans.reg(i) & RC_BORDER_REG))
+			{
+				flags[i] = 0;
+				continue;
+			}
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				unsigned short r = 0;
+				if (spans.con(i, dir) != RC_NOT_CONNECTED)
+				{
+					const int ax = x + rcGetDirOffsetX(dir);
+					const int ay = y + rcGetDirOffsetY(dir);
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, dir);
+					r = spans.reg(ai);
+				}
+				if (r == spans.reg(i))
+					res |= (1 << dir);
+			}
+			flags[i] = res ^ 0xf; // Inverse, mark non connected edges.
+		}
+	}
+}
+
+// Allocates a copy of the contour points, removing the heightfield border offset.
+static int* copyContourVerts(const rcIntArray& src, const int borderSize)
+{
+	const int n = src.size()/4;
+	int* dst = (int*)rcAlloc(sizeof(int)*n*4, RC_ALLOC_PERM);
+	if (!dst)
+		return 0;
+	memcpy(dst, src.data(), sizeof(int)*n*4);
+	if (borderSize > 0)
+	{
+		// If the heightfield was build with bordersize, remove the offset.
+		for (int j = 0; j < n; ++j)
+		{
+			int* v = &dst[j*4];
+			v[0] -= borderSize;
+			v[1] -= borderSize;
+		}
+	}
+	return dst;
+}
+
+static bool mergeContourHoles(rcContext* ctx, const rcCompactHeightfield& chf, rcContourSet& cset)
+{
+	if (cset.nconts <= 0)
+		return true;
+
+	// Calculate winding of all polygons.
+	rcScopedDelete<signed char> winding((signed char*)rcAlloc(sizeof(signed char)*cset.nconts, RC_ALLOC_TEMP));
+	if (!winding)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'hole' (%d).", cset.nconts);
+		return false;
+	}
+	int nholes = 0;
+	for (int i = 0; i < cset.nconts; ++i)
+	{
+		rcContour& cont = cset.conts[i];
+		// If the contour is wound backwards, it is a hole.
+		winding[i] = calcAreaOfPolygon2D(cont.verts, cont.nverts) < 0 ? -1 : 1;
+		if (winding[i] < 0)
+			nholes++;
+	}
+	
+	if (nholes == 0)
+		return true;
+
+	// Collect outline contour and holes contours per region.
+	// We assume that there is one outline and multiple holes.
+	const int nregions = chf.maxRegions+1;
+	rcScopedDelete<rcContourRegion> regions((rcContourRegion*)rcAlloc(sizeof(rcContourRegion)*nregions, RC_ALLOC_TEMP));
+	if (!regions)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'regions' (%d).", nregions);
+		return false;
+	}
+	memset(regions, 0, sizeof(rcContourRegion)*nregions);
+	
+	rcScopedDelete<rcContourHole> holes((rcContourHole*)rcAlloc(sizeof(rcContourHole)*cset.nconts, RC_ALLOC_TEMP));
+	if (!holes)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'holes' (%d).", cset.nconts);
+		return false;
+	}
+	memset(holes, 0, sizeof(rcContourHole)*cset.nconts);
+	
+	for (int i = 0; i < cset.nconts; ++i)
+	{
+		rcContour& cont = cset.conts[i];
+		// Positively would contours are outlines, negative holes.
+		if (winding[i] > 0)
+		{
+			if (regions[cont.reg].outline)
+				ctx->log(RC_LOG_ERROR, "rcBuildContours: Multiple outlines for region %d.", cont.reg);
+			regions[cont.reg].outline = &cont;
+		}
+		else
+		{
+			regions[cont.reg].nholes++;
+		}
+	}
+	int index = 0;
+	for (int i = 0; i < nregions; i++)
+	{
+		if (regions[i].nholes > 0)
+		{
+			regions[i].holes = &holes[index];
+			index += regions[i].nholes;
+			regions[i].nholes = 0;
+		}
+	}
+	for (int i = 0; i < cset.nconts; ++i)
+	{
+		rcContour& cont = cset.conts[i];
+		rcContourRegion& reg = regions[cont.reg];
+		if (winding[i] < 0)
+			reg.holes[reg.nholes++].contour = &cont;
+	}
+	
+	// Finally merge each regions holes into the outline.
+	for (int i = 0; i < nregions; i++)
+	{
+		rcContourRegion& reg = regions[i];
+		if (!reg.nholes) continue;
+		
+		if (reg.outline)
+		{
+			mergeRegionHoles(ctx, reg);
+		}
+		else
+		{
+			// The region does not have an outline.
+			// This can happen if the contour becaomes selfoverlapping because of
+			// too aggressive simplification settings.
+			ctx->log(RC_LOG_ERROR, "rcBuildContours: Bad outline for region %d, contour simplification is likely too aggressive.", i);
+		}
+	}
+
+	return true;
+}
+
+static void addContourCounts(rcContext* ctx, const rcContourSet& cset)
+{
+	int nverts = 0;
+	for (int i = 0; i < cset.nconts; ++i)
+		nverts += cset.conts[i].nverts;
+	ctx->addCount(RC_COUNTER_CONTOURS, cset.nconts);
+	ctx->addCount(RC_COUNTER_CONTOUR_VERTS, nverts);
+}
+
+template<class Spans>
+static bool buildContours(rcContext* ctx, rcCompactHeightfield& chf,
+						  const float maxError, const int maxEdgeLen,
+						  rcContourSet& cset, const int buildFlags, const Spans& spans)
+{
+	rcAssert(ctx);
+	
+	const int w = chf.width;
+	const int h = chf.height;
+	const int borderSize = chf.borderSize;
+	
+	rcScopedTimer timer(ctx, RC_TIMER_BUILD_CONTOURS);
+	
+	initContourSet(chf, maxError, cset);
 	
 	int maxContours = rcMax((int)chf.maxRegions, 8);
 	cset.conts = (rcContour*)rcAlloc(sizeof(rcContour)*maxContours, RC_ALLOC_PERM);
@@ -868,36 +1022,7 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 	
 	// Mark boundaries.
 	for (int y = 0; y < h; ++y)
-	{
-		for (int x = 0; x < w; ++x)
-		{
-			const rcCompactCell& c = chf.cells[x+y*w];
-			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
-			{
-				unsigned char res = 0;
-				const rcCompactSpan& s = chf.spans[i];
-				if (!chf.spans[i].reg || (chf.spans[i].reg & RC_BORDER_REG))
-				{
-					flags[i] = 0;
-					continue;
-				}
-				for (int dir = 0; dir < 4; ++dir)
-				{
-					unsigned short r = 0;
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
-					{
-						const int ax = x + rcGetDirOffsetX(dir);
-						const int ay = y + rcGetDirOffsetY(dir);
-						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
-						r = chf.spans[ai].reg;
-					}
-					if (r == chf.spans[i].reg)
-						res |= (1 << dir);
-				}
-				flags[i] = res ^ 0xf; // Inverse, mark non connected edges.
-			}
-		}
-	}
+		markBoundaryRow(chf, y, flags, spans);
 	
 	ctx->stopTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
 	
@@ -916,7 +1041,7 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 					flags[i] = 0;
 					continue;
 				}
-				const unsigned short reg = chf.spans[i].reg;
+				const unsigned short reg = spans.reg(i);
 				if (!reg || (reg & RC_BORDER_REG))
 					continue;
 				const unsigned char area = chf.areas[i];
@@ -925,7 +1050,7 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 				simplified.clear();
 				
 				ctx->startTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
-				walkContour(x, y, i, chf, flags, verts);
+				walkContour(x, y, i, chf, flags, verts, spans);
 				ctx->stopTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
 				
 				ctx->startTimer(RC_TIMER_BUILD_CONTOURS_SIMPLIFY);
@@ -961,42 +1086,20 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 					rcContour* cont = &cset.conts[cset.nconts++];
 					
 					cont->nverts = simplified.size()/4;
-					cont->verts = (int*)rcAlloc(sizeof(int)*cont->nverts*4, RC_ALLOC_PERM);
+					cont->verts = copyContourVerts(simplified, borderSize);
 					if (!cont->verts)
 					{
 						ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'verts' (%d).", cont->nverts);
 						return false;
 					}
-					memcpy(cont->verts, &simplified[0], sizeof(int)*cont->nverts*4);
-					if (borderSize > 0)
-					{
-						// If the heightfield was build with bordersize, remove the offset.
-						for (int j = 0; j < cont->nverts; ++j)
-						{
-							int* v = &cont->verts[j*4];
-							v[0] -= borderSize;
-							v[1] -= borderSize;
-						}
-					}
 					
 					cont->nrverts = verts.size()/4;
-					cont->rverts = (int*)rcAlloc(sizeof(int)*cont->nrverts*4, RC_ALLOC_PERM);
+					cont->rverts = copyContourVerts(verts, borderSize);
 					if (!cont->rverts)
 					{
 						ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'rverts' (%d).", cont->nrverts);
 						return false;
 					}
-					memcpy(cont->rverts, &verts[0], sizeof(int)*cont->nrverts*4);
-					if (borderSize > 0)
-					{
-						// If the heightfield was build with bordersize, remove the offset.
-						for (int j = 0; j < cont->nrverts; ++j)
-						{
-							int* v = &cont->rverts[j*4];
-							v[0] -= borderSize;
-							v[1] -= borderSize;
-						}
-					}
 					
 					cont->reg = reg;
 					cont->area = area;
@@ -1006,100 +1109,244 @@ bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
 	}
 	
 	// Merge holes if needed.
-	if (cset.nconts > 0)
+	if (!mergeContourHoles(ctx, chf, cset))
+		return false;
+	
+	addContourCounts(ctx, cset);
+	
+	return true;
+}
+
+/// @par
+///
+/// The raw contours will match the region outlines exactly. The @p maxError and @p maxEdgeLen
+/// parameters control how closely the simplified contours will match the raw contours.
+///
+/// Simplified contours are generated such that the vertices for portals between areas match up.
+/// (They are considered mandatory vertices.)
+///
+/// Setting @p maxEdgeLength to zero will disabled the edge length feature.
+///
+/// See the #rcConfig documentation for more information on the configuration parameters.
+///
+/// @see rcAllocContourSet, rcCompactHeightfield, rcContourSet, rcConfig
+bool rcBuildContours(rcContext* ctx, rcCompactHeightfield& chf,
+					 const float maxError, const int maxEdgeLen,
+					 rcContourSet& cset, const int buildFlags)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildContours(ctx, chf, maxError, maxEdgeLen, cset, buildFlags, rcCompactSpansSoA(chf));
+	return buildContours(ctx, chf, maxError, maxEdgeLen, cset, buildFlags, rcCompactSpansAoS(chf));
+}
+
+namespace
+{
+template<class Spans>
+struct rcMarkBoundaryBody
+{
+	Spans spans;
+	const rcCompactHeightfield* chf;
+	unsigned char* flags;
+
+	void operator()(const int begin, const int end) const
 	{
-		// Calculate winding of all polygons.
-		rcScopedDelete<signed char> winding((signed char*)rcAlloc(sizeof(signed char)*cset.nconts, RC_ALLOC_TEMP));
-		if (!winding)
-		{
-			ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'hole' (%d).", cset.nconts);
-			return false;
-		}
-		int nholes = 0;
-		for (int i = 0; i < cset.nconts; ++i)
-		{
-			rcContour& cont = cset.conts[i];
-			// If the contour is wound backwards, it is a hole.
-			winding[i] = calcAreaOfPolygon2D(cont.verts, cont.nverts) < 0 ? -1 : 1;
-			if (winding[i] < 0)
-				nholes++;
-		}
-		
-		if (nholes > 0)
+		for (int y = begin; y < end; ++y)
+			markBoundaryRow(*chf, y, flags, spans);
+	}
+};
+
+template<class Spans>
+struct rcTraceRegionsBody
+{
+	Spans spans;
+	rcCompactHeightfield* chf;
+	unsigned char* flags;
+	const int* regionIds;		// Regions that have boundary spans.
+	const int* regionFirst;		// First bucket entry per region id. [Size: maxRegions+2]
+	const int* bucket;			// Boundary span entries grouped by region, in scan order within the region.
+	const int* bspans;			// Span index per boundary span entry.
+	const int* bcoords;			// Cell (x, y) per boundary span entry.
+	rcContour* slots;			// Output contour per boundary span entry.
+	float maxError;
+	int maxEdgeLen;
+	int buildFlags;
+	std::atomic<int>* failed;
+
+	void operator()(const int begin, const int end) const
+	{
+		rcIntArray verts(256);
+		rcIntArray simplified(64);
+
+		for (int r = begin; r < end; ++r)
 		{
-			// Collect outline contour and holes contours per region.
-			// We assume that there is one outline and multiple holes.
-			const int nregions = chf.maxRegions+1;
-			rcScopedDelete<rcContourRegion> regions((rcContourRegion*)rcAlloc(sizeof(rcContourRegion)*nregions, RC_ALLOC_TEMP));
-			if (!regions)
-			{
-				ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'regions' (%d).", nregions);
-				return false;
-			}
-			memset(regions, 0, sizeof(rcContourRegion)*nregions);
-			
-			rcScopedDelete<rcContourHole> holes((rcContourHole*)rcAlloc(sizeof(rcContourHole)*cset.nconts, RC_ALLOC_TEMP));
-			if (!holes)
-			{
-				ctx->log(RC_LOG_ERROR, "rcBuildContours: Out of memory 'holes' (%d).", cset.nconts);
-				return false;
-			}
-			memset(holes, 0, sizeof(rcContourHole)*cset.nconts);
-			
-			for (int i = 0; i < cset.nconts; ++i)
+			const int reg = regionIds[r];
+			for (int k = regionFirst[reg]; k < regionFirst[reg+1]; ++k)
 			{
-				rcContour& cont = cset.conts[i];
-				// Positively would contours are outlines, negative holes.
-				if (winding[i] > 0)
-				{
-					if (regions[cont.reg].outline)
-						ctx->log(RC_LOG_ERROR, "rcBuildContours: Multiple outlines for region %d.", cont.reg);
-					regions[cont.reg].outline = &cont;
-				}
-				else
-				{
-					regions[cont.reg].nholes++;
-				}
-			}
-			int index = 0;
-			for (int i = 0; i < nregions; i++)
-			{
-				if (regions[i].nholes > 0)
-				{
-					regions[i].holes = &holes[index];
-					index += regions[i].nholes;
-					regions[i].nholes = 0;
-				}
-			}
-			for (int i = 0; i < cset.nconts; ++i)
-			{
-				rcContour& cont = cset.conts[i];
-				rcContourRegion& reg = regions[cont.reg];
-				if (winding[i] < 0)
-					reg.holes[reg.nholes++].contour = &cont;
+				const int p = bucket[k];
+				const int i = bspans[p];
+				// The edges may have already been visited by an earlier contour of this region.
+				if (flags[i] == 0)
+					continue;
+
+				verts.clear();
+				simplified.clear();
+
+				walkContour(bcoords[p*2+0], bcoords[p*2+1], i, *chf, flags, verts, spans);
+				simplifyContour(verts, simplified, maxError, maxEdgeLen, buildFlags);
+				removeDegenerateSegments(simplified);
+
+				if (simplified.size()/4 < 3)
+					continue;
+
+				rcContour& cont = slots[p];
+				cont.nverts = simplified.size()/4;
+				cont.verts = copyContourVerts(simplified, chf->borderSize);
+				cont.nrverts = verts.size()/4;
+				cont.rverts = copyContourVerts(verts, chf->borderSize);
+				cont.reg = (unsigned short)reg;
+				cont.area = chf->areas[i];
+				if (!cont.verts || !cont.rverts)
+					failed->store(1);
 			}
-			
-			// Finally merge each regions holes into the outline.
-			for (int i = 0; i < nregions; i++)
+		}
+	}
+};
+}  // namespace
+
+template<class Spans>
+static bool buildContoursParallel(rcContext* ctx, rcCompactHeightfield& chf,
+								  const float maxError, const int maxEdgeLen,
+								  rcContourSet& cset, const int buildFlags, const Spans& spans)
+{
+	rcAssert(ctx);
+	
+	const int w = chf.width;
+	const int h = chf.height;
+	
+	rcScopedTimer timer(ctx, RC_TIMER_BUILD_CONTOURS);
+	
+	initContourSet(chf, maxError, cset);
+	cset.conts = 0;
+	cset.nconts = 0;
+	
+	rcScopedDelete<unsigned char> flags((unsigned char*)rcAlloc(sizeof(unsigned char)*chf.spanCount, RC_ALLOC_TEMP));
+	if (!flags)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildContoursParallel: Out of memory 'flags' (%d).", chf.spanCount);
+		return false;
+	}
+	
+	ctx->startTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
+	
+	// Mark boundaries.
+	rcMarkBoundaryBody<Spans> markBody = { spans, &chf, flags };
+	ctx->parallelFor(h, 16, rcParallelForBody<rcMarkBoundaryBody<Spans> >, &markBody);
+	
+	// Collect the spans a contour can start from in scan order, and group them by region.
+	const int nregions = chf.maxRegions+1;
+	rcTempVector<int> regionFirst(nregions+1, 0);
+	rcTempVector<int> bspans;
+	rcTempVector<int> bcoords;
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				rcContourRegion& reg = regions[i];
-				if (!reg.nholes) continue;
-				
-				if (reg.outline)
-				{
-					mergeRegionHoles(ctx, reg);
-				}
-				else
+				if (flags[i] == 0 || flags[i] == 0xf)
 				{
-					// The region does not have an outline.
-					// This can happen if the contour becaomes selfoverlapping because of
-					// too aggressive simplification settings.
-					ctx->log(RC_LOG_ERROR, "rcBuildContours: Bad outline for region %d, contour simplification is likely too aggressive.", i);
+					flags[i] = 0;
+					continue;
 				}
+				bspans.push_back(i);
+				bcoords.push_back(x);
+				bcoords.push_back(y);
+				regionFirst[spans.reg(i)+1]++;
 			}
 		}
-		
 	}
+	const int nbspans = (int)bspans.size();
+	
+	rcTempVector<int> regionIds;
+	for (int i = 0; i < nregions; ++i)
+	{
+		if (regionFirst[i+1] > 0)
+			regionIds.push_back(i);
+		regionFirst[i+1] += regionFirst[i];
+	}
+	rcTempVector<int> bucket(rcMax(nbspans, 1));
+	{
+		rcTempVector<int> fill(regionFirst.data(), regionFirst.data() + nregions);
+		for (int p = 0; p < nbspans; ++p)
+			bucket[fill[spans.reg(bspans[p])]++] = p;
+	}
+	
+	rcTempVector<rcContour> slots(rcMax(nbspans, 1));
+	memset(slots.data(), 0, sizeof(rcContour)*slots.size());
+	
+	// Trace and simplify the regions.
+	std::atomic<int> failed(0);
+	rcTraceRegionsBody<Spans> traceBody = { spans, &chf, flags, regionIds.data(), regionFirst.data(), bucket.data(),
+									 bspans.data(), bcoords.data(), slots.data(),
+									 maxError, maxEdgeLen, buildFlags, &failed };
+	ctx->parallelFor((int)regionIds.size(), 1, rcParallelForBody<rcTraceRegionsBody<Spans> >, &traceBody);
+	
+	ctx->stopTimer(RC_TIMER_BUILD_CONTOURS_TRACE);
+	
+	int nconts = 0;
+	for (int p = 0; p < nbspans; ++p)
+	{
+		if (slots[p].nverts > 0)
+			nconts++;
+	}
+	
+	cset.conts = failed.load() ? 0 : (rcContour*)rcAlloc(sizeof(rcContour)*rcMax(nconts, 1), RC_ALLOC_PERM);
+	if (!cset.conts)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildContoursParallel: Out of memory 'conts' (%d).", nconts);
+		for (int p = 0; p < nbspans; ++p)
+		{
+			rcFree(slots[p].verts);
+			rcFree(slots[p].rverts);
+		}
+		return false;
+	}
+	for (int p = 0; p < nbspans; ++p)
+	{
+		if (slots[p].nverts > 0)
+			cset.conts[cset.nconts++] = slots[p];
+	}
+	
+	// Merge holes if needed.
+	if (!mergeContourHoles(ctx, chf, cset))
+		return false;
+	
+	addContourCounts(ctx, cset);
 	
 	return true;
 }
+
+/// @par
+///
+/// Produces the same contour set as #rcBuildContours, in the same order.
+///
+/// The boundary flags are computed one row at a time in parallel. Contour tracing only ever 
+/// visits spans of the region being traced, so the regions are traced and simplified 
+/// independently on the task scheduler of the build context. Each contour is 
+/// stored in a slot keyed by the span it was started from, and the slots are gathered in scan 
+/// order afterwards, which keeps the contour order identical to the serial build. The holes 
+/// are merged on the calling thread once all regions are done.
+///
+/// The build context is only accessed from the calling thread. Without a task scheduler the 
+/// regions are traced on the calling thread.
+///
+/// @see rcBuildContours, rcContext::setTaskScheduler, rcAllocContourSet, rcCompactHeightfield, rcContourSet, rcConfig
+bool rcBuildContoursParallel(rcContext* ctx, rcCompactHeightfield& chf,
+							 const float maxError, const int maxEdgeLen,
+							 rcContourSet& cset, const int buildFlags)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildContoursParallel(ctx, chf, maxError, maxEdgeLen, cset, buildFlags, rcCompactSpansSoA(chf));
+	return buildContoursParallel(ctx, chf, maxError, maxEdgeLen, cset, buildFlags, rcCompactSpansAoS(chf));
+}
@@ -25,28 +25,28 @@
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastCompactSpans.h"
 
 
-// Must be 255 or smaller (not 256) because layer IDs are stored as
-// a byte where 255 is a special value.
-static const int RC_MAX_LAYERS = 63;
-static const int RC_MAX_NEIS = 16;
+
+// Region id of spans that do not belong to any region.
+static const unsigned short RC_NULL_LAYER_REGION = 0xffff;
+// Number of rows swept by one task. (See: rcBuildHeightfieldLayers)
+static const int RC_LAYER_SWEEP_ROWS = 16;
 
 struct rcLayerRegion
 {
-	unsigned char layers[RC_MAX_LAYERS];
-	unsigned char neis[RC_MAX_NEIS];
+	rcTempVector<unsigned short> layers;	// Regions overlapping this region.
+	rcTempVector<unsigned short> neis;		// Neighbour regions.
 	unsigned short zmin, zmax;
-	unsigned char layerId;		// Layer ID
-	unsigned char nlayers;		// Layer count
-	unsigned char nneis;		// Neighbour count
+	int layerId;		// Layer ID
 	unsigned char base;		// Flag indicating if the region is the base of merged regions.
 };
 
 
-static bool contains(const unsigned char* a, const unsigned char an, const unsigned char v)
+static bool contains(const rcTempVector<unsigned short>& a, const unsigned short v)
 {
-	const int n = (int)an;
+	const int n = (int)a.size();
 	for (int i = 0; i < n; ++i)
 	{
 		if (a[i] == v)
@@ -55,17 +55,10 @@ static bool contains(const unsigned char* a, const unsigned char an, const unsig
 	return false;
 }
 
-static bool addUnique(unsigned char* a, unsigned char& an, int anMax, unsigned char v)
+static void addUnique(rcTempVector<unsigned short>& a, const unsigned short v)
 {
-	if (contains(a, an, v))
-		return true;
-
-	if ((int)an >= anMax)
-		return false;
-
-	a[an] = v;
-	an++;
-	return true;
+	if (!contains(a, v))
+		a.push_back(v);
 }
 
 
@@ -79,52 +72,40 @@ inline bool overlapRange(const unsigned short amin, const unsigned short amax,
 
 struct rcLayerSweepSpan
 {
-	unsigned short ns;	// number samples
-	unsigned char id;	// region id
-	unsigned char nei;	// neighbour id
+	int ns;					// number samples
+	unsigned short id;		// region id
+	unsigned short nei;		// neighbour id
 };
 
-/// @par
-/// 
-/// See the #rcConfig documentation for more information on the configuration parameters.
-/// 
-/// @see rcAllocHeightfieldLayerSet, rcCompactHeightfield, rcHeightfieldLayerSet, rcConfig
-bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
-							  const int borderSize, const int walkableHeight,
-							  rcHeightfieldLayerSet& lset)
+// A band of rows that is partitioned into monotone regions independently of the other bands.
+struct rcLayerSweepBand
+{
+	int miny, maxy;		// The rows of the band.
+	int nregs;			// The number of band local regions.
+	int nfirst;			// The number of band local regions started on the first row.
+	bool overflow;		// True if the band ran out of region ids.
+};
+
+// Partitions the rows of a band into monotone regions with band local region ids.
+// The first row is swept without looking at the previous band; see stitchLayerBand.
+template<class Spans>
+static void sweepLayerBand(const rcCompactHeightfield& chf, const int borderSize,
+						   unsigned short* srcReg, rcLayerSweepBand& band, const Spans& spans)
 {
-	rcAssert(ctx);
-	
-	rcScopedTimer timer(ctx, RC_TIMER_BUILD_LAYERS);
-	
 	const int w = chf.width;
-	const int h = chf.height;
 	
-	rcScopedDelete<unsigned char> srcReg((unsigned char*)rcAlloc(sizeof(unsigned char)*chf.spanCount, RC_ALLOC_TEMP));
-	if (!srcReg)
-	{
-		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'srcReg' (%d).", chf.spanCount);
-		return false;
-	}
-	memset(srcReg,0xff,sizeof(unsigned char)*chf.spanCount);
+	rcTempVector<rcLayerSweepSpan> sweeps(w);
+	rcTempVector<int> prevCount;
+	int regId = 0;
 	
-	const int nsweeps = chf.width;
-	rcScopedDelete<rcLayerSweepSpan> sweeps((rcLayerSweepSpan*)rcAlloc(sizeof(rcLayerSweepSpan)*nsweeps, RC_ALLOC_TEMP));
-	if (!sweeps)
-	{
-		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'sweeps' (%d).", nsweeps);
-		return false;
-	}
-	
-	
-	// Partition walkable area into monotone regions.
-	int prevCount[256];
-	unsigned char regId = 0;
+	band.nregs = 0;
+	band.nfirst = 0;
+	band.overflow = false;
 
-	for (int y = borderSize; y < h-borderSize; ++y)
+	for (int y = band.miny; y < band.maxy; ++y)
 	{
-		memset(prevCount,0,sizeof(int)*regId);
-		unsigned char sweepId = 0;
+		prevCount.assign(regId, 0);
+		int sweepId = 0;
 		
 		for (int x = borderSize; x < w-borderSize; ++x)
 		{
@@ -132,36 +113,43 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 			
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				if (chf.areas[i] == RC_NULL_AREA) continue;
 
-				unsigned char sid = 0xff;
+				unsigned short sid = RC_NULL_LAYER_REGION;
 
 				// -x
-				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
+				if (spans.con(i, 0) != RC_NOT_CONNECTED)
 				{
 					const int ax = x + rcGetDirOffsetX(0);
 					const int ay = y + rcGetDirOffsetY(0);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 0);
-					if (chf.areas[ai] != RC_NULL_AREA && srcReg[ai] != 0xff)
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 0);
+					if (chf.areas[ai] != RC_NULL_AREA && srcReg[ai] != RC_NULL_LAYER_REGION)
 						sid = srcReg[ai];
 				}
 				
-				if (sid == 0xff)
+				if (sid == RC_NULL_LAYER_REGION)
 				{
-					sid = sweepId++;
-					sweeps[sid].nei = 0xff;
+					if (sweepId >= (int)RC_NULL_LAYER_REGION)
+					{
+						band.overflow = true;
+						return;
+					}
+					// A row can have more sweeps than cells when the cells have several spans.
+					if (sweepId >= (int)sweeps.size())
+						sweeps.resize(rcMax(sweepId*2, 16));
+					sid = (unsigned short)sweepId++;
+					sweeps[sid].nei = RC_NULL_LAYER_REGION;
 					sweeps[sid].ns = 0;
 				}
 				
-				// -y
-				if (rcGetCon(s,3) != RC_NOT_CONNECTED)
+				// -y, the first row of the band is connected to the previous band later.
+				if (y > band.miny && spans.con(i, 3) != RC_NOT_CONNECTED)
 				{
 					const int ax = x + rcGetDirOffsetX(3);
 					const int ay = y + rcGetDirOffsetY(3);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
-					const unsigned char nr = srcReg[ai];
-					if (nr != 0xff)
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 3);
+					const unsigned short nr = srcReg[ai];
+					if (nr != RC_NULL_LAYER_REGION)
 					{
 						// Set neighbour when first valid neighbour is encoutered.
 						if (sweeps[sid].ns == 0)
@@ -177,7 +165,7 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 						{
 							// This is hit if there is nore than one neighbour.
 							// Invalidate the neighbour.
-							sweeps[sid].nei = 0xff;
+							sweeps[sid].nei = RC_NULL_LAYER_REGION;
 						}
 					}
 				}
@@ -191,20 +179,22 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 		{
 			// If the neighbour is set and there is only one continuous connection to it,
 			// the sweep will be merged with the previous one, else new region is created.
-			if (sweeps[i].nei != 0xff && prevCount[sweeps[i].nei] == (int)sweeps[i].ns)
+			if (sweeps[i].nei != RC_NULL_LAYER_REGION && prevCount[sweeps[i].nei] == sweeps[i].ns)
 			{
 				sweeps[i].id = sweeps[i].nei;
 			}
 			else
 			{
-				if (regId == 255)
+				if (regId >= (int)RC_NULL_LAYER_REGION)
 				{
-					ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Region ID overflow.");
-					return false;
+					band.overflow = true;
+					return;
 				}
-				sweeps[i].id = regId++;
+				sweeps[i].id = (unsigned short)regId++;
 			}
 		}
+		if (y == band.miny)
+			band.nfirst = regId;
 		
 		// Remap local sweep ids to region ids.
 		for (int x = borderSize; x < w-borderSize; ++x)
@@ -212,88 +202,345 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				if (srcReg[i] != 0xff)
+				if (srcReg[i] != RC_NULL_LAYER_REGION)
 					srcReg[i] = sweeps[srcReg[i]].id;
 			}
 		}
 	}
+	
+	band.nregs = regId;
+}
 
-	// Allocate and init layer regions.
-	const int nregs = (int)regId;
-	rcScopedDelete<rcLayerRegion> regs((rcLayerRegion*)rcAlloc(sizeof(rcLayerRegion)*nregs, RC_ALLOC_TEMP));
-	if (!regs)
+// Connects the regions started on the first row of a band to the regions of the previous band,
+// which must already use global region ids, and assigns global ids to the regions of the band.
+// The ids are the same as if all rows had been swept in one go.
+template<class Spans>
+static void stitchLayerBand(const rcCompactHeightfield& chf, const int borderSize,
+							const unsigned short* srcReg, const rcLayerSweepBand& band,
+							int& nregs, rcTempVector<int>& remap, const Spans& spans)
+{
+	const int w = chf.width;
+	const int y = band.miny;
+	
+	remap.resize(band.nregs);
+	
+	// Each region started on the first row covers exactly one sweep of that row.
+	rcTempVector<rcLayerSweepSpan> first(rcMax(band.nfirst, 1));
+	for (int i = 0; i < band.nfirst; ++i)
+	{
+		first[i].nei = RC_NULL_LAYER_REGION;
+		first[i].ns = 0;
+	}
+	rcTempVector<int> prevCount(rcMax(nregs, 1), 0);
+	
+	if (y > borderSize)
+	{
+		for (int x = borderSize; x < w-borderSize; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			{
+				const unsigned short sid = srcReg[i];
+				if (sid == RC_NULL_LAYER_REGION)
+					continue;
+				
+				// -y
+				if (spans.con(i, 3) != RC_NOT_CONNECTED)
+				{
+					const int ax = x + rcGetDirOffsetX(3);
+					const int ay = y + rcGetDirOffsetY(3);
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 3);
+					const unsigned short nr = srcReg[ai];
+					if (nr != RC_NULL_LAYER_REGION)
+					{
+						if (first[sid].ns == 0)
+							first[sid].nei = nr;
+						
+						if (first[sid].nei == nr)
+						{
+							first[sid].ns++;
+							prevCount[nr]++;
+						}
+						else
+						{
+							first[sid].nei = RC_NULL_LAYER_REGION;
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	for (int i = 0; i < band.nfirst; ++i)
+	{
+		if (first[i].nei != RC_NULL_LAYER_REGION && prevCount[first[i].nei] == first[i].ns)
+			remap[i] = first[i].nei;
+		else
+			remap[i] = nregs++;
+	}
+	for (int i = band.nfirst; i < band.nregs; ++i)
+		remap[i] = nregs++;
+}
+
+static void remapLayerRows(const rcCompactHeightfield& chf, const int borderSize,
+						   const int* remap, unsigned short* srcReg, const int miny, const int maxy)
+{
+	const int w = chf.width;
+	for (int y = miny; y < maxy; ++y)
+	{
+		for (int x = borderSize; x < w-borderSize; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			{
+				if (srcReg[i] != RC_NULL_LAYER_REGION)
+					srcReg[i] = (unsigned short)remap[srcReg[i]];
+			}
+		}
+	}
+}
+
+template<class Spans>
+struct rcLayerSweepBody
+{
+	const rcCompactHeightfield* chf;
+	int borderSize;
+	unsigned short* srcReg;
+	rcLayerSweepBand* bands;
+	Spans spans;
+
+	void operator()(const int begin, const int end) const
+	{
+		for (int b = begin; b < end; ++b)
+			sweepLayerBand(*chf, borderSize, srcReg, bands[b], spans);
+	}
+};
+
+struct rcLayerRemapBody
+{
+	const rcCompactHeightfield* chf;
+	int borderSize;
+	unsigned short* srcReg;
+	const rcLayerSweepBand* bands;
+	const rcTempVector<int>* remaps;
+
+	void operator()(const int begin, const int end) const
+	{
+		// The last row of each band was remapped while stitching.
+		for (int b = begin; b < end; ++b)
+			remapLayerRows(*chf, borderSize, remaps[b].data(), srcReg, bands[b].miny, bands[b].maxy-1);
+	}
+};
+
+// Copies the spans of one layer from the compact heightfield.
+template<class Spans>
+static void fillLayer(const rcCompactHeightfield& chf, const int borderSize,
+					  const unsigned short* srcReg, const rcLayerRegion* regs,
+					  const int curId, rcHeightfieldLayer* layer, const Spans& spans)
+{
+	const int w = chf.width;
+	const int lw = layer->width;
+	const int lh = layer->height;
+	const int hmin = layer->hmin;
+	
+	// Copy height and area from compact heightfield. 
+	for (int y = 0; y < lh; ++y)
+	{
+		for (int x = 0; x < lw; ++x)
+		{
+			const int cx = borderSize+x;
+			const int cy = borderSize+y;
+			const rcCompactCell& c = chf.cells[cx+cy*w];
+			for (int j = (int)c.index, nj = (int)(c.index+c.count); j < nj; ++j)
+			{
+				// Skip unassigned regions.
+				if (srcReg[j] == RC_NULL_LAYER_REGION)
+					continue;
+				// Skip of does nto belong to current layer.
+				const int lid = regs[srcReg[j]].layerId;
+				if (lid != curId)
+					continue;
+				
+				// Update data bounds.
+				layer->minx = rcMin(layer->minx, x);
+				layer->maxx = rcMax(layer->maxx, x);
+				layer->miny = rcMin(layer->miny, y);
+				layer->maxy = rcMax(layer->maxy, y);
+				
+				// Store height and area type.
+				const int idx = x+y*lw;
+				layer->heights[idx] = (unsigned char)(spans.z(j) - hmin);
+				layer->areas[idx] = chf.areas[j];
+				
+				// Check connection.
+				unsigned char portal = 0;
+				unsigned char con = 0;
+				for (int dir = 0; dir < 4; ++dir)
+				{
+					if (spans.con(j, dir) != RC_NOT_CONNECTED)
+					{
+						const int ax = cx + rcGetDirOffsetX(dir);
+						const int ay = cy + rcGetDirOffsetY(dir);
+						const int ai = (int)chf.cells[ax+ay*w].index + spans.con(j, dir);
+						const int alid = srcReg[ai] != RC_NULL_LAYER_REGION ? regs[srcReg[ai]].layerId : -1;
+						// Portal mask
+						if (chf.areas[ai] != RC_NULL_AREA && lid != alid)
+						{
+							portal |= (unsigned char)(1<<dir);
+							// Update height so that it matches on both sides of the portal.
+							if (spans.z(ai) > hmin)
+								layer->heights[idx] = rcMax(layer->heights[idx], (unsigned char)(spans.z(ai) - hmin));
+						}
+						// Valid connection mask
+						if (chf.areas[ai] != RC_NULL_AREA && lid == alid)
+						{
+							const int nx = ax - borderSize;
+							const int ny = ay - borderSize;
+							if (nx >= 0 && ny >= 0 && nx < lw && ny < lh)
+								con |= (unsigned char)(1<<dir);
+						}
+					}
+				}
+				
+				layer->cons[idx] = (portal << 4) | con;
+			}
+		}
+	}
+	
+	if (layer->minx > layer->maxx)
+		layer->minx = layer->maxx = 0;
+	if (layer->miny > layer->maxy)
+		layer->miny = layer->maxy = 0;
+}
+
+template<class Spans>
+struct rcLayerFillBody
+{
+	const rcCompactHeightfield* chf;
+	int borderSize;
+	const unsigned short* srcReg;
+	const rcLayerRegion* regs;
+	rcHeightfieldLayer* layers;
+	Spans spans;
+
+	void operator()(const int begin, const int end) const
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'regs' (%d).", nregs);
+		for (int i = begin; i < end; ++i)
+			fillLayer(*chf, borderSize, srcReg, regs, i, &layers[i], spans);
+	}
+};
+
+template<class Spans>
+static bool buildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
+								   const int borderSize, const int walkableHeight,
+								   rcHeightfieldLayerSet& lset, const Spans& spans)
+{
+	rcAssert(ctx);
+	
+	rcScopedTimer timer(ctx, RC_TIMER_BUILD_LAYERS);
+	
+	const int w = chf.width;
+	const int h = chf.height;
+	
+	rcScopedDelete<unsigned short> srcReg((unsigned short*)rcAlloc(sizeof(unsigned short)*chf.spanCount, RC_ALLOC_TEMP));
+	if (!srcReg)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'srcReg' (%d).", chf.spanCount);
 		return false;
 	}
-	memset(regs, 0, sizeof(rcLayerRegion)*nregs);
+	memset(srcReg,0xff,sizeof(unsigned short)*chf.spanCount);
+	
+	// Partition walkable area into monotone regions.
+	const int nrows = rcMax(h-borderSize*2, 0);
+	const int nbands = (nrows + RC_LAYER_SWEEP_ROWS-1) / RC_LAYER_SWEEP_ROWS;
+	rcTempVector<rcLayerSweepBand> bands(nbands);
+	for (int b = 0; b < nbands; ++b)
+	{
+		bands[b].miny = borderSize + b*RC_LAYER_SWEEP_ROWS;
+		bands[b].maxy = rcMin(bands[b].miny + RC_LAYER_SWEEP_ROWS, h-borderSize);
+	}
+	rcLayerSweepBody<Spans> sweepBody = { &chf, borderSize, srcReg, bands.data(), spans };
+	ctx->parallelFor(nbands, 1, rcParallelForBody<rcLayerSweepBody<Spans> >, &sweepBody);
+	
+	// Connect the bands and assign global region ids.
+	rcTempVector<rcTempVector<int> > remaps(nbands);
+	int nregs = 0;
+	for (int b = 0; b < nbands; ++b)
+	{
+		if (bands[b].overflow)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Region ID overflow.");
+			return false;
+		}
+		stitchLayerBand(chf, borderSize, srcReg, bands[b], nregs, remaps[b], spans);
+		if (nregs > (int)RC_NULL_LAYER_REGION)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Region ID overflow (%d).", nregs);
+			return false;
+		}
+		// The next band is connected to the last row of this band.
+		remapLayerRows(chf, borderSize, remaps[b].data(), srcReg, bands[b].maxy-1, bands[b].maxy);
+	}
+	rcLayerRemapBody remapBody = { &chf, borderSize, srcReg, bands.data(), remaps.data() };
+	ctx->parallelFor(nbands, 1, rcParallelForBody<rcLayerRemapBody>, &remapBody);
+
+	// Allocate and init layer regions.
+	rcTempVector<rcLayerRegion> regs(nregs);
 	for (int i = 0; i < nregs; ++i)
 	{
-		regs[i].layerId = 0xff;
+		regs[i].layerId = -1;
 		regs[i].zmin = 0xffff;
 		regs[i].zmax = 0;
+		regs[i].base = 0;
 	}
 	
 	// Find region neighbours and overlapping regions.
+	rcTempVector<unsigned short> lregs;
 	for (int y = 0; y < h; ++y)
 	{
 		for (int x = 0; x < w; ++x)
 		{
 			const rcCompactCell& c = chf.cells[x+y*w];
 			
-			unsigned char lregs[RC_MAX_LAYERS];
-			int nlregs = 0;
+			lregs.clear();
 			
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
-				const unsigned char ri = srcReg[i];
-				if (ri == 0xff) continue;
+				const unsigned short ri = srcReg[i];
+				if (ri == RC_NULL_LAYER_REGION) continue;
 				
-				regs[ri].zmin = rcMin(regs[ri].zmin, s.z);
-				regs[ri].zmax = rcMax(regs[ri].zmax, s.z);
+				regs[ri].zmin = rcMin(regs[ri].zmin, spans.z(i));
+				regs[ri].zmax = rcMax(regs[ri].zmax, spans.z(i));
 				
 				// Collect all region layers.
-				if (nlregs < RC_MAX_LAYERS)
-					lregs[nlregs++] = ri;
+				lregs.push_back(ri);
 				
 				// Update neighbours
 				for (int dir = 0; dir < 4; ++dir)
 				{
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					if (spans.con(i, dir) != RC_NOT_CONNECTED)
 					{
 						const int ax = x + rcGetDirOffsetX(dir);
 						const int ay = y + rcGetDirOffsetY(dir);
-						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
-						const unsigned char rai = srcReg[ai];
-						if (rai != 0xff && rai != ri)
-						{
-							// Don't check return value -- if we cannot add the neighbor
-							// it will just cause a few more regions to be created, which
-							// is fine.
-							addUnique(regs[ri].neis, regs[ri].nneis, RC_MAX_NEIS, rai);
-						}
+						const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, dir);
+						const unsigned short rai = srcReg[ai];
+						if (rai != RC_NULL_LAYER_REGION && rai != ri)
+							addUnique(regs[ri].neis, rai);
 					}
 				}
 				
 			}
 			
 			// Update overlapping regions.
+			const int nlregs = (int)lregs.size();
 			for (int i = 0; i < nlregs-1; ++i)
 			{
 				for (int j = i+1; j < nlregs; ++j)
 				{
 					if (lregs[i] != lregs[j])
 					{
-						rcLayerRegion& ri = regs[lregs[i]];
-						rcLayerRegion& rj = regs[lregs[j]];
-
-						if (!addUnique(ri.layers, ri.nlayers, RC_MAX_LAYERS, lregs[j]) ||
-							!addUnique(rj.layers, rj.nlayers, RC_MAX_LAYERS, lregs[i]))
-						{
-							ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: layer overflow (too many overlapping walkable platforms). Try increasing RC_MAX_LAYERS.");
-							return false;
-						}
+						addUnique(regs[lregs[i]].layers, lregs[j]);
+						addUnique(regs[lregs[j]].layers, lregs[i]);
 					}
 				}
 			}
@@ -302,44 +549,39 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 	}
 	
 	// Create 2D layers from regions.
-	unsigned char layerId = 0;
+	int layerId = 0;
 	
-	static const int MAX_STACK = 64;
-	unsigned char stack[MAX_STACK];
-	int nstack = 0;
+	rcTempVector<unsigned short> queue;
 	
 	for (int i = 0; i < nregs; ++i)
 	{
 		rcLayerRegion& root = regs[i];
 		// Skip already visited.
-		if (root.layerId != 0xff)
+		if (root.layerId != -1)
 			continue;
 
 		// Start search.
 		root.layerId = layerId;
 		root.base = 1;
 		
-		nstack = 0;
-		stack[nstack++] = (unsigned char)i;
+		queue.clear();
+		queue.push_back((unsigned short)i);
 		
-		while (nstack)
+		for (int head = 0; head < (int)queue.size(); ++head)
 		{
 			// Pop front
-			rcLayerRegion& reg = regs[stack[0]];
-			nstack--;
-			for (int j = 0; j < nstack; ++j)
-				stack[j] = stack[j+1];
+			const rcLayerRegion& reg = regs[queue[head]];
 			
-			const int nneis = (int)reg.nneis;
+			const int nneis = (int)reg.neis.size();
 			for (int j = 0; j < nneis; ++j)
 			{
-				const unsigned char nei = reg.neis[j];
+				const unsigned short nei = reg.neis[j];
 				rcLayerRegion& regn = regs[nei];
 				// Skip already visited.
-				if (regn.layerId != 0xff)
+				if (regn.layerId != -1)
 					continue;
 				// Skip if the neighbour is overlapping root region.
-				if (contains(root.layers, root.nlayers, nei))
+				if (contains(root.layers, nei))
 					continue;
 				// Skip if the height range would become too large.
 				const int zmin = rcMin(root.zmin, regn.zmin);
@@ -347,25 +589,16 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 				if ((zmax - zmin) >= 255)
 					 continue;
 
-				if (nstack < MAX_STACK)
-				{
-					// Deepen
-					stack[nstack++] = (unsigned char)nei;
-					
-					// Mark layer id
-					regn.layerId = layerId;
-					// Merge current layers to root.
-					for (int k = 0; k < regn.nlayers; ++k)
-					{
-						if (!addUnique(root.layers, root.nlayers, RC_MAX_LAYERS, regn.layers[k]))
-						{
-							ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: layer overflow (too many overlapping walkable platforms). Try increasing RC_MAX_LAYERS.");
-							return false;
-						}
-					}
-					root.zmin = rcMin(root.zmin, regn.zmin);
-					root.zmax = rcMax(root.zmax, regn.zmax);
-				}
+				// Deepen
+				queue.push_back(nei);
+				
+				// Mark layer id
+				regn.layerId = layerId;
+				// Merge current layers to root.
+				for (int k = 0; k < (int)regn.layers.size(); ++k)
+					addUnique(root.layers, regn.layers[k]);
+				root.zmin = rcMin(root.zmin, regn.zmin);
+				root.zmax = rcMax(root.zmax, regn.zmax);
 			}
 		}
 		
@@ -380,11 +613,11 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 		rcLayerRegion& ri = regs[i];
 		if (!ri.base) continue;
 		
-		unsigned char newId = ri.layerId;
+		const int newId = ri.layerId;
 		
 		for (;;)
 		{
-			unsigned char oldId = 0xff;
+			int oldId = -1;
 			
 			for (int j = 0; j < nregs; ++j)
 			{
@@ -402,15 +635,12 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 				  continue;
 						  
 				// Make sure that there is no overlap when merging 'ri' and 'rj'.
+				// Check if any region overlapping 'ri' has the same layerId as 'rj'.
+				// Index to 'regs' is the same as region id.
 				bool overlap = false;
-				// Iterate over all regions which have the same layerId as 'rj'
-				for (int k = 0; k < nregs; ++k)
+				for (int k = 0; k < (int)ri.layers.size(); ++k)
 				{
-					if (regs[k].layerId != rj.layerId)
-						continue;
-					// Check if region 'k' is overlapping region 'ri'
-					// Index to 'regs' is the same as region id.
-					if (contains(ri.layers,ri.nlayers, (unsigned char)k))
+					if (regs[ri.layers[k]].layerId == rj.layerId)
 					{
 						overlap = true;
 						break;
@@ -426,7 +656,7 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 			}
 			
 			// Could not find anything to merge with, stop.
-			if (oldId == 0xff)
+			if (oldId == -1)
 				break;
 			
 			// Merge
@@ -439,14 +669,8 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 					// Remap layerIds.
 					rj.layerId = newId;
 					// Add overlaid layers from 'rj' to 'ri'.
-					for (int k = 0; k < rj.nlayers; ++k)
-					{
-						if (!addUnique(ri.layers, ri.nlayers, RC_MAX_LAYERS, rj.layers[k]))
-						{
-							ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: layer overflow (too many overlapping walkable platforms). Try increasing RC_MAX_LAYERS.");
-							return false;
-						}
-					}
+					for (int k = 0; k < (int)rj.layers.size(); ++k)
+						addUnique(ri.layers, rj.layers[k]);
 
 					// Update height bounds.
 					ri.zmin = rcMin(ri.zmin, rj.zmin);
@@ -457,26 +681,25 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 	}
 	
 	// Compact layerIds
-	unsigned char remap[256];
-	memset(remap, 0, 256);
+	rcTempVector<int> remap(rcMax(layerId, 1), 0);
 
 	// Find number of unique layers.
-	layerId = 0;
 	for (int i = 0; i < nregs; ++i)
 		remap[regs[i].layerId] = 1;
-	for (int i = 0; i < 256; ++i)
+	int nlayers = 0;
+	for (int i = 0; i < layerId; ++i)
 	{
 		if (remap[i])
-			remap[i] = layerId++;
+			remap[i] = nlayers++;
 		else
-			remap[i] = 0xff;
+			remap[i] = -1;
 	}
 	// Remap ids.
 	for (int i = 0; i < nregs; ++i)
 		regs[i].layerId = remap[regs[i].layerId];
 	
 	// No layers, return empty.
-	if (layerId == 0)
+	if (nlayers == 0)
 		return true;
 	
 	// Create layers.
@@ -494,7 +717,7 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 	bmax[0] -= borderSize*chf.cs;
 	bmax[1] -= borderSize*chf.cs;
 	
-	lset.nlayers = (int)layerId;
+	lset.nlayers = nlayers;
 	
 	lset.layers = (rcHeightfieldLayer*)rcAlloc(sizeof(rcHeightfieldLayer)*lset.nlayers, RC_ALLOC_PERM);
 	if (!lset.layers)
@@ -504,12 +727,21 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 	}
 	memset(lset.layers, 0, sizeof(rcHeightfieldLayer)*lset.nlayers);
 
+	// Find layer height bounds.
+	rcTempVector<int> hmins(nlayers, 0);
+	rcTempVector<int> hmaxs(nlayers, 0);
+	for (int j = 0; j < nregs; ++j)
+	{
+		if (regs[j].base)
+		{
+			hmins[regs[j].layerId] = (int)regs[j].zmin;
+			hmaxs[regs[j].layerId] = (int)regs[j].zmax;
+		}
+	}
 	
-	// Store layers.
+	// Allocate layers.
 	for (int i = 0; i < lset.nlayers; ++i)
 	{
-		unsigned char curId = (unsigned char)i;
-
 		rcHeightfieldLayer* layer = &lset.layers[i];
 
 		const int gridSize = sizeof(unsigned char)*lw*lh;
@@ -538,16 +770,8 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 		}
 		memset(layer->cons, 0, gridSize);
 		
-		// Find layer height bounds.
-		int hmin = 0, hmax = 0;
-		for (int j = 0; j < nregs; ++j)
-		{
-			if (regs[j].base && regs[j].layerId == curId)
-			{
-				hmin = (int)regs[j].zmin;
-				hmax = (int)regs[j].zmax;
-			}
-		}
+		const int hmin = hmins[i];
+		const int hmax = hmaxs[i];
 
 		layer->width = lw;
 		layer->height = lh;
@@ -567,78 +791,38 @@ bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
 		layer->maxx = 0;
 		layer->miny = layer->height;
 		layer->maxy = 0;
-		
-		// Copy height and area from compact heightfield. 
-		for (int y = 0; y < lh; ++y)
-		{
-			for (int x = 0; x < lw; ++x)
-			{
-				const int cx = borderSize+x;
-				const int cy = borderSize+y;
-				const rcCompactCell& c = chf.cells[cx+cy*w];
-				for (int j = (int)c.index, nj = (int)(c.index+c.count); j < nj; ++j)
-				{
-					const rcCompactSpan& s = chf.spans[j];
-					// Skip unassigned regions.
-					if (srcReg[j] == 0xff)
-						continue;
-					// Skip of does nto belong to current layer.
-					unsigned char lid = regs[srcReg[j]].layerId;
-					if (lid != curId)
-						continue;
-					
-					// Update data bounds.
-					layer->minx = rcMin(layer->minx, x);
-					layer->maxx = rcMax(layer->maxx, x);
-					layer->miny = rcMin(layer->miny, y);
-					layer->maxy = rcMax(layer->maxy, y);
-					
-					// Store height and area type.
-					const int idx = x+y*lw;
-					layer->heights[idx] = (unsigned char)(s.z - hmin);
-					layer->areas[idx] = chf.areas[j];
-					
-					// Check connection.
-					unsigned char portal = 0;
-					unsigned char con = 0;
-					for (int dir = 0; dir < 4; ++dir)
-					{
-						if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
-						{
-							const int ax = cx + rcGetDirOffsetX(dir);
-							const int ay = cy + rcGetDirOffsetY(dir);
-							const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
-							unsigned char alid = srcReg[ai] != 0xff ? regs[srcReg[ai]].layerId : 0xff;
-							// Portal mask
-							if (chf.areas[ai] != RC_NULL_AREA && lid != alid)
-							{
-								portal |= (unsigned char)(1<<dir);
-								// Update height so that it matches on both sides of the portal.
-								const rcCompactSpan& as = chf.spans[ai];
-								if (as.z > hmin)
-									layer->heights[idx] = rcMax(layer->heights[idx], (unsigned char)(as.z - hmin));
-							}
-							// Valid connection mask
-							if (chf.areas[ai] != RC_NULL_AREA && lid == alid)
-							{
-								const int nx = ax - borderSize;
-								const int ny = ay - borderSize;
-								if (nx >= 0 && ny >= 0 && nx < lw && ny < lh)
-									con |= (unsigned char)(1<<dir);
-							}
-						}
-					}
-					
-					layer->cons[idx] = (portal << 4) | con;
-				}
-			}
-		}
-		
-		if (layer->minx > layer->maxx)
-			layer->minx = layer->maxx = 0;
-		if (layer->miny > layer->maxy)
-			layer->miny = layer->maxy = 0;
 	}
 	
+	// Store layers.
+	rcLayerFillBody<Spans> fillBody = { &chf, borderSize, srcReg, regs.data(), lset.layers, spans };
+	ctx->parallelFor(lset.nlayers, 1, rcParallelForBody<rcLayerFillBody<Spans> >, &fillBody);
+	
+	ctx->addCount(RC_COUNTER_LAYERS, lset.nlayers);
+	
 	return true;
 }
+
+/// @par
+/// 
+/// See the #rcConfig documentation for more information on the configuration parameters.
+/// 
+/// The walkable area is first partitioned into monotone regions. Bands of rows are swept 
+/// in parallel on the task scheduler of the build context, and the bands are connected in 
+/// order afterwards, so the regions are the same as if the rows had been swept one by one.
+/// The regions are then merged into layers on the calling thread, and the layers are copied 
+/// out of the compact heightfield in parallel.
+///
+/// The number of regions and overlapping layers is only limited by memory (up to 65535 regions). 
+/// The layer ids only depend on the input, so rebuilding the same heightfield produces the same 
+/// layers in the same order, with or without a task scheduler.
+/// 
+/// @see rcAllocHeightfieldLayerSet, rcCompactHeightfield, rcHeightfieldLayerSet, rcConfig, 
+/// rcContext::setTaskScheduler
+bool rcBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
+							  const int borderSize, const int walkableHeight,
+							  rcHeightfieldLayerSet& lset)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildHeightfieldLayers(ctx, chf, borderSize, walkableHeight, lset, rcCompactSpansSoA(chf));
+	return buildHeightfieldLayers(ctx, chf, borderSize, walkableHeight, lset, rcCompactSpansAoS(chf));
+}
@@ -1374,6 +1374,9 @@ bool rcBuildPolyMesh(rcContext* ctx, rcContourSet& cset, const int nvp, rcPolyMe
 		ctx->log(RC_LOG_ERROR, "rcBuildPolyMesh: The resulting mesh has too many polygons %d (max %d). Data can be corrupted.", mesh.npolys, 0xffff);
 	}
 	
+	ctx->addCount(RC_COUNTER_POLYS, mesh.npolys);
+	ctx->addCount(RC_COUNTER_POLY_VERTS, mesh.nverts);
+	
 	return true;
 }
 
@@ -1553,6 +1556,9 @@ bool rcMergePolyMeshes(rcContext* ctx, rcPolyMesh** meshes, const int nmeshes, r
 		ctx->log(RC_LOG_ERROR, "rcMergePolyMeshes: The resulting mesh has too many polygons %d (max %d). Data can be corrupted.", mesh.npolys, 0xffff);
 	}
 	
+	ctx->addCount(RC_COUNTER_POLYS, mesh.npolys);
+	ctx->addCount(RC_COUNTER_POLY_VERTS, mesh.nverts);
+	
 	return true;
 }
 
@@ -25,6 +25,7 @@
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastCompactSpans.h"
 #include <algorithm>
 
 static const unsigned RC_UNSET_HEIGHT = 0xffff;
@@ -975,10 +976,11 @@ static bool buildPolyDetail(rcContext* ctx, const float* in, const int nin,
 	return true;
 }
 
+template<class Spans>
 static void seedArrayWithPolyCenter(rcContext* ctx, const rcCompactHeightfield& chf,
 									const unsigned short* poly, const int npoly,
 									const unsigned short* verts, const int bs,
-									rcHeightPatch& hp, rcIntArray& array)
+									rcHeightPatch& hp, rcIntArray& array, const Spans& spans)
 {
 	// Note: Reads to the compact heightfield are offset by border size (bs)
 	// since border size offset is already removed from the polymesh vertices.
@@ -1005,8 +1007,7 @@ static void seedArrayWithPolyCenter(rcContext* ctx, const rcCompactHeightfield&
 			const rcCompactCell& c = chf.cells[(ax+bs)+(ay+bs)*chf.width];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni && dmin > 0; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
-				int d = rcAbs(az - (int)s.z);
+				int d = rcAbs(az - (int)spans.z(i));
 				if (d < dmin)
 				{
 					startCellX = ax;
@@ -1069,11 +1070,10 @@ static void seedArrayWithPolyCenter(rcContext* ctx, const rcCompactHeightfield&
 		// Push the direct dir last so we start with this on next iteration
 		rcSwap(dirs[directDir], dirs[3]);
 
-		const rcCompactSpan& cs = chf.spans[ci];
 		for (int i = 0; i < 4; i++)
 		{
 			int dir = dirs[i];
-			if (rcGetCon(cs, dir) == RC_NOT_CONNECTED)
+			if (spans.con(ci, dir) == RC_NOT_CONNECTED)
 				continue;
 
 			int newX = cx + rcGetDirOffsetX(dir);
@@ -1090,7 +1090,7 @@ static void seedArrayWithPolyCenter(rcContext* ctx, const rcCompactHeightfield&
 			hp.data[hpx+hpy*hp.width] = 1;
 			array.push(newX);
 			array.push(newY);
-			array.push((int)chf.cells[(newX+bs)+(newY+bs)*chf.width].index + rcGetCon(cs, dir));
+			array.push((int)chf.cells[(newX+bs)+(newY+bs)*chf.width].index + spans.con(ci, dir));
 		}
 
 		rcSwap(dirs[directDir], dirs[3]);
@@ -1103,8 +1103,7 @@ static void seedArrayWithPolyCenter(rcContext* ctx, const rcCompactHeightfield&
 	array.push(ci);
 
 	memset(hp.data, 0xff, sizeof(unsigned short)*hp.width*hp.height);
-	const rcCompactSpan& cs = chf.spans[ci];
-	hp.data[cx-hp.xmin+(cy-hp.ymin)*hp.width] = cs.z;
+	hp.data[cx-hp.xmin+(cy-hp.ymin)*hp.width] = spans.z(ci);
 }
 
 
@@ -1116,11 +1115,12 @@ static void push3(rcIntArray& queue, int v1, int v2, int v3)
 	queue[queue.size() - 1] = v3;
 }
 
+template<class Spans>
 static void getHeightData(rcContext* ctx, const rcCompactHeightfield& chf,
 						  const unsigned short* poly, const int npoly,
 						  const unsigned short* verts, const int bs,
 						  rcHeightPatch& hp, rcIntArray& queue,
-						  int region)
+						  int region, const Spans& spans)
 {
 	// Note: Reads to the compact heightfield are offset by border size (bs)
 	// since border size offset is already removed from the polymesh vertices.
@@ -1147,11 +1147,10 @@ static void getHeightData(rcContext* ctx, const rcCompactHeightfield& chf,
 				const rcCompactCell& c = chf.cells[x + y*chf.width];
 				for (int i = (int)c.index, ni = (int)(c.index + c.count); i < ni; ++i)
 				{
-					const rcCompactSpan& s = chf.spans[i];
-					if (s.reg == region)
+					if (spans.reg(i) == region)
 					{
 						// Store height
-						hp.data[hx + hy*hp.width] = s.z;
+						hp.data[hx + hy*hp.width] = spans.z(i);
 						empty = false;
 
 						// If any of the neighbours is not in same region,
@@ -1159,13 +1158,12 @@ static void getHeightData(rcContext* ctx, const rcCompactHeightfield& chf,
 						bool border = false;
 						for (int dir = 0; dir < 4; ++dir)
 						{
-							if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+							if (spans.con(i, dir) != RC_NOT_CONNECTED)
 							{
 								const int ax = x + rcGetDirOffsetX(dir);
 								const int ay = y + rcGetDirOffsetY(dir);
-								const int ai = (int)chf.cells[ax + ay*chf.width].index + rcGetCon(s, dir);
-								const rcCompactSpan& as = chf.spans[ai];
-								if (as.reg != region)
+								const int ai = (int)chf.cells[ax + ay*chf.width].index + spans.con(i, dir);
+								if (spans.reg(ai) != region)
 								{
 									border = true;
 									break;
@@ -1185,7 +1183,7 @@ static void getHeightData(rcContext* ctx, const rcCompactHeightfield& chf,
 	// or if it could potentially be overlapping polygons of the same region,
 	// then use the center as the seed point.
 	if (empty)
-		seedArrayWithPolyCenter(ctx, chf, poly, npoly, verts, bs, hp, queue);
+		seedArrayWithPolyCenter(ctx, chf, poly, npoly, verts, bs, hp, queue, spans);
 	
 	static const int RETRACT_SIZE = 256;
 	int head = 0;
@@ -1207,10 +1205,9 @@ static void getHeightData(rcContext* ctx, const rcCompactHeightfield& chf,
 			queue.resize(queue.size()-RETRACT_SIZE*3);
 		}
 		
-		const rcCompactSpan& cs = chf.spans[ci];
 		for (int dir = 0; dir < 4; ++dir)
 		{
-			if (rcGetCon(cs, dir) == RC_NOT_CONNECTED) continue;
+			if (spans.con(ci, dir) == RC_NOT_CONNECTED) continue;
 			
 			const int ax = cx + rcGetDirOffsetX(dir);
 			const int ay = cy + rcGetDirOffsetY(dir);
@@ -1223,10 +1220,9 @@ static void getHeightData(rcContext* ctx, const rcCompactHeightfield& chf,
 			if (hp.data[hx + hy*hp.width] != RC_UNSET_HEIGHT)
 				continue;
 			
-			const int ai = (int)chf.cells[ax + ay*chf.width].index + rcGetCon(cs, dir);
-			const rcCompactSpan& as = chf.spans[ai];
+			const int ai = (int)chf.cells[ax + ay*chf.width].index + spans.con(ci, dir);
 			
-			hp.data[hx + hy*hp.width] = as.z;
+			hp.data[hx + hy*hp.width] = spans.z(ai);
 			
 			push3(queue, ax, ay, ai);
 		}
@@ -1258,14 +1254,214 @@ static unsigned char getTriFlags(const float* va, const float* vb, const float*
 	return flags;
 }
 
-/// @par
-///
-/// See the #rcConfig documentation for more information on the configuration parameters.
-///
-/// @see rcAllocPolyMeshDetail, rcPolyMesh, rcCompactHeightfield, rcPolyMeshDetail, rcConfig
-bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompactHeightfield& chf,
-						   const float sampleDist, const float sampleMaxError,
-						   rcPolyMeshDetail& dmesh)
+namespace
+{
+/// The detail submesh of one polygon, built on a worker before it is gathered into the detail mesh.
+struct rcDetailSlot
+{
+	float* verts;			// World space vertices, followed by the triangles. [(x, y, z) * nverts]
+	unsigned char* tris;	// Triangles in detail mesh format. [(vertA, vertB, vertC, flags) * ntris]
+	int nverts;
+	int ntris;
+	char* log;				// Messages logged while building the polygon. [(category, text, '\0') * n]
+	int logSize;
+	bool failed;
+};
+
+/// Records the messages logged by a worker into the slot of the polygon being built, so that 
+/// they can be passed to the build context in polygon order on the calling thread.
+class rcDetailLogContext : public rcContext
+{
+public:
+	rcDetailLogContext() : rcContext(true), m_slot(0) {}
+	
+	void setSlot(rcDetailSlot* slot) { m_slot = slot; }
+	
+protected:
+	virtual void doLog(const rcLogCategory category, const char* msg, const int len)
+	{
+		char* log = (char*)rcAlloc(m_slot->logSize + len + 2, RC_ALLOC_TEMP);
+		if (!log)
+			return;
+		if (m_slot->logSize)
+			memcpy(log, m_slot->log, m_slot->logSize);
+		log[m_slot->logSize] = (char)category;
+		memcpy(&log[m_slot->logSize+1], msg, len);
+		log[m_slot->logSize+1+len] = '\0';
+		rcFree(m_slot->log);
+		m_slot->log = log;
+		m_slot->logSize += len + 2;
+	}
+	
+private:
+	rcDetailSlot* m_slot;
+};
+
+template<class Spans>
+struct rcBuildDetailBody
+{
+	Spans spans;
+	const rcPolyMesh* mesh;
+	const rcCompactHeightfield* chf;
+	const int* bounds;
+	float sampleDist;
+	float sampleMaxError;
+	int heightSearchRadius;
+	int maxhw, maxhh;
+	rcDetailSlot* slots;
+	
+	void operator()(const int begin, const int end) const
+	{
+		const int nvp = mesh->nvp;
+		const float cs = mesh->cs;
+		const float ch = mesh->ch;
+		const float* orig = mesh->bmin;
+		
+		rcDetailLogContext log;
+		rcIntArray edges(64);
+		rcIntArray tris(512);
+		rcIntArray arr(512);
+		rcIntArray samples(512);
+		float verts[256*3];
+		rcHeightPatch hp;
+		hp.data = (unsigned short*)rcAlloc(sizeof(unsigned short)*maxhw*maxhh, RC_ALLOC_TEMP);
+		rcScopedDelete<float> poly((float*)rcAlloc(sizeof(float)*nvp*3, RC_ALLOC_TEMP));
+		
+		for (int i = begin; i < end; ++i)
+		{
+			rcDetailSlot& slot = slots[i];
+			log.setSlot(&slot);
+			
+			if (!hp.data)
+			{
+				log.log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'hp.data' (%d).", maxhw*maxhh);
+				slot.failed = true;
+				continue;
+			}
+			if (!poly)
+			{
+				log.log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'poly' (%d).", nvp*3);
+				slot.failed = true;
+				continue;
+			}
+			
+			const unsigned short* p = &mesh->polys[i*nvp*2];
+			
+			// Store polygon vertices for processing.
+			int npoly = 0;
+			for (int j = 0; j < nvp; ++j)
+			{
+				if(p[j] == RC_MESH_NULL_IDX) break;
+				const unsigned short* v = &mesh->verts[p[j]*3];
+				poly[j*3+0] = v[0]*cs;
+				poly[j*3+1] = v[1]*cs;
+				poly[j*3+2] = v[2]*ch;
+				npoly++;
+			}
+			
+			// Get the height data from the area of the polygon.
+			hp.xmin = bounds[i*4+0];
+			hp.ymin = bounds[i*4+2];
+			hp.width = bounds[i*4+1]-bounds[i*4+0];
+			hp.height = bounds[i*4+3]-bounds[i*4+2];
+			getHeightData(&log, *chf, p, npoly, mesh->verts, mesh->borderSize, hp, arr, mesh->regs[i], spans);
+			
+			// Build detail mesh.
+			int nverts = 0;
+			if (!buildPolyDetail(&log, poly, npoly,
+								 sampleDist, sampleMaxError,
+								 heightSearchRadius, *chf, hp,
+								 verts, nverts, tris,
+								 edges, samples))
+			{
+				slot.failed = true;
+				continue;
+			}
+			
+			// Move detail verts to world space.
+			for (int j = 0; j < nverts; ++j)
+			{
+				verts[j*3+0] += orig[0];
+				verts[j*3+1] += orig[1];
+				verts[j*3+2] += orig[2] + chf->ch; // Is this offset necessary?
+			}
+			// Offset poly too, will be used to flag checking.
+			for (int j = 0; j < npoly; ++j)
+			{
+				poly[j*3+0] += orig[0];
+				poly[j*3+1] += orig[1];
+				poly[j*3+2] += orig[2];
+			}
+			
+			// Store detail submesh.
+			const int ntris = tris.size()/4;
+			const int dataSize = sizeof(float)*nverts*3 + sizeof(unsigned char)*ntris*4;
+			slot.verts = (float*)rcAlloc(rcMax(dataSize, 1), RC_ALLOC_TEMP);
+			if (!slot.verts)
+			{
+				log.log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'slot' (%d).", dataSize);
+				slot.failed = true;
+				continue;
+			}
+			slot.tris = (unsigned char*)&slot.verts[nverts*3];
+			slot.nverts = nverts;
+			slot.ntris = ntris;
+			
+			memcpy(slot.verts, verts, sizeof(float)*nverts*3);
+			for (int j = 0; j < ntris; ++j)
+			{
+				const int* t = &tris[j*4];
+#if 1
+				slot.tris[j*4+0] = (unsigned char)t[0];
+				slot.tris[j*4+1] = (unsigned char)t[2];
+				slot.tris[j*4+2] = (unsigned char)t[1];
+				slot.tris[j*4+3] = getTriFlags(&verts[t[0]*3], &verts[t[2]*3], &verts[t[1]*3], poly, npoly);
+				
+#else
+				slot.tris[j * 4 + 0] = (unsigned char)t[0];
+				slot.tris[j * 4 + 1] = (unsigned char)t[1];
+				slot.tris[j * 4 + 2] = (unsigned char)t[2];
+				slot.tris[j * 4 + 3] = getTriFlags(&verts[t[0] * 3], &verts[t[1] * 3], &verts[t[2] * 3], poly, npoly);
+#endif
+			}
+		}
+	}
+};
+
+struct rcGatherDetailBody
+{
+	rcPolyMeshDetail* dmesh;
+	rcDetailSlot* slots;
+	
+	void operator()(const int begin, const int end) const
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			rcDetailSlot& slot = slots[i];
+			const unsigned int vbase = dmesh->meshes[i*4+0];
+			const unsigned int tbase = dmesh->meshes[i*4+2];
+			memcpy(&dmesh->verts[vbase*3], slot.verts, sizeof(float)*slot.nverts*3);
+			memcpy(&dmesh->tris[tbase*4], slot.tris, sizeof(unsigned char)*slot.ntris*4);
+			rcFree(slot.verts);
+			slot.verts = 0;
+		}
+	}
+};
+}  // namespace
+
+static void freeDetailSlots(rcDetailSlot* slots, const int nslots)
+{
+	for (int i = 0; i < nslots; ++i)
+	{
+		rcFree(slots[i].verts);
+		rcFree(slots[i].log);
+	}
+}
+
+template<class Spans>
+static bool buildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompactHeightfield& chf,
+								const float sampleDist, const float sampleMaxError,
+								rcPolyMeshDetail& dmesh, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -1275,19 +1471,8 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 		return true;
 	
 	const int nvp = mesh.nvp;
-	const float cs = mesh.cs;
-	const float ch = mesh.ch;
-	const float* orig = mesh.bmin;
-	const int borderSize = mesh.borderSize;
 	const int heightSearchRadius = rcMax(1, (int)ceilf(mesh.maxEdgeError));
 	
-	rcIntArray edges(64);
-	rcIntArray tris(512);
-	rcIntArray arr(512);
-	rcIntArray samples(512);
-	float verts[256*3];
-	rcHeightPatch hp;
-	int nPolyVerts = 0;
 	int maxhw = 0, maxhh = 0;
 	
 	rcScopedDelete<int> bounds((int*)rcAlloc(sizeof(int)*mesh.npolys*4, RC_ALLOC_TEMP));
@@ -1296,12 +1481,6 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'bounds' (%d).", mesh.npolys*4);
 		return false;
 	}
-	rcScopedDelete<float> poly((float*)rcAlloc(sizeof(float)*nvp*3, RC_ALLOC_TEMP));
-	if (!poly)
-	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'poly' (%d).", nvp*3);
-		return false;
-	}
 	
 	// Find max size for a polygon area.
 	for (int i = 0; i < mesh.npolys; ++i)
@@ -1323,7 +1502,6 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 			xmax = rcMax(xmax, (int)v[0]);
 			ymin = rcMin(ymin, (int)v[1]);
 			ymax = rcMax(ymax, (int)v[1]);
-			nPolyVerts++;
 		}
 		xmin = rcMax(0,xmin-1);
 		xmax = rcMin(chf.width,xmax+1);
@@ -1334,10 +1512,26 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 		maxhh = rcMax(maxhh, ymax-ymin);
 	}
 	
-	hp.data = (unsigned short*)rcAlloc(sizeof(unsigned short)*maxhw*maxhh, RC_ALLOC_TEMP);
-	if (!hp.data)
+	rcTempVector<rcDetailSlot> slots(mesh.npolys);
+	memset(slots.data(), 0, sizeof(rcDetailSlot)*slots.size());
+	
+	// Build the polygons.
+	rcBuildDetailBody<Spans> buildBody = { spans, &mesh, &chf, bounds, sampleDist, sampleMaxError,
+										   heightSearchRadius, maxhw, maxhh, slots.data() };
+	ctx->parallelFor(mesh.npolys, 8, rcParallelForBody<rcBuildDetailBody<Spans> >, &buildBody);
+	
+	// Pass the messages on in polygon order, up to the first polygon that failed.
+	bool failed = false;
+	for (int i = 0; i < mesh.npolys && !failed; ++i)
+	{
+		const rcDetailSlot& slot = slots[i];
+		for (int j = 0; j < slot.logSize; j += (int)strlen(&slot.log[j+1]) + 2)
+			ctx->log((rcLogCategory)slot.log[j], "%s", &slot.log[j+1]);
+		failed = slot.failed;
+	}
+	if (failed)
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'hp.data' (%d).", maxhw*maxhh);
+		freeDetailSlots(slots.data(), mesh.npolys);
 		return false;
 	}
 	
@@ -1348,147 +1542,67 @@ bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompa
 	if (!dmesh.meshes)
 	{
 		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.meshes' (%d).", dmesh.nmeshes*4);
+		freeDetailSlots(slots.data(), mesh.npolys);
 		return false;
 	}
 	
-	int vcap = nPolyVerts+nPolyVerts/2;
-	int tcap = vcap*2;
+	// Lay the submeshes out in polygon order.
+	for (int i = 0; i < mesh.npolys; ++i)
+	{
+		dmesh.meshes[i*4+0] = (unsigned int)dmesh.nverts;
+		dmesh.meshes[i*4+1] = (unsigned int)slots[i].nverts;
+		dmesh.meshes[i*4+2] = (unsigned int)dmesh.ntris;
+		dmesh.meshes[i*4+3] = (unsigned int)slots[i].ntris;
+		dmesh.nverts += slots[i].nverts;
+		dmesh.ntris += slots[i].ntris;
+	}
 	
-	dmesh.nverts = 0;
-	dmesh.verts = (float*)rcAlloc(sizeof(float)*vcap*3, RC_ALLOC_PERM);
+	dmesh.verts = (float*)rcAlloc(sizeof(float)*rcMax(dmesh.nverts, 1)*3, RC_ALLOC_PERM);
 	if (!dmesh.verts)
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.verts' (%d).", vcap*3);
+		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.verts' (%d).", dmesh.nverts*3);
+		freeDetailSlots(slots.data(), mesh.npolys);
 		return false;
 	}
-	dmesh.ntris = 0;
-	dmesh.tris = (unsigned char*)rcAlloc(sizeof(unsigned char)*tcap*4, RC_ALLOC_PERM);
+	dmesh.tris = (unsigned char*)rcAlloc(sizeof(unsigned char)*rcMax(dmesh.ntris, 1)*4, RC_ALLOC_PERM);
 	if (!dmesh.tris)
 	{
-		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.tris' (%d).", tcap*4);
+		ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'dmesh.tris' (%d).", dmesh.ntris*4);
+		freeDetailSlots(slots.data(), mesh.npolys);
 		return false;
 	}
 	
-	for (int i = 0; i < mesh.npolys; ++i)
-	{
-		const unsigned short* p = &mesh.polys[i*nvp*2];
-		
-		// Store polygon vertices for processing.
-		int npoly = 0;
-		for (int j = 0; j < nvp; ++j)
-		{
-			if(p[j] == RC_MESH_NULL_IDX) break;
-			const unsigned short* v = &mesh.verts[p[j]*3];
-			poly[j*3+0] = v[0]*cs;
-			poly[j*3+1] = v[1]*cs;
-			poly[j*3+2] = v[2]*ch;
-			npoly++;
-		}
-		
-		// Get the height data from the area of the polygon.
-		hp.xmin = bounds[i*4+0];
-		hp.ymin = bounds[i*4+2];
-		hp.width = bounds[i*4+1]-bounds[i*4+0];
-		hp.height = bounds[i*4+3]-bounds[i*4+2];
-		getHeightData(ctx, chf, p, npoly, mesh.verts, borderSize, hp, arr, mesh.regs[i]);
-		
-		// Build detail mesh.
-		int nverts = 0;
-		if (!buildPolyDetail(ctx, poly, npoly,
-							 sampleDist, sampleMaxError,
-							 heightSearchRadius, chf, hp,
-							 verts, nverts, tris,
-							 edges, samples))
-		{
-			return false;
-		}
-		
-		// Move detail verts to world space.
-		for (int j = 0; j < nverts; ++j)
-		{
-			verts[j*3+0] += orig[0];
-			verts[j*3+1] += orig[1];
-			verts[j*3+2] += orig[2] + chf.ch; // Is this offset necessary?
-		}
-		// Offset poly too, will be used to flag checking.
-		for (int j = 0; j < npoly; ++j)
-		{
-			poly[j*3+0] += orig[0];
-			poly[j*3+1] += orig[1];
-			poly[j*3+2] += orig[2];
-		}
-		
-		// Store detail submesh.
-		const int ntris = tris.size()/4;
-		
-		dmesh.meshes[i*4+0] = (unsigned int)dmesh.nverts;
-		dmesh.meshes[i*4+1] = (unsigned int)nverts;
-		dmesh.meshes[i*4+2] = (unsigned int)dmesh.ntris;
-		dmesh.meshes[i*4+3] = (unsigned int)ntris;
-		
-		// Store vertices, allocate more memory if necessary.
-		if (dmesh.nverts+nverts > vcap)
-		{
-			while (dmesh.nverts+nverts > vcap)
-				vcap += 256;
-			
-			float* newv = (float*)rcAlloc(sizeof(float)*vcap*3, RC_ALLOC_PERM);
-			if (!newv)
-			{
-				ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'newv' (%d).", vcap*3);
-				return false;
-			}
-			if (dmesh.nverts)
-				memcpy(newv, dmesh.verts, sizeof(float)*3*dmesh.nverts);
-			rcFree(dmesh.verts);
-			dmesh.verts = newv;
-		}
-		for (int j = 0; j < nverts; ++j)
-		{
-			dmesh.verts[dmesh.nverts*3+0] = verts[j*3+0];
-			dmesh.verts[dmesh.nverts*3+1] = verts[j*3+1];
-			dmesh.verts[dmesh.nverts*3+2] = verts[j*3+2];
-			dmesh.nverts++;
-		}
-		
-		// Store triangles, allocate more memory if necessary.
-		if (dmesh.ntris+ntris > tcap)
-		{
-			while (dmesh.ntris+ntris > tcap)
-				tcap += 256;
-			unsigned char* newt = (unsigned char*)rcAlloc(sizeof(unsigned char)*tcap*4, RC_ALLOC_PERM);
-			if (!newt)
-			{
-				ctx->log(RC_LOG_ERROR, "rcBuildPolyMeshDetail: Out of memory 'newt' (%d).", tcap*4);
-				return false;
-			}
-			if (dmesh.ntris)
-				memcpy(newt, dmesh.tris, sizeof(unsigned char)*4*dmesh.ntris);
-			rcFree(dmesh.tris);
-			dmesh.tris = newt;
-		}
-		for (int j = 0; j < ntris; ++j)
-		{
-			const int* t = &tris[j*4];
-#if 1
-			dmesh.tris[dmesh.ntris*4+0] = (unsigned char)t[0];
-			dmesh.tris[dmesh.ntris*4+1] = (unsigned char)t[2];
-			dmesh.tris[dmesh.ntris*4+2] = (unsigned char)t[1];
-			dmesh.tris[dmesh.ntris*4+3] = getTriFlags(&verts[t[0]*3], &verts[t[2]*3], &verts[t[1]*3], poly, npoly);
-			
-#else
-			dmesh.tris[dmesh.ntris * 4 + 0] = (unsigned char)t[0];
-			dmesh.tris[dmesh.ntris * 4 + 1] = (unsigned char)t[1];
-			dmesh.tris[dmesh.ntris * 4 + 2] = (unsigned char)t[2];
-			dmesh.tris[dmesh.ntris * 4 + 3] = getTriFlags(&verts[t[0] * 3], &verts[t[1] * 3], &verts[t[2] * 3], poly, npoly);
-#endif
-			dmesh.ntris++;
-		}
-	}
+	// Copy the submeshes to their offsets.
+	rcGatherDetailBody gatherBody = { &dmesh, slots.data() };
+	ctx->parallelFor(mesh.npolys, 64, rcParallelForBody<rcGatherDetailBody>, &gatherBody);
+	freeDetailSlots(slots.data(), mesh.npolys);
+	
+	ctx->addCount(RC_COUNTER_DETAIL_VERTS, dmesh.nverts);
+	ctx->addCount(RC_COUNTER_DETAIL_TRIS, dmesh.ntris);
 	
 	return true;
 }
 
+/// @par
+///
+/// See the #rcConfig documentation for more information on the configuration parameters.
+///
+/// The polygons are independent of each other and are built on the task scheduler of the 
+/// build context. Each polygon is built into its own buffer first, then the submeshes are 
+/// copied into the detail mesh at offsets summed up in polygon order, so the result is the 
+/// same with or without a scheduler. Messages logged while building a polygon are passed to 
+/// the build context on the calling thread, in polygon order.
+///
+/// @see rcAllocPolyMeshDetail, rcPolyMesh, rcCompactHeightfield, rcPolyMeshDetail, rcConfig, rcContext::setTaskScheduler
+bool rcBuildPolyMeshDetail(rcContext* ctx, const rcPolyMesh& mesh, const rcCompactHeightfield& chf,
+						   const float sampleDist, const float sampleMaxError,
+						   rcPolyMeshDetail& dmesh)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildPolyMeshDetail(ctx, mesh, chf, sampleDist, sampleMaxError, dmesh, rcCompactSpansSoA(chf));
+	return buildPolyMeshDetail(ctx, mesh, chf, sampleDist, sampleMaxError, dmesh, rcCompactSpansAoS(chf));
+}
+
 /// @see rcAllocPolyMeshDetail, rcPolyMeshDetail
 bool rcMergePolyMeshDetails(rcContext* ctx, rcPolyMeshDetail** meshes, const int nmeshes, rcPolyMeshDetail& mesh)
 {
@@ -1563,6 +1677,9 @@ bool rcMergePolyMeshDetails(rcContext* ctx, rcPolyMeshDetail** meshes, const int
 		}
 	}
 	
+	ctx->addCount(RC_COUNTER_DETAIL_VERTS, mesh.nverts);
+	ctx->addCount(RC_COUNTER_DETAIL_TRIS, mesh.ntris);
+	
 	return true;
 }
 static unsigned char flip_flags(unsigned char flags_in)
@@ -25,6 +25,7 @@
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastCompactSpans.h"
 
 namespace
 {
@@ -37,7 +38,8 @@ struct LevelStackEntry
 };
 }  // namespace
 
-static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* src, unsigned short& maxDist)
+template<class Spans>
+static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* src, unsigned short& maxDist, const Spans& spans)
 {
 	const int w = chf.width;
 	const int h = chf.height;
@@ -54,17 +56,16 @@ static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* sr
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				const unsigned char area = chf.areas[i];
 				
 				int nc = 0;
 				for (int dir = 0; dir < 4; ++dir)
 				{
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					if (spans.con(i, dir) != RC_NOT_CONNECTED)
 					{
 						const int ax = x + rcGetDirOffsetX(dir);
 						const int ay = y + rcGetDirOffsetY(dir);
-						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
+						const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, dir);
 						if (area == chf.areas[ai])
 							nc++;
 					}
@@ -84,44 +85,41 @@ static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* sr
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				
-				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
+				if (spans.con(i, 0) != RC_NOT_CONNECTED)
 				{
 					// (-1,0)
 					const int ax = x + rcGetDirOffsetX(0);
 					const int ay = y + rcGetDirOffsetY(0);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 0);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 0);
 					if (src[ai]+2 < src[i])
 						src[i] = src[ai]+2;
 					
 					// (-1,-1)
-					if (rcGetCon(as, 3) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 3) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(3);
 						const int aay = ay + rcGetDirOffsetY(3);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 3);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 3);
 						if (src[aai]+3 < src[i])
 							src[i] = src[aai]+3;
 					}
 				}
-				if (rcGetCon(s, 3) != RC_NOT_CONNECTED)
+				if (spans.con(i, 3) != RC_NOT_CONNECTED)
 				{
 					// (0,-1)
 					const int ax = x + rcGetDirOffsetX(3);
 					const int ay = y + rcGetDirOffsetY(3);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 3);
 					if (src[ai]+2 < src[i])
 						src[i] = src[ai]+2;
 					
 					// (1,-1)
-					if (rcGetCon(as, 2) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 2) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(2);
 						const int aay = ay + rcGetDirOffsetY(2);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 2);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 2);
 						if (src[aai]+3 < src[i])
 							src[i] = src[aai]+3;
 					}
@@ -138,44 +136,41 @@ static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* sr
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				
-				if (rcGetCon(s, 2) != RC_NOT_CONNECTED)
+				if (spans.con(i, 2) != RC_NOT_CONNECTED)
 				{
 					// (1,0)
 					const int ax = x + rcGetDirOffsetX(2);
 					const int ay = y + rcGetDirOffsetY(2);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 2);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 2);
 					if (src[ai]+2 < src[i])
 						src[i] = src[ai]+2;
 					
 					// (1,1)
-					if (rcGetCon(as, 1) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 1) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(1);
 						const int aay = ay + rcGetDirOffsetY(1);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 1);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 1);
 						if (src[aai]+3 < src[i])
 							src[i] = src[aai]+3;
 					}
 				}
-				if (rcGetCon(s, 1) != RC_NOT_CONNECTED)
+				if (spans.con(i, 1) != RC_NOT_CONNECTED)
 				{
 					// (0,1)
 					const int ax = x + rcGetDirOffsetX(1);
 					const int ay = y + rcGetDirOffsetY(1);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 1);
-					const rcCompactSpan& as = chf.spans[ai];
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 1);
 					if (src[ai]+2 < src[i])
 						src[i] = src[ai]+2;
 					
 					// (-1,1)
-					if (rcGetCon(as, 0) != RC_NOT_CONNECTED)
+					if (spans.con(ai, 0) != RC_NOT_CONNECTED)
 					{
 						const int aax = ax + rcGetDirOffsetX(0);
 						const int aay = ay + rcGetDirOffsetY(0);
-						const int aai = (int)chf.cells[aax+aay*w].index + rcGetCon(as, 0);
+						const int aai = (int)chf.cells[aax+aay*w].index + spans.con(ai, 0);
 						if (src[aai]+3 < src[i])
 							src[i] = src[aai]+3;
 					}
@@ -190,22 +185,20 @@ static void calculateDistanceField(rcCompactHeightfield& chf, unsigned short* sr
 	
 }
 
-static unsigned short* boxBlur(rcCompactHeightfield& chf, int thr,
-							   unsigned short* src, unsigned short* dst)
+template<class Spans>
+static void boxBlurRows(const rcCompactHeightfield& chf, const int thr,
+						const unsigned short* src, unsigned short* dst,
+						const int miny, const int maxy, const Spans& spans)
 {
 	const int w = chf.width;
-	const int h = chf.height;
-	
-	thr *= 2;
 	
-	for (int y = 0; y < h; ++y)
+	for (int y = miny; y < maxy; ++y)
 	{
 		for (int x = 0; x < w; ++x)
 		{
 			const rcCompactCell& c = chf.cells[x+y*w];
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				const unsigned short cd = src[i];
 				if (cd <= thr)
 				{
@@ -216,20 +209,19 @@ static unsigned short* boxBlur(rcCompactHeightfield& chf, int thr,
 				int d = (int)cd;
 				for (int dir = 0; dir < 4; ++dir)
 				{
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					if (spans.con(i, dir) != RC_NOT_CONNECTED)
 					{
 						const int ax = x + rcGetDirOffsetX(dir);
 						const int ay = y + rcGetDirOffsetY(dir);
-						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
+						const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, dir);
 						d += (int)src[ai];
 						
-						const rcCompactSpan& as = chf.spans[ai];
 						const int dir2 = (dir+1) & 0x3;
-						if (rcGetCon(as, dir2) != RC_NOT_CONNECTED)
+						if (spans.con(ai, dir2) != RC_NOT_CONNECTED)
 						{
 							const int ax2 = ax + rcGetDirOffsetX(dir2);
 							const int ay2 = ay + rcGetDirOffsetY(dir2);
-							const int ai2 = (int)chf.cells[ax2+ay2*w].index + rcGetCon(as, dir2);
+							const int ai2 = (int)chf.cells[ax2+ay2*w].index + spans.con(ai, dir2);
 							d += (int)src[ai2];
 						}
 						else
@@ -246,15 +238,40 @@ static unsigned short* boxBlur(rcCompactHeightfield& chf, int thr,
 			}
 		}
 	}
+}
+
+template<class Spans>
+struct rcBoxBlurBody
+{
+	const rcCompactHeightfield* chf;
+	int thr;
+	const unsigned short* src;
+	unsigned short* dst;
+	Spans spans;
+
+	void operator()(const int begin, const int end) const
+	{
+		boxBlurRows(*chf, thr, src, dst, begin, end, spans);
+	}
+};
+
+template<class Spans>
+static unsigned short* boxBlur(rcContext* ctx, rcCompactHeightfield& chf, int thr,
+							   unsigned short* src, unsigned short* dst, const Spans& spans)
+{
+	// Each row only reads from src, so the rows are blurred in parallel.
+	rcBoxBlurBody<Spans> body = { &chf, thr*2, src, dst, spans };
+	ctx->parallelFor(chf.height, 16, rcParallelForBody<rcBoxBlurBody<Spans> >, &body);
 	return dst;
 }
 
 
+template<class Spans>
 static bool floodRegion(int x, int y, int i,
 						unsigned short level, unsigned short r,
 						rcCompactHeightfield& chf,
 						unsigned short* srcReg, unsigned short* srcDist,
-						rcTempVector<LevelStackEntry>& stack)
+						rcTempVector<LevelStackEntry>& stack, const Spans& spans)
 {
 	const int w = chf.width;
 	
@@ -277,18 +294,17 @@ static bool floodRegion(int x, int y, int i,
 		int ci = back.index;
 		stack.pop_back();
 		
-		const rcCompactSpan& cs = chf.spans[ci];
 		
 		// Check if any of the neighbours already have a valid region set.
 		unsigned short ar = 0;
 		for (int dir = 0; dir < 4; ++dir)
 		{
 			// 8 connected
-			if (rcGetCon(cs, dir) != RC_NOT_CONNECTED)
+			if (spans.con(ci, dir) != RC_NOT_CONNECTED)
 			{
 				const int ax = cx + rcGetDirOffsetX(dir);
 				const int ay = cy + rcGetDirOffsetY(dir);
-				const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(cs, dir);
+				const int ai = (int)chf.cells[ax+ay*w].index + spans.con(ci, dir);
 				if (chf.areas[ai] != area)
 					continue;
 				unsigned short nr = srcReg[ai];
@@ -300,14 +316,13 @@ static bool floodRegion(int x, int y, int i,
 					break;
 				}
 				
-				const rcCompactSpan& as = chf.spans[ai];
 				
 				const int dir2 = (dir+1) & 0x3;
-				if (rcGetCon(as, dir2) != RC_NOT_CONNECTED)
+				if (spans.con(ai, dir2) != RC_NOT_CONNECTED)
 				{
 					const int ax2 = ax + rcGetDirOffsetX(dir2);
 					const int ay2 = ay + rcGetDirOffsetY(dir2);
-					const int ai2 = (int)chf.cells[ax2+ay2*w].index + rcGetCon(as, dir2);
+					const int ai2 = (int)chf.cells[ax2+ay2*w].index + spans.con(ai, dir2);
 					if (chf.areas[ai2] != area)
 						continue;
 					unsigned short nr2 = srcReg[ai2];
@@ -330,11 +345,11 @@ static bool floodRegion(int x, int y, int i,
 		// Expand neighbours.
 		for (int dir = 0; dir < 4; ++dir)
 		{
-			if (rcGetCon(cs, dir) != RC_NOT_CONNECTED)
+			if (spans.con(ci, dir) != RC_NOT_CONNECTED)
 			{
 				const int ax = cx + rcGetDirOffsetX(dir);
 				const int ay = cy + rcGetDirOffsetY(dir);
-				const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(cs, dir);
+				const int ai = (int)chf.cells[ax+ay*w].index + spans.con(ci, dir);
 				if (chf.areas[ai] != area)
 					continue;
 				if (chf.dist[ai] >= lev && srcReg[ai] == 0)
@@ -353,17 +368,70 @@ static bool floodRegion(int x, int y, int i,
 // Struct to keep track of entries in the region table that have been changed.
 struct DirtyEntry
 {
+	DirtyEntry() : index(-1), region(0), distance2(0) {}
 	DirtyEntry(int index_, unsigned short region_, unsigned short distance2_)
 		: index(index_), region(region_), distance2(distance2_) {}
 	int index;
 	unsigned short region;
 	unsigned short distance2;
 };
-static void expandRegions(int maxIter, unsigned short level,
+template<class Spans>
+struct rcExpandRegionsBody
+{
+	const rcCompactHeightfield* chf;
+	const unsigned short* srcReg;
+	const unsigned short* srcDist;
+	LevelStackEntry* stack;
+	DirtyEntry* dirtyEntries;	// One per stack entry, with a null region if the entry was not expanded.
+	Spans spans;
+
+	void operator()(const int begin, const int end) const
+	{
+		const int w = chf->width;
+
+		for (int j = begin; j < end; j++)
+		{
+			int x = stack[j].x;
+			int y = stack[j].y;
+			int i = stack[j].index;
+			dirtyEntries[j] = DirtyEntry(i, 0, 0);
+			if (i < 0)
+				continue;
+			
+			unsigned short r = srcReg[i];
+			unsigned short d2 = 0xffff;
+			const unsigned char area = chf->areas[i];
+			for (int dir = 0; dir < 4; ++dir)
+			{
+				if (spans.con(i, dir) == RC_NOT_CONNECTED) continue;
+				const int ax = x + rcGetDirOffsetX(dir);
+				const int ay = y + rcGetDirOffsetY(dir);
+				const int ai = (int)chf->cells[ax+ay*w].index + spans.con(i, dir);
+				if (chf->areas[ai] != area) continue;
+				if (srcReg[ai] > 0 && (srcReg[ai] & RC_BORDER_REG) == 0)
+				{
+					if ((int)srcDist[ai]+2 < (int)d2)
+					{
+						r = srcReg[ai];
+						d2 = srcDist[ai]+2;
+					}
+				}
+			}
+			if (r)
+			{
+				stack[j].index = -1; // mark as used
+				dirtyEntries[j] = DirtyEntry(i, r, d2);
+			}
+		}
+	}
+};
+
+template<class Spans>
+static void expandRegions(rcContext* ctx, int maxIter, unsigned short level,
 					      rcCompactHeightfield& chf,
 					      unsigned short* srcReg, unsigned short* srcDist,
 					      rcTempVector<LevelStackEntry>& stack,
-					      bool fillStack)
+					      bool fillStack, const Spans& spans)
 {
 	const int w = chf.width;
 	const int h = chf.height;
@@ -402,59 +470,24 @@ static void expandRegions(int maxIter, unsigned short level,
 	int iter = 0;
 	while (stack.size() > 0)
 	{
-		int failed = 0;
-		dirtyEntries.clear();
-		
-		for (int j = 0; j < stack.size(); j++)
-		{
-			int x = stack[j].x;
-			int y = stack[j].y;
-			int i = stack[j].index;
-			if (i < 0)
-			{
-				failed++;
-				continue;
-			}
-			
-			unsigned short r = srcReg[i];
-			unsigned short d2 = 0xffff;
-			const unsigned char area = chf.areas[i];
-			const rcCompactSpan& s = chf.spans[i];
-			for (int dir = 0; dir < 4; ++dir)
-			{
-				if (rcGetCon(s, dir) == RC_NOT_CONNECTED) continue;
-				const int ax = x + rcGetDirOffsetX(dir);
-				const int ay = y + rcGetDirOffsetY(dir);
-				const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
-				if (chf.areas[ai] != area) continue;
-				if (srcReg[ai] > 0 && (srcReg[ai] & RC_BORDER_REG) == 0)
-				{
-					if ((int)srcDist[ai]+2 < (int)d2)
-					{
-						r = srcReg[ai];
-						d2 = srcDist[ai]+2;
-					}
-				}
-			}
-			if (r)
-			{
-				stack[j].index = -1; // mark as used
-				dirtyEntries.push_back(DirtyEntry(i, r, d2));
-			}
-			else
-			{
-				failed++;
-			}
-		}
+		// The entries only read the regions of the previous iteration and every span is on the 
+		// stack at most once, so the entries are expanded in parallel.
+		dirtyEntries.resize(stack.size());
+		rcExpandRegionsBody<Spans> body = { &chf, srcReg, srcDist, stack.data(), dirtyEntries.data(), spans };
+		ctx->parallelFor((int)stack.size(), 256, rcParallelForBody<rcExpandRegionsBody<Spans> >, &body);
 		
 		// Copy entries that differ between src and dst to keep them in sync.
-		for (int i = 0; i < dirtyEntries.size(); i++) {
-			int idx = dirtyEntries[i].index;
-			srcReg[idx] = dirtyEntries[i].region;
-			srcDist[idx] = dirtyEntries[i].distance2;
+		int expanded = 0;
+		for (int j = 0; j < dirtyEntries.size(); j++) {
+			if (!dirtyEntries[j].region)
+				continue;
+			int idx = dirtyEntries[j].index;
+			srcReg[idx] = dirtyEntries[j].region;
+			srcDist[idx] = dirtyEntries[j].distance2;
+			expanded++;
 		}
 		
-		if (failed == stack.size())
+		if (expanded == 0)
 			break;
 		
 		if (level > 0)
@@ -680,16 +713,16 @@ static bool isRegionConnectedToBorder(const rcRegion& reg)
 	return false;
 }
 
+template<class Spans>
 static bool isSolidEdge(rcCompactHeightfield& chf, const unsigned short* srcReg,
-						int x, int y, int i, int dir)
+						int x, int y, int i, int dir, const Spans& spans)
 {
-	const rcCompactSpan& s = chf.spans[i];
 	unsigned short r = 0;
-	if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+	if (spans.con(i, dir) != RC_NOT_CONNECTED)
 	{
 		const int ax = x + rcGetDirOffsetX(dir);
 		const int ay = y + rcGetDirOffsetY(dir);
-		const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dir);
+		const int ai = (int)chf.cells[ax+ay*chf.width].index + spans.con(i, dir);
 		r = srcReg[ai];
 	}
 	if (r == srcReg[i])
@@ -697,21 +730,21 @@ static bool isSolidEdge(rcCompactHeightfield& chf, const unsigned short* srcReg,
 	return true;
 }
 
+template<class Spans>
 static void walkContour(int x, int y, int i, int dir,
 						rcCompactHeightfield& chf,
 						const unsigned short* srcReg,
-						rcIntArray& cont)
+						rcIntArray& cont, const Spans& spans)
 {
 	int startDir = dir;
 	int starti = i;
 
-	const rcCompactSpan& ss = chf.spans[i];
 	unsigned short curReg = 0;
-	if (rcGetCon(ss, dir) != RC_NOT_CONNECTED)
+	if (spans.con(i, dir) != RC_NOT_CONNECTED)
 	{
 		const int ax = x + rcGetDirOffsetX(dir);
 		const int ay = y + rcGetDirOffsetY(dir);
-		const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(ss, dir);
+		const int ai = (int)chf.cells[ax+ay*chf.width].index + spans.con(i, dir);
 		curReg = srcReg[ai];
 	}
 	cont.push(curReg);
@@ -719,17 +752,16 @@ static void walkContour(int x, int y, int i, int dir,
 	int iter = 0;
 	while (++iter < 40000)
 	{
-		const rcCompactSpan& s = chf.spans[i];
 		
-		if (isSolidEdge(chf, srcReg, x, y, i, dir))
+		if (isSolidEdge(chf, srcReg, x, y, i, dir, spans))
 		{
 			// Choose the edge corner
 			unsigned short r = 0;
-			if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+			if (spans.con(i, dir) != RC_NOT_CONNECTED)
 			{
 				const int ax = x + rcGetDirOffsetX(dir);
 				const int ay = y + rcGetDirOffsetY(dir);
-				const int ai = (int)chf.cells[ax+ay*chf.width].index + rcGetCon(s, dir);
+				const int ai = (int)chf.cells[ax+ay*chf.width].index + spans.con(i, dir);
 				r = srcReg[ai];
 			}
 			if (r != curReg)
@@ -745,10 +777,10 @@ static void walkContour(int x, int y, int i, int dir,
 			int ni = -1;
 			const int nx = x + rcGetDirOffsetX(dir);
 			const int ny = y + rcGetDirOffsetY(dir);
-			if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+			if (spans.con(i, dir) != RC_NOT_CONNECTED)
 			{
 				const rcCompactCell& nc = chf.cells[nx+ny*chf.width];
-				ni = (int)nc.index + rcGetCon(s, dir);
+				ni = (int)nc.index + spans.con(i, dir);
 			}
 			if (ni == -1)
 			{
@@ -786,10 +818,11 @@ static void walkContour(int x, int y, int i, int dir,
 }
 
 
+template<class Spans>
 static bool mergeAndFilterRegions(rcContext* ctx, int minRegionArea, int mergeRegionSize,
 								  unsigned short& maxRegionId,
 								  rcCompactHeightfield& chf,
-								  unsigned short* srcReg, rcIntArray& overlaps)
+								  unsigned short* srcReg, rcIntArray& overlaps, const Spans& spans)
 {
 	const int w = chf.width;
 	const int h = chf.height;
@@ -842,7 +875,7 @@ static bool mergeAndFilterRegions(rcContext* ctx, int minRegionArea, int mergeRe
 				int ndir = -1;
 				for (int dir = 0; dir < 4; ++dir)
 				{
-					if (isSolidEdge(chf, srcReg, x, y, i, dir))
+					if (isSolidEdge(chf, srcReg, x, y, i, dir, spans))
 					{
 						ndir = dir;
 						break;
@@ -853,7 +886,7 @@ static bool mergeAndFilterRegions(rcContext* ctx, int minRegionArea, int mergeRe
 				{
 					// The cell is at border.
 					// Walk around the contour to find all the neighbours.
-					walkContour(x, y, i, ndir, chf, srcReg, reg.connections);
+					walkContour(x, y, i, ndir, chf, srcReg, reg.connections, spans);
 				}
 			}
 		}
@@ -1041,10 +1074,11 @@ static void addUniqueConnection(rcRegion& reg, int n)
 	reg.connections.push(n);
 }
 
+template<class Spans>
 static bool mergeAndFilterLayerRegions(rcContext* ctx, int minRegionArea,
 									   unsigned short& maxRegionId,
 									   rcCompactHeightfield& chf,
-									   unsigned short* srcReg)
+									   unsigned short* srcReg, const Spans& spans)
 {
 	const int w = chf.width;
 	const int h = chf.height;
@@ -1072,15 +1106,14 @@ static bool mergeAndFilterLayerRegions(rcContext* ctx, int minRegionArea,
 			
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				const unsigned short ri = srcReg[i];
 				if (ri == 0 || ri >= nreg) continue;
 				rcRegion& reg = regions[ri];
 				
 				reg.spanCount++;
 				
-				reg.zmin = rcMin(reg.zmin, s.z);
-				reg.zmax = rcMax(reg.zmax, s.z);
+				reg.zmin = rcMin(reg.zmin, spans.z(i));
+				reg.zmax = rcMax(reg.zmax, spans.z(i));
 				
 				// Collect all region layers.
 				lregs.push(ri);
@@ -1088,11 +1121,11 @@ static bool mergeAndFilterLayerRegions(rcContext* ctx, int minRegionArea,
 				// Update neighbours
 				for (int dir = 0; dir < 4; ++dir)
 				{
-					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					if (spans.con(i, dir) != RC_NOT_CONNECTED)
 					{
 						const int ax = x + rcGetDirOffsetX(dir);
 						const int ay = y + rcGetDirOffsetY(dir);
-						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
+						const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, dir);
 						const unsigned short rai = srcReg[ai];
 						if (rai > 0 && rai < nreg && rai != ri)
 							addUniqueConnection(reg, rai);
@@ -1241,17 +1274,8 @@ static bool mergeAndFilterLayerRegions(rcContext* ctx, int minRegionArea,
 
 
 
-/// @par
-/// 
-/// This is usually the second to the last step in creating a fully built
-/// compact heightfield.  This step is required before regions are built
-/// using #rcBuildRegions or #rcBuildRegionsMonotone.
-/// 
-/// After this step, the distance data is available via the rcCompactHeightfield::maxDistance
-/// and rcCompactHeightfield::dist fields.
-///
-/// @see rcCompactHeightfield, rcBuildRegions, rcBuildRegionsMonotone
-bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
+template<class Spans>
+static bool buildDistanceField(rcContext* ctx, rcCompactHeightfield& chf, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -1282,7 +1306,7 @@ bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 	{
 		rcScopedTimer timerDist(ctx, RC_TIMER_BUILD_DISTANCEFIELD_DIST);
 
-		calculateDistanceField(chf, src, maxDist);
+		calculateDistanceField(chf, src, maxDist, spans);
 		chf.maxDistance = maxDist;
 	}
 
@@ -1290,7 +1314,7 @@ bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 		rcScopedTimer timerBlur(ctx, RC_TIMER_BUILD_DISTANCEFIELD_BLUR);
 
 		// Blur
-		if (boxBlur(chf, 1, src, dst) != src)
+		if (boxBlur(ctx, chf, 1, src, dst, spans) != src)
 			rcSwap(src, dst);
 
 		// Store distance.
@@ -1302,6 +1326,23 @@ bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
 	return true;
 }
 
+/// @par
+/// 
+/// This is usually the second to the last step in creating a fully built
+/// compact heightfield.  This step is required before regions are built
+/// using #rcBuildRegions or #rcBuildRegionsMonotone.
+/// 
+/// After this step, the distance data is available via the rcCompactHeightfield::maxDistance
+/// and rcCompactHeightfield::dist fields.
+///
+/// @see rcCompactHeightfield, rcBuildRegions, rcBuildRegionsMonotone
+bool rcBuildDistanceField(rcContext* ctx, rcCompactHeightfield& chf)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildDistanceField(ctx, chf, rcCompactSpansSoA(chf));
+	return buildDistanceField(ctx, chf, rcCompactSpansAoS(chf));
+}
+
 static void paintRectRegion(int minx, int maxx, int miny, int maxy, unsigned short regId,
 							rcCompactHeightfield& chf, unsigned short* srcReg)
 {
@@ -1331,27 +1372,9 @@ struct rcSweepSpan
 	unsigned short nei;	// neighbour id
 };
 
-/// @par
-/// 
-/// Non-null regions will consist of connected, non-overlapping walkable spans that form a single contour.
-/// Contours will form simple polygons.
-/// 
-/// If multiple regions form an area that is smaller than @p minRegionArea, then all spans will be
-/// re-assigned to the zero (null) region.
-/// 
-/// Partitioning can result in smaller than necessary regions. @p mergeRegionArea helps 
-/// reduce unecessarily small regions.
-/// 
-/// See the #rcConfig documentation for more information on the configuration parameters.
-/// 
-/// The region data will be available via the rcCompactHeightfield::maxRegions
-/// and rcCompactSpan::reg fields.
-/// 
-/// @warning The distance field must be created using #rcBuildDistanceField before attempting to build regions.
-/// 
-/// @see rcCompactHeightfield, rcCompactSpan, rcBuildDistanceField, rcBuildRegionsMonotone, rcConfig
-bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
-							const int borderSize, const int minRegionArea, const int mergeRegionArea)
+template<class Spans>
+static bool buildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
+								 const int borderSize, const int minRegionArea, const int mergeRegionArea, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -1409,16 +1432,15 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 			
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				if (chf.areas[i] == RC_NULL_AREA) continue;
 				
 				// -x
 				unsigned short previd = 0;
-				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
+				if (spans.con(i, 0) != RC_NOT_CONNECTED)
 				{
 					const int ax = x + rcGetDirOffsetX(0);
 					const int ay = y + rcGetDirOffsetY(0);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 0);
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 0);
 					if ((srcReg[ai] & RC_BORDER_REG) == 0 && chf.areas[i] == chf.areas[ai])
 						previd = srcReg[ai];
 				}
@@ -1432,11 +1454,11 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 				}
 
 				// -y
-				if (rcGetCon(s,3) != RC_NOT_CONNECTED)
+				if (spans.con(i, 3) != RC_NOT_CONNECTED)
 				{
 					const int ax = x + rcGetDirOffsetX(3);
 					const int ay = y + rcGetDirOffsetY(3);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 3);
 					if (srcReg[ai] && (srcReg[ai] & RC_BORDER_REG) == 0 && chf.areas[i] == chf.areas[ai])
 					{
 						unsigned short nr = srcReg[ai];
@@ -1491,7 +1513,7 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 		// Merge regions and filter out small regions.
 		rcIntArray overlaps;
 		chf.maxRegions = id;
-		if (!mergeAndFilterRegions(ctx, minRegionArea, mergeRegionArea, chf.maxRegions, chf, srcReg, overlaps))
+		if (!mergeAndFilterRegions(ctx, minRegionArea, mergeRegionArea, chf.maxRegions, chf, srcReg, overlaps, spans))
 			return false;
 
 		// Monotone partitioning does not generate overlapping regions.
@@ -1499,7 +1521,9 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 	
 	// Store the result out.
 	for (int i = 0; i < chf.spanCount; ++i)
-		chf.spans[i].reg = srcReg[i];
+		spans.setReg(i, srcReg[i]);
+
+	ctx->addCount(RC_COUNTER_REGIONS, chf.maxRegions);
 
 	return true;
 }
@@ -1512,8 +1536,8 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 /// If multiple regions form an area that is smaller than @p minRegionArea, then all spans will be
 /// re-assigned to the zero (null) region.
 /// 
-/// Watershed partitioning can result in smaller than necessary regions, especially in diagonal corridors. 
-/// @p mergeRegionArea helps reduce unecessarily small regions.
+/// Partitioning can result in smaller than necessary regions. @p mergeRegionArea helps 
+/// reduce unecessarily small regions.
 /// 
 /// See the #rcConfig documentation for more information on the configuration parameters.
 /// 
@@ -1523,8 +1547,17 @@ bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
 /// @warning The distance field must be created using #rcBuildDistanceField before attempting to build regions.
 /// 
 /// @see rcCompactHeightfield, rcCompactSpan, rcBuildDistanceField, rcBuildRegionsMonotone, rcConfig
-bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
-					const int borderSize, const int minRegionArea, const int mergeRegionArea)
+bool rcBuildRegionsMonotone(rcContext* ctx, rcCompactHeightfield& chf,
+							const int borderSize, const int minRegionArea, const int mergeRegionArea)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildRegionsMonotone(ctx, chf, borderSize, minRegionArea, mergeRegionArea, rcCompactSpansSoA(chf));
+	return buildRegionsMonotone(ctx, chf, borderSize, minRegionArea, mergeRegionArea, rcCompactSpansAoS(chf));
+}
+
+template<class Spans>
+static bool buildRegions(rcContext* ctx, rcCompactHeightfield& chf,
+						 const int borderSize, const int minRegionArea, const int mergeRegionArea, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -1540,17 +1573,6 @@ bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
 		return false;
 	}
 	
-	ctx->startTimer(RC_TIMER_BUILD_REGIONS_WATERSHED);
-
-	const int LOG_NB_STACKS = 3;
-	const int NB_STACKS = 1 << LOG_NB_STACKS;
-	rcTempVector<LevelStackEntry> lvlStacks[NB_STACKS];
-	for (int i=0; i<NB_STACKS; ++i)
-		lvlStacks[i].reserve(256);
-
-	rcTempVector<LevelStackEntry> stack;
-	stack.reserve(256);
-	
 	unsigned short* srcReg = buf;
 	unsigned short* srcDist = buf+chf.spanCount;
 	
@@ -1558,82 +1580,95 @@ bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
 	memset(srcDist, 0, sizeof(unsigned short)*chf.spanCount);
 	
 	unsigned short regionId = 1;
-	unsigned short level = (chf.maxDistance+1) & ~1;
+	
+	{
+		// Scoped, so that the timer is also stopped when the region IDs overflow.
+		rcScopedTimer timerWatershed(ctx, RC_TIMER_BUILD_REGIONS_WATERSHED);
 
-	// TODO: Figure better formula, expandIters defines how much the 
-	// watershed "overflows" and simplifies the regions. Tying it to
-	// agent radius was usually good indication how greedy it could be.
-//	const int expandIters = 4 + walkableRadius * 2;
-	const int expandIters = 8;
+		const int LOG_NB_STACKS = 3;
+		const int NB_STACKS = 1 << LOG_NB_STACKS;
+		rcTempVector<LevelStackEntry> lvlStacks[NB_STACKS];
+		for (int i=0; i<NB_STACKS; ++i)
+			lvlStacks[i].reserve(256);
 
-	if (borderSize > 0)
-	{
-		// Make sure border will not overflow.
-		const int bw = rcMin(w, borderSize);
-		const int bh = rcMin(h, borderSize);
+		rcTempVector<LevelStackEntry> stack;
+		stack.reserve(256);
+	
+		unsigned short level = (chf.maxDistance+1) & ~1;
+
+		// TODO: Figure better formula, expandIters defines how much the 
+		// watershed "overflows" and simplifies the regions. Tying it to
+		// agent radius was usually good indication how greedy it could be.
+//		const int expandIters = 4 + walkableRadius * 2;
+		const int expandIters = 8;
+
+		if (borderSize > 0)
+		{
+			// Make sure border will not overflow.
+			const int bw = rcMin(w, borderSize);
+			const int bh = rcMin(h, borderSize);
 		
-		// Paint regions
-		paintRectRegion(0, bw, 0, h, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
-		paintRectRegion(w-bw, w, 0, h, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
-		paintRectRegion(0, w, 0, bh, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
-		paintRectRegion(0, w, h-bh, h, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
-	}
+			// Paint regions
+			paintRectRegion(0, bw, 0, h, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
+			paintRectRegion(w-bw, w, 0, h, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
+			paintRectRegion(0, w, 0, bh, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
+			paintRectRegion(0, w, h-bh, h, regionId|RC_BORDER_REG, chf, srcReg); regionId++;
+		}
 
-	chf.borderSize = borderSize;
+		chf.borderSize = borderSize;
 	
-	int sId = -1;
-	while (level > 0)
-	{
-		level = level >= 2 ? level-2 : 0;
-		sId = (sId+1) & (NB_STACKS-1);
+		int sId = -1;
+		while (level > 0)
+		{
+			level = level >= 2 ? level-2 : 0;
+			sId = (sId+1) & (NB_STACKS-1);
 
-//		ctx->startTimer(RC_TIMER_DIVIDE_TO_LEVELS);
+//			ctx->startTimer(RC_TIMER_DIVIDE_TO_LEVELS);
 
-		if (sId == 0)
-			sortCellsByLevel(level, chf, srcReg, NB_STACKS, lvlStacks, 1);
-		else 
-			appendStacks(lvlStacks[sId-1], lvlStacks[sId], srcReg); // copy left overs from last level
+			if (sId == 0)
+				sortCellsByLevel(level, chf, srcReg, NB_STACKS, lvlStacks, 1);
+			else 
+				appendStacks(lvlStacks[sId-1], lvlStacks[sId], srcReg); // copy left overs from last level
 
-//		ctx->stopTimer(RC_TIMER_DIVIDE_TO_LEVELS);
+//			ctx->stopTimer(RC_TIMER_DIVIDE_TO_LEVELS);
 
-		{
-			rcScopedTimer timerExpand(ctx, RC_TIMER_BUILD_REGIONS_EXPAND);
+			{
+				rcScopedTimer timerExpand(ctx, RC_TIMER_BUILD_REGIONS_EXPAND);
 
-			// Expand current regions until no empty connected cells found.
-			expandRegions(expandIters, level, chf, srcReg, srcDist, lvlStacks[sId], false);
-		}
+				// Expand current regions until no empty connected cells found.
+				expandRegions(ctx, expandIters, level, chf, srcReg, srcDist, lvlStacks[sId], false, spans);
+			}
 		
-		{
-			rcScopedTimer timerFloor(ctx, RC_TIMER_BUILD_REGIONS_FLOOD);
-
-			// Mark new regions with IDs.
-			for (int j = 0; j<lvlStacks[sId].size(); j++)
 			{
-				LevelStackEntry current = lvlStacks[sId][j];
-				int x = current.x;
-				int y = current.y;
-				int i = current.index;
-				if (i >= 0 && srcReg[i] == 0)
+				rcScopedTimer timerFloor(ctx, RC_TIMER_BUILD_REGIONS_FLOOD);
+
+				// Mark new regions with IDs.
+				for (int j = 0; j<lvlStacks[sId].size(); j++)
 				{
-					if (floodRegion(x, y, i, level, regionId, chf, srcReg, srcDist, stack))
+					LevelStackEntry current = lvlStacks[sId][j];
+					int x = current.x;
+					int y = current.y;
+					int i = current.index;
+					if (i >= 0 && srcReg[i] == 0)
 					{
-						if (regionId == 0xFFFF)
+						if (floodRegion(x, y, i, level, regionId, chf, srcReg, srcDist, stack, spans))
 						{
-							ctx->log(RC_LOG_ERROR, "rcBuildRegions: Region ID overflow");
-							return false;
-						}
+							if (regionId == 0xFFFF)
+							{
+								ctx->log(RC_LOG_ERROR, "rcBuildRegions: Region ID overflow");
+								return false;
+							}
 						
-						regionId++;
+							regionId++;
+						}
 					}
 				}
 			}
 		}
-	}
-	
-	// Expand current regions until no empty connected cells found.
-	expandRegions(expandIters*8, 0, chf, srcReg, srcDist, stack, true);
 	
-	ctx->stopTimer(RC_TIMER_BUILD_REGIONS_WATERSHED);
+		// Expand current regions until no empty connected cells found.
+		expandRegions(ctx, expandIters*8, 0, chf, srcReg, srcDist, stack, true, spans);
+	}
 	
 	{
 		rcScopedTimer timerFilter(ctx, RC_TIMER_BUILD_REGIONS_FILTER);
@@ -1641,7 +1676,7 @@ bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
 		// Merge regions and filter out smalle regions.
 		rcIntArray overlaps;
 		chf.maxRegions = regionId;
-		if (!mergeAndFilterRegions(ctx, minRegionArea, mergeRegionArea, chf.maxRegions, chf, srcReg, overlaps))
+		if (!mergeAndFilterRegions(ctx, minRegionArea, mergeRegionArea, chf.maxRegions, chf, srcReg, overlaps, spans))
 			return false;
 
 		// If overlapping regions were found during merging, split those regions.
@@ -1653,14 +1688,47 @@ bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
 		
 	// Write the result out.
 	for (int i = 0; i < chf.spanCount; ++i)
-		chf.spans[i].reg = srcReg[i];
+		spans.setReg(i, srcReg[i]);
+	
+	ctx->addCount(RC_COUNTER_REGIONS, chf.maxRegions);
 	
 	return true;
 }
 
+/// @par
+/// 
+/// Non-null regions will consist of connected, non-overlapping walkable spans that form a single contour.
+/// Contours will form simple polygons.
+/// 
+/// If multiple regions form an area that is smaller than @p minRegionArea, then all spans will be
+/// re-assigned to the zero (null) region.
+/// 
+/// Watershed partitioning can result in smaller than necessary regions, especially in diagonal corridors. 
+/// @p mergeRegionArea helps reduce unecessarily small regions.
+/// 
+/// See the #rcConfig documentation for more information on the configuration parameters.
+/// 
+/// The region data will be available via the rcCompactHeightfield::maxRegions
+/// and rcCompactSpan::reg fields.
+/// 
+/// The regions are expanded on the task scheduler of the build context. New regions are flooded 
+/// and merged on the calling thread, since their ids depend on the order the spans are visited in.
+/// 
+/// @warning The distance field must be created using #rcBuildDistanceField before attempting to build regions.
+/// 
+/// @see rcCompactHeightfield, rcCompactSpan, rcBuildDistanceField, rcBuildRegionsMonotone, rcConfig, rcContext::setTaskScheduler
+bool rcBuildRegions(rcContext* ctx, rcCompactHeightfield& chf,
+					const int borderSize, const int minRegionArea, const int mergeRegionArea)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildRegions(ctx, chf, borderSize, minRegionArea, mergeRegionArea, rcCompactSpansSoA(chf));
+	return buildRegions(ctx, chf, borderSize, minRegionArea, mergeRegionArea, rcCompactSpansAoS(chf));
+}
+
 
-bool rcBuildLayerRegions(rcContext* ctx, rcCompactHeightfield& chf,
-						 const int borderSize, const int minRegionArea)
+template<class Spans>
+static bool buildLayerRegions(rcContext* ctx, rcCompactHeightfield& chf,
+							  const int borderSize, const int minRegionArea, const Spans& spans)
 {
 	rcAssert(ctx);
 	
@@ -1718,16 +1786,15 @@ bool rcBuildLayerRegions(rcContext* ctx, rcCompactHeightfield& chf,
 			
 			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
 			{
-				const rcCompactSpan& s = chf.spans[i];
 				if (chf.areas[i] == RC_NULL_AREA) continue;
 				
 				// -x
 				unsigned short previd = 0;
-				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
+				if (spans.con(i, 0) != RC_NOT_CONNECTED)
 				{
 					const int ax = x + rcGetDirOffsetX(0);
 					const int ay = y + rcGetDirOffsetY(0);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 0);
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 0);
 					if ((srcReg[ai] & RC_BORDER_REG) == 0 && chf.areas[i] == chf.areas[ai])
 						previd = srcReg[ai];
 				}
@@ -1741,11 +1808,11 @@ bool rcBuildLayerRegions(rcContext* ctx, rcCompactHeightfield& chf,
 				}
 				
 				// -y
-				if (rcGetCon(s,3) != RC_NOT_CONNECTED)
+				if (spans.con(i, 3) != RC_NOT_CONNECTED)
 				{
 					const int ax = x + rcGetDirOffsetX(3);
 					const int ay = y + rcGetDirOffsetY(3);
-					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
+					const int ai = (int)chf.cells[ax+ay*w].index + spans.con(i, 3);
 					if (srcReg[ai] && (srcReg[ai] & RC_BORDER_REG) == 0 && chf.areas[i] == chf.areas[ai])
 					{
 						unsigned short nr = srcReg[ai];
@@ -1799,14 +1866,24 @@ bool rcBuildLayerRegions(rcContext* ctx, rcCompactHeightfield& chf,
 
 		// Merge monotone regions to layers and remove small regions.
 		chf.maxRegions = id;
-		if (!mergeAndFilterLayerRegions(ctx, minRegionArea, chf.maxRegions, chf, srcReg))
+		if (!mergeAndFilterLayerRegions(ctx, minRegionArea, chf.maxRegions, chf, srcReg, spans))
 			return false;
 	}
 	
 	
 	// Store the result out.
 	for (int i = 0; i < chf.spanCount; ++i)
-		chf.spans[i].reg = srcReg[i];
+		spans.setReg(i, srcReg[i]);
+	
+	ctx->addCount(RC_COUNTER_REGIONS, chf.maxRegions);
 	
 	return true;
 }
+
+bool rcBuildLayerRegions(rcContext* ctx, rcCompactHeightfield& chf,
+						 const int borderSize, const int minRegionArea)
+{
+	if (chf.layout == RC_COMPACT_SPANS_SOA)
+		return buildLayerRegions(ctx, chf, borderSize, minRegionArea, rcCompactSpansSoA(chf));
+	return buildLayerRegions(ctx, chf, borderSize, minRegionArea, rcCompactSpansAoS(chf));
+}
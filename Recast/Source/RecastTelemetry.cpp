@@ -0,0 +1,287 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include "Recast.h"
+#include "RecastAlloc.h"
+#include "RecastAssert.h"
+#include "RecastTelemetry.h"
+
+namespace
+{
+static const int MAX_SAMPLE_DEPTH = 32;
+
+// Unique id per telemetry instance and reset, used to detect stale thread state.
+std::atomic<int> s_telemetryGeneration(0);
+
+// Temporary memory accounting. (See: rcBuildTelemetry::installAllocTracking)
+// Threads running a parallel loop for another thread charge the account of that thread.
+struct rcTempAccount
+{
+	std::atomic<long long> live;
+	std::atomic<long long> peak;
+};
+
+thread_local rcTempAccount t_ownAccount;
+thread_local rcTempAccount* t_account = 0;
+
+rcTempAccount& currentAccount()
+{
+	return t_account ? *t_account : t_ownAccount;
+}
+
+// The open samples of the calling thread.
+struct rcTelemetryThreadState
+{
+	int generation;
+	int thread;
+	int depth;
+	int open[MAX_SAMPLE_DEPTH];				// Index of the open sample per depth.
+	long long start[MAX_SAMPLE_DEPTH];		// Start time of the open sample per depth.
+	long long tempBase[MAX_SAMPLE_DEPTH];	// Temporary memory in use when the sample was opened.
+	long long savedPeak[MAX_SAMPLE_DEPTH];	// Peak of the enclosing sample when the sample was opened.
+	int closed[MAX_SAMPLE_DEPTH+1][RC_MAX_TIMERS];	// Closed sample per depth and label, used to merge repeated samples.
+};
+
+thread_local rcTelemetryThreadState t_state = { -1, 0, 0, {}, {}, {}, {}, {} };
+
+void resetClosed(int* closed)
+{
+	for (int i = 0; i < RC_MAX_TIMERS; ++i)
+		closed[i] = -1;
+}
+
+// The sizes of the live temporary blocks allocated by the tracking allocator. Blocks carry no
+// header, so blocks of the default allocator and of the tracking allocator are interchangeable.
+struct rcTrackedBlocks
+{
+	std::mutex mutex;
+	std::unordered_map<void*, size_t> sizes;
+};
+
+rcTrackedBlocks& trackedBlocks()
+{
+	static rcTrackedBlocks blocks;
+	return blocks;
+}
+
+void* trackedAlloc(size_t size, rcAllocHint hint)
+{
+	void* ptr = malloc(size);
+	if (!ptr || hint != RC_ALLOC_TEMP)
+		return ptr;
+	{
+		rcTrackedBlocks& blocks = trackedBlocks();
+		std::lock_guard<std::mutex> lock(blocks.mutex);
+		blocks.sizes[ptr] = size;
+	}
+	rcTempAccount& account = currentAccount();
+	const long long live = account.live.fetch_add((long long)size) + (long long)size;
+	long long peak = account.peak.load();
+	while (live > peak && !account.peak.compare_exchange_weak(peak, live)) {}
+	return ptr;
+}
+
+void trackedFree(void* ptr)
+{
+	size_t size = 0;
+	{
+		rcTrackedBlocks& blocks = trackedBlocks();
+		std::lock_guard<std::mutex> lock(blocks.mutex);
+		std::unordered_map<void*, size_t>::iterator it = blocks.sizes.find(ptr);
+		if (it != blocks.sizes.end())
+		{
+			size = it->second;
+			blocks.sizes.erase(it);
+		}
+	}
+	if (size)
+		currentAccount().live -= (long long)size;
+	free(ptr);
+}
+
+// Runs a range of a parallel loop, charging the temporary memory to the thread that started the loop.
+struct rcTrackedParallelFor
+{
+	rcParallelForFunc* func;
+	void* userData;
+	rcTempAccount* account;
+};
+
+void trackedParallelForRange(void* userData, const int begin, const int end)
+{
+	const rcTrackedParallelFor* loop = (const rcTrackedParallelFor*)userData;
+	rcTempAccount* saved = t_account;
+	t_account = loop->account;
+	loop->func(loop->userData, begin, end);
+	t_account = saved;
+}
+}  // namespace
+
+rcBuildTelemetry::rcBuildTelemetry() :
+	m_threadCount(0),
+	m_generation(++s_telemetryGeneration),
+	m_epochUsec(0)
+{
+	m_epochUsec = nowUsec();
+}
+
+rcBuildTelemetry::~rcBuildTelemetry()
+{
+}
+
+long long rcBuildTelemetry::nowUsec() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void rcBuildTelemetry::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_samples.clear();
+	m_threadCount.store(0);
+	m_generation = ++s_telemetryGeneration;
+	m_epochUsec = nowUsec();
+}
+
+/// @par
+///
+/// If the calling thread already closed a sample with the same label under the same parent,
+/// that sample is reopened instead of creating a new one.
+void rcBuildTelemetry::beginSample(const rcTimerLabel label, const int tileX, const int tileY, const int tileLayer)
+{
+	rcTelemetryThreadState& ts = t_state;
+	if (ts.generation != m_generation)
+	{
+		ts.generation = m_generation;
+		ts.thread = m_threadCount++;
+		ts.depth = 0;
+		resetClosed(ts.closed[0]);
+	}
+	if (ts.depth >= MAX_SAMPLE_DEPTH)
+	{
+		// Keep the depth balanced, the sample is dropped.
+		ts.depth++;
+		return;
+	}
+
+	const int depth = ts.depth;
+	const int parent = depth > 0 ? ts.open[depth-1] : -1;
+	const long long now = nowUsec();
+
+	int index = -1;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const int last = ts.closed[depth][label];
+		if (last != -1 && m_samples[last].tileX == tileX && m_samples[last].tileY == tileY && m_samples[last].tileLayer == tileLayer)
+		{
+			index = last;
+			m_samples[index].calls++;
+		}
+		else
+		{
+			rcTelemetrySample sample;
+			memset(&sample, 0, sizeof(sample));
+			sample.label = label;
+			sample.tileX = tileX;
+			sample.tileY = tileY;
+			sample.tileLayer = tileLayer;
+			sample.thread = ts.thread;
+			sample.parent = parent;
+			sample.depth = depth;
+			sample.calls = 1;
+			sample.startUsec = now - m_epochUsec;
+			index = (int)m_samples.size();
+			m_samples.push_back(sample);
+		}
+	}
+
+	ts.open[depth] = index;
+	ts.start[depth] = now;
+	rcTempAccount& account = currentAccount();
+	ts.tempBase[depth] = account.live.load();
+	ts.savedPeak[depth] = account.peak.exchange(ts.tempBase[depth]);
+	resetClosed(ts.closed[depth+1]);
+	ts.depth++;
+}
+
+void rcBuildTelemetry::endSample(const rcTimerLabel label)
+{
+	rcTelemetryThreadState& ts = t_state;
+	if (ts.generation != m_generation || ts.depth <= 0)
+		return;
+	ts.depth--;
+	if (ts.depth >= MAX_SAMPLE_DEPTH)
+		return;
+
+	const int depth = ts.depth;
+	const int index = ts.open[depth];
+	const long long elapsed = nowUsec() - ts.start[depth];
+	rcTempAccount& account = currentAccount();
+	const long long samplePeak = account.peak.load();
+	const long long peak = samplePeak - ts.tempBase[depth];
+	// Restore the peak of the enclosing sample.
+	account.peak.store(rcMax(ts.savedPeak[depth], samplePeak));
+	ts.closed[depth][label] = index;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	rcTelemetrySample& sample = m_samples[index];
+	rcAssert(sample.label == label);
+	rcIgnoreUnused(label);
+	sample.durationUsec += elapsed;
+	sample.peakTempBytes = rcMax(sample.peakTempBytes, peak);
+}
+
+void rcBuildTelemetry::addCount(const rcTelemetryCounter counter, const long long value)
+{
+	const rcTelemetryThreadState& ts = t_state;
+	if (ts.generation != m_generation || ts.depth <= 0 || ts.depth > MAX_SAMPLE_DEPTH)
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_samples[ts.open[ts.depth-1]].counters[counter] += value;
+}
+
+/// @par
+///
+/// Temporary memory allocated by the ranges of rcContext::parallelFor is charged to the 
+/// thread that started the loop, as long as the context has a telemetry assigned.
+void rcBuildTelemetry::installAllocTracking()
+{
+	rcAllocSetCustom(trackedAlloc, trackedFree);
+}
+
+bool rcBuildTelemetry::uninstallAllocTracking()
+{
+	rcTrackedBlocks& blocks = trackedBlocks();
+	std::lock_guard<std::mutex> lock(blocks.mutex);
+	if (!blocks.sizes.empty())
+		return false;
+	rcAllocSetCustom(0, 0);
+	return true;
+}
+
+void rcBuildTelemetry::parallelFor(rcTaskScheduler* scheduler, const int count, const int grain,
+								   rcParallelForFunc* func, void* userData)
+{
+	rcTrackedParallelFor loop = { func, userData, &currentAccount() };
+	scheduler->parallelFor(count, grain, trackedParallelForRange, &loop);
+}
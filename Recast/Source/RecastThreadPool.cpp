@@ -0,0 +1,306 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include "Recast.h"
+#include "RecastAlloc.h"
+#include "RecastAssert.h"
+#include "RecastThreadPool.h"
+
+namespace
+{
+// A contiguous range of items owned by one thread, packed as (tail << 32 | head) so that
+// the owner and thieves can update it with a single compare-and-swap.
+struct rcWorkRange
+{
+	std::atomic<unsigned long long> packed;
+	char pad[64 - sizeof(std::atomic<unsigned long long>)]; // Keep ranges on separate cache lines.
+};
+
+inline unsigned long long packRange(unsigned int head, unsigned int tail)
+{
+	return ((unsigned long long)tail << 32) | head;
+}
+
+// Pops up to grain items from the front of the thread's own range.
+bool popRange(rcWorkRange& range, const int grain, int& begin, int& end)
+{
+	unsigned long long cur = range.packed.load();
+	for (;;)
+	{
+		const unsigned int head = (unsigned int)cur;
+		const unsigned int tail = (unsigned int)(cur >> 32);
+		if (head >= tail)
+			return false;
+		const unsigned int next = rcMin(head + (unsigned int)grain, tail);
+		if (range.packed.compare_exchange_weak(cur, packRange(next, tail)))
+		{
+			begin = (int)head;
+			end = (int)next;
+			return true;
+		}
+	}
+}
+
+// Steals the back half of the victim's remaining range and makes it the thief's own range.
+bool stealRange(rcWorkRange& victim, rcWorkRange& own)
+{
+	unsigned long long cur = victim.packed.load();
+	for (;;)
+	{
+		const unsigned int head = (unsigned int)cur;
+		const unsigned int tail = (unsigned int)(cur >> 32);
+		if (head >= tail)
+			return false;
+		const unsigned int mid = head + (tail - head) / 2;
+		if (victim.packed.compare_exchange_weak(cur, packRange(head, mid)))
+		{
+			// Our own range is empty, so nobody else will modify it.
+			own.packed.store(packRange(mid, tail));
+			return true;
+		}
+	}
+}
+
+struct rcParallelForJob
+{
+	rcWorkRange* ranges;
+	int nranges;
+	int grain;
+	rcParallelForFunc* func;
+	void* userData;
+	std::atomic<int> nextRange;
+};
+
+void runParallelFor(rcParallelForJob& job, const int index)
+{
+	rcWorkRange& own = job.ranges[index];
+	int begin, end;
+	for (;;)
+	{
+		while (popRange(own, job.grain, begin, end))
+			job.func(job.userData, begin, end);
+
+		// Out of work, try to steal from the other threads.
+		bool stolen = false;
+		for (int i = 1; i < job.nranges && !stolen; ++i)
+			stolen = stealRange(job.ranges[(index + i) % job.nranges], own);
+		if (!stolen)
+			return;
+	}
+}
+
+// Task that joins a parallel-for. Helpers that start late find their range stolen and return.
+void parallelForHelper(void* userData)
+{
+	rcParallelForJob& job = *(rcParallelForJob*)userData;
+	const int index = job.nextRange++;
+	if (index < job.nranges)
+		runParallelFor(job, index);
+}
+
+class rcThreadPoolTaskGroup : public rcTaskGroup
+{
+public:
+	explicit rcThreadPoolTaskGroup(rcThreadPool* pool) : m_pool(pool), m_pending(0) {}
+
+	virtual void run(rcTaskFunc* func, void* userData)
+	{
+		rcThreadPool::Task task = { func, userData, &m_pending };
+		m_pool->push(task);
+	}
+
+	virtual void wait()
+	{
+		m_pool->waitPending(m_pending);
+	}
+
+private:
+	rcThreadPool* m_pool;
+	std::atomic<int> m_pending;
+};
+}  // namespace
+
+rcThreadPool::rcThreadPool(const int threadCount) :
+	m_stop(false),
+	m_threadCount(threadCount),
+	m_workers(0),
+	m_workerCount(0)
+{
+	if (m_threadCount <= 0)
+		m_threadCount = (int)std::thread::hardware_concurrency();
+	m_threadCount = rcMax(m_threadCount, 1);
+
+	if (m_threadCount > 1)
+		m_workers = (std::thread*)rcAlloc(sizeof(std::thread)*(m_threadCount-1), RC_ALLOC_PERM);
+	if (!m_workers)
+	{
+		// Run everything on the calling thread.
+		m_threadCount = 1;
+		return;
+	}
+	for (m_workerCount = 0; m_workerCount < m_threadCount-1; ++m_workerCount)
+		::new(rcNewTag(), (void*)&m_workers[m_workerCount]) std::thread(workerMain, this);
+}
+
+rcThreadPool::~rcThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_all();
+	for (int i = 0; i < m_workerCount; ++i)
+	{
+		m_workers[i].join();
+		m_workers[i].~thread();
+	}
+	rcFree(m_workers);
+}
+
+void rcThreadPool::workerMain(rcThreadPool* pool)
+{
+	std::unique_lock<std::mutex> lock(pool->m_mutex);
+	for (;;)
+	{
+		if (pool->tryRunTask(lock))
+			continue;
+		if (pool->m_stop)
+			return;
+		pool->m_cond.wait(lock);
+	}
+}
+
+// Runs the most recently queued task, if any. The lock is released while the task runs.
+bool rcThreadPool::tryRunTask(std::unique_lock<std::mutex>& lock)
+{
+	if (m_tasks.empty())
+		return false;
+	const Task task = m_tasks.back();
+	m_tasks.pop_back();
+	lock.unlock();
+
+	task.func(task.userData);
+	task.pending->fetch_sub(1);
+
+	lock.lock();
+	// Wake up the threads waiting for the task, and the threads waiting for work.
+	m_cond.notify_all();
+	return true;
+}
+
+/// @par
+///
+/// The task is executed on the calling thread if the queue cannot grow.
+void rcThreadPool::push(const Task& task)
+{
+	task.pending->fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_workerCount > 0 &&
+			(m_tasks.size() < m_tasks.capacity() || m_tasks.reserve(rcMax((rcSizeType)16, m_tasks.capacity()*2))))
+		{
+			m_tasks.push_back(task);
+			m_cond.notify_one();
+			return;
+		}
+	}
+	task.func(task.userData);
+	task.pending->fetch_sub(1);
+
+	// Wake up the threads waiting for the task.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cond.notify_all();
+}
+
+void rcThreadPool::waitPending(std::atomic<int>& pending)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (pending.load() > 0)
+	{
+		if (!tryRunTask(lock))
+			m_cond.wait(lock);
+	}
+}
+
+/// @par
+///
+/// The calling thread processes the first range itself, and one helper task per additional
+/// range is queued for the workers.
+void rcThreadPool::parallelFor(const int count, const int grain, rcParallelForFunc* func, void* userData)
+{
+	rcAssert(grain > 0);
+	if (count <= 0)
+		return;
+	const int nranges = rcClamp(count / rcMax(grain, 1), 1, m_threadCount);
+	if (nranges == 1)
+	{
+		func(userData, 0, count);
+		return;
+	}
+
+	rcScopedDelete<rcWorkRange> ranges((rcWorkRange*)rcAlloc(sizeof(rcWorkRange)*nranges, RC_ALLOC_TEMP));
+	if (!ranges)
+	{
+		func(userData, 0, count);
+		return;
+	}
+	for (int i = 0; i < nranges; ++i)
+	{
+		::new(rcNewTag(), (void*)&ranges[i]) rcWorkRange;
+		ranges[i].packed.store(packRange((unsigned int)((long long)count * i / nranges),
+										 (unsigned int)((long long)count * (i+1) / nranges)));
+	}
+
+	rcParallelForJob job;
+	job.ranges = ranges;
+	job.nranges = nranges;
+	job.grain = rcMax(grain, 1);
+	job.func = func;
+	job.userData = userData;
+	job.nextRange.store(1);
+
+	std::atomic<int> pending(0);
+	for (int i = 1; i < nranges; ++i)
+	{
+		Task task = { parallelForHelper, &job, &pending };
+		push(task);
+	}
+
+	runParallelFor(job, 0);
+	waitPending(pending);
+
+	for (int i = 0; i < nranges; ++i)
+		ranges[i].~rcWorkRange();
+}
+
+rcTaskGroup* rcThreadPool::createTaskGroup()
+{
+	void* mem = rcAlloc(sizeof(rcThreadPoolTaskGroup), RC_ALLOC_PERM);
+	if (!mem)
+		return 0;
+	return ::new(rcNewTag(), mem) rcThreadPoolTaskGroup(this);
+}
+
+void rcThreadPool::destroyTaskGroup(rcTaskGroup* group)
+{
+	if (!group)
+		return;
+	group->wait();
+	group->~rcTaskGroup();
+	rcFree(group);
+}
@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef NAVMESHSETSTREAM_H
+#define NAVMESHSETSTREAM_H
+
+#include <stdio.h>
+#include <vector>
+#include "DetourNavMesh.h"
+#include "DetourTileStreamer.h"
+
+static const int NAVMESHSET_MAGIC = 'M'<<24 | 'S'<<16 | 'E'<<8 | 'T'; //'MSET';
+static const int NAVMESHSET_VERSION = 5;
+
+/// The header of a .nm navmesh set file, followed by the tiles. (See: Sample::saveAll)
+struct NavMeshSetHeader
+{
+	int magic;
+	int version;
+	int numTiles;
+	dtNavMeshParams params;
+};
+
+/// Precedes the data of each tile in a .nm navmesh set file.
+struct NavMeshTileHeader
+{
+	dtTileRef tileRef;
+	int dataSize;
+};
+
+/// Streams the tiles of a .nm navmesh set file, as written by Sample::saveAll, into a dtTileStreamer.
+///
+/// The tile table is read by #open, and the data of each tile is read from the file when the 
+/// streamer asks for it. The data is streamed as stored, the TF2 coordinate fix-up of 
+/// Sample::loadAll is not applied.
+class NavMeshSetStreamSource : public dtTileStreamSource
+{
+public:
+	NavMeshSetStreamSource();
+	virtual ~NavMeshSetStreamSource();
+
+	/// Opens the file and reads its navmesh parameters and tile table.
+	/// @return True if the file is a navmesh set file of the supported version.
+	bool open(const char* path);
+
+	/// The parameters to initialize the navmesh with.
+	const dtNavMeshParams& getParams() const { return m_params; }
+
+	/// The number of tiles in the file.
+	int getTileCount() const { return (int)m_tiles.size(); }
+
+	/// The tiles to initialize the streamer with, added with the references they were saved with. [Size: #getTileCount()]
+	const dtStreamTileInfo* getTiles() const { return m_tiles.empty() ? 0 : &m_tiles[0]; }
+
+	virtual bool readTile(const int index, unsigned char** data, int* dataSize);
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	NavMeshSetStreamSource(const NavMeshSetStreamSource&);
+	NavMeshSetStreamSource& operator=(const NavMeshSetStreamSource&);
+
+	void close();
+
+	FILE* m_fp;
+	dtNavMeshParams m_params;
+	std::vector<dtStreamTileInfo> m_tiles;
+	std::vector<long> m_offsets;	///< The file offset of the data of each tile.
+};
+
+#endif // NAVMESHSETSTREAM_H
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include "NavMeshSetStream.h"
+#include "DetourAlloc.h"
+
+NavMeshSetStreamSource::NavMeshSetStreamSource() :
+	m_fp(0),
+	m_params()
+{
+}
+
+NavMeshSetStreamSource::~NavMeshSetStreamSource()
+{
+	close();
+}
+
+void NavMeshSetStreamSource::close()
+{
+	if (m_fp)
+		fclose(m_fp);
+	m_fp = 0;
+	m_tiles.clear();
+	m_offsets.clear();
+}
+
+bool NavMeshSetStreamSource::open(const char* path)
+{
+	close();
+
+	m_fp = fopen(path, "rb");
+	if (!m_fp)
+		return false;
+
+	NavMeshSetHeader header;
+	if (fread(&header, sizeof(NavMeshSetHeader), 1, m_fp) != 1 ||
+		header.magic != NAVMESHSET_MAGIC || header.version != NAVMESHSET_VERSION)
+	{
+		close();
+		return false;
+	}
+	m_params = header.params;
+
+	// Read the tile table, skipping over the tile data past the mesh header.
+	for (int i = 0; i < header.numTiles; ++i)
+	{
+		NavMeshTileHeader tileHeader;
+		if (fread(&tileHeader, sizeof(tileHeader), 1, m_fp) != 1)
+		{
+			close();
+			return false;
+		}
+		if (!tileHeader.tileRef || !tileHeader.dataSize)
+			break;
+
+		const long offset = ftell(m_fp);
+		dtMeshHeader meshHeader;
+		if (tileHeader.dataSize < (int)sizeof(dtMeshHeader) ||
+			fread(&meshHeader, sizeof(dtMeshHeader), 1, m_fp) != 1 ||
+			fseek(m_fp, offset + tileHeader.dataSize, SEEK_SET) != 0)
+		{
+			close();
+			return false;
+		}
+
+		dtStreamTileInfo info;
+		info.x = meshHeader.x;
+		info.y = meshHeader.y;
+		info.dataSize = tileHeader.dataSize;
+		info.ref = tileHeader.tileRef;
+		m_tiles.push_back(info);
+		m_offsets.push_back(offset);
+	}
+
+	return true;
+}
+
+bool NavMeshSetStreamSource::readTile(const int index, unsigned char** data, int* dataSize)
+{
+	if (!m_fp || index < 0 || index >= (int)m_tiles.size())
+		return false;
+
+	const int size = m_tiles[index].dataSize;
+	unsigned char* tileData = (unsigned char*)dtAlloc(size, DT_ALLOC_PERM);
+	if (!tileData)
+		return false;
+	if (fseek(m_fp, m_offsets[index], SEEK_SET) != 0 || fread(tileData, size, 1, m_fp) != 1)
+	{
+		dtFree(tileData);
+		return false;
+	}
+
+	*data = tileData;
+	*dataSize = size;
+	return true;
+}
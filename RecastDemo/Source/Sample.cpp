@@ -24,9 +24,11 @@
 #include "Recast.h"
 #include "RecastDebugDraw.h"
 #include "DetourDebugDraw.h"
+#include "DetourCommon.h"
 #include "DetourNavMesh.h"
 #include "DetourNavMeshQuery.h"
 #include "DetourCrowd.h"
+#include "NavMeshSetStream.h"
 #include "imgui.h"
 #include "SDL.h"
 #include "SDL_opengl.h"
@@ -344,23 +346,6 @@ void Sample::renderOverlayToolStates(double* proj, double* model, int* view)
 	}
 }
 
-static const int NAVMESHSET_MAGIC = 'M'<<24 | 'S'<<16 | 'E'<<8 | 'T'; //'MSET';
-static const int NAVMESHSET_VERSION = 5;
-
-struct NavMeshSetHeader
-{
-	int magic;
-	int version;
-	int numTiles;
-	dtNavMeshParams params;
-};
-
-struct NavMeshTileHeader
-{
-	dtTileRef tileRef;
-	int dataSize;
-};
-
 void coord_tf_fix(float* c)
 {
 	std::swap(c[1], c[2]);
@@ -390,30 +375,56 @@ void unpatch_headertf2(NavMeshSetHeader& h)
 	coord_tf_unfix(h.params.orig);
 }
 
-void patch_tiletf2(dtMeshTile* t)
+static void patch_tilesectionstf2(dtMeshHeader* header, float* verts, float* detailVerts, dtPoly* polys,
+								  dtBVNode* bvTree, dtOffMeshConnection* offMeshCons)
 {
-	coord_tf_fix(t->header->bmin);
-	coord_tf_fix(t->header->bmax);
+	coord_tf_fix(header->bmin);
+	coord_tf_fix(header->bmax);
 
-	for (size_t i = 0; i < t->header->vertCount * 3; i += 3)
-		coord_tf_fix(t->verts + i);
-	for (size_t i = 0; i < t->header->detailVertCount * 3; i += 3)
-		coord_tf_fix(t->detailVerts + i);
-	for (size_t i = 0; i < t->header->polyCount; i++)
-		coord_tf_fix(t->polys[i].org);
+	for (size_t i = 0; i < header->vertCount * 3; i += 3)
+		coord_tf_fix(verts + i);
+	for (size_t i = 0; detailVerts && i < header->detailVertCount * 3; i += 3)
+		coord_tf_fix(detailVerts + i);
+	for (size_t i = 0; i < header->polyCount; i++)
+		coord_tf_fix(polys[i].org);
 	//might be wrong because of coord change might break tree layout
-	for (size_t i = 0; i < t->header->bvNodeCount; i++)
+	for (size_t i = 0; i < header->bvNodeCount; i++)
 	{
-		coord_short_tf_fix(t->bvTree[i].bmax);
-		coord_short_tf_fix(t->bvTree[i].bmin);
+		coord_short_tf_fix(bvTree[i].bmax);
+		coord_short_tf_fix(bvTree[i].bmin);
 	}
-	for (size_t i = 0; i < t->header->offMeshConCount; i++)
+	for (size_t i = 0; i < header->offMeshConCount; i++)
 	{
-		coord_tf_fix(t->offMeshCons[i].pos);
-		coord_tf_fix(t->offMeshCons[i].pos + 3);
-		coord_tf_fix(t->offMeshCons[i].unk);
+		coord_tf_fix(offMeshCons[i].pos);
+		coord_tf_fix(offMeshCons[i].pos + 3);
+		coord_tf_fix(offMeshCons[i].unk);
 	}
 }
+void patch_tiletf2(dtMeshTile* t)
+{
+	patch_tilesectionstf2(t->header, t->verts, t->detailVerts, t->polys, t->bvTree, t->offMeshCons);
+}
+// Patches tile data before it is added to a navmesh. The navmesh builds its derived data 
+// (wide BV tree, portal edges, off-mesh sides, detail blocks) when the tile is added, so the 
+// coordinates must be fixed before that.
+void patch_tiledatatf2(unsigned char* data)
+{
+	dtMeshHeader* header = (dtMeshHeader*)data;
+	if (header->magic != DT_NAVMESH_MAGIC)
+		return;
+
+	unsigned char* d = data + dtAlign4(sizeof(dtMeshHeader));
+	float* verts = dtGetThenAdvanceBufferPointer<float>(d, dtAlign4(sizeof(float)*3*header->vertCount));
+	dtPoly* polys = dtGetThenAdvanceBufferPointer<dtPoly>(d, dtAlign4(sizeof(dtPoly)*header->polyCount));
+	d += header->sth_per_poly*header->polyCount*4;
+	d += dtAlign4(sizeof(dtLink)*header->maxLinkCount);
+	d += dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
+	float* detailVerts = dtGetThenAdvanceBufferPointer<float>(d, dtAlign4(sizeof(float)*3*header->detailVertCount));
+	d += dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
+	dtBVNode* bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, dtAlign4(sizeof(dtBVNode)*header->bvNodeCount));
+	dtOffMeshConnection* offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount));
+	patch_tilesectionstf2(header, verts, detailVerts, polys, bvTree, offMeshCons);
+}
 void unpatch_tiletf2(dtMeshTile* t)
 {
 	coord_tf_unfix(t->header->bmin);
@@ -421,7 +432,7 @@ void unpatch_tiletf2(dtMeshTile* t)
 
 	for (size_t i = 0; i < t->header->vertCount * 3; i += 3)
 		coord_tf_unfix(t->verts + i);
-	for (size_t i = 0; i < t->header->detailVertCount * 3; i += 3)
+	for (size_t i = 0; t->detailVerts && i < t->header->detailVertCount * 3; i += 3)
 		coord_tf_unfix(t->detailVerts + i);
 	for (size_t i = 0; i < t->header->polyCount; i++)
 		coord_tf_unfix(t->polys[i].org);
@@ -480,13 +491,18 @@ dtNavMesh* Sample::loadAll(const char* path)
 		return 0;
 	}
 	
-	// Read tiles.
+	// Read all tiles first, so that they are linked in a single pass.
+	std::vector<unsigned char*> tileData;
+	std::vector<int> tileSizes;
+	std::vector<dtTileRef> tileRefs;
 	for (int i = 0; i < header.numTiles; ++i)
 	{
 		NavMeshTileHeader tileHeader;
 		readLen = fread(&tileHeader, sizeof(tileHeader), 1, fp);
 		if (readLen != 1)
 		{
+			for (size_t j = 0; j < tileData.size(); ++j)
+				dtFree(tileData[j]);
 			fclose(fp);
 			return 0;
 		}
@@ -501,13 +517,38 @@ dtNavMesh* Sample::loadAll(const char* path)
 		if (readLen != 1)
 		{
 			dtFree(data);
+			for (size_t j = 0; j < tileData.size(); ++j)
+				dtFree(tileData[j]);
 			fclose(fp);
 			return 0;
 		}
-		dtTileRef result;
-		mesh->addTile(data, tileHeader.dataSize, DT_TILE_FREE_DATA, tileHeader.tileRef, &result);
-		auto tile = const_cast<dtMeshTile*>(mesh->getTileByRef(result));
-		if (*is_tf2) patch_tiletf2(tile);
+		if (*is_tf2) patch_tiledatatf2(data);
+		tileData.push_back(data);
+		tileSizes.push_back(tileHeader.dataSize);
+		tileRefs.push_back(tileHeader.tileRef);
+	}
+
+	if (!tileData.empty())
+	{
+		const int tileCount = (int)tileData.size();
+		std::vector<dtTileRef> results(tileCount);
+		mesh->addTiles(&tileData[0], &tileSizes[0], tileCount, DT_TILE_FREE_DATA, &tileRefs[0], 0, &results[0]);
+		for (int i = 0; i < tileCount; ++i)
+		{
+			if (!results[i])
+				dtFree(tileData[i]);
+		}
+	}
+
+	// Read the reachability tables, they follow the per group data. (See: saveAll)
+	if (header.params.disjointPolyGroupCount > 0 && header.params.reachabilityTableCount > 0 &&
+		fseek(fp, sizeof(int)*header.params.disjointPolyGroupCount, SEEK_CUR) == 0)
+	{
+		const int tablesSize = header.params.reachabilityTableCount*header.params.reachabilityTableSize;
+		unsigned int* tables = (unsigned int*)dtAlloc(tablesSize, DT_ALLOC_TEMP);
+		if (tables && fread(tables, tablesSize, 1, fp) == 1)
+			mesh->setReachabilityTables(tables, tablesSize);
+		dtFree(tables);
 	}
 
 	fclose(fp);
@@ -22,6 +22,7 @@
 #include "Sample_Debug.h"
 #include "InputGeom.h"
 #include "Recast.h"
+#include "RecastCompactSpans.h"
 #include "DetourNavMesh.h"
 #include "RecastDebugDraw.h"
 #include "DetourDebugDraw.h"
@@ -75,15 +76,16 @@ Sample_Debug::Sample_Debug() :
 	
 /*	if (m_chf)
 	{
-		unsigned short ymin = 0xffff;
-		unsigned short ymax = 0;
+		unsigned short zmin = 0xffff;
+		unsigned short zmax = 0;
+		const bool soa = m_chf->layout == RC_COMPACT_SPANS_SOA;
 		for (int i = 0; i < m_chf->spanCount; ++i)
 		{
-			const rcCompactSpan& s = m_chf->spans[i];
-			if (s.y < ymin) ymin = s.y;
-			if (s.y > ymax) ymax = s.y;
+			const unsigned short z = soa ? rcCompactSpansSoA(*m_chf).z(i) : rcCompactSpansAoS(*m_chf).z(i);
+			if (z < zmin) zmin = z;
+			if (z > zmax) zmax = z;
 		}
-		printf("ymin=%d ymax=%d\n", (int)ymin, (int)ymax);
+		printf("zmin=%d zmax=%d\n", (int)zmin, (int)zmax);
 		
 		int maxSpans = 0;
 		for (int i = 0; i < m_chf->width*m_chf->height; ++i)
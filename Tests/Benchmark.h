@@ -0,0 +1,63 @@
+#ifndef TESTS_BENCHMARK_H
+#define TESTS_BENCHMARK_H
+
+// Benchmark helpers shared by the test files. BM is only defined where the benchmarks can be timed.
+// TODO: Implement benchmarking for platforms other than posix.
+#ifdef __unix__
+#include <unistd.h>
+#ifdef _POSIX_TIMERS
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+inline int64_t NowNanos() {
+	struct timespec tp;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tp);
+	return tp.tv_nsec + 1000000000LL * tp.tv_sec;
+}
+
+// The body runs once before the timer starts, so that fixtures built on first use are not
+// measured by whichever benchmark happens to run first.
+#define BM(name, iterations) \
+	struct BM_ ## name { \
+		static void Run() { \
+			Body(); \
+			int64_t begin_time = NowNanos(); \
+			for (int i = 0 ; i < iterations; i++) { \
+				Body(); \
+			} \
+			int64_t nanos = NowNanos() - begin_time; \
+			printf("BM_%-35s %ld iterations in %10ld nanos: %10.2f nanos/it\n", #name ":", (int64_t)iterations, nanos, double(nanos) / iterations); \
+		} \
+		static void Body(); \
+	}; \
+	TEST_CASE(#name) { \
+		BM_ ## name::Run(); \
+	} \
+	void BM_ ## name::Body()
+
+// Prevent compiler from eliding a calculation.
+// TODO: Implement for MSVC.
+template <typename T>
+void DoNotOptimize(T* v) {
+	asm volatile ("" : "+r" (v));
+}
+
+// Stores a result of a calculation, so that the compiler cannot elide the calculation.
+template <typename T>
+void KeepResult(const T v) {
+	static volatile T sink;
+	sink = v;
+}
+
+// Returns the fixture shared by the benchmarks of the same type, built on first use.
+template <typename Fixture>
+Fixture& BenchmarkFixture() {
+	static Fixture fixture;
+	return fixture;
+}
+
+#endif // _POSIX_TIMERS
+#endif // __unix__
+
+#endif // TESTS_BENCHMARK_H
@@ -1,6 +1,23 @@
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
 #include "catch.hpp"
+#include "Benchmark.h"
 
+#include "DetourAlloc.h"
 #include "DetourCommon.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourFlowField.h"
+#include "DetourNode.h"
+#include "DetourPathCorridor.h"
+#include "DetourQueryService.h"
+#include "DetourTileGraph.h"
+#include "DetourTileStreamer.h"
+#include "RecastThreadPool.h"
 
 TEST_CASE("dtRandomPointInConvexPoly")
 {
@@ -31,3 +48,3365 @@ TEST_CASE("dtRandomPointInConvexPoly")
 		REQUIRE(out[2] == Approx(0));
 	}
 }
+
+// Builds a single tile navigation mesh of four unit quads along the x-axis. The first two
+// and the last two quads are connected, with a gap between the second and the third quad.
+// The quads are assigned to disjoint poly groups 0, 0, 1 and 1.
+static dtNavMesh* buildTwoIslandNavMesh()
+{
+	unsigned short verts[6*2*3];
+	for (int x = 0; x < 6; ++x)
+	{
+		for (int y = 0; y < 2; ++y)
+		{
+			unsigned short* v = &verts[(x*2+y)*3];
+			v[0] = (unsigned short)x;
+			v[1] = (unsigned short)y;
+			v[2] = 0;
+		}
+	}
+	const unsigned short N = 0xffff;
+	const unsigned short polys[] = {
+		0, 2, 3, 1,		N, 1, N, N,
+		2, 4, 5, 3,		N, N, N, 0,
+		6, 8, 9, 7,		N, 3, N, N,
+		8, 10, 11, 9,	N, N, N, 2,
+	};
+	const unsigned short polyFlags[] = { 1, 1, 1, 1 };
+	const unsigned char polyAreas[] = { 0, 0, 0, 0 };
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = 12;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = 4;
+	params.nvp = 4;
+	params.bmax[0] = 5;
+	params.bmax[1] = 1;
+	params.bmax[2] = 1;
+	params.walkableHeight = 2;
+	params.walkableRadius = 0.5f;
+	params.walkableClimb = 0.5f;
+	params.cs = 1;
+	params.ch = 1;
+	params.buildBvTree = true;
+
+	unsigned char* data = 0;
+	int dataSize = 0;
+	if (!dtCreateNavMeshData(&params, &data, &dataSize))
+		return 0;
+
+	dtNavMeshParams meshParams = {};
+	meshParams.orig[0] = 5;	// The tile grid grows along -x.
+	meshParams.tileWidth = 5;
+	meshParams.tileHeight = 1;
+	meshParams.maxTiles = 1;
+	meshParams.maxPolys = 4;
+	meshParams.disjointPolyGroupCount = 2;
+	meshParams.reachabilityTableSize = 2*sizeof(unsigned int);
+	meshParams.reachabilityTableCount = 1;
+
+	dtNavMesh* mesh = dtAllocNavMesh();
+	if (!mesh || dtStatusFailed(mesh->init(&meshParams)) ||
+		dtStatusFailed(mesh->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)))
+	{
+		dtFreeNavMesh(mesh);
+		return 0;
+	}
+	dtMeshTile* tile = mesh->getTile(0);
+	for (int i = 0; i < 4; ++i)
+		tile->polys[i].disjointSetId = (unsigned short)(i / 2);
+	return mesh;
+}
+
+TEST_CASE("Reachability early rejection")
+{
+	dtNavMesh* mesh = buildTwoIslandNavMesh();
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 64)));
+	dtQueryFilter filter;
+
+	const dtPolyRef base = mesh->getPolyRefBase(mesh->getTile(0));
+	const dtPolyRef a = base, b = base + 1, d = base + 3;
+	const float startPos[] = { 0.5f, 0.5f, 0 };
+	const float endPos[] = { 4.5f, 0.5f, 0 };
+	dtPolyRef path[8];
+	int pathCount = 0;
+
+	SECTION("Without tables the search runs until the open list is exhausted")
+	{
+		REQUIRE(!mesh->hasReachabilityTables());
+		REQUIRE(mesh->isGoalPolyReachable(a, d, 0));
+		const dtStatus status = query.findPath(a, d, startPos, endPos, &filter, path, &pathCount, 8);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(pathCount == 2);
+		REQUIRE(path[1] == b);
+		REQUIRE(dtStatusInProgress(query.initSlicedFindPath(a, d, startPos, endPos, &filter)));
+	}
+
+	SECTION("Unreachable goals are rejected without searching")
+	{
+		const unsigned int table[] = { 0x1, 0x2 };
+		REQUIRE(dtStatusSucceed(mesh->setReachabilityTables(table, sizeof(table))));
+		REQUIRE(mesh->isGoalPolyReachable(a, b, 0));
+		REQUIRE(!mesh->isGoalPolyReachable(a, d, 0));
+
+		dtStatus status = query.findPath(a, d, startPos, endPos, &filter, path, &pathCount, 8);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(pathCount == 1);
+		REQUIRE(path[0] == a);
+
+		status = query.initSlicedFindPath(a, d, startPos, endPos, &filter);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(dtStatusSucceed(query.finalizeSlicedFindPath(path, &pathCount, 8)));
+		REQUIRE(pathCount == 1);
+		REQUIRE(path[0] == a);
+
+		// Reachable goals are searched as before.
+		status = query.findPath(a, b, startPos, endPos, &filter, path, &pathCount, 8);
+		REQUIRE(status == DT_SUCCESS);
+		REQUIRE(pathCount == 2);
+	}
+
+	SECTION("Unreachable goals can be redirected to the nearest reachable polygon")
+	{
+		const unsigned int table[] = { 0x1, 0x2 };
+		REQUIRE(dtStatusSucceed(mesh->setReachabilityTables(table, sizeof(table))));
+
+		dtStatus status = query.findPath(a, d, startPos, endPos, &filter, path, &pathCount, 8, DT_FINDPATH_CLOSEST_REACHABLE);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(pathCount == 2);
+		REQUIRE(path[1] == b);
+
+		status = query.initSlicedFindPath(a, d, startPos, endPos, &filter, DT_FINDPATH_CLOSEST_REACHABLE);
+		REQUIRE(dtStatusInProgress(status));
+		status = query.updateSlicedFindPath(64, 0);
+		REQUIRE(dtStatusSucceed(status));
+		status = query.finalizeSlicedFindPath(path, &pathCount, 8);
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(pathCount == 2);
+		REQUIRE(path[1] == b);
+	}
+
+	SECTION("Tables can be cleared")
+	{
+		const unsigned int table[] = { 0x1, 0x2 };
+		REQUIRE(dtStatusSucceed(mesh->setReachabilityTables(table, sizeof(table))));
+		REQUIRE(dtStatusFailed(mesh->setReachabilityTables(table, sizeof(unsigned int))));
+		REQUIRE(!mesh->hasReachabilityTables());
+		REQUIRE(dtStatusSucceed(mesh->setReachabilityTables(0, 0)));
+		REQUIRE(mesh->isGoalPolyReachable(a, d, 0));
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+// Builds the tile at (tx, ty) of a grid navigation mesh made of unit quads. Each tile covers
+// tileSize*tileSize cells, cells for which blocked() returns true are left out. The tile grid
+// grows along -x, so tile tx covers the cells [width - (tx+1)*tileSize, width - tx*tileSize).
+// A non-zero detailBump gives each cell a detail vertex at its center raised to that height.
+static bool buildGridTile(const int tilesX, const int tilesY, const int tileSize, bool (*blocked)(int, int),
+						  const int tx, const int ty, unsigned char** data, int* dataSize,
+						  const float* offMeshConVerts = 0, const int offMeshConCount = 0,
+						  const float detailBump = 0)
+{
+	const int width = tilesX*tileSize;
+	const int height = tilesY*tileSize;
+	const int x0 = width - (tx+1)*tileSize;
+	const int y0 = ty*tileSize;
+	const int nv = tileSize+1;
+	const unsigned short N = 0xffff;
+
+	unsigned short* verts = new unsigned short[nv*nv*3];
+	for (int x = 0; x < nv; ++x)
+	{
+		for (int y = 0; y < nv; ++y)
+		{
+			unsigned short* v = &verts[(x*nv+y)*3];
+			v[0] = (unsigned short)x;
+			v[1] = (unsigned short)y;
+			v[2] = 0;
+		}
+	}
+
+	int* cellPolys = new int[tileSize*tileSize];
+	int polyCount = 0;
+	for (int x = 0; x < tileSize; ++x)
+		for (int y = 0; y < tileSize; ++y)
+			cellPolys[x*tileSize+y] = blocked(x0+x, y0+y) ? -1 : polyCount++;
+
+	unsigned short* polys = new unsigned short[tileSize*tileSize*8];
+	unsigned short* polyFlags = new unsigned short[tileSize*tileSize];
+	unsigned char* polyAreas = new unsigned char[tileSize*tileSize];
+	// Quad edges in order: y-, x+, y+, x-. Portals leading along +x connect to tile tx-1.
+	static const int dx[4] = { 0, 1, 0, -1 };
+	static const int dy[4] = { -1, 0, 1, 0 };
+	static const unsigned short portalDir[4] = { 3, 0, 1, 2 };
+	for (int x = 0; x < tileSize; ++x)
+	{
+		for (int y = 0; y < tileSize; ++y)
+		{
+			const int i = cellPolys[x*tileSize+y];
+			if (i == -1)
+				continue;
+			unsigned short* p = &polys[i*8];
+			p[0] = (unsigned short)(x*nv+y);
+			p[1] = (unsigned short)((x+1)*nv+y);
+			p[2] = (unsigned short)((x+1)*nv+y+1);
+			p[3] = (unsigned short)(x*nv+y+1);
+			for (int e = 0; e < 4; ++e)
+			{
+				const int nx = x+dx[e], ny = y+dy[e];
+				if (nx >= 0 && ny >= 0 && nx < tileSize && ny < tileSize)
+				{
+					const int nei = cellPolys[nx*tileSize+ny];
+					p[4+e] = nei == -1 ? N : (unsigned short)nei;
+				}
+				else
+				{
+					const int gx = x0+nx, gy = y0+ny;
+					const bool inside = gx >= 0 && gy >= 0 && gx < width && gy < height;
+					p[4+e] = inside ? (unsigned short)(0x8000 | portalDir[e]) : N;
+				}
+			}
+			polyFlags[i] = 1;
+			polyAreas[i] = 0;
+		}
+	}
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = nv*nv;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = polyCount;
+	params.nvp = 4;
+	params.tileX = tx;
+	params.tileY = ty;
+	params.bmin[0] = (float)x0;
+	params.bmin[1] = (float)y0;
+	params.bmax[0] = (float)(x0+tileSize);
+	params.bmax[1] = (float)(y0+tileSize);
+	params.bmax[2] = 1;
+	params.walkableHeight = 2;
+	params.walkableRadius = 0.5f;
+	params.walkableClimb = 0.5f;
+	params.cs = 1;
+	params.ch = 1;
+	params.buildBvTree = true;
+
+	// Bidirectional off-mesh connections of unit radius.
+	float* offMeshConRad = new float[offMeshConCount];
+	unsigned short* offMeshConFlags = new unsigned short[offMeshConCount];
+	unsigned char* offMeshConAreas = new unsigned char[offMeshConCount];
+	unsigned char* offMeshConDir = new unsigned char[offMeshConCount];
+	for (int i = 0; i < offMeshConCount; ++i)
+	{
+		offMeshConRad[i] = 1;
+		offMeshConFlags[i] = 1;
+		offMeshConAreas[i] = 0;
+		offMeshConDir[i] = 1;
+	}
+	params.offMeshConVerts = offMeshConVerts;
+	params.offMeshConRad = offMeshConRad;
+	params.offMeshConFlags = offMeshConFlags;
+	params.offMeshConAreas = offMeshConAreas;
+	params.offMeshConDir = offMeshConDir;
+	params.offMeshConCount = offMeshConCount;
+
+	// Detail mesh of four triangles around the cell center, the poly vertices come first.
+	unsigned int* detailMeshes = new unsigned int[polyCount*4];
+	float* detailVerts = new float[polyCount*5*3];
+	unsigned char* detailTris = new unsigned char[polyCount*4*4];
+	for (int i = 0; i < polyCount; ++i)
+	{
+		const unsigned short* p = &polys[i*8];
+		for (int k = 0; k < 4; ++k)
+		{
+			const unsigned short* v = &verts[p[k]*3];
+			detailVerts[(i*5+k)*3+0] = (float)(x0+v[0]);
+			detailVerts[(i*5+k)*3+1] = (float)(y0+v[1]);
+			detailVerts[(i*5+k)*3+2] = 0;
+			unsigned char* t = &detailTris[(i*4+k)*4];
+			t[0] = (unsigned char)k;
+			t[1] = (unsigned char)((k+1) % 4);
+			t[2] = 4;
+			t[3] = DT_DETAIL_EDGE_BOUNDARY << 0;
+		}
+		float* c = &detailVerts[(i*5+4)*3];
+		c[0] = detailVerts[i*5*3+0] + 0.5f;
+		c[1] = detailVerts[i*5*3+1] + 0.5f;
+		c[2] = detailBump;
+		detailMeshes[i*4+0] = (unsigned int)(i*5);
+		detailMeshes[i*4+1] = 5;
+		detailMeshes[i*4+2] = (unsigned int)(i*4);
+		detailMeshes[i*4+3] = 4;
+	}
+	if (detailBump != 0)
+	{
+		params.detailMeshes = detailMeshes;
+		params.detailVerts = detailVerts;
+		params.detailVertsCount = polyCount*5;
+		params.detailTris = detailTris;
+		params.detailTriCount = polyCount*4;
+	}
+
+	const bool ok = polyCount > 0 && dtCreateNavMeshData(&params, data, dataSize);
+	delete [] detailMeshes;
+	delete [] detailVerts;
+	delete [] detailTris;
+	delete [] offMeshConRad;
+	delete [] offMeshConFlags;
+	delete [] offMeshConAreas;
+	delete [] offMeshConDir;
+	delete [] verts;
+	delete [] cellPolys;
+	delete [] polys;
+	delete [] polyFlags;
+	delete [] polyAreas;
+	return ok;
+}
+
+static dtNavMesh* allocGridNavMesh(const int tilesX, const int tilesY, const int tileSize, const int offMeshConsPerTile = 0)
+{
+	dtNavMeshParams meshParams = {};
+	meshParams.orig[0] = (float)(tilesX*tileSize);
+	meshParams.tileWidth = (float)tileSize;
+	meshParams.tileHeight = (float)tileSize;
+	meshParams.maxTiles = tilesX*tilesY;
+	meshParams.maxPolys = tileSize*tileSize + offMeshConsPerTile;
+
+	dtNavMesh* mesh = dtAllocNavMesh();
+	if (!mesh || dtStatusFailed(mesh->init(&meshParams)))
+	{
+		dtFreeNavMesh(mesh);
+		return 0;
+	}
+	return mesh;
+}
+
+static dtNavMesh* buildGridNavMesh(const int tilesX, const int tilesY, const int tileSize, bool (*blocked)(int, int),
+								   const int tileFlags = DT_TILE_FREE_DATA)
+{
+	dtNavMesh* mesh = allocGridNavMesh(tilesX, tilesY, tileSize);
+	if (!mesh)
+		return 0;
+	for (int ty = 0; ty < tilesY; ++ty)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			unsigned char* data = 0;
+			int dataSize = 0;
+			if (!buildGridTile(tilesX, tilesY, tileSize, blocked, tx, ty, &data, &dataSize))
+				continue;
+			if (dtStatusFailed(mesh->addTile(data, dataSize, tileFlags, 0, 0)))
+			{
+				dtFree(data);
+				dtFreeNavMesh(mesh);
+				return 0;
+			}
+		}
+	}
+	return mesh;
+}
+
+static bool openCell(int, int)
+{
+	return false;
+}
+
+// Walls every 16 cells with a gap alternating between the top and the bottom of a 64 cells high grid.
+static bool mazeCell(int x, int y)
+{
+	if (x % 16 != 12)
+		return false;
+	return (x / 16) % 2 == 0 ? y < 62 : y >= 2;
+}
+
+static dtPolyRef findGridPoly(const dtNavMeshQuery& query, const float* pos)
+{
+	const float halfExtents[3] = { 0.1f, 0.1f, 1 };
+	dtQueryFilter filter;
+	dtPolyRef ref = 0;
+	query.findNearestPoly(pos, halfExtents, &filter, &ref, 0);
+	return ref;
+}
+
+static bool isLinkedPath(const dtNavMesh* mesh, const dtPolyRef* path, const int pathCount)
+{
+	for (int i = 0; i + 1 < pathCount; ++i)
+	{
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		if (dtStatusFailed(mesh->getTileAndPolyByRef(path[i], &tile, &poly)))
+			return false;
+		bool linked = false;
+		for (unsigned int j = poly->firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
+			linked |= tile->links[j].ref == path[i+1];
+		if (!linked)
+			return false;
+	}
+	return true;
+}
+
+TEST_CASE("dtTileGraph")
+{
+	SECTION("Paths match the polygon search")
+	{
+		dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+		REQUIRE(mesh);
+		dtNavMeshQuery query;
+		REQUIRE(dtStatusSucceed(query.init(mesh, 4096)));
+		dtTileGraph graph;
+		REQUIRE(dtStatusSucceed(graph.init(mesh)));
+		dtQueryFilter filter;
+
+		const float startPos[] = { 1.5f, 1.5f, 0 };
+		const float endPos[] = { 62.5f, 1.5f, 0 };
+		const dtPolyRef startRef = findGridPoly(query, startPos);
+		const dtPolyRef endRef = findGridPoly(query, endPos);
+		REQUIRE(startRef);
+		REQUIRE(endRef);
+
+		static const int MAX_PATH = 1024;
+		dtPolyRef flatPath[MAX_PATH];
+		int flatCount = 0;
+		REQUIRE(query.findPath(startRef, endRef, startPos, endPos, &filter, flatPath, &flatCount, MAX_PATH) == DT_SUCCESS);
+
+		dtPolyRef path[MAX_PATH];
+		int pathCount = 0;
+		REQUIRE(graph.findPath(&query, startRef, endRef, startPos, endPos, &filter, path, &pathCount, MAX_PATH) == DT_SUCCESS);
+		REQUIRE(graph.getCorridorTileCount() > 1);
+		REQUIRE(graph.getCorridorTileCount() < 16);
+		REQUIRE(path[0] == startRef);
+		REQUIRE(path[pathCount-1] == endRef);
+		REQUIRE(isLinkedPath(mesh, path, pathCount));
+		REQUIRE(pathCount <= flatCount + flatCount/10);
+
+		dtFreeNavMesh(mesh);
+	}
+
+	SECTION("Tile changes update the graph")
+	{
+		dtNavMesh* mesh = buildGridNavMesh(3, 1, 4, openCell);
+		REQUIRE(mesh);
+		dtNavMeshQuery query;
+		REQUIRE(dtStatusSucceed(query.init(mesh, 256)));
+		dtTileGraph graph;
+		REQUIRE(dtStatusSucceed(graph.init(mesh)));
+		mesh->setTileListener(&graph);
+		dtQueryFilter filter;
+
+		const float startPos[] = { 0.5f, 0.5f, 0 };
+		const float endPos[] = { 11.5f, 0.5f, 0 };
+		const dtPolyRef startRef = findGridPoly(query, startPos);
+		const dtPolyRef endRef = findGridPoly(query, endPos);
+		dtPolyRef path[64];
+		int pathCount = 0;
+		REQUIRE(graph.findPath(&query, startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64) == DT_SUCCESS);
+		REQUIRE(graph.getCorridorTileCount() == 3);
+
+		// Removing the middle tile disconnects the outer tiles.
+		const dtTileRef middle = mesh->getTileRefAt(1, 0, 0);
+		const unsigned int middleIndex = mesh->decodePolyIdTile((dtPolyRef)middle);
+		const unsigned int startIndex = mesh->decodePolyIdTile(startRef);
+		REQUIRE(graph.getTile((int)middleIndex)->clusterCount == 2);
+		REQUIRE(dtStatusSucceed(mesh->removeTile(middle, 0, 0)));
+		REQUIRE(graph.getTile((int)middleIndex)->ref == 0);
+		REQUIRE(graph.getTile((int)startIndex)->clusterCount == 0);
+		dtStatus status = graph.findPath(&query, startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64);
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(graph.getCorridorTileCount() == 0);
+
+		// Adding it back restores the clusters.
+		unsigned char* data = 0;
+		int dataSize = 0;
+		REQUIRE(buildGridTile(3, 1, 4, openCell, 1, 0, &data, &dataSize));
+		REQUIRE(dtStatusSucceed(mesh->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		REQUIRE(graph.getTile((int)startIndex)->clusterCount == 1);
+		REQUIRE(graph.findPath(&query, startRef, endRef, startPos, endPos, &filter, path, &pathCount, 64) == DT_SUCCESS);
+		REQUIRE(graph.getCorridorTileCount() == 3);
+		REQUIRE(isLinkedPath(mesh, path, pathCount));
+
+		mesh->setTileListener(0);
+		dtFreeNavMesh(mesh);
+	}
+}
+
+TEST_CASE("Tile indexed node pool")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+	dtQueryFilter filter;
+
+	SECTION("Nodes are found per polygon and state until cleared")
+	{
+		dtNodePool pool(16, mesh);
+		const dtPolyRef ref = mesh->getPolyRefBase(mesh->getTile(3)) | 5;
+		dtNode* a = pool.getNode(ref, 0);
+		dtNode* b = pool.getNode(ref, 2);
+		REQUIRE(a);
+		REQUIRE(b);
+		REQUIRE(a != b);
+		REQUIRE(pool.getNode(ref, 0) == a);
+		REQUIRE(pool.findNode(ref, 2) == b);
+		REQUIRE(pool.findNode(ref + 1, 0) == 0);
+		dtNode* nodes[4];
+		REQUIRE(pool.findNodes(ref, nodes, 4) == 2);
+
+		pool.clear();
+		REQUIRE(pool.getNodeCount() == 0);
+		REQUIRE(pool.findNode(ref, 0) == 0);
+		REQUIRE(pool.getNode(ref, 2) == pool.getNodeAtIdx(1));
+	}
+
+	SECTION("Paths match the hash table pool")
+	{
+		dtNavMeshQuery hashQuery;
+		dtNavMeshQuery tileQuery;
+		REQUIRE(dtStatusSucceed(hashQuery.init(mesh, 4096)));
+		REQUIRE(dtStatusSucceed(tileQuery.init(mesh, 4096, DT_NODE_POOL_TILE_INDEXED)));
+		REQUIRE(tileQuery.getNodePool()->getTileIndexedNavMesh() == mesh);
+
+		const float startPos[] = { 1.5f, 1.5f, 0 };
+		const float endPos[] = { 62.5f, 1.5f, 0 };
+		const dtPolyRef startRef = findGridPoly(hashQuery, startPos);
+		const dtPolyRef endRef = findGridPoly(hashQuery, endPos);
+
+		static const int MAX_PATH = 1024;
+		dtPolyRef hashPath[MAX_PATH];
+		dtPolyRef tilePath[MAX_PATH];
+		int hashCount = 0, tileCount = 0;
+		for (int i = 0; i < 2; ++i)
+		{
+			REQUIRE(hashQuery.findPath(startRef, endRef, startPos, endPos, &filter, hashPath, &hashCount, MAX_PATH) == DT_SUCCESS);
+			REQUIRE(tileQuery.findPath(startRef, endRef, startPos, endPos, &filter, tilePath, &tileCount, MAX_PATH) == DT_SUCCESS);
+			REQUIRE(hashCount == tileCount);
+			REQUIRE(memcmp(hashPath, tilePath, sizeof(dtPolyRef)*hashCount) == 0);
+		}
+
+		// Running out of nodes is reported the same way.
+		dtNavMeshQuery smallQuery;
+		REQUIRE(dtStatusSucceed(smallQuery.init(mesh, 64, DT_NODE_POOL_TILE_INDEXED)));
+		const dtStatus status = smallQuery.findPath(startRef, endRef, startPos, endPos, &filter, tilePath, &tileCount, MAX_PATH);
+		REQUIRE(dtStatusDetail(status, DT_OUT_OF_NODES));
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+static float straightPathLength(const dtNavMeshQuery& query, const float* startPos, const float* endPos,
+								const dtPolyRef* path, const int pathCount)
+{
+	float points[256*3];
+	int count = 0;
+	query.findStraightPath(startPos, endPos, path, pathCount, points, 0, 0, &count, 256);
+	float length = 0;
+	for (int i = 1; i < count; ++i)
+		length += dtVdist(&points[(i-1)*3], &points[i*3]);
+	return length;
+}
+
+TEST_CASE("Open list types")
+{
+	const dtNodeQueueType types[] = { DT_NODE_QUEUE_BINARY_HEAP, DT_NODE_QUEUE_QUATERNARY_HEAP, DT_NODE_QUEUE_RADIX_HEAP };
+
+	SECTION("Nodes are popped in order of their total cost")
+	{
+		static const int NODE_COUNT = 200;
+		for (int t = 0; t < 3; ++t)
+		{
+			dtNode nodes[NODE_COUNT];
+			memset(nodes, 0, sizeof(nodes));
+			dtNodeQueue queue(NODE_COUNT, types[t]);
+			for (int i = 0; i < NODE_COUNT; ++i)
+			{
+				nodes[i].total = (float)((i*7919) % 1000) + 10.0f;
+				queue.push(&nodes[i]);
+			}
+			// Lower the cost of every third node.
+			for (int i = 0; i < NODE_COUNT; i += 3)
+			{
+				nodes[i].total -= 9.5f;
+				queue.modify(&nodes[i]);
+			}
+			REQUIRE(queue.top()->total == Approx(0.5f));
+			float last = 0;
+			int count = 0;
+			while (!queue.empty())
+			{
+				const dtNode* node = queue.pop();
+				REQUIRE(node->total >= last);
+				last = node->total;
+				count++;
+			}
+			REQUIRE(count == NODE_COUNT);
+		}
+	}
+
+	SECTION("Paths match the binary heap")
+	{
+		dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+		REQUIRE(mesh);
+		dtQueryFilter filter;
+		const float startPos[] = { 1.5f, 1.5f, 0 };
+		const float endPos[] = { 62.5f, 1.5f, 0 };
+
+		float lengths[3];
+		for (int t = 0; t < 3; ++t)
+		{
+			dtNavMeshQuery query;
+			REQUIRE(dtStatusSucceed(query.init(mesh, 4096, DT_NODE_POOL_HASH, types[t])));
+			const dtPolyRef startRef = findGridPoly(query, startPos);
+			const dtPolyRef endRef = findGridPoly(query, endPos);
+			dtPolyRef path[1024];
+			int pathCount = 0;
+			REQUIRE(query.findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 1024) == DT_SUCCESS);
+			REQUIRE(path[pathCount-1] == endRef);
+			REQUIRE(isLinkedPath(mesh, path, pathCount));
+			lengths[t] = straightPathLength(query, startPos, endPos, path, pathCount);
+		}
+		REQUIRE(lengths[1] == Approx(lengths[0]).epsilon(0.01));
+		REQUIRE(lengths[2] == Approx(lengths[0]).epsilon(0.01));
+
+		dtFreeNavMesh(mesh);
+	}
+}
+
+TEST_CASE("Batch path queries")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 4096)));
+	dtQueryFilter filter;
+
+	// Six agents head for one goal, the others have goals of their own.
+	static const int REQUEST_COUNT = 9;
+	dtPathRequest requests[REQUEST_COUNT];
+	for (int i = 0; i < REQUEST_COUNT; ++i)
+	{
+		dtPathRequest& req = requests[i];
+		dtVset(req.startPos, (float)((i*23) % 64) + 0.5f, (float)((i*41) % 64) + 0.5f, 0);
+		if (i < 6)
+			dtVset(req.endPos, 62.5f, 1.5f, 0);
+		else
+			dtVset(req.endPos, (float)(i*5) + 0.5f, 60.5f, 0);
+		req.startRef = findGridPoly(query, req.startPos);
+		req.endRef = findGridPoly(query, req.endPos);
+		req.filter = &filter;
+	}
+
+	static const int MAX_PATH = 1024;
+	static const int MAX_STRAIGHT_PATH = 128;
+	dtPathResult results[REQUEST_COUNT];
+	dtPolyRef* paths = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*MAX_PATH*REQUEST_COUNT, DT_ALLOC_TEMP);
+	float* straightPaths = (float*)dtAlloc(sizeof(float)*3*MAX_STRAIGHT_PATH*REQUEST_COUNT, DT_ALLOC_TEMP);
+
+	SECTION("Results match individual queries")
+	{
+		REQUIRE(query.findPaths(requests, REQUEST_COUNT, results, paths, MAX_PATH,
+								straightPaths, MAX_STRAIGHT_PATH, 2) == DT_SUCCESS);
+
+		for (int i = 0; i < REQUEST_COUNT; ++i)
+		{
+			const dtPathRequest& req = requests[i];
+			const dtPolyRef* path = paths + i*MAX_PATH;
+			REQUIRE(results[i].status == DT_SUCCESS);
+			REQUIRE(path[0] == req.startRef);
+			REQUIRE(path[results[i].pathCount-1] == req.endRef);
+			REQUIRE(isLinkedPath(mesh, path, results[i].pathCount));
+
+			const float* straightPath = straightPaths + i*MAX_STRAIGHT_PATH*3;
+			REQUIRE(results[i].straightPathCount >= 2);
+			REQUIRE(dtVdist(&straightPath[(results[i].straightPathCount-1)*3], req.endPos) < 0.01f);
+
+			dtPolyRef single[MAX_PATH];
+			int singleCount = 0;
+			REQUIRE(query.findPath(req.startRef, req.endRef, req.startPos, req.endPos, &filter, single, &singleCount, MAX_PATH) == DT_SUCCESS);
+			float batchLength = 0;
+			for (int j = 1; j < results[i].straightPathCount; ++j)
+				batchLength += dtVdist(&straightPath[(j-1)*3], &straightPath[j*3]);
+			REQUIRE(batchLength == Approx(straightPathLength(query, req.startPos, req.endPos, single, singleCount)).epsilon(0.02));
+		}
+	}
+
+	SECTION("Corridors are truncated to the buffer size")
+	{
+		REQUIRE(query.findPaths(requests, REQUEST_COUNT, results, paths, 4, 0, 0, 2) == DT_SUCCESS);
+		for (int i = 0; i < 6; ++i)
+		{
+			REQUIRE((results[i].status & DT_BUFFER_TOO_SMALL) != 0);
+			REQUIRE(results[i].pathCount == 4);
+			REQUIRE(paths[i*4] == requests[i].startRef);
+			REQUIRE(isLinkedPath(mesh, paths + i*4, 4));
+		}
+	}
+
+	SECTION("Invalid requests fail on their own")
+	{
+		requests[2].startRef = 0;
+		REQUIRE(query.findPaths(requests, REQUEST_COUNT, results, paths, MAX_PATH, 0, 0, 2) == DT_SUCCESS);
+		REQUIRE(dtStatusFailed(results[2].status));
+		REQUIRE(results[2].pathCount == 0);
+		REQUIRE(results[3].status == DT_SUCCESS);
+		REQUIRE(query.findPaths(requests, REQUEST_COUNT, 0, paths, MAX_PATH, 0, 0) == (DT_FAILURE | DT_INVALID_PARAM));
+	}
+
+	dtFree(paths);
+	dtFree(straightPaths);
+	dtFreeNavMesh(mesh);
+}
+
+static std::atomic<int> s_completedPathJobs(0);
+
+static void countPathJob(dtStatus, void*)
+{
+	s_completedPathJobs++;
+}
+
+static void swapMazeTile(dtNavMesh& nav, void*)
+{
+	nav.removeTile(nav.getTileRefAt(1, 1, 0), 0, 0);
+	unsigned char* data = 0;
+	int dataSize = 0;
+	if (buildGridTile(4, 4, 16, mazeCell, 1, 1, &data, &dataSize) &&
+		dtStatusFailed(nav.addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)))
+	{
+		dtFree(data);
+	}
+}
+
+TEST_CASE("Query service")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 4096)));
+	dtQueryFilter filter;
+
+	static const int JOB_COUNT = 32;
+	static const int MAX_PATH = 1024;
+	static const int MAX_STRAIGHT_PATH = 128;
+	dtQueryPathJob jobs[JOB_COUNT];
+	dtQueryFuture futures[JOB_COUNT];
+	dtPolyRef* paths = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*MAX_PATH*JOB_COUNT, DT_ALLOC_TEMP);
+	float* straightPaths = (float*)dtAlloc(sizeof(float)*3*MAX_STRAIGHT_PATH*JOB_COUNT, DT_ALLOC_TEMP);
+	for (int i = 0; i < JOB_COUNT; ++i)
+	{
+		dtQueryPathJob& job = jobs[i];
+		dtVset(job.request.startPos, (float)((i*23) % 64) + 0.5f, (float)((i*41) % 64) + 0.5f, 0);
+		dtVset(job.request.endPos, (float)((i*29 + 17) % 64) + 0.5f, (float)((i*13 + 5) % 64) + 0.5f, 0);
+		job.request.startRef = findGridPoly(query, job.request.startPos);
+		job.request.endRef = findGridPoly(query, job.request.endPos);
+		job.request.filter = &filter;
+		job.path = paths + i*MAX_PATH;
+		job.maxPath = MAX_PATH;
+		job.straightPath = straightPaths + i*MAX_STRAIGHT_PATH*3;
+		job.maxStraightPath = MAX_STRAIGHT_PATH;
+	}
+
+	dtQueryService service;
+	REQUIRE(service.init(mesh, 4, 4096, 16) == DT_SUCCESS);
+	REQUIRE(service.getThreadCount() == 4);
+
+	SECTION("Path jobs match single threaded queries")
+	{
+		s_completedPathJobs = 0;
+		for (int i = 0; i < JOB_COUNT; ++i)
+		{
+			// The queue holds 16 jobs, wait for a slot when it is full.
+			dtStatus status;
+			while ((status = service.submitPath(&jobs[i], &futures[i], countPathJob)) == (DT_FAILURE | DT_BUFFER_TOO_SMALL))
+				futures[i-16].wait();
+			REQUIRE(status == DT_SUCCESS);
+		}
+		for (int i = 0; i < JOB_COUNT; ++i)
+		{
+			const dtQueryPathJob& job = jobs[i];
+			REQUIRE(dtStatusSucceed(futures[i].wait()));
+			REQUIRE(futures[i].getStatus() == job.result.status);
+
+			dtPolyRef path[MAX_PATH];
+			int pathCount = 0;
+			query.findPath(job.request.startRef, job.request.endRef, job.request.startPos, job.request.endPos,
+						   &filter, path, &pathCount, MAX_PATH);
+			REQUIRE(job.result.pathCount == pathCount);
+			REQUIRE(memcmp(job.path, path, sizeof(dtPolyRef)*pathCount) == 0);
+			REQUIRE(job.result.straightPathCount >= 2);
+		}
+		service.waitIdle();
+		REQUIRE(s_completedPathJobs == JOB_COUNT);
+	}
+
+	SECTION("Tiles can be swapped while jobs run")
+	{
+		s_completedPathJobs = 0;
+		int submitted = 0;
+		for (int round = 0; round < 8; ++round)
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				// Refs into the swapped tile go stale, the jobs must fail cleanly.
+				if (service.submitPath(&jobs[(round*16 + i) % JOB_COUNT], 0, countPathJob) == DT_SUCCESS)
+					submitted++;
+			}
+			service.updateNavMesh(swapMazeTile, 0);
+			service.waitIdle();
+		}
+		REQUIRE(s_completedPathJobs == submitted);
+
+		// The swapped tile is linked to its neighbours again.
+		const float startPos[] = { 35.5f, 5.5f, 0 };
+		const float endPos[] = { 35.5f, 40.5f, 0 };
+		dtPolyRef path[MAX_PATH];
+		int pathCount = 0;
+		REQUIRE(query.findPath(findGridPoly(query, startPos), findGridPoly(query, endPos), startPos, endPos,
+							   &filter, path, &pathCount, MAX_PATH) == DT_SUCCESS);
+		REQUIRE(isLinkedPath(mesh, path, pathCount));
+	}
+
+	dtFree(paths);
+	dtFree(straightPaths);
+	dtFreeNavMesh(mesh);
+}
+
+TEST_CASE("Flow field")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 8192)));
+	dtQueryFilter filter;
+
+	const float goalPos[] = { 62.5f, 1.5f, 0 };
+	const dtPolyRef goalRef = findGridPoly(query, goalPos);
+	dtFlowField field;
+
+	SECTION("Paths lead to the goal")
+	{
+		REQUIRE(query.buildFlowField(goalRef, goalPos, &filter, FLT_MAX, &field) == DT_SUCCESS);
+		REQUIRE(field.isValid());
+		REQUIRE(field.getGoalRef() == goalRef);
+		REQUIRE(field.getTileCount() == 16);
+
+		for (int i = 0; i < 8; ++i)
+		{
+			const float startPos[] = { (float)((i*23) % 64) + 0.5f, (float)((i*41) % 64) + 0.5f, 0 };
+			const dtPolyRef startRef = findGridPoly(query, startPos);
+			dtPolyRef path[1024];
+			int pathCount = 0;
+			REQUIRE(field.getPath(startRef, path, &pathCount, 1024) == DT_SUCCESS);
+			REQUIRE(path[0] == startRef);
+			REQUIRE(path[pathCount-1] == goalRef);
+			REQUIRE(isLinkedPath(mesh, path, pathCount));
+
+			// Costs fall towards the goal.
+			float lastCost = FLT_MAX;
+			for (int j = 0; j < pathCount; ++j)
+			{
+				float cost = 0;
+				dtPolyRef next = 0;
+				REQUIRE(field.getNextHop(path[j], &next, &cost));
+				REQUIRE(cost < lastCost);
+				lastCost = cost;
+			}
+			REQUIRE(lastCost == 0);
+
+			dtPolyRef single[1024];
+			int singleCount = 0;
+			query.findPath(startRef, goalRef, startPos, goalPos, &filter, single, &singleCount, 1024);
+			REQUIRE(straightPathLength(query, startPos, goalPos, path, pathCount) ==
+					Approx(straightPathLength(query, startPos, goalPos, single, singleCount)).epsilon(0.02));
+		}
+	}
+
+	SECTION("The field is bounded by cost")
+	{
+		REQUIRE(query.buildFlowField(goalRef, goalPos, &filter, 20.0f, &field) == DT_SUCCESS);
+		const float nearPos[] = { 50.5f, 1.5f, 0 };
+		const float farPos[] = { 1.5f, 1.5f, 0 };
+		float cost = 0;
+		dtPolyRef next = 0;
+		REQUIRE(field.getNextHop(findGridPoly(query, nearPos), &next, &cost));
+		REQUIRE(cost <= 20.0f);
+		REQUIRE(!field.getNextHop(findGridPoly(query, farPos), &next, &cost));
+
+		dtPolyRef path[16];
+		int pathCount = 0;
+		REQUIRE(dtStatusFailed(field.getPath(findGridPoly(query, farPos), path, &pathCount, 16)));
+		REQUIRE(pathCount == 0);
+
+		// Neighbours beyond the bound take no nodes, every node of the search is part of the field.
+		const dtNodePool* pool = query.getNodePool();
+		REQUIRE(pool->getNodeCount() > 1);
+		for (int i = 0; i < pool->getNodeCount(); ++i)
+		{
+			const dtNode* node = pool->getNodeAtIdx(i+1);
+			REQUIRE(node->flags != 0);
+			REQUIRE(node->cost <= 20.0f);
+		}
+	}
+
+	SECTION("Replaced tiles invalidate the field")
+	{
+		REQUIRE(query.buildFlowField(goalRef, goalPos, &filter, FLT_MAX, &field) == DT_SUCCESS);
+		const float startPos[] = { 35.5f, 5.5f, 0 };
+		const dtPolyRef startRef = findGridPoly(query, startPos);
+		dtPolyRef path[1024];
+		int pathCount = 0;
+		REQUIRE(field.getPath(startRef, path, &pathCount, 1024) == DT_SUCCESS);
+
+		swapMazeTile(*mesh, 0);
+		REQUIRE(!field.isValid());
+		// The start tile is unchanged, but its path crosses the replaced tile.
+		REQUIRE(dtStatusFailed(field.getPath(startRef, path, &pathCount, 1024)));
+	}
+
+	SECTION("Out of nodes")
+	{
+		dtNavMeshQuery smallQuery;
+		REQUIRE(dtStatusSucceed(smallQuery.init(mesh, 64)));
+		const dtStatus status = smallQuery.buildFlowField(goalRef, goalPos, &filter, FLT_MAX, &field);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_OUT_OF_NODES));
+		dtPolyRef next = 0;
+		REQUIRE(field.getNextHop(goalRef, &next, 0));
+		REQUIRE(next == 0);
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+static int sortRefs(const void* a, const void* b)
+{
+	const dtPolyRef ra = *(const dtPolyRef*)a;
+	const dtPolyRef rb = *(const dtPolyRef*)b;
+	return ra < rb ? -1 : (ra > rb ? 1 : 0);
+}
+
+TEST_CASE("Wide BV tree")
+{
+	dtNavMesh* wideMesh = buildGridNavMesh(2, 2, 32, mazeCell);
+	dtNavMesh* binaryMesh = buildGridNavMesh(2, 2, 32, mazeCell, DT_TILE_FREE_DATA | DT_TILE_NO_WIDE_BVTREE);
+	REQUIRE(wideMesh);
+	REQUIRE(binaryMesh);
+
+	SECTION("Every tile has a wide tree unless disabled")
+	{
+		for (int i = 0; i < wideMesh->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = wideMesh->getTile(i);
+			REQUIRE(tile->wideBvTree);
+			REQUIRE(tile->wideBvNodeCount > 0);
+			REQUIRE(tile->wideBvNodeCount < tile->header->polyCount/2);
+			REQUIRE(!binaryMesh->getTile(i)->wideBvTree);
+		}
+	}
+
+	SECTION("Queries match the binary tree")
+	{
+		dtNavMeshQuery wideQuery;
+		dtNavMeshQuery binaryQuery;
+		REQUIRE(dtStatusSucceed(wideQuery.init(wideMesh, 256)));
+		REQUIRE(dtStatusSucceed(binaryQuery.init(binaryMesh, 256)));
+		dtQueryFilter filter;
+
+		for (int i = 0; i < 200; ++i)
+		{
+			const float center[] = { (float)((i*37) % 640)*0.1f + 0.05f, (float)((i*53) % 640)*0.1f + 0.05f, 0 };
+			const float halfExtents[] = { (float)(i % 7)*0.7f + 0.1f, (float)(i % 5)*0.9f + 0.1f, 1 };
+
+			dtPolyRef wideRefs[512];
+			dtPolyRef binaryRefs[512];
+			int wideCount = 0;
+			int binaryCount = 0;
+			REQUIRE(dtStatusSucceed(wideQuery.queryPolygons(center, halfExtents, &filter, wideRefs, &wideCount, 512)));
+			REQUIRE(dtStatusSucceed(binaryQuery.queryPolygons(center, halfExtents, &filter, binaryRefs, &binaryCount, 512)));
+			qsort(wideRefs, wideCount, sizeof(dtPolyRef), sortRefs);
+			qsort(binaryRefs, binaryCount, sizeof(dtPolyRef), sortRefs);
+			// The unused last node of the binary tree reports polygon 0 again at the tile origin.
+			binaryCount = (int)(std::unique(binaryRefs, binaryRefs + binaryCount) - binaryRefs);
+			REQUIRE(wideCount > 0);
+			REQUIRE(wideCount == binaryCount);
+			REQUIRE(memcmp(wideRefs, binaryRefs, sizeof(dtPolyRef)*wideCount) == 0);
+
+			dtPolyRef wideNearest = 0;
+			dtPolyRef binaryNearest = 0;
+			float widePt[3], binaryPt[3];
+			wideQuery.findNearestPoly(center, halfExtents, &filter, &wideNearest, widePt);
+			binaryQuery.findNearestPoly(center, halfExtents, &filter, &binaryNearest, binaryPt);
+			REQUIRE(dtVdist(widePt, binaryPt) < 1e-4f);
+		}
+	}
+
+	dtFreeNavMesh(wideMesh);
+	dtFreeNavMesh(binaryMesh);
+}
+
+// Builds a single tile of cols*rows unit quads repeated on several storeys, 4 units apart.
+static bool buildStoreyTile(const int cols, const int rows, const int storeys, const unsigned char bvTreeBuildMethod,
+							unsigned char** data, int* dataSize)
+{
+	const int nvx = cols+1, nvy = rows+1;
+	const int vertsPerStorey = nvx*nvy;
+	const int polysPerStorey = cols*rows;
+	const int polyCount = polysPerStorey*storeys;
+
+	unsigned short* verts = new unsigned short[vertsPerStorey*storeys*3];
+	unsigned short* polys = new unsigned short[polyCount*8];
+	unsigned short* polyFlags = new unsigned short[polyCount];
+	unsigned char* polyAreas = new unsigned char[polyCount];
+	for (int s = 0; s < storeys; ++s)
+	{
+		for (int x = 0; x < nvx; ++x)
+		{
+			for (int y = 0; y < nvy; ++y)
+			{
+				unsigned short* v = &verts[(s*vertsPerStorey + x*nvy+y)*3];
+				v[0] = (unsigned short)x;
+				v[1] = (unsigned short)y;
+				v[2] = (unsigned short)(s*4);
+			}
+		}
+		for (int x = 0; x < cols; ++x)
+		{
+			for (int y = 0; y < rows; ++y)
+			{
+				const int i = s*polysPerStorey + x*rows+y;
+				const int v0 = s*vertsPerStorey;
+				unsigned short* p = &polys[i*8];
+				p[0] = (unsigned short)(v0 + x*nvy+y);
+				p[1] = (unsigned short)(v0 + (x+1)*nvy+y);
+				p[2] = (unsigned short)(v0 + (x+1)*nvy+y+1);
+				p[3] = (unsigned short)(v0 + x*nvy+y+1);
+				p[4] = p[5] = p[6] = p[7] = 0xffff;
+				polyFlags[i] = 1;
+				polyAreas[i] = 0;
+			}
+		}
+	}
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = vertsPerStorey*storeys;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = polyCount;
+	params.nvp = 4;
+	params.bmax[0] = (float)cols;
+	params.bmax[1] = (float)rows;
+	params.bmax[2] = (float)(storeys*4);
+	params.walkableHeight = 2;
+	params.walkableRadius = 0.5f;
+	params.walkableClimb = 0.5f;
+	params.cs = 1;
+	params.ch = 1;
+	params.buildBvTree = true;
+	params.bvTreeBuildMethod = bvTreeBuildMethod;
+
+	const bool ok = dtCreateNavMeshData(&params, data, dataSize);
+	delete [] verts;
+	delete [] polys;
+	delete [] polyFlags;
+	delete [] polyAreas;
+	return ok;
+}
+
+static dtNavMesh* buildStoreyNavMesh(const int cols, const int rows, const int storeys, const unsigned char bvTreeBuildMethod,
+									 const int tileFlags = DT_TILE_FREE_DATA)
+{
+	unsigned char* data = 0;
+	int dataSize = 0;
+	if (!buildStoreyTile(cols, rows, storeys, bvTreeBuildMethod, &data, &dataSize))
+		return 0;
+	dtNavMesh* mesh = dtAllocNavMesh();
+	if (!mesh || dtStatusFailed(mesh->init(data, dataSize, tileFlags)))
+	{
+		dtFree(data);
+		dtFreeNavMesh(mesh);
+		return 0;
+	}
+	return mesh;
+}
+
+// Returns the number of binary tree nodes a polygon query visits, using the same quantization.
+static int countBVTreeVisits(const dtMeshTile* tile, const float* center, const float* halfExtents)
+{
+	const float* tbmin = tile->header->bmin;
+	const float* tbmax = tile->header->bmax;
+	const float qfac = tile->header->bvQuantFactor;
+	unsigned short bmin[3], bmax[3];
+	for (int j = 0; j < 3; ++j)
+	{
+		bmin[j] = (unsigned short)(qfac * (dtClamp(center[j] - halfExtents[j], tbmin[j], tbmax[j]) - tbmin[j])) & 0xfffe;
+		bmax[j] = (unsigned short)(qfac * (dtClamp(center[j] + halfExtents[j], tbmin[j], tbmax[j]) - tbmin[j]) + 1) | 1;
+	}
+
+	int visits = 0;
+	const dtBVNode* node = tile->bvTree;
+	const dtBVNode* end = tile->bvTree + tile->header->bvNodeCount;
+	while (node < end)
+	{
+		visits++;
+		const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
+		if (overlap || node->i >= 0)
+			node++;
+		else
+			node += -node->i;
+	}
+	return visits;
+}
+
+TEST_CASE("Surface area heuristic BV tree")
+{
+	dtNavMesh* medianMesh = buildStoreyNavMesh(64, 8, 4, DT_BVTREE_MEDIAN, DT_TILE_FREE_DATA | DT_TILE_NO_WIDE_BVTREE);
+	dtNavMesh* sahMesh = buildStoreyNavMesh(64, 8, 4, DT_BVTREE_SAH, DT_TILE_FREE_DATA | DT_TILE_NO_WIDE_BVTREE);
+	REQUIRE(medianMesh);
+	REQUIRE(sahMesh);
+	const dtMeshTile* medianTile = medianMesh->getTile(0);
+	const dtMeshTile* sahTile = sahMesh->getTile(0);
+
+	SECTION("The tree keeps the escape index encoding")
+	{
+		const int polyCount = sahTile->header->polyCount;
+		REQUIRE(sahTile->header->bvNodeCount == medianTile->header->bvNodeCount);
+		REQUIRE(-sahTile->bvTree[0].i == 2*polyCount-1);
+
+		// Every polygon is in exactly one leaf, and every leaf lies inside its parent.
+		int* seen = new int[polyCount];
+		memset(seen, 0, sizeof(int)*polyCount);
+		for (int n = 0; n < 2*polyCount-1; ++n)
+		{
+			const dtBVNode& node = sahTile->bvTree[n];
+			if (node.i >= 0)
+			{
+				REQUIRE(node.i < polyCount);
+				seen[node.i]++;
+				continue;
+			}
+			const dtBVNode& left = sahTile->bvTree[n+1];
+			for (int j = 0; j < 3; ++j)
+			{
+				REQUIRE(left.bmin[j] >= node.bmin[j]);
+				REQUIRE(left.bmax[j] <= node.bmax[j]);
+			}
+		}
+		for (int i = 0; i < polyCount; ++i)
+			REQUIRE(seen[i] == 1);
+		delete [] seen;
+	}
+
+	SECTION("Queries match the median tree and visit fewer nodes")
+	{
+		dtNavMeshQuery medianQuery;
+		dtNavMeshQuery sahQuery;
+		REQUIRE(dtStatusSucceed(medianQuery.init(medianMesh, 256)));
+		REQUIRE(dtStatusSucceed(sahQuery.init(sahMesh, 256)));
+		dtQueryFilter filter;
+
+		int medianVisits = 0;
+		int sahVisits = 0;
+		for (int i = 0; i < 200; ++i)
+		{
+			const float center[] = { (float)((i*37) % 640)*0.1f + 0.05f, (float)((i*53) % 80)*0.1f + 0.05f, (float)((i % 4)*4) };
+			const float halfExtents[] = { (float)(i % 7)*0.7f + 0.1f, (float)(i % 5)*0.9f + 0.1f, 1 };
+
+			dtPolyRef medianRefs[512];
+			dtPolyRef sahRefs[512];
+			int medianCount = 0;
+			int sahCount = 0;
+			REQUIRE(dtStatusSucceed(medianQuery.queryPolygons(center, halfExtents, &filter, medianRefs, &medianCount, 512)));
+			REQUIRE(dtStatusSucceed(sahQuery.queryPolygons(center, halfExtents, &filter, sahRefs, &sahCount, 512)));
+			qsort(medianRefs, medianCount, sizeof(dtPolyRef), sortRefs);
+			qsort(sahRefs, sahCount, sizeof(dtPolyRef), sortRefs);
+			medianCount = (int)(std::unique(medianRefs, medianRefs + medianCount) - medianRefs);
+			sahCount = (int)(std::unique(sahRefs, sahRefs + sahCount) - sahRefs);
+			REQUIRE(sahCount > 0);
+			REQUIRE(sahCount == medianCount);
+			REQUIRE(memcmp(sahRefs, medianRefs, sizeof(dtPolyRef)*sahCount) == 0);
+
+			medianVisits += countBVTreeVisits(medianTile, center, halfExtents);
+			sahVisits += countBVTreeVisits(sahTile, center, halfExtents);
+		}
+		REQUIRE(sahVisits < medianVisits);
+	}
+
+	SECTION("The wide tree is built from it")
+	{
+		dtNavMesh* wideMesh = buildStoreyNavMesh(64, 8, 4, DT_BVTREE_SAH);
+		REQUIRE(wideMesh);
+		REQUIRE(wideMesh->getTile(0)->wideBvTree);
+		dtFreeNavMesh(wideMesh);
+	}
+
+	dtFreeNavMesh(medianMesh);
+	dtFreeNavMesh(sahMesh);
+}
+
+// Checks that grid queries return each polygon the tiles return exactly once. Boxes of up to
+// one cell are found through the grid, larger ones through the tiles.
+static void checkPolyGridQueries(dtNavMesh* mesh, const dtNavMeshQuery& query)
+{
+	static const int queryCount = 200;
+	static const int maxRefs = 256;
+	dtQueryFilter filter;
+	std::vector<dtPolyRef> gridRefs(queryCount*maxRefs);
+	int gridCounts[queryCount];
+	const int cellsPerTile = mesh->getPolyGridCellsPerTile();
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (int i = 0; i < queryCount; ++i)
+		{
+			const float center[] = { (float)((i*37) % 640)*0.1f + 0.05f, (float)((i*53) % 640)*0.1f + 0.05f, (float)(i % 3)*0.4f - 0.4f };
+			const float scale = (i % 4) ? 0.3f : 1.3f;
+			const float halfExtents[] = { (float)(i % 7)*scale + 0.1f, (float)(i % 5)*scale + 0.1f, 0.5f };
+			dtPolyRef refs[maxRefs];
+			int count = 0;
+			REQUIRE(dtStatusSucceed(query.queryPolygons(center, halfExtents, &filter, refs, &count, maxRefs)));
+			REQUIRE(count < maxRefs);
+			qsort(refs, count, sizeof(dtPolyRef), sortRefs);
+			if (pass == 0)
+			{
+				gridCounts[i] = count;
+				memcpy(&gridRefs[i*maxRefs], refs, sizeof(dtPolyRef)*count);
+				continue;
+			}
+			REQUIRE(count == gridCounts[i]);
+			REQUIRE(memcmp(refs, &gridRefs[i*maxRefs], sizeof(dtPolyRef)*count) == 0);
+		}
+		// Query the tiles for the reference results.
+		REQUIRE(dtStatusSucceed(mesh->initPolyGrid(pass == 0 ? 0 : cellsPerTile)));
+	}
+}
+
+TEST_CASE("Polygon grid")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 256)));
+	REQUIRE(dtStatusSucceed(mesh->initPolyGrid(4)));
+	REQUIRE(mesh->getPolyGridCellsPerTile() == 4);
+	dtQueryFilter filter;
+
+	SECTION("Queries return the polygons of the tiles once")
+	{
+		checkPolyGridQueries(mesh, query);
+
+		const float center[] = { 20.5f, 30.5f, 0 };
+		const float halfExtents[] = { 0.4f, 0.4f, 1 };
+		dtPolyRef ref = 0;
+		float pt[3];
+		REQUIRE(dtStatusSucceed(query.findNearestPoly(center, halfExtents, &filter, &ref, pt)));
+		REQUIRE(ref == findGridPoly(query, center));
+		REQUIRE(dtVdist(pt, center) < 1e-4f);
+	}
+
+	SECTION("Tile changes update the grid")
+	{
+		swapMazeTile(*mesh, 0);
+		REQUIRE(mesh->getPolyGridColumn(1, 1));
+		checkPolyGridQueries(mesh, query);
+
+		REQUIRE(dtStatusSucceed(mesh->removeTile(mesh->getTileRefAt(2, 2, 0), 0, 0)));
+		REQUIRE(!mesh->getPolyGridColumn(2, 2));
+		checkPolyGridQueries(mesh, query);
+	}
+
+	SECTION("The grid can be freed")
+	{
+		REQUIRE(dtStatusFailed(mesh->initPolyGrid(DT_POLYGRID_MAX_CELLS_PER_TILE+1)));
+		REQUIRE(mesh->getPolyGridCellsPerTile() == 4);
+		REQUIRE(dtStatusSucceed(mesh->initPolyGrid(0)));
+		REQUIRE(mesh->getPolyGridCellsPerTile() == 0);
+		REQUIRE(!mesh->getPolyGridColumn(1, 1));
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+// Collects the sorted link targets of every polygon of the mesh.
+static void collectLinks(const dtNavMesh* mesh, std::vector<dtPolyRef>& links)
+{
+	links.clear();
+	for (int i = 0; i < mesh->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = mesh->getTile(i);
+		if (!tile->header)
+			continue;
+		for (int j = 0; j < tile->header->polyCount; ++j)
+		{
+			const size_t first = links.size();
+			for (unsigned int k = tile->polys[j].firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+				links.push_back(tile->links[k].ref);
+			std::sort(links.begin() + first, links.end());
+			links.push_back(0);
+		}
+	}
+}
+
+TEST_CASE("Portal edge index")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+
+	SECTION("Every portal edge is indexed by side and sorted along the border")
+	{
+		for (int i = 0; i < mesh->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = mesh->getTile(i);
+			int portalCount = 0;
+			for (int j = 0; j < tile->header->polyCount; ++j)
+				for (int k = 0; k < tile->polys[j].vertCount; ++k)
+					if (tile->polys[j].neis[k] & DT_EXT_LINK)
+						portalCount++;
+			REQUIRE(portalCount > 0);
+			REQUIRE(tile->portalEdgeSides[0] == 0);
+			REQUIRE(tile->portalEdgeSides[8] == portalCount);
+			for (int side = 0; side < 8; ++side)
+			{
+				for (int j = tile->portalEdgeSides[side]; j < tile->portalEdgeSides[side+1]; ++j)
+				{
+					const dtPortalEdge& edge = tile->portalEdges[j];
+					REQUIRE(edge.side == side);
+					REQUIRE(tile->polys[edge.poly].neis[edge.edge] == (DT_EXT_LINK | side));
+					if (j > tile->portalEdgeSides[side])
+					{
+						REQUIRE(edge.smin >= tile->portalEdges[j-1].smin);
+						REQUIRE(edge.reach >= tile->portalEdges[j-1].reach);
+					}
+				}
+			}
+		}
+	}
+
+	SECTION("Removing and adding a tile restores the links")
+	{
+		std::vector<dtPolyRef> before;
+		collectLinks(mesh, before);
+
+		const dtTileRef ref = mesh->getTileRefAt(1, 1, 0);
+		unsigned char* data = 0;
+		int dataSize = 0;
+		REQUIRE(dtStatusSucceed(mesh->removeTile(ref, &data, &dataSize)));
+		REQUIRE(data == 0);
+		const unsigned int removedTile = mesh->decodePolyIdTile((dtPolyRef)ref);
+		for (int i = 0; i < mesh->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = mesh->getTile(i);
+			if (!tile->header)
+				continue;
+			for (int j = 0; j < tile->header->polyCount; ++j)
+				for (unsigned int k = tile->polys[j].firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+					REQUIRE(mesh->decodePolyIdTile(tile->links[k].ref) != removedTile);
+		}
+
+		REQUIRE(buildGridTile(4, 4, 16, mazeCell, 1, 1, &data, &dataSize));
+		REQUIRE(dtStatusSucceed(mesh->addTile(data, dataSize, DT_TILE_FREE_DATA, ref, 0)));
+		std::vector<dtPolyRef> after;
+		collectLinks(mesh, after);
+		REQUIRE(after == before);
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+// Builds the data of all tiles of a grid navigation mesh, in the order buildGridNavMesh adds them.
+static int buildGridTiles(const int tilesX, const int tilesY, const int tileSize, bool (*blocked)(int, int),
+						  unsigned char** data, int* dataSizes)
+{
+	int count = 0;
+	for (int ty = 0; ty < tilesY; ++ty)
+		for (int tx = 0; tx < tilesX; ++tx)
+			if (buildGridTile(tilesX, tilesY, tileSize, blocked, tx, ty, &data[count], &dataSizes[count]))
+				count++;
+	return count;
+}
+
+// Runs the parallel loops of the navigation mesh on a Recast thread pool.
+class ThreadPoolScheduler : public dtTaskScheduler
+{
+public:
+	rcThreadPool pool;
+
+	explicit ThreadPoolScheduler(const int threadCount = 0) : pool(threadCount) {}
+
+	virtual void parallelFor(const int count, const int grain, dtParallelForFunc* func, void* userData)
+	{
+		pool.parallelFor(count, grain, func, userData);
+	}
+};
+
+TEST_CASE("Bulk tile loading")
+{
+	dtNavMesh* reference = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(reference);
+	std::vector<dtPolyRef> expected;
+	collectLinks(reference, expected);
+	dtFreeNavMesh(reference);
+
+	unsigned char* data[16];
+	int dataSizes[16];
+	const int count = buildGridTiles(4, 4, 16, mazeCell, data, dataSizes);
+	REQUIRE(count == 16);
+
+	dtNavMesh* mesh = allocGridNavMesh(4, 4, 16);
+	REQUIRE(mesh);
+
+	SECTION("Links match adding the tiles one by one")
+	{
+		dtTileRef refs[16];
+		REQUIRE(mesh->addTiles(data, dataSizes, count, 0, 0, 0, refs) == DT_SUCCESS);
+		for (int i = 0; i < count; ++i)
+			REQUIRE(mesh->getTileByRef(refs[i])->data == data[i]);
+
+		std::vector<dtPolyRef> links;
+		collectLinks(mesh, links);
+		REQUIRE(links == expected);
+	}
+
+	SECTION("Links match when built by several threads")
+	{
+		ThreadPoolScheduler scheduler(3);
+		REQUIRE(mesh->addTiles(data, dataSizes, count, 0, 0, &scheduler, 0) == DT_SUCCESS);
+
+		std::vector<dtPolyRef> links;
+		collectLinks(mesh, links);
+		REQUIRE(links == expected);
+	}
+
+	SECTION("Tiles already in the mesh are linked to the new tiles")
+	{
+		for (int i = 0; i < 5; ++i)
+			REQUIRE(dtStatusSucceed(mesh->addTile(data[i], dataSizes[i], 0, 0, 0)));
+		ThreadPoolScheduler scheduler(2);
+		REQUIRE(dtStatusSucceed(mesh->addTiles(data + 5, dataSizes + 5, count-5, 0, 0, &scheduler, 0)));
+
+		std::vector<dtPolyRef> links;
+		collectLinks(mesh, links);
+		REQUIRE(links == expected);
+	}
+
+	SECTION("Tiles that cannot be added are skipped")
+	{
+		REQUIRE(dtStatusSucceed(mesh->addTile(data[0], dataSizes[0], 0, 0, 0)));
+		dtTileRef refs[16];
+		ThreadPoolScheduler scheduler(2);
+		const dtStatus status = mesh->addTiles(data, dataSizes, count, 0, 0, &scheduler, refs);
+		REQUIRE(dtStatusSucceed(status));
+		REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+		REQUIRE(refs[0] == 0);
+		for (int i = 1; i < count; ++i)
+			REQUIRE(refs[i] != 0);
+
+		std::vector<dtPolyRef> links;
+		collectLinks(mesh, links);
+		REQUIRE(links == expected);
+	}
+
+	dtFreeNavMesh(mesh);
+	for (int i = 0; i < count; ++i)
+		dtFree(data[i]);
+}
+
+// Returns whether the bounds of the mesh are the bounds of the tiles in it.
+static bool boundsMatchTiles(const dtNavMesh* mesh)
+{
+	float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	bool any = false;
+	for (int i = 0; i < mesh->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = mesh->getTile(i);
+		if (!tile->header)
+			continue;
+		dtVmin(bmin, tile->header->bmin);
+		dtVmax(bmax, tile->header->bmax);
+		any = true;
+	}
+	float meshMin[3], meshMax[3];
+	if (!mesh->getBounds(meshMin, meshMax))
+		return !any;
+	return any && dtVequal(bmin, meshMin) && dtVequal(bmax, meshMax);
+}
+
+TEST_CASE("Navigation mesh bounds")
+{
+	unsigned char* data[9];
+	int dataSizes[9];
+	REQUIRE(buildGridTiles(3, 3, 16, openCell, data, dataSizes) == 9);
+	dtNavMesh* mesh = allocGridNavMesh(3, 3, 16);
+	REQUIRE(mesh);
+	float bmin[3], bmax[3];
+	REQUIRE(!mesh->getBounds(bmin, bmax));
+
+	dtTileRef refs[9];
+	for (int i = 0; i < 9; ++i)
+	{
+		REQUIRE(dtStatusSucceed(mesh->addTile(data[i], dataSizes[i], DT_TILE_FREE_DATA, 0, &refs[i])));
+		REQUIRE(boundsMatchTiles(mesh));
+	}
+	REQUIRE(mesh->getBounds(bmin, bmax));
+	REQUIRE(bmin[0] == 0);
+	REQUIRE(bmax[0] == 48);
+
+	SECTION("Removing tiles shrinks the bounds")
+	{
+		// The center tile does not touch the bounds.
+		REQUIRE(dtStatusSucceed(mesh->removeTile(refs[4], 0, 0)));
+		REQUIRE(boundsMatchTiles(mesh));
+		// The tiles at x = 0 are the ones at the maximum x.
+		for (int i = 0; i < 9; i += 3)
+		{
+			REQUIRE(dtStatusSucceed(mesh->removeTile(refs[i], 0, 0)));
+			REQUIRE(boundsMatchTiles(mesh));
+		}
+		REQUIRE(mesh->getBounds(bmin, bmax));
+		REQUIRE(bmax[0] == 32);
+	}
+
+	SECTION("A mesh without tiles has no bounds")
+	{
+		for (int i = 0; i < 9; ++i)
+			REQUIRE(dtStatusSucceed(mesh->removeTile(refs[i], 0, 0)));
+		REQUIRE(!mesh->getBounds(bmin, bmax));
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+// Builds the tile at (tx, ty) of a 3x3 tile open grid mesh. The tile has columns of off-mesh
+// connections leading to the same point in the neighbours along y and to a point inside the
+// tile, or only to points inside the tile if not @p crossTiles. Along x, the off-mesh sides of
+// the builder do not follow the mirrored tile grid.
+static bool buildOffMeshGridTile(const int tileSize, const int columns, const int tx, const int ty,
+								 unsigned char** data, int* dataSize, const bool crossTiles = true)
+{
+	std::vector<float> verts;
+	for (int c = 0; c < columns; ++c)
+	{
+		const float cx = (2 - tx + (c + 0.5f)/columns)*tileSize;
+		const float cy = (ty + 0.5f)*tileSize;
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			const float ey = crossTiles ? cy + dy*tileSize : cy + 2.0f*(dy+2);
+			if (ey < 0 || ey >= 3*tileSize)
+				continue;
+			const float v[6] = { cx, cy, 0, cx, crossTiles && dy == 0 ? cy + 2.0f : ey, 0 };
+			verts.insert(verts.end(), v, v + 6);
+		}
+	}
+	return buildGridTile(3, 3, tileSize, openCell, tx, ty, data, dataSize, &verts[0], (int)verts.size()/6);
+}
+
+static dtNavMesh* buildOffMeshGridNavMesh(const int tileSize, const int columns, unsigned char** centerData, int* centerDataSize,
+										  const bool crossTiles = true)
+{
+	dtNavMesh* mesh = allocGridNavMesh(3, 3, tileSize, 3*columns);
+	if (!mesh)
+		return 0;
+	for (int ty = 0; ty < 3; ++ty)
+	{
+		for (int tx = 0; tx < 3; ++tx)
+		{
+			unsigned char* data = 0;
+			int dataSize = 0;
+			if (!buildOffMeshGridTile(tileSize, columns, tx, ty, &data, &dataSize, crossTiles) ||
+				dtStatusFailed(mesh->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)))
+			{
+				dtFree(data);
+				dtFreeNavMesh(mesh);
+				return 0;
+			}
+			if (centerData && tx == 1 && ty == 1)
+			{
+				*centerData = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+				memcpy(*centerData, data, dataSize);
+				*centerDataSize = dataSize;
+			}
+		}
+	}
+	return mesh;
+}
+
+TEST_CASE("Off-mesh connection index")
+{
+	unsigned char* centerData = 0;
+	int centerDataSize = 0;
+	dtNavMesh* mesh = buildOffMeshGridNavMesh(8, 1, &centerData, &centerDataSize);
+	REQUIRE(mesh);
+
+	SECTION("Connections are indexed by the side of their end point")
+	{
+		for (int i = 0; i < mesh->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = mesh->getTile(i);
+			REQUIRE(tile->offMeshConSides[0] == 0);
+			REQUIRE(tile->offMeshConSides[9] == tile->header->offMeshConCount);
+			for (int side = 0; side < 9; ++side)
+			{
+				for (int j = tile->offMeshConSides[side]; j < tile->offMeshConSides[side+1]; ++j)
+					REQUIRE(tile->offMeshCons[tile->offMeshConsBySide[j]].side == (side == 8 ? 0xff : side));
+			}
+		}
+
+		const dtMeshTile* center = mesh->getTileAt(1, 1, 0);
+		REQUIRE(center->offMeshConSides[3] - center->offMeshConSides[2] == 1);
+		REQUIRE(center->offMeshConSides[7] - center->offMeshConSides[6] == 1);
+		REQUIRE(center->offMeshConSides[9] - center->offMeshConSides[8] == 1);
+	}
+
+	SECTION("Every connection links to the tile its end point is in")
+	{
+		for (int i = 0; i < mesh->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = mesh->getTile(i);
+			for (int j = 0; j < tile->header->offMeshConCount; ++j)
+			{
+				const dtOffMeshConnection& con = tile->offMeshCons[j];
+				int tx, ty;
+				mesh->calcTileLoc(&con.pos[3], &tx, &ty);
+				const dtMeshTile* landTile = mesh->getTileAt(tx, ty, 0);
+				REQUIRE(landTile);
+
+				// The connection links to the landing polygon, which links back.
+				const unsigned int landTileNum = mesh->decodePolyIdTile((dtPolyRef)mesh->getTileRef(landTile));
+				dtPolyRef landRef = 0;
+				const dtPoly* conPoly = &tile->polys[con.poly];
+				for (unsigned int k = conPoly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+					if (tile->links[k].edge == 1 && mesh->decodePolyIdTile(tile->links[k].ref) == landTileNum)
+						landRef = tile->links[k].ref;
+				REQUIRE(landRef);
+
+				const dtPolyRef conRef = mesh->getPolyRefBase(tile) | (dtPolyRef)con.poly;
+				const dtPoly* landPoly = &landTile->polys[mesh->decodePolyIdPoly(landRef)];
+				bool linkedBack = false;
+				for (unsigned int k = landPoly->firstLink; k != DT_NULL_LINK; k = landTile->links[k].next)
+					linkedBack |= landTile->links[k].ref == conRef;
+				REQUIRE(linkedBack);
+			}
+		}
+	}
+
+	SECTION("Removing and adding a tile restores the links")
+	{
+		std::vector<dtPolyRef> before;
+		collectLinks(mesh, before);
+
+		const dtTileRef ref = mesh->getTileRefAt(1, 1, 0);
+		REQUIRE(dtStatusSucceed(mesh->removeTile(ref, 0, 0)));
+		REQUIRE(dtStatusSucceed(mesh->addTile(centerData, centerDataSize, DT_TILE_FREE_DATA, ref, 0)));
+		centerData = 0;
+
+		std::vector<dtPolyRef> after;
+		collectLinks(mesh, after);
+		REQUIRE(after == before);
+	}
+
+	dtFree(centerData);
+	dtFreeNavMesh(mesh);
+}
+
+TEST_CASE("Read-only tile data")
+{
+	// Tiles with off-mesh connections and a reference mesh that owns copies of the data.
+	unsigned char* data[9];
+	int dataSizes[9];
+	unsigned char* pristine[9];
+	dtNavMesh* reference = allocGridNavMesh(3, 3, 8, 3);
+	REQUIRE(reference);
+	for (int i = 0; i < 9; ++i)
+	{
+		REQUIRE(buildOffMeshGridTile(8, 1, i % 3, i / 3, &data[i], &dataSizes[i]));
+		pristine[i] = (unsigned char*)dtAlloc(dataSizes[i], DT_ALLOC_PERM);
+		memcpy(pristine[i], data[i], dataSizes[i]);
+		unsigned char* copy = (unsigned char*)dtAlloc(dataSizes[i], DT_ALLOC_PERM);
+		memcpy(copy, data[i], dataSizes[i]);
+		REQUIRE(dtStatusSucceed(reference->addTile(copy, dataSizes[i], DT_TILE_FREE_DATA, 0, 0)));
+	}
+	std::vector<dtPolyRef> expected;
+	collectLinks(reference, expected);
+
+	// Two meshes sharing the same tile data.
+	dtNavMesh* meshes[2];
+	for (int m = 0; m < 2; ++m)
+	{
+		meshes[m] = allocGridNavMesh(3, 3, 8, 3);
+		REQUIRE(meshes[m]);
+		REQUIRE(dtStatusSucceed(meshes[m]->addTiles(data, dataSizes, 9, DT_TILE_READ_ONLY_DATA, 0, 0, 0)));
+	}
+
+	SECTION("The data is not written and the links match")
+	{
+		for (int i = 0; i < 9; ++i)
+			REQUIRE(memcmp(data[i], pristine[i], dataSizes[i]) == 0);
+		for (int m = 0; m < 2; ++m)
+		{
+			std::vector<dtPolyRef> links;
+			collectLinks(meshes[m], links);
+			REQUIRE(links == expected);
+
+			// The snapped off-mesh connection end points match as well.
+			for (int i = 0; i < 9; ++i)
+			{
+				const dtMeshTile* tile = meshes[m]->getTile(i);
+				const dtMeshTile* refTile = reference->getTile(i);
+				REQUIRE(tile->data == data[i]);
+				REQUIRE(memcmp(tile->verts, refTile->verts, sizeof(float)*3*tile->header->vertCount) == 0);
+			}
+		}
+	}
+
+	SECTION("Polygon flags and areas are per mesh")
+	{
+		const dtPolyRef ref = meshes[0]->getPolyRefBase(meshes[0]->getTile(4));
+		REQUIRE(dtStatusSucceed(meshes[0]->setPolyFlags(ref, 0x10)));
+		REQUIRE(dtStatusSucceed(meshes[0]->setPolyArea(ref, 3)));
+
+		unsigned short flags = 0;
+		unsigned char area = 0;
+		REQUIRE(dtStatusSucceed(meshes[1]->getPolyFlags(ref, &flags)));
+		REQUIRE(dtStatusSucceed(meshes[1]->getPolyArea(ref, &area)));
+		REQUIRE(flags == 1);
+		REQUIRE(area == 0);
+		REQUIRE(memcmp(data[4], pristine[4], dataSizes[4]) == 0);
+	}
+
+	SECTION("Tiles can be removed from one mesh and added back")
+	{
+		const dtTileRef ref = meshes[0]->getTileRefAt(1, 1, 0);
+		unsigned char* removed = 0;
+		REQUIRE(dtStatusSucceed(meshes[0]->removeTile(ref, &removed, 0)));
+		REQUIRE(removed == data[4]);
+		REQUIRE(dtStatusSucceed(meshes[0]->addTile(data[4], dataSizes[4], DT_TILE_READ_ONLY_DATA, ref, 0)));
+
+		std::vector<dtPolyRef> links;
+		collectLinks(meshes[0], links);
+		REQUIRE(links == expected);
+		collectLinks(meshes[1], links);
+		REQUIRE(links == expected);
+	}
+
+	dtFreeNavMesh(meshes[0]);
+	dtFreeNavMesh(meshes[1]);
+	dtFreeNavMesh(reference);
+	for (int i = 0; i < 9; ++i)
+	{
+		dtFree(data[i]);
+		dtFree(pristine[i]);
+	}
+}
+
+// Streams copies of tile data kept in memory.
+class MemoryTileSource : public dtTileStreamSource
+{
+public:
+	unsigned char* data[16];
+	int dataSizes[16];
+	int failures[16];	///< The number of reads of each tile that fail before one succeeds.
+	std::atomic<int> reads;
+
+	MemoryTileSource() : reads(0) { memset(failures, 0, sizeof(failures)); }
+
+	virtual bool readTile(const int index, unsigned char** tileData, int* tileDataSize)
+	{
+		reads++;
+		if (failures[index] > 0)
+		{
+			failures[index]--;
+			return false;
+		}
+		*tileData = (unsigned char*)dtAlloc(dataSizes[index], DT_ALLOC_PERM);
+		memcpy(*tileData, data[index], dataSizes[index]);
+		*tileDataSize = dataSizes[index];
+		return true;
+	}
+};
+
+// Returns the center of the tile at (tx, ty) of a 4x4 tile grid mesh of 16x16 cells.
+static void gridTileCenter(const int tx, const int ty, float* pos)
+{
+	pos[0] = (4 - tx - 0.5f)*16;
+	pos[1] = (ty + 0.5f)*16;
+	pos[2] = 0;
+}
+
+TEST_CASE("Tile streamer")
+{
+	MemoryTileSource source;
+	REQUIRE(buildGridTiles(4, 4, 16, openCell, source.data, source.dataSizes) == 16);
+	dtStreamTileInfo infos[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		infos[i].x = i % 4;
+		infos[i].y = i / 4;
+		infos[i].dataSize = source.dataSizes[i];
+		infos[i].ref = 0;
+	}
+
+	dtNavMesh* mesh = allocGridNavMesh(4, 4, 16);
+	REQUIRE(mesh);
+	// Border tiles have fewer links, so the budgets are given by the tiles that must fit.
+	const int cornerBytes = source.dataSizes[0] + source.dataSizes[1] + source.dataSizes[4] + source.dataSizes[5];
+	const int rowBytes = source.dataSizes[0] + source.dataSizes[1] + source.dataSizes[2] + source.dataSizes[3];
+	dtTileStreamer streamer;
+
+	SECTION("Tiles near the positions are kept within the budget")
+	{
+		REQUIRE(dtStatusSucceed(streamer.init(mesh, &source, infos, 16, cornerBytes)));
+		float pos[3];
+		gridTileCenter(0, 0, pos);
+		streamer.update(pos, 1, 16);
+		streamer.flush();
+		for (int i = 0; i < 16; ++i)
+		{
+			const bool near = infos[i].x < 2 && infos[i].y < 2;
+			REQUIRE(streamer.getTileState(i) == (near ? DT_STREAM_TILE_RESIDENT : DT_STREAM_TILE_UNLOADED));
+			REQUIRE((mesh->getTileAt(infos[i].x, infos[i].y, 0) != 0) == near);
+		}
+
+		gridTileCenter(3, 3, pos);
+		streamer.update(pos, 1, 16);
+		REQUIRE(streamer.getResidentBytes() + streamer.getLoadingBytes() <= cornerBytes);
+		streamer.flush();
+		for (int i = 0; i < 16; ++i)
+		{
+			const bool near = infos[i].x >= 2 && infos[i].y >= 2;
+			REQUIRE(streamer.getTileState(i) == (near ? DT_STREAM_TILE_RESIDENT : DT_STREAM_TILE_UNLOADED));
+		}
+		REQUIRE(streamer.getResidentBytes() == cornerBytes);
+		REQUIRE(source.reads == 8);
+	}
+
+	SECTION("The least recently used tiles are removed first")
+	{
+		REQUIRE(dtStatusSucceed(streamer.init(mesh, &source, infos, 16, rowBytes)));
+		const int visits[5][2] = { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 }, { 0, 0 } };
+		float pos[3];
+		for (int i = 0; i < 5; ++i)
+		{
+			gridTileCenter(visits[i][0], visits[i][1], pos);
+			streamer.update(pos, 1, 0);
+			streamer.flush();
+		}
+		REQUIRE(source.reads == 4);
+
+		gridTileCenter(0, 1, pos);
+		streamer.update(pos, 1, 0);
+		streamer.flush();
+		REQUIRE(streamer.getTileState(0) == DT_STREAM_TILE_RESIDENT);
+		REQUIRE(streamer.getTileState(1) == DT_STREAM_TILE_UNLOADED);
+		REQUIRE(streamer.getTileState(2) == DT_STREAM_TILE_RESIDENT);
+		REQUIRE(streamer.getTileState(3) == DT_STREAM_TILE_RESIDENT);
+		REQUIRE(streamer.getTileState(4) == DT_STREAM_TILE_RESIDENT);
+	}
+
+	SECTION("Polygon references are valid again when their tile returns")
+	{
+		REQUIRE(dtStatusSucceed(streamer.init(mesh, &source, infos, 16, rowBytes)));
+		float pos[3];
+		gridTileCenter(0, 0, pos);
+		streamer.update(pos, 1, 0);
+		streamer.flush();
+
+		dtNavMeshQuery query;
+		REQUIRE(dtStatusSucceed(query.init(mesh, 128)));
+		const dtPolyRef ref = findGridPoly(query, pos);
+		REQUIRE(ref);
+		REQUIRE(mesh->decodePolyIdTile(ref) == 0);
+
+		// Fill the budget with tiles far away.
+		for (int tx = 0; tx < 4; ++tx)
+		{
+			gridTileCenter(tx, 3, pos);
+			streamer.update(pos, 1, 0);
+			streamer.flush();
+		}
+		REQUIRE(streamer.getTileState(0) == DT_STREAM_TILE_UNLOADED);
+		REQUIRE(!mesh->isValidPolyRef(ref));
+
+		gridTileCenter(0, 0, pos);
+		streamer.update(pos, 1, 0);
+		streamer.flush();
+		REQUIRE(streamer.getTileState(0) == DT_STREAM_TILE_RESIDENT);
+		REQUIRE(mesh->isValidPolyRef(ref));
+		REQUIRE(findGridPoly(query, pos) == ref);
+	}
+
+	SECTION("Tiles that fail to read are requested again after a back-off")
+	{
+		REQUIRE(dtStatusSucceed(streamer.init(mesh, &source, infos, 16, rowBytes)));
+		source.failures[0] = 2;
+		float pos[3];
+		gridTileCenter(0, 0, pos);
+		const int reads[4] = { 1, 2, 2, 3 };
+		const int states[4] = { DT_STREAM_TILE_FAILED, DT_STREAM_TILE_FAILED, DT_STREAM_TILE_FAILED, DT_STREAM_TILE_RESIDENT };
+		for (int i = 0; i < 4; ++i)
+		{
+			streamer.update(pos, 1, 0);
+			streamer.flush();
+			REQUIRE(source.reads == reads[i]);
+			REQUIRE(streamer.getTileState(0) == states[i]);
+		}
+		REQUIRE(mesh->getTileAt(0, 0, 0));
+		REQUIRE(streamer.getResidentBytes() == source.dataSizes[0]);
+		REQUIRE(streamer.getLoadingBytes() == 0);
+	}
+
+	SECTION("Tiles are charged the size that was read")
+	{
+		// Understate the sizes, so that the tiles need more room than was reserved.
+		for (int i = 0; i < 4; ++i)
+			infos[i].dataSize = source.dataSizes[i] / 2;
+		REQUIRE(dtStatusSucceed(streamer.init(mesh, &source, infos, 16, rowBytes - 1)));
+		float pos[3];
+		gridTileCenter(0, 0, pos);
+		streamer.update(pos, 1, 48);
+		streamer.flush();
+		REQUIRE(streamer.getLoadingBytes() == 0);
+		int resident = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (streamer.getTileState(i) == DT_STREAM_TILE_RESIDENT)
+				resident += source.dataSizes[i];
+		}
+		REQUIRE(streamer.getResidentBytes() == resident);
+
+		// Once every tile has been read, the reservations keep to the budget.
+		for (int ty = 0; ty < 4; ++ty)
+		{
+			gridTileCenter(0, ty, pos);
+			streamer.update(pos, 1, 0);
+			streamer.flush();
+		}
+		for (int tx = 0; tx < 4; ++tx)
+		{
+			gridTileCenter(tx, 0, pos);
+			streamer.update(pos, 1, 0);
+			REQUIRE(streamer.getResidentBytes() + streamer.getLoadingBytes() <= rowBytes - 1);
+			streamer.flush();
+			REQUIRE(streamer.getResidentBytes() <= rowBytes - 1);
+		}
+	}
+
+	dtFreeNavMesh(mesh);
+	for (int i = 0; i < 16; ++i)
+		dtFree(source.data[i]);
+}
+
+TEST_CASE("Tile streamer with saved tile references")
+{
+	// Stream the tiles back in with the references they were saved with, as Sample::saveAll does.
+	dtNavMesh* saved = buildGridNavMesh(4, 4, 16, openCell);
+	REQUIRE(saved);
+	MemoryTileSource source;
+	dtStreamTileInfo infos[16];
+	const dtNavMesh* constSaved = saved;
+	for (int i = 0; i < 16; ++i)
+	{
+		// Store the tiles in reverse, so that the references do not match the indices.
+		const dtMeshTile* tile = constSaved->getTile(15 - i);
+		source.data[i] = (unsigned char*)dtAlloc(tile->dataSize, DT_ALLOC_PERM);
+		memcpy(source.data[i], tile->data, tile->dataSize);
+		source.dataSizes[i] = tile->dataSize;
+		infos[i].x = tile->header->x;
+		infos[i].y = tile->header->y;
+		infos[i].dataSize = tile->dataSize;
+		infos[i].ref = saved->getTileRef(tile);
+	}
+
+	dtNavMesh* mesh = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(mesh->init(saved->getParams())));
+	dtTileStreamer streamer;
+	REQUIRE(dtStatusSucceed(streamer.init(mesh, &source, infos, 16, 1 << 30)));
+
+	float pos[3];
+	gridTileCenter(1, 2, pos);
+	streamer.update(pos, 1, 0);
+	streamer.flush();
+	const dtMeshTile* tile = mesh->getTileAt(1, 2, 0);
+	REQUIRE(tile);
+	REQUIRE(mesh->getTileRef(tile) == saved->getTileRef(saved->getTileAt(1, 2, 0)));
+	REQUIRE(tile->dataSize == saved->getTileAt(1, 2, 0)->dataSize);
+	REQUIRE(memcmp(tile->verts, saved->getTileAt(1, 2, 0)->verts, sizeof(float)*3*tile->header->vertCount) == 0);
+	REQUIRE(!mesh->getTileAt(0, 0, 0));
+
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 128)));
+	dtNavMeshQuery savedQuery;
+	REQUIRE(dtStatusSucceed(savedQuery.init(saved, 128)));
+	REQUIRE(findGridPoly(query, pos));
+	REQUIRE(findGridPoly(query, pos) == findGridPoly(savedQuery, pos));
+
+	dtFreeNavMesh(mesh);
+	dtFreeNavMesh(saved);
+	for (int i = 0; i < 16; ++i)
+		dtFree(source.data[i]);
+}
+
+TEST_CASE("Packed detail vertices")
+{
+	// The same 2x1 tiles with raised detail mesh centers, as built and packed.
+	dtNavMesh* meshes[2];
+	int sizes[2][2];
+	for (int m = 0; m < 2; ++m)
+	{
+		meshes[m] = allocGridNavMesh(2, 1, 8);
+		REQUIRE(meshes[m]);
+		for (int tx = 0; tx < 2; ++tx)
+		{
+			unsigned char* data = 0;
+			int dataSize = 0;
+			REQUIRE(buildGridTile(2, 1, 8, openCell, tx, 0, &data, &dataSize, 0, 0, 0.5f));
+			sizes[m][tx] = dataSize;
+			if (m == 1)
+			{
+				unsigned char* packed = 0;
+				REQUIRE(dtPackNavMeshDetailVerts(data, dataSize, &packed, &sizes[m][tx]));
+				dtFree(data);
+				data = packed;
+			}
+			REQUIRE(dtStatusSucceed(meshes[m]->addTile(data, sizes[m][tx], DT_TILE_FREE_DATA, 0, 0)));
+		}
+	}
+	const dtMeshTile* packedTile = meshes[1]->getTile(0);
+
+	SECTION("Packed data only stores quantized detail vertices")
+	{
+		// Six bytes per vertex, less the quantization origin and step.
+		const int vertCount = packedTile->header->detailVertCount;
+		REQUIRE(sizes[0][0] - sizes[1][0] == 12*vertCount - dtAlign4(24 + 6*vertCount));
+		REQUIRE(packedTile->header->magic == DT_NAVMESH_PACKED_DETAIL_MAGIC);
+		REQUIRE(packedTile->detailVerts == 0);
+		REQUIRE(packedTile->packedDetailVerts != 0);
+		REQUIRE(meshes[0]->getTile(0)->packedDetailVerts == 0);
+
+		std::vector<dtPolyRef> links[2];
+		collectLinks(meshes[0], links[0]);
+		collectLinks(meshes[1], links[1]);
+		REQUIRE(links[0] == links[1]);
+	}
+
+	SECTION("Detail vertices unpack within a quantization step")
+	{
+		const dtMeshTile* tile = meshes[0]->getTile(0);
+		float tmp[3];
+		for (int i = 0; i < tile->header->detailVertCount; ++i)
+		{
+			const float* v = dtGetDetailVert(tile, i, tmp);
+			REQUIRE(v == &tile->detailVerts[i*3]);
+			const float* pv = dtGetDetailVert(packedTile, i, tmp);
+			for (int j = 0; j < 3; ++j)
+				REQUIRE(fabsf(pv[j] - v[j]) <= packedTile->packedDetailScale[j]*0.5f + 1e-5f);
+		}
+	}
+
+	SECTION("Heights and closest points match")
+	{
+		dtNavMeshQuery* queries[2];
+		for (int m = 0; m < 2; ++m)
+		{
+			queries[m] = dtAllocNavMeshQuery();
+			REQUIRE(dtStatusSucceed(queries[m]->init(meshes[m], 64)));
+		}
+		for (int t = 0; t < 2; ++t)
+		{
+			const dtMeshTile* tile = meshes[0]->getTile(t);
+			const dtPolyRef base = meshes[0]->getPolyRefBase(tile);
+			REQUIRE(base == meshes[1]->getPolyRefBase(meshes[1]->getTile(t)));
+			for (int i = 0; i < tile->header->polyCount; ++i)
+			{
+				const float* v = &tile->verts[tile->polys[i].verts[0]*3];
+				const float samples[3][3] = {
+					{ v[0]+0.5f, v[1]+0.5f, 1 },
+					{ v[0]+0.3f, v[1]+0.6f, 1 },
+					{ v[0]-1.5f, v[1]+0.5f, 1 },
+				};
+				float heights[2], closest[2][3];
+				for (int m = 0; m < 2; ++m)
+				{
+					REQUIRE(dtStatusSucceed(queries[m]->getPolyHeight(base | (dtPolyRef)i, samples[0], &heights[m])));
+					bool over = false;
+					REQUIRE(dtStatusSucceed(queries[m]->closestPointOnPoly(base | (dtPolyRef)i, samples[1+(i&1)], closest[m], &over)));
+				}
+				REQUIRE(heights[0] == Approx(0.5f));
+				REQUIRE(fabsf(heights[1] - heights[0]) < 1e-3f);
+				for (int j = 0; j < 3; ++j)
+					REQUIRE(fabsf(closest[1][j] - closest[0][j]) < 1e-3f);
+			}
+		}
+		for (int m = 0; m < 2; ++m)
+			dtFreeNavMeshQuery(queries[m]);
+	}
+
+	for (int m = 0; m < 2; ++m)
+		dtFreeNavMesh(meshes[m]);
+}
+
+TEST_CASE("Detail blocks")
+{
+	// The same tiles with raised detail mesh centers, with and without detail blocks.
+	dtNavMesh* meshes[2];
+	dtNavMeshQuery* queries[2];
+	for (int m = 0; m < 2; ++m)
+	{
+		meshes[m] = allocGridNavMesh(2, 2, 8);
+		REQUIRE(meshes[m]);
+		for (int t = 0; t < 4; ++t)
+		{
+			unsigned char* data = 0;
+			int dataSize = 0;
+			REQUIRE(buildGridTile(2, 2, 8, mazeCell, t % 2, t / 2, &data, &dataSize, 0, 0, 0.25f*(t+1)));
+			const int flags = DT_TILE_FREE_DATA | (m == 1 ? DT_TILE_DETAIL_BLOCKS : 0);
+			REQUIRE(dtStatusSucceed(meshes[m]->addTile(data, dataSize, flags, 0, 0)));
+		}
+		queries[m] = dtAllocNavMeshQuery();
+		REQUIRE(dtStatusSucceed(queries[m]->init(meshes[m], 64)));
+	}
+
+	SECTION("Blocks are only built with the flag")
+	{
+		const dtMeshTile* tile = meshes[1]->getTile(0);
+		REQUIRE(meshes[0]->getTile(0)->detailTriBlocks == 0);
+		REQUIRE(tile->detailTriBlocks != 0);
+		REQUIRE(tile->detailBlocks[0].edgeCount == 4);
+	}
+
+	SECTION("Heights and closest points match the triangle walk exactly")
+	{
+		unsigned int seed = 1;
+		for (int t = 0; t < 4; ++t)
+		{
+			const dtMeshTile* tile = meshes[0]->getTile(t);
+			const dtPolyRef base = meshes[0]->getPolyRefBase(tile);
+			for (int i = 0; i < tile->header->polyCount; ++i)
+			{
+				const float* v = &tile->verts[tile->polys[i].verts[0]*3];
+				for (int k = 0; k < 8; ++k)
+				{
+					// Positions over the polygon and around it.
+					float pos[3];
+					for (int c = 0; c < 2; ++c)
+					{
+						seed = seed*1103515245u + 12345u;
+						pos[c] = v[c] - 1 + 3*(float)((seed >> 8) & 0xffff) / 65535.0f;
+					}
+					pos[2] = 1;
+
+					float heights[2] = { 0, 0 }, closest[2][3];
+					bool over[2];
+					dtStatus status[2];
+					for (int m = 0; m < 2; ++m)
+					{
+						status[m] = queries[m]->getPolyHeight(base | (dtPolyRef)i, pos, &heights[m]);
+						REQUIRE(dtStatusSucceed(queries[m]->closestPointOnPoly(base | (dtPolyRef)i, pos, closest[m], &over[m])));
+					}
+					REQUIRE(status[0] == status[1]);
+					REQUIRE(heights[0] == heights[1]);
+					REQUIRE(over[0] == over[1]);
+					REQUIRE(memcmp(closest[0], closest[1], sizeof(closest[0])) == 0);
+				}
+			}
+		}
+	}
+
+	for (int m = 0; m < 2; ++m)
+	{
+		dtFreeNavMeshQuery(queries[m]);
+		dtFreeNavMesh(meshes[m]);
+	}
+}
+
+// Rejects the polygons over the wall cells of mazeCell, without any flags on the mesh.
+struct MazeWallFilter : public dtQueryFilter
+{
+	inline bool passFilter(const dtPolyRef ref, const dtMeshTile* tile, const dtPoly* poly) const
+	{
+		const float* v = &tile->verts[poly->verts[0]*3];
+		return !mazeCell((int)v[0], (int)v[1]) && dtQueryFilter::passFilter(ref, tile, poly);
+	}
+};
+
+TEST_CASE("Templated query filter")
+{
+	// The open grid queried with the maze walls rejected by the filter, and with the wall
+	// polygons flagged and excluded by a plain filter. Both must give the same results.
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, openCell);
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 4096)));
+
+	static const unsigned short WALL_FLAG = 0x2;
+	MazeWallFilter wallFilter;
+	dtQueryFilter flagFilter;
+	flagFilter.setExcludeFlags(WALL_FLAG);
+
+	const float startPos[] = { 1.5f, 1.5f, 0 };
+	const float endPos[] = { 62.5f, 1.5f, 0 };
+	const dtPolyRef startRef = findGridPoly(query, startPos);
+	const dtPolyRef endRef = findGridPoly(query, endPos);
+	REQUIRE(startRef);
+	REQUIRE(endRef);
+
+	static const int MAX_PATH = 1024;
+	dtPolyRef wallPath[MAX_PATH], flagPath[MAX_PATH];
+	int wallCount = 0, flagCount = 0;
+	REQUIRE(query.findPath(startRef, endRef, startPos, endPos, &wallFilter, wallPath, &wallCount, MAX_PATH) == DT_SUCCESS);
+
+	dtPolyRef slicedPath[MAX_PATH];
+	int slicedCount = 0;
+	dtStatus status = query.initSlicedFindPath(startRef, endRef, startPos, endPos, &wallFilter);
+	REQUIRE(status == DT_IN_PROGRESS);
+	while (dtStatusInProgress(status))
+		status = query.updateSlicedFindPath(64, 0);
+	REQUIRE(status == DT_SUCCESS);
+	REQUIRE(dtStatusSucceed(query.finalizeSlicedFindPath(slicedPath, &slicedCount, MAX_PATH)));
+
+	const float rayEnd[] = { 20.5f, 1.5f, 0 };
+	float wallT = 0, flagT = 0, hitNormal[3];
+	dtPolyRef rayPath[MAX_PATH];
+	int rayCount = 0;
+	REQUIRE(dtStatusSucceed(query.raycast(startRef, startPos, rayEnd, &wallFilter, &wallT, hitNormal, rayPath, &rayCount, MAX_PATH)));
+
+	const float movePos[] = { 14.5f, 30.5f, 0 };
+	const float moveEnd[] = { 8.5f, 30.5f, 0 };
+	const dtPolyRef moveRef = findGridPoly(query, movePos);
+	float wallMoved[3], flagMoved[3];
+	dtPolyRef visited[MAX_PATH];
+	int visitedCount = 0;
+	REQUIRE(dtStatusSucceed(query.moveAlongSurface(moveRef, movePos, moveEnd, &wallFilter, wallMoved, visited, &visitedCount, MAX_PATH)));
+
+	dtPolyRef around[MAX_PATH];
+	int wallAround = 0, flagAround = 0;
+	REQUIRE(dtStatusSucceed(query.findPolysAroundCircle(startRef, startPos, 16, &wallFilter, around, 0, 0, &wallAround, MAX_PATH)));
+
+	// Flag the wall polygons and repeat the queries with the plain filter.
+	for (int t = 0; t < mesh->getMaxTiles(); ++t)
+	{
+		const dtMeshTile* tile = ((const dtNavMesh*)mesh)->getTile(t);
+		if (!tile->header)
+			continue;
+		const dtPolyRef base = mesh->getPolyRefBase(tile);
+		for (int i = 0; i < tile->header->polyCount; ++i)
+		{
+			const float* v = &tile->verts[tile->polys[i].verts[0]*3];
+			if (mazeCell((int)v[0], (int)v[1]))
+				mesh->setPolyFlags(base | (dtPolyRef)i, WALL_FLAG);
+		}
+	}
+
+	REQUIRE(query.findPath(startRef, endRef, startPos, endPos, &flagFilter, flagPath, &flagCount, MAX_PATH) == DT_SUCCESS);
+	REQUIRE(wallCount == flagCount);
+	REQUIRE(memcmp(wallPath, flagPath, sizeof(dtPolyRef)*flagCount) == 0);
+
+	dtPolyRef flagSlicedPath[MAX_PATH];
+	int flagSlicedCount = 0;
+	status = query.initSlicedFindPath(startRef, endRef, startPos, endPos, &flagFilter);
+	while (dtStatusInProgress(status))
+		status = query.updateSlicedFindPath(64, 0);
+	REQUIRE(status == DT_SUCCESS);
+	REQUIRE(dtStatusSucceed(query.finalizeSlicedFindPath(flagSlicedPath, &flagSlicedCount, MAX_PATH)));
+	REQUIRE(slicedCount == flagSlicedCount);
+	REQUIRE(memcmp(slicedPath, flagSlicedPath, sizeof(dtPolyRef)*flagSlicedCount) == 0);
+
+	REQUIRE(dtStatusSucceed(query.raycast(startRef, startPos, rayEnd, &flagFilter, &flagT, hitNormal, rayPath, &rayCount, MAX_PATH)));
+	REQUIRE(wallT < 1);
+	REQUIRE(wallT == flagT);
+
+	REQUIRE(dtStatusSucceed(query.moveAlongSurface(moveRef, movePos, moveEnd, &flagFilter, flagMoved, visited, &visitedCount, MAX_PATH)));
+	REQUIRE(wallMoved[0] >= 13);
+	REQUIRE(dtVequal(wallMoved, flagMoved));
+
+	REQUIRE(dtStatusSucceed(query.findPolysAroundCircle(startRef, startPos, 16, &flagFilter, around, 0, 0, &flagAround, MAX_PATH)));
+	REQUIRE(wallAround == flagAround);
+
+	dtFreeNavMesh(mesh);
+}
+
+TEST_CASE("Batch raycasts")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 64)));
+	dtQueryFilter filter;
+
+	// More rays than a single batch, from around the center of a cell next to a wall and a tile border.
+	static const int RAY_COUNT = 150;
+	static const int MAX_PATH = 64;
+	const float center[] = { 11.5f, 15.5f, 0 };
+	const dtPolyRef startRef = findGridPoly(query, center);
+	REQUIRE(startRef);
+	float startPos[RAY_COUNT*3], endPos[RAY_COUNT*3];
+	unsigned int seed = 1;
+	for (int i = 0; i < RAY_COUNT; ++i)
+	{
+		for (int c = 0; c < 2; ++c)
+		{
+			seed = seed*1103515245u + 12345u;
+			startPos[i*3+c] = center[c] - 0.4f + 0.8f*(float)((seed >> 8) & 0xffff) / 65535.0f;
+			seed = seed*1103515245u + 12345u;
+			endPos[i*3+c] = center[c] - 20 + 40*(float)((seed >> 8) & 0xffff) / 65535.0f;
+		}
+		startPos[i*3+2] = endPos[i*3+2] = 0;
+	}
+	// A ray ending in the start polygon and a ray with a too small path buffer.
+	dtVcopy(&endPos[0], center);
+
+	for (unsigned int options = 0; options <= DT_RAYCAST_USE_COSTS; ++options)
+	{
+		dtRaycastHit hits[RAY_COUNT];
+		static dtPolyRef paths[RAY_COUNT][MAX_PATH];
+		for (int i = 0; i < RAY_COUNT; ++i)
+		{
+			hits[i].path = paths[i];
+			hits[i].maxPath = i == 1 ? 1 : MAX_PATH;
+		}
+		const dtStatus batchStatus = query.raycasts(startRef, startPos, endPos, RAY_COUNT, &filter, options, hits);
+		REQUIRE(dtStatusSucceed(batchStatus));
+		REQUIRE(dtStatusDetail(batchStatus, DT_BUFFER_TOO_SMALL));
+		REQUIRE(hits[0].t == FLT_MAX);
+
+		int wallHits = 0;
+		for (int i = 0; i < RAY_COUNT; ++i)
+		{
+			dtRaycastHit hit;
+			dtPolyRef path[MAX_PATH];
+			hit.path = path;
+			hit.maxPath = i == 1 ? 1 : MAX_PATH;
+			const dtStatus status = query.raycast(startRef, &startPos[i*3], &endPos[i*3], &filter, options, &hit);
+			REQUIRE(dtStatusSucceed(status));
+			REQUIRE(hit.t == hits[i].t);
+			REQUIRE(hit.pathCount == hits[i].pathCount);
+			REQUIRE(memcmp(path, paths[i], sizeof(dtPolyRef)*hit.pathCount) == 0);
+			REQUIRE(hit.pathCost == hits[i].pathCost);
+			if (hit.t == FLT_MAX)
+				continue;
+			wallHits++;
+			REQUIRE(hit.hitEdgeIndex == hits[i].hitEdgeIndex);
+			REQUIRE(dtVequal(hit.hitNormal, hits[i].hitNormal));
+		}
+		REQUIRE(wallHits > 0);
+		REQUIRE(wallHits < RAY_COUNT);
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+// Returns the corners of findStraightPath() over the corridor, pruned the same way as by findCorners().
+static int findCorridorCorners(const dtNavMeshQuery& query, const dtPathCorridor& corridor, float* verts,
+							   unsigned char* flags, dtPolyRef* polys, const int maxCorners)
+{
+	int ncorners = 0;
+	query.findStraightPath(corridor.getPos(), corridor.getTarget(), corridor.getPath(), corridor.getPathCount(),
+						   verts, flags, polys, &ncorners, maxCorners);
+	int first = 0;
+	while (first < ncorners && !(flags[first] & DT_STRAIGHTPATH_OFFMESH_CONNECTION) &&
+		   dtVdist2DSqr(&verts[first*3], corridor.getPos()) <= dtSqr(0.01f))
+		first++;
+	int count = 0;
+	for (int i = first; i < ncorners; ++i)
+	{
+		dtVcopy(&verts[count*3], &verts[i*3]);
+		flags[count] = flags[i];
+		polys[count] = polys[i];
+		count++;
+		if (flags[i] & DT_STRAIGHTPATH_OFFMESH_CONNECTION)
+			break;
+	}
+	return count;
+}
+
+static void requireCachedCorners(dtNavMeshQuery& query, dtPathCorridor& corridor, const int maxCorners,
+								 float* verts, int* count)
+{
+	static const int MAX_CORNERS = 64;
+	unsigned char flags[MAX_CORNERS], expectedFlags[MAX_CORNERS];
+	dtPolyRef polys[MAX_CORNERS], expectedPolys[MAX_CORNERS];
+	float expectedVerts[MAX_CORNERS*3];
+	dtQueryFilter filter;
+	const int ncorners = corridor.findCorners(verts, flags, polys, maxCorners, &query, &filter);
+	const int nexpected = findCorridorCorners(query, corridor, expectedVerts, expectedFlags, expectedPolys, maxCorners);
+	REQUIRE(ncorners == nexpected);
+	REQUIRE(memcmp(verts, expectedVerts, sizeof(float)*3*ncorners) == 0);
+	REQUIRE(memcmp(flags, expectedFlags, ncorners) == 0);
+	REQUIRE(memcmp(polys, expectedPolys, sizeof(dtPolyRef)*ncorners) == 0);
+	*count = ncorners;
+}
+
+TEST_CASE("Path corridor portal cache")
+{
+	dtNavMesh* mesh = buildGridNavMesh(4, 4, 16, mazeCell);
+	REQUIRE(mesh);
+	dtNavMeshQuery query;
+	REQUIRE(dtStatusSucceed(query.init(mesh, 4096)));
+	dtQueryFilter filter;
+
+	static const int MAX_PATH = 512;
+	const float startPos[] = { 1.5f, 1.5f, 0 };
+	const float endPos[] = { 62.5f, 1.5f, 0 };
+	const dtPolyRef startRef = findGridPoly(query, startPos);
+	const dtPolyRef endRef = findGridPoly(query, endPos);
+	dtPolyRef path[MAX_PATH];
+	int pathCount = 0;
+	const dtStatus status = query.findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, MAX_PATH);
+	REQUIRE(status == DT_SUCCESS);
+	REQUIRE(path[pathCount-1] == endRef);
+
+	dtPathCorridor corridor;
+	REQUIRE(corridor.init(MAX_PATH));
+	corridor.reset(startRef, startPos);
+	corridor.setCorridor(endPos, path, pathCount);
+
+	float corners[64*3];
+	int ncorners = 0;
+
+	SECTION("Corners follow the corridor while it changes")
+	{
+		int steps = 0;
+		for (; corridor.getPathCount() > 1 && steps < MAX_PATH; ++steps)
+		{
+			requireCachedCorners(query, corridor, 64, corners, &ncorners);
+			requireCachedCorners(query, corridor, 4, corners, &ncorners);
+			REQUIRE(ncorners > 0);
+
+			// Step to the center of the next polygon, shortcutting the corridor from time to time.
+			const dtMeshTile* tile = 0;
+			const dtPoly* poly = 0;
+			REQUIRE(dtStatusSucceed(mesh->getTileAndPolyByRef(corridor.getPath()[1], &tile, &poly)));
+			float npos[3] = { 0, 0, 0 };
+			for (int i = 0; i < poly->vertCount; ++i)
+				dtVadd(npos, npos, &tile->verts[poly->verts[i]*3]);
+			dtVscale(npos, npos, 1.0f / poly->vertCount);
+			REQUIRE(corridor.movePosition(npos, &query, &filter));
+			if (steps % 10 == 5)
+				corridor.optimizePathVisibility(&corners[(ncorners-1)*3], 30.0f, &query, &filter);
+		}
+		REQUIRE(corridor.getPathCount() == 1);
+		REQUIRE(steps > 50);
+		requireCachedCorners(query, corridor, 4, corners, &ncorners);
+		REQUIRE(dtVdist2D(corridor.getPos(), endPos) < 0.01f);
+	}
+
+	SECTION("Portals of replaced tiles are fetched again")
+	{
+		requireCachedCorners(query, corridor, 64, corners, &ncorners);
+
+		// Replace a tile in the middle of the corridor, the corridor now leads into a stale polygon.
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		REQUIRE(dtStatusSucceed(mesh->getTileAndPolyByRef(path[pathCount/2], &tile, &poly)));
+		const int tx = tile->header->x, ty = tile->header->y;
+		REQUIRE(dtStatusSucceed(mesh->removeTile(mesh->getTileRefAt(tx, ty, 0), 0, 0)));
+		unsigned char* data = 0;
+		int dataSize = 0;
+		REQUIRE(buildGridTile(4, 4, 16, mazeCell, tx, ty, &data, &dataSize));
+		REQUIRE(dtStatusSucceed(mesh->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+
+		requireCachedCorners(query, corridor, 64, corners, &ncorners);
+		REQUIRE(ncorners > 0);
+		REQUIRE(corners[(ncorners-1)*3] != endPos[0]);
+	}
+
+	dtFreeNavMesh(mesh);
+}
+
+#ifdef BM
+
+const int64_t kNumPathLoops = 20;
+
+// Walls every 16 cells with a gap alternating between the top and the bottom of a 128 cells high grid.
+static bool largeMazeCell(int x, int y)
+{
+	if (x % 16 != 12)
+		return false;
+	return (x / 16) % 2 == 0 ? y < 126 : y >= 2;
+}
+
+// Behaves like dtQueryFilter, but is called through virtual functions as a build with
+// DT_VIRTUAL_QUERYFILTER would call its filters.
+struct VirtualPathFilter : public dtQueryFilter
+{
+	virtual ~VirtualPathFilter() {}
+
+	virtual bool passFilter(const dtPolyRef ref, const dtMeshTile* tile, const dtPoly* poly) const
+	{
+		return dtQueryFilter::passFilter(ref, tile, poly);
+	}
+
+	virtual float getCost(const float* pa, const float* pb,
+						  const dtPolyRef prevRef, const dtMeshTile* prevTile, const dtPoly* prevPoly,
+						  const dtPolyRef curRef, const dtMeshTile* curTile, const dtPoly* curPoly,
+						  const dtPolyRef nextRef, const dtMeshTile* nextTile, const dtPoly* nextPoly) const
+	{
+		return dtQueryFilter::getCost(pa, pb, prevRef, prevTile, prevPoly, curRef, curTile, curPoly, nextRef, nextTile, nextPoly);
+	}
+};
+
+// A 8x8 tile maze shared by the path benchmarks, with a path across all of its walls.
+struct PathBenchmark
+{
+	dtNavMesh* mesh;
+	dtNavMeshQuery query;
+	dtTileGraph graph;
+	dtQueryFilter filter;
+	const VirtualPathFilter* virtualFilter;
+	float startPos[3];
+	float endPos[3];
+	dtPolyRef startRef;
+	dtPolyRef endRef;
+	dtPolyRef path[4096];
+	int pathCount;
+
+	static const int SHORT_PATH_COUNT = 256;
+	dtNavMeshQuery tileQuery;
+	dtNavMeshQuery quaternaryQuery;
+	dtNavMeshQuery radixQuery;
+	float shortStartPos[SHORT_PATH_COUNT][3];
+	float shortEndPos[SHORT_PATH_COUNT][3];
+	dtPolyRef shortStartRef[SHORT_PATH_COUNT];
+	dtPolyRef shortEndRef[SHORT_PATH_COUNT];
+
+	PathBenchmark() : startRef(0), endRef(0), pathCount(0)
+	{
+		mesh = buildGridNavMesh(8, 8, 16, largeMazeCell);
+		query.init(mesh, 65535);
+		tileQuery.init(mesh, 65535, DT_NODE_POOL_TILE_INDEXED);
+		quaternaryQuery.init(mesh, 65535, DT_NODE_POOL_HASH, DT_NODE_QUEUE_QUATERNARY_HEAP);
+		radixQuery.init(mesh, 65535, DT_NODE_POOL_HASH, DT_NODE_QUEUE_RADIX_HEAP);
+		graph.init(mesh);
+		virtualFilter = new VirtualPathFilter;
+		dtVset(startPos, 1.5f, 1.5f, 0);
+		dtVset(endPos, 126.5f, 1.5f, 0);
+		startRef = findGridPoly(query, startPos);
+		endRef = findGridPoly(query, endPos);
+
+		// Report the search size, so the timings below can be read as expansion rates.
+		query.findPath(startRef, endRef, startPos, endPos, &filter, path, &pathCount, 4096);
+		printf("Path benchmark: %d nodes per long search\n", query.getNodePool()->getNodeCount());
+
+		// Short paths of a few cells, as issued by many agents per frame.
+		for (int i = 0; i < SHORT_PATH_COUNT; ++i)
+		{
+			const int x = ((i*37) % 8)*16 + i % 4, y = (i*53) % 120;
+			dtVset(shortStartPos[i], x + 0.5f, y + 0.5f, 0);
+			dtVset(shortEndPos[i], x + 8.5f, y + 6.5f, 0);
+			shortStartRef[i] = findGridPoly(query, shortStartPos[i]);
+			shortEndRef[i] = findGridPoly(query, shortEndPos[i]);
+		}
+	}
+
+	void findShortPaths(const dtNavMeshQuery& q)
+	{
+		for (int i = 0; i < SHORT_PATH_COUNT; ++i)
+			q.findPath(shortStartRef[i], shortEndRef[i], shortStartPos[i], shortEndPos[i], &filter, path, &pathCount, 4096);
+	}
+
+	~PathBenchmark()
+	{
+		delete virtualFilter;
+		dtFreeNavMesh(mesh);
+	}
+};
+
+BM(FindPath_Flat, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.query.findPath(b.startRef, b.endRef, b.startPos, b.endPos, &b.filter, b.path, &b.pathCount, 4096);
+}
+
+BM(FindPath_VirtualFilter, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.query.findPath(b.startRef, b.endRef, b.startPos, b.endPos, b.virtualFilter, b.path, &b.pathCount, 4096);
+}
+
+BM(FindPath_TileIndexedPool, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.tileQuery.findPath(b.startRef, b.endRef, b.startPos, b.endPos, &b.filter, b.path, &b.pathCount, 4096);
+}
+
+BM(FindPath_QuaternaryHeap, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.quaternaryQuery.findPath(b.startRef, b.endRef, b.startPos, b.endPos, &b.filter, b.path, &b.pathCount, 4096);
+}
+
+BM(FindPath_RadixHeap, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.radixQuery.findPath(b.startRef, b.endRef, b.startPos, b.endPos, &b.filter, b.path, &b.pathCount, 4096);
+}
+
+BM(FindShortPaths_HashPool, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.findShortPaths(b.query);
+}
+
+BM(FindShortPaths_TileIndexedPool, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.findShortPaths(b.tileQuery);
+}
+
+BM(FindPath_TileGraph, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.graph.findPath(&b.query, b.startRef, b.endRef, b.startPos, b.endPos, &b.filter, b.path, &b.pathCount, 4096);
+}
+
+BM(TileGraph_Init, kNumPathLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	b.graph.init(b.mesh);
+}
+
+static const int kNumBatchLoops = 5;
+
+// Agents spread over the large maze, heading for a few shared goals.
+struct BatchBenchmark
+{
+	static const int REQUEST_COUNT = 128;
+	static const int MAX_PATH = 4096;
+	static const int MAX_STRAIGHT_PATH = 256;
+	dtPathRequest requests[REQUEST_COUNT];
+	dtPathResult results[REQUEST_COUNT];
+	dtPolyRef* paths;
+	float* straightPaths;
+
+	BatchBenchmark()
+	{
+		PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+		const float goals[4][3] = { { 1.5f, 1.5f, 0 }, { 126.5f, 1.5f, 0 }, { 1.5f, 126.5f, 0 }, { 126.5f, 126.5f, 0 } };
+		for (int i = 0; i < REQUEST_COUNT; ++i)
+		{
+			dtPathRequest& req = requests[i];
+			dtVset(req.startPos, (float)((i*37) % 128) + 0.5f, (float)((i*53) % 128) + 0.5f, 0);
+			dtVcopy(req.endPos, goals[i % 4]);
+			req.startRef = findGridPoly(b.query, req.startPos);
+			req.endRef = findGridPoly(b.query, req.endPos);
+			req.filter = &b.filter;
+		}
+		paths = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*MAX_PATH*REQUEST_COUNT, DT_ALLOC_PERM);
+		straightPaths = (float*)dtAlloc(sizeof(float)*3*MAX_STRAIGHT_PATH*REQUEST_COUNT, DT_ALLOC_PERM);
+	}
+
+	~BatchBenchmark()
+	{
+		dtFree(paths);
+		dtFree(straightPaths);
+	}
+};
+
+BM(FindPaths_Individual, kNumBatchLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	BatchBenchmark& bb = BenchmarkFixture<BatchBenchmark>();
+	for (int i = 0; i < BatchBenchmark::REQUEST_COUNT; ++i)
+	{
+		const dtPathRequest& req = bb.requests[i];
+		dtPolyRef* path = bb.paths + i*BatchBenchmark::MAX_PATH;
+		int pathCount = 0;
+		b.query.findPath(req.startRef, req.endRef, req.startPos, req.endPos, req.filter, path, &pathCount, BatchBenchmark::MAX_PATH);
+		b.query.findStraightPath(req.startPos, req.endPos, path, pathCount, bb.straightPaths + i*BatchBenchmark::MAX_STRAIGHT_PATH*3,
+								 0, 0, &bb.results[i].straightPathCount, BatchBenchmark::MAX_STRAIGHT_PATH);
+	}
+}
+
+BM(FindPaths_Batch, kNumBatchLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	BatchBenchmark& bb = BenchmarkFixture<BatchBenchmark>();
+	b.query.findPaths(bb.requests, BatchBenchmark::REQUEST_COUNT, bb.results, bb.paths, BatchBenchmark::MAX_PATH,
+					  bb.straightPaths, BatchBenchmark::MAX_STRAIGHT_PATH);
+}
+
+// Agents of the batch benchmark which head for the first goal.
+BM(FindPaths_SameGoalIndividual, kNumBatchLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	BatchBenchmark& bb = BenchmarkFixture<BatchBenchmark>();
+	for (int i = 0; i < BatchBenchmark::REQUEST_COUNT; i += 4)
+	{
+		const dtPathRequest& req = bb.requests[i];
+		int pathCount = 0;
+		b.query.findPath(req.startRef, req.endRef, req.startPos, req.endPos, req.filter, bb.paths, &pathCount, BatchBenchmark::MAX_PATH);
+	}
+}
+
+BM(FindPaths_SameGoalFlowField, kNumBatchLoops)
+{
+	PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+	BatchBenchmark& bb = BenchmarkFixture<BatchBenchmark>();
+	static dtFlowField field;
+	b.query.buildFlowField(bb.requests[0].endRef, bb.requests[0].endPos, &b.filter, FLT_MAX, &field);
+	for (int i = 0; i < BatchBenchmark::REQUEST_COUNT; i += 4)
+	{
+		int pathCount = 0;
+		field.getPath(bb.requests[i].startRef, bb.paths, &pathCount, BatchBenchmark::MAX_PATH);
+	}
+}
+
+// The short paths of the path benchmark, spread over one worker per hardware thread.
+struct ServiceBenchmark
+{
+	static const int MAX_PATH = 256;
+	dtQueryService service;
+	dtQueryPathJob jobs[PathBenchmark::SHORT_PATH_COUNT];
+	dtPolyRef paths[PathBenchmark::SHORT_PATH_COUNT][MAX_PATH];
+	float straightPaths[PathBenchmark::SHORT_PATH_COUNT][MAX_PATH*3];
+
+	ServiceBenchmark()
+	{
+		PathBenchmark& b = BenchmarkFixture<PathBenchmark>();
+		service.init(b.mesh, 0, 4096, PathBenchmark::SHORT_PATH_COUNT);
+		for (int i = 0; i < PathBenchmark::SHORT_PATH_COUNT; ++i)
+		{
+			dtQueryPathJob& job = jobs[i];
+			job.request.startRef = b.shortStartRef[i];
+			job.request.endRef = b.shortEndRef[i];
+			dtVcopy(job.request.startPos, b.shortStartPos[i]);
+			dtVcopy(job.request.endPos, b.shortEndPos[i]);
+			job.request.filter = &b.filter;
+			job.path = paths[i];
+			job.maxPath = MAX_PATH;
+			job.straightPath = straightPaths[i];
+			job.maxStraightPath = MAX_PATH;
+		}
+	}
+};
+
+BM(FindShortPaths_QueryService, kNumPathLoops)
+{
+	ServiceBenchmark& sb = BenchmarkFixture<ServiceBenchmark>();
+	for (int i = 0; i < PathBenchmark::SHORT_PATH_COUNT; ++i)
+		sb.service.submitPath(&sb.jobs[i]);
+	sb.service.waitIdle();
+}
+
+// Nearest polygon queries against a single tile of 128x128 polygons.
+struct BVTreeBenchmark
+{
+	static const int QUERY_COUNT = 4096;
+	dtNavMesh* wideMesh;
+	dtNavMesh* binaryMesh;
+	dtNavMeshQuery wideQuery;
+	dtNavMeshQuery binaryQuery;
+	dtQueryFilter filter;
+	float centers[QUERY_COUNT][3];
+
+	BVTreeBenchmark()
+	{
+		wideMesh = buildGridNavMesh(1, 1, 128, openCell);
+		binaryMesh = buildGridNavMesh(1, 1, 128, openCell, DT_TILE_FREE_DATA | DT_TILE_NO_WIDE_BVTREE);
+		wideQuery.init(wideMesh, 256);
+		binaryQuery.init(binaryMesh, 256);
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			dtVset(centers[i], (float)((i*7919) % 12800)*0.01f, (float)((i*104729) % 12800)*0.01f, 0);
+	}
+
+	void findNearestPolys(const dtNavMeshQuery& q, const float extent)
+	{
+		const float halfExtents[] = { extent, extent, 1 };
+		dtPolyRef ref;
+		float pt[3];
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			q.findNearestPoly(centers[i], halfExtents, &filter, &ref, pt);
+	}
+
+	void queryPolygons(const dtNavMeshQuery& q, const float extent)
+	{
+		const float halfExtents[] = { extent, extent, 1 };
+		dtPolyRef refs[256];
+		int count = 0;
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			q.queryPolygons(centers[i], halfExtents, &filter, refs, &count, 256);
+	}
+
+	~BVTreeBenchmark()
+	{
+		dtFreeNavMesh(wideMesh);
+		dtFreeNavMesh(binaryMesh);
+	}
+};
+
+BM(FindNearestPoly_BinaryBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBenchmark>().findNearestPolys(BenchmarkFixture<BVTreeBenchmark>().binaryQuery, 0.5f);
+}
+
+BM(FindNearestPoly_WideBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBenchmark>().findNearestPolys(BenchmarkFixture<BVTreeBenchmark>().wideQuery, 0.5f);
+}
+
+BM(QueryPolygons_BinaryBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBenchmark>().queryPolygons(BenchmarkFixture<BVTreeBenchmark>().binaryQuery, 4.0f);
+}
+
+BM(QueryPolygons_WideBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBenchmark>().queryPolygons(BenchmarkFixture<BVTreeBenchmark>().wideQuery, 4.0f);
+}
+
+// Bounding volume tree builds and binary tree queries on an elongated tile with four storeys.
+struct BVTreeBuildBenchmark
+{
+	static const int QUERY_COUNT = 4096;
+	static const int COLS = 256;
+	static const int ROWS = 16;
+	static const int STOREYS = 4;
+	dtNavMesh* medianMesh;
+	dtNavMesh* sahMesh;
+	dtNavMeshQuery medianQuery;
+	dtNavMeshQuery sahQuery;
+	dtQueryFilter filter;
+	float centers[QUERY_COUNT][3];
+
+	BVTreeBuildBenchmark()
+	{
+		medianMesh = buildStoreyNavMesh(COLS, ROWS, STOREYS, DT_BVTREE_MEDIAN, DT_TILE_FREE_DATA | DT_TILE_NO_WIDE_BVTREE);
+		sahMesh = buildStoreyNavMesh(COLS, ROWS, STOREYS, DT_BVTREE_SAH, DT_TILE_FREE_DATA | DT_TILE_NO_WIDE_BVTREE);
+		medianQuery.init(medianMesh, 256);
+		sahQuery.init(sahMesh, 256);
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			dtVset(centers[i], (float)((i*7919) % (COLS*100))*0.01f, (float)((i*104729) % (ROWS*100))*0.01f, (float)((i % STOREYS)*4));
+
+		// Report the tree shapes, so the timings below can be read per visited node.
+		const float halfExtents[] = { 2, 2, 1 };
+		const dtMeshTile* medianTile = medianMesh->getTile(0);
+		const dtMeshTile* sahTile = sahMesh->getTile(0);
+		int medianVisits = 0;
+		int sahVisits = 0;
+		for (int i = 0; i < QUERY_COUNT; ++i)
+		{
+			medianVisits += countBVTreeVisits(medianTile, centers[i], halfExtents);
+			sahVisits += countBVTreeVisits(sahTile, centers[i], halfExtents);
+		}
+		printf("BV tree benchmark: median %d nodes, %.1f visits per query; SAH %d nodes, %.1f visits per query\n",
+			   medianTile->header->bvNodeCount, (float)medianVisits / QUERY_COUNT,
+			   sahTile->header->bvNodeCount, (float)sahVisits / QUERY_COUNT);
+	}
+
+	void build(const unsigned char bvTreeBuildMethod)
+	{
+		unsigned char* data = 0;
+		int dataSize = 0;
+		if (buildStoreyTile(COLS, ROWS, STOREYS, bvTreeBuildMethod, &data, &dataSize))
+			dtFree(data);
+	}
+
+	void queryPolygons(const dtNavMeshQuery& q)
+	{
+		const float halfExtents[] = { 2, 2, 1 };
+		dtPolyRef refs[256];
+		int count = 0;
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			q.queryPolygons(centers[i], halfExtents, &filter, refs, &count, 256);
+	}
+
+	~BVTreeBuildBenchmark()
+	{
+		dtFreeNavMesh(medianMesh);
+		dtFreeNavMesh(sahMesh);
+	}
+};
+
+BM(CreateNavMeshData_MedianBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBuildBenchmark>().build(DT_BVTREE_MEDIAN);
+}
+
+BM(CreateNavMeshData_SAHBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBuildBenchmark>().build(DT_BVTREE_SAH);
+}
+
+BM(QueryPolygons_MedianBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBuildBenchmark>().queryPolygons(BenchmarkFixture<BVTreeBuildBenchmark>().medianQuery);
+}
+
+BM(QueryPolygons_SAHBVTree, kNumPathLoops)
+{
+	BenchmarkFixture<BVTreeBuildBenchmark>().queryPolygons(BenchmarkFixture<BVTreeBuildBenchmark>().sahQuery);
+}
+
+// Nearest polygon lookups for spawning entities, and wide polygon queries, on a 8x8 tile mesh.
+struct PolyGridBenchmark
+{
+	static const int QUERY_COUNT = 4096;
+	dtNavMesh* tileMesh;
+	dtNavMesh* gridMesh;
+	dtNavMeshQuery tileQuery;
+	dtNavMeshQuery gridQuery;
+	dtQueryFilter filter;
+	float centers[QUERY_COUNT][3];
+
+	PolyGridBenchmark()
+	{
+		tileMesh = buildGridNavMesh(8, 8, 16, largeMazeCell);
+		gridMesh = buildGridNavMesh(8, 8, 16, largeMazeCell);
+		gridMesh->initPolyGrid(8);
+		tileQuery.init(tileMesh, 256);
+		gridQuery.init(gridMesh, 256);
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			dtVset(centers[i], (float)((i*7919) % 12800)*0.01f, (float)((i*104729) % 12800)*0.01f, 0);
+	}
+
+	void findNearestPolys(const dtNavMeshQuery& q)
+	{
+		const float halfExtents[] = { 1, 1, 1 };
+		dtPolyRef ref;
+		float pt[3];
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			q.findNearestPoly(centers[i], halfExtents, &filter, &ref, pt);
+	}
+
+	void queryPolygons(const dtNavMeshQuery& q, const float extent = 8)
+	{
+		const float halfExtents[] = { extent, extent, 1 };
+		dtPolyRef refs[512];
+		int count = 0;
+		for (int i = 0; i < QUERY_COUNT; ++i)
+			q.queryPolygons(centers[i], halfExtents, &filter, refs, &count, 512);
+	}
+
+	~PolyGridBenchmark()
+	{
+		dtFreeNavMesh(tileMesh);
+		dtFreeNavMesh(gridMesh);
+	}
+};
+
+BM(FindNearestPoly_Tiles, kNumPathLoops)
+{
+	BenchmarkFixture<PolyGridBenchmark>().findNearestPolys(BenchmarkFixture<PolyGridBenchmark>().tileQuery);
+}
+
+BM(FindNearestPoly_PolyGrid, kNumPathLoops)
+{
+	BenchmarkFixture<PolyGridBenchmark>().findNearestPolys(BenchmarkFixture<PolyGridBenchmark>().gridQuery);
+}
+
+BM(QueryPolygons_Tiles, kNumPathLoops)
+{
+	BenchmarkFixture<PolyGridBenchmark>().queryPolygons(BenchmarkFixture<PolyGridBenchmark>().tileQuery);
+}
+
+BM(QueryPolygons_PolyGrid, kNumPathLoops)
+{
+	BenchmarkFixture<PolyGridBenchmark>().queryPolygons(BenchmarkFixture<PolyGridBenchmark>().gridQuery);
+}
+
+BM(QueryPolygonsSmall_Tiles, kNumPathLoops)
+{
+	BenchmarkFixture<PolyGridBenchmark>().queryPolygons(BenchmarkFixture<PolyGridBenchmark>().tileQuery, 1);
+}
+
+BM(QueryPolygonsSmall_PolyGrid, kNumPathLoops)
+{
+	BenchmarkFixture<PolyGridBenchmark>().queryPolygons(BenchmarkFixture<PolyGridBenchmark>().gridQuery, 1);
+}
+
+// Streams the center tile of a 3x3 tile mesh of 64x64 polygons out and back in.
+struct StitchBenchmark
+{
+	dtNavMesh* mesh;
+	unsigned char* data;
+	int dataSize;
+	dtTileRef ref;
+
+	StitchBenchmark() : data(0), dataSize(0)
+	{
+		mesh = buildGridNavMesh(3, 3, 64, openCell);
+		ref = mesh->getTileRefAt(1, 1, 0);
+		mesh->removeTile(ref, 0, 0);
+		buildGridTile(3, 3, 64, openCell, 1, 1, &data, &dataSize);
+	}
+
+	void restream()
+	{
+		mesh->addTile(data, dataSize, 0, ref, 0);
+		mesh->removeTile(ref, 0, 0);
+	}
+
+	~StitchBenchmark()
+	{
+		dtFreeNavMesh(mesh);
+		dtFree(data);
+	}
+};
+
+BM(AddRemoveTile, kNumPathLoops)
+{
+	BenchmarkFixture<StitchBenchmark>().restream();
+}
+
+// Streams the center tile of a 3x3 tile mesh of 32x32 polygons with 96 off-mesh connections per
+// tile, leading to the neighbours along y or staying inside the tile.
+template<bool CrossTiles>
+struct OffMeshStitchBenchmark
+{
+	dtNavMesh* mesh;
+	unsigned char* data;
+	int dataSize;
+	dtTileRef ref;
+
+	OffMeshStitchBenchmark() : data(0), dataSize(0)
+	{
+		mesh = buildOffMeshGridNavMesh(32, 32, &data, &dataSize, CrossTiles);
+		ref = mesh->getTileRefAt(1, 1, 0);
+		mesh->removeTile(ref, 0, 0);
+	}
+
+	void restream()
+	{
+		mesh->addTile(data, dataSize, 0, ref, 0);
+		mesh->removeTile(ref, 0, 0);
+	}
+
+	~OffMeshStitchBenchmark()
+	{
+		dtFreeNavMesh(mesh);
+		dtFree(data);
+	}
+};
+
+BM(AddRemoveOffMeshTile, 200)
+{
+	BenchmarkFixture<OffMeshStitchBenchmark<true> >().restream();
+}
+
+BM(AddRemoveOffMeshTile_Local, 200)
+{
+	BenchmarkFixture<OffMeshStitchBenchmark<false> >().restream();
+}
+
+// Loads a 16x16 tile mesh of 32x32 polygons, one tile at a time or in bulk.
+struct BulkLoadBenchmark
+{
+	unsigned char* data[256];
+	int dataSizes[256];
+	int count;
+
+	BulkLoadBenchmark()
+	{
+		count = buildGridTiles(16, 16, 32, largeMazeCell, data, dataSizes);
+	}
+
+	void load(const bool bulk, dtTaskScheduler* scheduler = 0)
+	{
+		dtNavMesh* mesh = allocGridNavMesh(16, 16, 32);
+		if (bulk)
+		{
+			mesh->addTiles(data, dataSizes, count, 0, 0, scheduler, 0);
+		}
+		else
+		{
+			for (int i = 0; i < count; ++i)
+				mesh->addTile(data[i], dataSizes[i], 0, 0, 0);
+		}
+		dtFreeNavMesh(mesh);
+	}
+
+	~BulkLoadBenchmark()
+	{
+		for (int i = 0; i < count; ++i)
+			dtFree(data[i]);
+	}
+};
+
+BM(LoadTiles_Sequential, kNumBatchLoops)
+{
+	BenchmarkFixture<BulkLoadBenchmark>().load(false);
+}
+
+BM(LoadTiles_Bulk, kNumBatchLoops)
+{
+	BenchmarkFixture<BulkLoadBenchmark>().load(true);
+}
+
+BM(LoadTiles_BulkThreadPool, kNumBatchLoops)
+{
+	BenchmarkFixture<BulkLoadBenchmark>().load(true, &BenchmarkFixture<ThreadPoolScheduler>());
+}
+
+// Polygon heights and closest points over a 16x16 tile mesh of 32x32 polygons, with float or packed
+// detail vertices and with or without detail blocks.
+struct DetailQueryBenchmark
+{
+	dtNavMesh* meshes[3];
+	dtNavMeshQuery* queries[3];
+	float* samples;
+	dtPolyRef* refs;
+	int sampleCount;
+
+	DetailQueryBenchmark() : samples(0), refs(0), sampleCount(0)
+	{
+		for (int m = 0; m < 3; ++m)
+		{
+			meshes[m] = allocGridNavMesh(16, 16, 32);
+			const int flags = DT_TILE_FREE_DATA | (m == 2 ? DT_TILE_DETAIL_BLOCKS : 0);
+			for (int ty = 0; ty < 16; ++ty)
+			{
+				for (int tx = 0; tx < 16; ++tx)
+				{
+					unsigned char* data = 0;
+					int dataSize = 0;
+					if (!buildGridTile(16, 16, 32, openCell, tx, ty, &data, &dataSize, 0, 0, 0.5f))
+						continue;
+					if (m == 1)
+					{
+						unsigned char* packed = 0;
+						dtPackNavMeshDetailVerts(data, dataSize, &packed, &dataSize);
+						dtFree(data);
+						data = packed;
+					}
+					meshes[m]->addTile(data, dataSize, flags, 0, 0);
+				}
+			}
+			queries[m] = dtAllocNavMeshQuery();
+			queries[m]->init(meshes[m], 64);
+		}
+
+		// A sample position inside every polygon.
+		sampleCount = 16*16*32*32;
+		samples = new float[sampleCount*3];
+		refs = new dtPolyRef[sampleCount];
+		int n = 0;
+		for (int i = 0; i < meshes[0]->getMaxTiles(); ++i)
+		{
+			const dtMeshTile* tile = ((const dtNavMesh*)meshes[0])->getTile(i);
+			if (!tile->header)
+				continue;
+			for (int j = 0; j < tile->header->polyCount && n < sampleCount; ++j, ++n)
+			{
+				const float* v = &tile->verts[tile->polys[j].verts[0]*3];
+				samples[n*3+0] = v[0] + 0.3f;
+				samples[n*3+1] = v[1] + 0.6f;
+				samples[n*3+2] = 1;
+				refs[n] = meshes[0]->getPolyRefBase(tile) | (dtPolyRef)j;
+			}
+		}
+		sampleCount = n;
+	}
+
+	void height(const int m)
+	{
+		float sum = 0;
+		for (int i = 0; i < sampleCount; ++i)
+		{
+			float h = 0;
+			if (dtStatusSucceed(queries[m]->getPolyHeight(refs[i], &samples[i*3], &h)))
+				sum += h;
+		}
+		KeepResult(sum);
+	}
+
+	// Closest points from positions over the neighbour polygon.
+	void closest(const int m)
+	{
+		float sum = 0;
+		for (int i = 0; i < sampleCount; ++i)
+		{
+			const float pos[3] = { samples[i*3+0] + 1, samples[i*3+1], samples[i*3+2] };
+			float pt[3];
+			queries[m]->closestPointOnPoly(refs[i], pos, pt, 0);
+			sum += pt[2];
+		}
+		KeepResult(sum);
+	}
+
+	~DetailQueryBenchmark()
+	{
+		for (int m = 0; m < 3; ++m)
+		{
+			dtFreeNavMeshQuery(queries[m]);
+			dtFreeNavMesh(meshes[m]);
+		}
+		delete [] samples;
+		delete [] refs;
+	}
+};
+
+BM(GetPolyHeight_FloatDetail, kNumBatchLoops)
+{
+	BenchmarkFixture<DetailQueryBenchmark>().height(0);
+}
+
+BM(GetPolyHeight_PackedDetail, kNumBatchLoops)
+{
+	BenchmarkFixture<DetailQueryBenchmark>().height(1);
+}
+
+BM(GetPolyHeight_DetailBlocks, kNumBatchLoops)
+{
+	BenchmarkFixture<DetailQueryBenchmark>().height(2);
+}
+
+BM(ClosestPointOnPoly_DetailTris, kNumBatchLoops)
+{
+	BenchmarkFixture<DetailQueryBenchmark>().closest(0);
+}
+
+BM(ClosestPointOnPoly_DetailBlocks, kNumBatchLoops)
+{
+	BenchmarkFixture<DetailQueryBenchmark>().closest(2);
+}
+
+// Line of sight checks from agents spread over a maze to a group of targets, each agent
+// casting one ray per target.
+struct RaycastBenchmark
+{
+	static const int AGENT_COUNT = 256;
+	static const int TARGET_COUNT = 16;
+	dtNavMesh* mesh;
+	dtNavMeshQuery query;
+	dtQueryFilter filter;
+	dtPolyRef agentRefs[AGENT_COUNT];
+	float startPos[AGENT_COUNT][TARGET_COUNT*3];
+	float endPos[AGENT_COUNT][TARGET_COUNT*3];
+	dtRaycastHit hits[TARGET_COUNT];
+	dtPolyRef paths[TARGET_COUNT][32];
+
+	RaycastBenchmark()
+	{
+		mesh = buildGridNavMesh(8, 8, 16, largeMazeCell);
+		query.init(mesh, 64);
+		unsigned int seed = 1;
+		for (int i = 0; i < AGENT_COUNT; ++i)
+		{
+			float pos[3] = { 0, 0, 0 };
+			do
+			{
+				seed = seed*1103515245u + 12345u;
+				pos[0] = (float)((seed >> 8) % 128) + 0.5f;
+				seed = seed*1103515245u + 12345u;
+				pos[1] = (float)((seed >> 8) % 128) + 0.5f;
+				agentRefs[i] = findGridPoly(query, pos);
+			}
+			while (!agentRefs[i]);
+
+			// The targets are spread over a few cells, about eight cells away.
+			seed = seed*1103515245u + 12345u;
+			const float angle = (float)((seed >> 8) & 0xffff) / 65535.0f * 6.2831853f;
+			const float groupPos[2] = { pos[0] + 8*cosf(angle), pos[1] + 8*sinf(angle) };
+			for (int j = 0; j < TARGET_COUNT; ++j)
+			{
+				dtVcopy(&startPos[i][j*3], pos);
+				for (int c = 0; c < 2; ++c)
+				{
+					seed = seed*1103515245u + 12345u;
+					endPos[i][j*3+c] = groupPos[c] - 2 + 4*(float)((seed >> 8) & 0xffff) / 65535.0f;
+				}
+				endPos[i][j*3+2] = 0;
+			}
+		}
+		for (int j = 0; j < TARGET_COUNT; ++j)
+		{
+			hits[j].path = paths[j];
+			hits[j].maxPath = 32;
+		}
+	}
+
+	~RaycastBenchmark()
+	{
+		dtFreeNavMesh(mesh);
+	}
+};
+
+BM(Raycast_Individual, kNumPathLoops)
+{
+	RaycastBenchmark& b = BenchmarkFixture<RaycastBenchmark>();
+	for (int i = 0; i < RaycastBenchmark::AGENT_COUNT; ++i)
+		for (int j = 0; j < RaycastBenchmark::TARGET_COUNT; ++j)
+			b.query.raycast(b.agentRefs[i], &b.startPos[i][j*3], &b.endPos[i][j*3], &b.filter, 0, &b.hits[j]);
+}
+
+BM(Raycast_Batch, kNumPathLoops)
+{
+	RaycastBenchmark& b = BenchmarkFixture<RaycastBenchmark>();
+	for (int i = 0; i < RaycastBenchmark::AGENT_COUNT; ++i)
+		b.query.raycasts(b.agentRefs[i], b.startPos[i], b.endPos[i], RaycastBenchmark::TARGET_COUNT, &b.filter, 0, b.hits);
+}
+
+// Corner queries of agents following long corridors through a maze, as done by the crowd every frame.
+struct CorridorBenchmark
+{
+	static const int AGENT_COUNT = 64;
+	static const int MAX_CORNERS = 4;
+	dtNavMesh* mesh;
+	dtNavMeshQuery query;
+	dtQueryFilter filter;
+	dtPathCorridor corridors[AGENT_COUNT];
+	float corners[MAX_CORNERS*3];
+	unsigned char flags[MAX_CORNERS];
+	dtPolyRef polys[MAX_CORNERS];
+
+	CorridorBenchmark()
+	{
+		mesh = buildGridNavMesh(8, 8, 16, largeMazeCell);
+		query.init(mesh, 65535);
+		dtPolyRef path[256];
+		for (int i = 0; i < AGENT_COUNT; ++i)
+		{
+			float startPos[3], endPos[3];
+			dtVset(startPos, (float)((i*37) % 112) + 0.5f, (float)((i*53) % 128) + 0.5f, 0);
+			dtVset(endPos, startPos[0] + 15, 127.5f - startPos[1], 0);
+			const dtPolyRef startRef = findGridPoly(query, startPos);
+			int pathCount = 0;
+			query.findPath(startRef, findGridPoly(query, endPos), startPos, endPos, &filter, path, &pathCount, 256);
+			corridors[i].init(256);
+			corridors[i].reset(startRef, startPos);
+			corridors[i].setCorridor(endPos, path, dtMin(pathCount, 255));
+		}
+	}
+
+	~CorridorBenchmark()
+	{
+		dtFreeNavMesh(mesh);
+	}
+};
+
+BM(FindCorners_StraightPath, kNumPathLoops)
+{
+	CorridorBenchmark& b = BenchmarkFixture<CorridorBenchmark>();
+	for (int frame = 0; frame < 16; ++frame)
+	{
+		for (int i = 0; i < CorridorBenchmark::AGENT_COUNT; ++i)
+		{
+			const dtPathCorridor& c = b.corridors[i];
+			int ncorners = 0;
+			b.query.findStraightPath(c.getPos(), c.getTarget(), c.getPath(), c.getPathCount(),
+									 b.corners, b.flags, b.polys, &ncorners, CorridorBenchmark::MAX_CORNERS);
+		}
+	}
+}
+
+BM(FindCorners_PortalCache, kNumPathLoops)
+{
+	CorridorBenchmark& b = BenchmarkFixture<CorridorBenchmark>();
+	for (int frame = 0; frame < 16; ++frame)
+		for (int i = 0; i < CorridorBenchmark::AGENT_COUNT; ++i)
+			b.corridors[i].findCorners(b.corners, b.flags, b.polys, CorridorBenchmark::MAX_CORNERS, &b.query, &b.filter);
+}
+
+#undef BM
+#endif  // BM
@@ -2,12 +2,18 @@
 #include <string.h>
 
 #include "catch.hpp"
+#include "Benchmark.h"
 
 #include "Recast.h"
 #include "RecastAlloc.h"
 #include "RecastAssert.h"
+#include "RecastTelemetry.h"
+#include "RecastThreadPool.h"
 
 // For comparing to rcVector in benchmarks.
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <vector>
 
 TEST_CASE("rcSwap")
@@ -837,6 +843,1239 @@ TEST_CASE("rcRasterizeTriangles")
 	}
 }
 
+// Builds a compact heightfield with regions over a floor with pillars, a mezzanine floor
+// and a few separate areas, so that later build stages see holes, overlaps and many regions.
+static bool buildTestCompactHeightfield(rcContext* ctx, rcCompactHeightfield& chf)
+{
+	const int size = 96;
+	const int walkableHeight = 4;
+	const int walkableClimb = 2;
+	const float bmin[] = { 0, 0, 0 };
+	const float bmax[] = { (float)size, (float)size, 64 };
+
+	rcHeightfield hf;
+	if (!rcCreateHeightfield(ctx, hf, size, size, bmin, bmax, 1.0f, 1.0f))
+		return false;
+
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			// Pillars punch holes in the floor.
+			const bool pillar = (x % 12) >= 5 && (x % 12) < 7 && (y % 12) >= 5 && (y % 12) < 7;
+			if (pillar)
+			{
+				rcAddSpan(ctx, hf, x, y, 0, 40, RC_NULL_AREA, 1);
+				continue;
+			}
+			const unsigned char area = (x > 60 && y > 60) ? 3 : RC_WALKABLE_AREA;
+			rcAddSpan(ctx, hf, x, y, 0, 1, area, 1);
+			// Mezzanine floor on top of the first one.
+			if (x >= 20 && x < 50 && y >= 10 && y < 70)
+				rcAddSpan(ctx, hf, x, y, 20, 21, RC_WALKABLE_AREA, 1);
+		}
+	}
+
+	if (!rcBuildCompactHeightfield(ctx, walkableHeight, walkableClimb, hf, chf))
+		return false;
+	if (!rcBuildDistanceField(ctx, chf))
+		return false;
+	return rcBuildRegions(ctx, chf, 0, 4, 20);
+}
+
+TEST_CASE("rcBuildContoursParallel")
+{
+	rcContext ctx(false);
+	rcCompactHeightfield chf;
+	REQUIRE(buildTestCompactHeightfield(&ctx, chf));
+	REQUIRE(chf.maxRegions > 1);
+
+	rcContourSet serial;
+	REQUIRE(rcBuildContours(&ctx, chf, 1.3f, 12, serial));
+	REQUIRE(serial.nconts > 1);
+
+	SECTION("Matches the serial build")
+	{
+		const int threadCounts[] = { 1, 2, 4, 7 };
+		for (int t = 0; t < 4; ++t)
+		{
+			rcThreadPool pool(threadCounts[t]);
+			ctx.setTaskScheduler(&pool);
+			rcContourSet parallel;
+			REQUIRE(rcBuildContoursParallel(&ctx, chf, 1.3f, 12, parallel));
+			ctx.setTaskScheduler(0);
+			REQUIRE(parallel.nconts == serial.nconts);
+			for (int i = 0; i < serial.nconts; ++i)
+			{
+				const rcContour& a = serial.conts[i];
+				const rcContour& b = parallel.conts[i];
+				REQUIRE(a.reg == b.reg);
+				REQUIRE(a.area == b.area);
+				REQUIRE(a.nverts == b.nverts);
+				REQUIRE(a.nrverts == b.nrverts);
+				REQUIRE(memcmp(a.verts, b.verts, sizeof(int)*4*a.nverts) == 0);
+				REQUIRE(memcmp(a.rverts, b.rverts, sizeof(int)*4*a.nrverts) == 0);
+			}
+		}
+	}
+}
+
+struct CountItemsBody
+{
+	std::atomic<int>* hits;
+
+	void operator()(const int begin, const int end) const
+	{
+		for (int i = begin; i < end; ++i)
+			hits[i]++;
+	}
+};
+
+struct NestedForBody
+{
+	rcTaskScheduler* scheduler;
+	std::atomic<int>* hits;
+
+	void operator()(const int begin, const int end) const
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			CountItemsBody inner = { hits + i*16 };
+			scheduler->parallelFor(16, 2, rcParallelForBody<CountItemsBody>, &inner);
+		}
+	}
+};
+
+static void incrementTask(void* userData)
+{
+	(*(std::atomic<int>*)userData)++;
+}
+
+TEST_CASE("rcThreadPool")
+{
+	rcThreadPool pool(4);
+	REQUIRE(pool.getThreadCount() == 4);
+
+	SECTION("parallelFor visits every item once")
+	{
+		const int count = 10007;
+		std::vector<std::atomic<int> > hits(count);
+		for (int i = 0; i < count; ++i)
+			hits[i].store(0);
+		CountItemsBody body = { hits.data() };
+		pool.parallelFor(count, 3, rcParallelForBody<CountItemsBody>, &body);
+		for (int i = 0; i < count; ++i)
+			REQUIRE(hits[i].load() == 1);
+	}
+
+	SECTION("parallelFor can be nested")
+	{
+		std::vector<std::atomic<int> > hits(64*16);
+		for (size_t i = 0; i < hits.size(); ++i)
+			hits[i].store(0);
+		NestedForBody body = { &pool, hits.data() };
+		pool.parallelFor(64, 1, rcParallelForBody<NestedForBody>, &body);
+		for (size_t i = 0; i < hits.size(); ++i)
+			REQUIRE(hits[i].load() == 1);
+	}
+
+	SECTION("Task group waits for all tasks")
+	{
+		std::atomic<int> counter(0);
+		rcTaskGroup* group = pool.createTaskGroup();
+		REQUIRE(group);
+		for (int i = 0; i < 100; ++i)
+			group->run(incrementTask, &counter);
+		group->wait();
+		REQUIRE(counter.load() == 100);
+		pool.destroyTaskGroup(group);
+	}
+
+	SECTION("Build stages match the serial build")
+	{
+		rcContext ctx(false);
+		rcCompactHeightfield serial;
+		REQUIRE(buildTestCompactHeightfield(&ctx, serial));
+		REQUIRE(rcMedianFilterWalkableArea(&ctx, serial));
+
+		ctx.setTaskScheduler(&pool);
+		rcCompactHeightfield parallel;
+		REQUIRE(buildTestCompactHeightfield(&ctx, parallel));
+		REQUIRE(rcMedianFilterWalkableArea(&ctx, parallel));
+
+		REQUIRE(parallel.spanCount == serial.spanCount);
+		REQUIRE(parallel.maxRegions == serial.maxRegions);
+		REQUIRE(memcmp(parallel.spans, serial.spans, sizeof(rcCompactSpan)*serial.spanCount) == 0);
+		REQUIRE(memcmp(parallel.dist, serial.dist, sizeof(unsigned short)*serial.spanCount) == 0);
+		REQUIRE(memcmp(parallel.areas, serial.areas, serial.spanCount) == 0);
+	}
+}
+
+// Builds a compact heightfield of stacked floors, each with a hole and an optional grid of pillars.
+static bool buildTestFloorStack(rcContext* ctx, rcCompactHeightfield& chf, const int nfloors, const int pillarStep, const int size)
+{
+	rcHeightfield hf;
+	const float bmin[3] = { 0.0f, 0.0f, 0.0f };
+	const float bmax[3] = { (float)size, (float)size, (float)(nfloors*8 + 16) };
+	if (!rcCreateHeightfield(ctx, hf, size, size, bmin, bmax, 1.0f, 1.0f))
+		return false;
+	for (int f = 0; f < nfloors; ++f)
+	{
+		const int hx = (f*7) % size;
+		const int hy = (f*13) % size;
+		for (int y = 0; y < size; ++y)
+		{
+			for (int x = 0; x < size; ++x)
+			{
+				if (x >= hx && x < hx+6 && y >= hy && y < hy+5)
+					continue;
+				const bool pillar = pillarStep > 0 && (x % pillarStep) == 1 && (y % pillarStep) == 1;
+				const unsigned short z = (unsigned short)(f*8);
+				const unsigned char area = pillar ? RC_NULL_AREA : (x > size/2 ? 3 : RC_WALKABLE_AREA);
+				if (!rcAddSpan(ctx, hf, x, y, z, (unsigned short)(pillar ? z+7 : z+1), area, 1))
+					return false;
+			}
+		}
+	}
+	return rcBuildCompactHeightfield(ctx, 4, 2, hf, chf);
+}
+
+static bool sameLayers(const rcHeightfieldLayerSet& a, const rcHeightfieldLayerSet& b)
+{
+	if (a.nlayers != b.nlayers)
+		return false;
+	for (int i = 0; i < a.nlayers; ++i)
+	{
+		const rcHeightfieldLayer& la = a.layers[i];
+		const rcHeightfieldLayer& lb = b.layers[i];
+		const int n = la.width*la.height;
+		if (la.width != lb.width || la.height != lb.height ||
+			la.minx != lb.minx || la.maxx != lb.maxx || la.miny != lb.miny || la.maxy != lb.maxy ||
+			la.hmin != lb.hmin || la.hmax != lb.hmax ||
+			memcmp(la.heights, lb.heights, n) != 0 || memcmp(la.areas, lb.areas, n) != 0 || memcmp(la.cons, lb.cons, n) != 0)
+			return false;
+	}
+	return true;
+}
+
+// A copy of rcBuildHeightfieldLayers from before the sweep was split into bands, with its
+// fixed layer and region limits. The layer sets of the current build must match it.
+
+// Must be 255 or smaller (not 256) because layer IDs are stored as
+// a byte where 255 is a special value.
+static const int REF_MAX_LAYERS = 63;
+static const int REF_MAX_NEIS = 16;
+
+struct RefLayerRegion
+{
+	unsigned char layers[REF_MAX_LAYERS];
+	unsigned char neis[REF_MAX_NEIS];
+	unsigned short zmin, zmax;
+	unsigned char layerId;		// Layer ID
+	unsigned char nlayers;		// Layer count
+	unsigned char nneis;		// Neighbour count
+	unsigned char base;		// Flag indicating if the region is the base of merged regions.
+};
+
+
+static bool refContains(const unsigned char* a, const unsigned char an, const unsigned char v)
+{
+	const int n = (int)an;
+	for (int i = 0; i < n; ++i)
+	{
+		if (a[i] == v)
+			return true;
+	}
+	return false;
+}
+
+static bool refAddUnique(unsigned char* a, unsigned char& an, int anMax, unsigned char v)
+{
+	if (refContains(a, an, v))
+		return true;
+
+	if ((int)an >= anMax)
+		return false;
+
+	a[an] = v;
+	an++;
+	return true;
+}
+
+
+static inline bool refOverlapRange(const unsigned short amin, const unsigned short amax,
+						 const unsigned short bmin, const unsigned short bmax)
+{
+	return (amin > bmax || amax < bmin) ? false : true;
+}
+
+
+
+struct RefLayerSweepSpan
+{
+	unsigned short ns;	// number samples
+	unsigned char id;	// region id
+	unsigned char nei;	// neighbour id
+};
+
+static bool referenceBuildHeightfieldLayers(rcContext* ctx, rcCompactHeightfield& chf,
+											 const int borderSize, const int walkableHeight,
+											 rcHeightfieldLayerSet& lset)
+{
+	rcAssert(ctx);
+	
+	rcScopedTimer timer(ctx, RC_TIMER_BUILD_LAYERS);
+	
+	const int w = chf.width;
+	const int h = chf.height;
+	
+	rcScopedDelete<unsigned char> srcReg((unsigned char*)rcAlloc(sizeof(unsigned char)*chf.spanCount, RC_ALLOC_TEMP));
+	if (!srcReg)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'srcReg' (%d).", chf.spanCount);
+		return false;
+	}
+	memset(srcReg,0xff,sizeof(unsigned char)*chf.spanCount);
+	
+	const int nsweeps = chf.width;
+	rcScopedDelete<RefLayerSweepSpan> sweeps((RefLayerSweepSpan*)rcAlloc(sizeof(RefLayerSweepSpan)*nsweeps, RC_ALLOC_TEMP));
+	if (!sweeps)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'sweeps' (%d).", nsweeps);
+		return false;
+	}
+	
+	
+	// Partition walkable area into monotone regions.
+	int prevCount[256];
+	unsigned char regId = 0;
+
+	for (int y = borderSize; y < h-borderSize; ++y)
+	{
+		memset(prevCount,0,sizeof(int)*regId);
+		unsigned char sweepId = 0;
+		
+		for (int x = borderSize; x < w-borderSize; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			{
+				const rcCompactSpan& s = chf.spans[i];
+				if (chf.areas[i] == RC_NULL_AREA) continue;
+
+				unsigned char sid = 0xff;
+
+				// -x
+				if (rcGetCon(s, 0) != RC_NOT_CONNECTED)
+				{
+					const int ax = x + rcGetDirOffsetX(0);
+					const int ay = y + rcGetDirOffsetY(0);
+					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 0);
+					if (chf.areas[ai] != RC_NULL_AREA && srcReg[ai] != 0xff)
+						sid = srcReg[ai];
+				}
+				
+				if (sid == 0xff)
+				{
+					sid = sweepId++;
+					sweeps[sid].nei = 0xff;
+					sweeps[sid].ns = 0;
+				}
+				
+				// -y
+				if (rcGetCon(s,3) != RC_NOT_CONNECTED)
+				{
+					const int ax = x + rcGetDirOffsetX(3);
+					const int ay = y + rcGetDirOffsetY(3);
+					const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, 3);
+					const unsigned char nr = srcReg[ai];
+					if (nr != 0xff)
+					{
+						// Set neighbour when first valid neighbour is encoutered.
+						if (sweeps[sid].ns == 0)
+							sweeps[sid].nei = nr;
+						
+						if (sweeps[sid].nei == nr)
+						{
+							// Update existing neighbour
+							sweeps[sid].ns++;
+							prevCount[nr]++;
+						}
+						else
+						{
+							// This is hit if there is nore than one neighbour.
+							// Invalidate the neighbour.
+							sweeps[sid].nei = 0xff;
+						}
+					}
+				}
+				
+				srcReg[i] = sid;
+			}
+		}
+		
+		// Create unique ID.
+		for (int i = 0; i < sweepId; ++i)
+		{
+			// If the neighbour is set and there is only one continuous connection to it,
+			// the sweep will be merged with the previous one, else new region is created.
+			if (sweeps[i].nei != 0xff && prevCount[sweeps[i].nei] == (int)sweeps[i].ns)
+			{
+				sweeps[i].id = sweeps[i].nei;
+			}
+			else
+			{
+				if (regId == 255)
+				{
+					ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Region ID overflow.");
+					return false;
+				}
+				sweeps[i].id = regId++;
+			}
+		}
+		
+		// Remap local sweep ids to region ids.
+		for (int x = borderSize; x < w-borderSize; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			{
+				if (srcReg[i] != 0xff)
+					srcReg[i] = sweeps[srcReg[i]].id;
+			}
+		}
+	}
+
+	// Allocate and init layer regions.
+	const int nregs = (int)regId;
+	rcScopedDelete<RefLayerRegion> regs((RefLayerRegion*)rcAlloc(sizeof(RefLayerRegion)*nregs, RC_ALLOC_TEMP));
+	if (!regs)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'regs' (%d).", nregs);
+		return false;
+	}
+	memset(regs, 0, sizeof(RefLayerRegion)*nregs);
+	for (int i = 0; i < nregs; ++i)
+	{
+		regs[i].layerId = 0xff;
+		regs[i].zmin = 0xffff;
+		regs[i].zmax = 0;
+	}
+	
+	// Find region neighbours and overlapping regions.
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const rcCompactCell& c = chf.cells[x+y*w];
+			
+			unsigned char lregs[REF_MAX_LAYERS];
+			int nlregs = 0;
+			
+			for (int i = (int)c.index, ni = (int)(c.index+c.count); i < ni; ++i)
+			{
+				const rcCompactSpan& s = chf.spans[i];
+				const unsigned char ri = srcReg[i];
+				if (ri == 0xff) continue;
+				
+				regs[ri].zmin = rcMin(regs[ri].zmin, s.z);
+				regs[ri].zmax = rcMax(regs[ri].zmax, s.z);
+				
+				// Collect all region layers.
+				if (nlregs < REF_MAX_LAYERS)
+					lregs[nlregs++] = ri;
+				
+				// Update neighbours
+				for (int dir = 0; dir < 4; ++dir)
+				{
+					if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+					{
+						const int ax = x + rcGetDirOffsetX(dir);
+						const int ay = y + rcGetDirOffsetY(dir);
+						const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
+						const unsigned char rai = srcReg[ai];
+						if (rai != 0xff && rai != ri)
+						{
+							// Don't check return value -- if we cannot add the neighbor
+							// it will just cause a few more regions to be created, which
+							// is fine.
+							refAddUnique(regs[ri].neis, regs[ri].nneis, REF_MAX_NEIS, rai);
+						}
+					}
+				}
+				
+			}
+			
+			// Update overlapping regions.
+			for (int i = 0; i < nlregs-1; ++i)
+			{
+				for (int j = i+1; j < nlregs; ++j)
+				{
+					if (lregs[i] != lregs[j])
+					{
+						RefLayerRegion& ri = regs[lregs[i]];
+						RefLayerRegion& rj = regs[lregs[j]];
+
+						if (!refAddUnique(ri.layers, ri.nlayers, REF_MAX_LAYERS, lregs[j]) ||
+							!refAddUnique(rj.layers, rj.nlayers, REF_MAX_LAYERS, lregs[i]))
+						{
+							ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: layer overflow (too many overlapping walkable platforms). Try increasing REF_MAX_LAYERS.");
+							return false;
+						}
+					}
+				}
+			}
+			
+		}
+	}
+	
+	// Create 2D layers from regions.
+	unsigned char layerId = 0;
+	
+	static const int MAX_STACK = 64;
+	unsigned char stack[MAX_STACK];
+	int nstack = 0;
+	
+	for (int i = 0; i < nregs; ++i)
+	{
+		RefLayerRegion& root = regs[i];
+		// Skip already visited.
+		if (root.layerId != 0xff)
+			continue;
+
+		// Start search.
+		root.layerId = layerId;
+		root.base = 1;
+		
+		nstack = 0;
+		stack[nstack++] = (unsigned char)i;
+		
+		while (nstack)
+		{
+			// Pop front
+			RefLayerRegion& reg = regs[stack[0]];
+			nstack--;
+			for (int j = 0; j < nstack; ++j)
+				stack[j] = stack[j+1];
+			
+			const int nneis = (int)reg.nneis;
+			for (int j = 0; j < nneis; ++j)
+			{
+				const unsigned char nei = reg.neis[j];
+				RefLayerRegion& regn = regs[nei];
+				// Skip already visited.
+				if (regn.layerId != 0xff)
+					continue;
+				// Skip if the neighbour is overlapping root region.
+				if (refContains(root.layers, root.nlayers, nei))
+					continue;
+				// Skip if the height range would become too large.
+				const int zmin = rcMin(root.zmin, regn.zmin);
+				const int zmax = rcMax(root.zmax, regn.zmax);
+				if ((zmax - zmin) >= 255)
+					 continue;
+
+				if (nstack < MAX_STACK)
+				{
+					// Deepen
+					stack[nstack++] = (unsigned char)nei;
+					
+					// Mark layer id
+					regn.layerId = layerId;
+					// Merge current layers to root.
+					for (int k = 0; k < regn.nlayers; ++k)
+					{
+						if (!refAddUnique(root.layers, root.nlayers, REF_MAX_LAYERS, regn.layers[k]))
+						{
+							ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: layer overflow (too many overlapping walkable platforms). Try increasing REF_MAX_LAYERS.");
+							return false;
+						}
+					}
+					root.zmin = rcMin(root.zmin, regn.zmin);
+					root.zmax = rcMax(root.zmax, regn.zmax);
+				}
+			}
+		}
+		
+		layerId++;
+	}
+	
+	// Merge non-overlapping regions that are close in height.
+	const unsigned short mergeHeight = (unsigned short)walkableHeight * 4;
+	
+	for (int i = 0; i < nregs; ++i)
+	{
+		RefLayerRegion& ri = regs[i];
+		if (!ri.base) continue;
+		
+		unsigned char newId = ri.layerId;
+		
+		for (;;)
+		{
+			unsigned char oldId = 0xff;
+			
+			for (int j = 0; j < nregs; ++j)
+			{
+				if (i == j) continue;
+				RefLayerRegion& rj = regs[j];
+				if (!rj.base) continue;
+				
+				// Skip if the regions are not close to each other.
+				if (!refOverlapRange(ri.zmin,ri.zmax+mergeHeight, rj.zmin,rj.zmax+mergeHeight))
+					continue;
+				// Skip if the height range would become too large.
+				const int zmin = rcMin(ri.zmin, rj.zmin);
+				const int zmax = rcMax(ri.zmax, rj.zmax);
+				if ((zmax - zmin) >= 255)
+				  continue;
+						  
+				// Make sure that there is no overlap when merging 'ri' and 'rj'.
+				bool overlap = false;
+				// Iterate over all regions which have the same layerId as 'rj'
+				for (int k = 0; k < nregs; ++k)
+				{
+					if (regs[k].layerId != rj.layerId)
+						continue;
+					// Check if region 'k' is overlapping region 'ri'
+					// Index to 'regs' is the same as region id.
+					if (refContains(ri.layers,ri.nlayers, (unsigned char)k))
+					{
+						overlap = true;
+						break;
+					}
+				}
+				// Cannot merge of regions overlap.
+				if (overlap)
+					continue;
+				
+				// Can merge i and j.
+				oldId = rj.layerId;
+				break;
+			}
+			
+			// Could not find anything to merge with, stop.
+			if (oldId == 0xff)
+				break;
+			
+			// Merge
+			for (int j = 0; j < nregs; ++j)
+			{
+				RefLayerRegion& rj = regs[j];
+				if (rj.layerId == oldId)
+				{
+					rj.base = 0;
+					// Remap layerIds.
+					rj.layerId = newId;
+					// Add overlaid layers from 'rj' to 'ri'.
+					for (int k = 0; k < rj.nlayers; ++k)
+					{
+						if (!refAddUnique(ri.layers, ri.nlayers, REF_MAX_LAYERS, rj.layers[k]))
+						{
+							ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: layer overflow (too many overlapping walkable platforms). Try increasing REF_MAX_LAYERS.");
+							return false;
+						}
+					}
+
+					// Update height bounds.
+					ri.zmin = rcMin(ri.zmin, rj.zmin);
+					ri.zmax = rcMax(ri.zmax, rj.zmax);
+				}
+			}
+		}
+	}
+	
+	// Compact layerIds
+	unsigned char remap[256];
+	memset(remap, 0, 256);
+
+	// Find number of unique layers.
+	layerId = 0;
+	for (int i = 0; i < nregs; ++i)
+		remap[regs[i].layerId] = 1;
+	for (int i = 0; i < 256; ++i)
+	{
+		if (remap[i])
+			remap[i] = layerId++;
+		else
+			remap[i] = 0xff;
+	}
+	// Remap ids.
+	for (int i = 0; i < nregs; ++i)
+		regs[i].layerId = remap[regs[i].layerId];
+	
+	// No layers, return empty.
+	if (layerId == 0)
+		return true;
+	
+	// Create layers.
+	rcAssert(lset.layers == 0);
+	
+	const int lw = w - borderSize*2;
+	const int lh = h - borderSize*2;
+
+	// Build contracted bbox for layers.
+	float bmin[3], bmax[3];
+	rcVcopy(bmin, chf.bmin);
+	rcVcopy(bmax, chf.bmax);
+	bmin[0] += borderSize*chf.cs;
+	bmin[1] += borderSize*chf.cs;
+	bmax[0] -= borderSize*chf.cs;
+	bmax[1] -= borderSize*chf.cs;
+	
+	lset.nlayers = (int)layerId;
+	
+	lset.layers = (rcHeightfieldLayer*)rcAlloc(sizeof(rcHeightfieldLayer)*lset.nlayers, RC_ALLOC_PERM);
+	if (!lset.layers)
+	{
+		ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'layers' (%d).", lset.nlayers);
+		return false;
+	}
+	memset(lset.layers, 0, sizeof(rcHeightfieldLayer)*lset.nlayers);
+
+	
+	// Store layers.
+	for (int i = 0; i < lset.nlayers; ++i)
+	{
+		unsigned char curId = (unsigned char)i;
+
+		rcHeightfieldLayer* layer = &lset.layers[i];
+
+		const int gridSize = sizeof(unsigned char)*lw*lh;
+
+		layer->heights = (unsigned char*)rcAlloc(gridSize, RC_ALLOC_PERM);
+		if (!layer->heights)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'heights' (%d).", gridSize);
+			return false;
+		}
+		memset(layer->heights, 0xff, gridSize);
+
+		layer->areas = (unsigned char*)rcAlloc(gridSize, RC_ALLOC_PERM);
+		if (!layer->areas)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'areas' (%d).", gridSize);
+			return false;
+		}
+		memset(layer->areas, 0, gridSize);
+
+		layer->cons = (unsigned char*)rcAlloc(gridSize, RC_ALLOC_PERM);
+		if (!layer->cons)
+		{
+			ctx->log(RC_LOG_ERROR, "rcBuildHeightfieldLayers: Out of memory 'cons' (%d).", gridSize);
+			return false;
+		}
+		memset(layer->cons, 0, gridSize);
+		
+		// Find layer height bounds.
+		int hmin = 0, hmax = 0;
+		for (int j = 0; j < nregs; ++j)
+		{
+			if (regs[j].base && regs[j].layerId == curId)
+			{
+				hmin = (int)regs[j].zmin;
+				hmax = (int)regs[j].zmax;
+			}
+		}
+
+		layer->width = lw;
+		layer->height = lh;
+		layer->cs = chf.cs;
+		layer->ch = chf.ch;
+		
+		// Adjust the bbox to fit the heightfield.
+		rcVcopy(layer->bmin, bmin);
+		rcVcopy(layer->bmax, bmax);
+		layer->bmin[2] = bmin[2] + hmin*chf.ch;
+		layer->bmax[2] = bmin[2] + hmax*chf.ch;
+		layer->hmin = hmin;
+		layer->hmax = hmax;
+
+		// Update usable data region.
+		layer->minx = layer->width;
+		layer->maxx = 0;
+		layer->miny = layer->height;
+		layer->maxy = 0;
+		
+		// Copy height and area from compact heightfield. 
+		for (int y = 0; y < lh; ++y)
+		{
+			for (int x = 0; x < lw; ++x)
+			{
+				const int cx = borderSize+x;
+				const int cy = borderSize+y;
+				const rcCompactCell& c = chf.cells[cx+cy*w];
+				for (int j = (int)c.index, nj = (int)(c.index+c.count); j < nj; ++j)
+				{
+					const rcCompactSpan& s = chf.spans[j];
+					// Skip unassigned regions.
+					if (srcReg[j] == 0xff)
+						continue;
+					// Skip of does nto belong to current layer.
+					unsigned char lid = regs[srcReg[j]].layerId;
+					if (lid != curId)
+						continue;
+					
+					// Update data bounds.
+					layer->minx = rcMin(layer->minx, x);
+					layer->maxx = rcMax(layer->maxx, x);
+					layer->miny = rcMin(layer->miny, y);
+					layer->maxy = rcMax(layer->maxy, y);
+					
+					// Store height and area type.
+					const int idx = x+y*lw;
+					layer->heights[idx] = (unsigned char)(s.z - hmin);
+					layer->areas[idx] = chf.areas[j];
+					
+					// Check connection.
+					unsigned char portal = 0;
+					unsigned char con = 0;
+					for (int dir = 0; dir < 4; ++dir)
+					{
+						if (rcGetCon(s, dir) != RC_NOT_CONNECTED)
+						{
+							const int ax = cx + rcGetDirOffsetX(dir);
+							const int ay = cy + rcGetDirOffsetY(dir);
+							const int ai = (int)chf.cells[ax+ay*w].index + rcGetCon(s, dir);
+							unsigned char alid = srcReg[ai] != 0xff ? regs[srcReg[ai]].layerId : 0xff;
+							// Portal mask
+							if (chf.areas[ai] != RC_NULL_AREA && lid != alid)
+							{
+								portal |= (unsigned char)(1<<dir);
+								// Update height so that it matches on both sides of the portal.
+								const rcCompactSpan& as = chf.spans[ai];
+								if (as.z > hmin)
+									layer->heights[idx] = rcMax(layer->heights[idx], (unsigned char)(as.z - hmin));
+							}
+							// Valid connection mask
+							if (chf.areas[ai] != RC_NULL_AREA && lid == alid)
+							{
+								const int nx = ax - borderSize;
+								const int ny = ay - borderSize;
+								if (nx >= 0 && ny >= 0 && nx < lw && ny < lh)
+									con |= (unsigned char)(1<<dir);
+							}
+						}
+					}
+					
+					layer->cons[idx] = (portal << 4) | con;
+				}
+			}
+		}
+		
+		if (layer->minx > layer->maxx)
+			layer->minx = layer->maxx = 0;
+		if (layer->miny > layer->maxy)
+			layer->miny = layer->maxy = 0;
+	}
+	
+	return true;
+}
+
+TEST_CASE("rcBuildHeightfieldLayers")
+{
+	rcContext ctx(false);
+
+	SECTION("More overlapping floors than the former layer limit")
+	{
+		rcCompactHeightfield chf;
+		REQUIRE(buildTestFloorStack(&ctx, chf, 70, 0, 24));
+		rcHeightfieldLayerSet lset;
+		REQUIRE(rcBuildHeightfieldLayers(&ctx, chf, 0, 4, lset));
+		REQUIRE(lset.nlayers == 70);
+		for (int i = 0; i < lset.nlayers; ++i)
+			REQUIRE(lset.layers[i].hmax - lset.layers[i].hmin < 255);
+	}
+
+	SECTION("More than 255 regions")
+	{
+		rcCompactHeightfield chf;
+		REQUIRE(buildTestFloorStack(&ctx, chf, 8, 2, 100));
+		rcHeightfieldLayerSet lset;
+		REQUIRE(rcBuildHeightfieldLayers(&ctx, chf, 3, 4, lset));
+		REQUIRE(lset.nlayers == 8);
+	}
+
+	SECTION("Layers match the single sweep build")
+	{
+		rcCompactHeightfield stacks[3];
+		REQUIRE(buildTestFloorStack(&ctx, stacks[0], 8, 0, 48));
+		REQUIRE(buildTestFloorStack(&ctx, stacks[1], 2, 12, 48));
+		REQUIRE(buildTestCompactHeightfield(&ctx, stacks[2]));
+		const int borderSizes[] = { 0, 3 };
+		for (int i = 0; i < 3; ++i)
+		{
+			for (int b = 0; b < 2; ++b)
+			{
+				INFO("mesh " << i << " border " << b);
+				rcHeightfieldLayerSet expected;
+				REQUIRE(referenceBuildHeightfieldLayers(&ctx, stacks[i], borderSizes[b], 4, expected));
+				REQUIRE(expected.nlayers > 0);
+				rcHeightfieldLayerSet serial;
+				REQUIRE(rcBuildHeightfieldLayers(&ctx, stacks[i], borderSizes[b], 4, serial));
+				REQUIRE(sameLayers(expected, serial));
+
+				rcThreadPool pool(3);
+				ctx.setTaskScheduler(&pool);
+				rcHeightfieldLayerSet parallel;
+				REQUIRE(rcBuildHeightfieldLayers(&ctx, stacks[i], borderSizes[b], 4, parallel));
+				ctx.setTaskScheduler(0);
+				REQUIRE(sameLayers(expected, parallel));
+			}
+		}
+	}
+
+	SECTION("Layers do not depend on the task scheduler")
+	{
+		rcCompactHeightfield chf;
+		REQUIRE(buildTestFloorStack(&ctx, chf, 20, 4, 64));
+		rcHeightfieldLayerSet serial;
+		REQUIRE(rcBuildHeightfieldLayers(&ctx, chf, 2, 4, serial));
+		REQUIRE(serial.nlayers == 20);
+
+		const int threadCounts[] = { 2, 5 };
+		for (int t = 0; t < 2; ++t)
+		{
+			rcThreadPool pool(threadCounts[t]);
+			ctx.setTaskScheduler(&pool);
+			rcHeightfieldLayerSet parallel;
+			REQUIRE(rcBuildHeightfieldLayers(&ctx, chf, 2, 4, parallel));
+			ctx.setTaskScheduler(0);
+			REQUIRE(sameLayers(serial, parallel));
+		}
+	}
+}
+
+// Compares the spans, distances and areas of a compact heightfield in the AoS layout to one in the SoA layout.
+static bool sameCompactSpans(const rcCompactHeightfield& aos, const rcCompactHeightfield& soa)
+{
+	if (aos.spanCount != soa.spanCount || aos.maxRegions != soa.maxRegions || aos.maxDistance != soa.maxDistance)
+		return false;
+	for (int i = 0; i < aos.spanCount; ++i)
+	{
+		const rcCompactSpan& s = aos.spans[i];
+		if (s.z != soa.spanZ[i] || s.h != soa.spanH[i] || s.reg != soa.spanReg[i] || s.con != soa.spanCon[i])
+			return false;
+	}
+	if (memcmp(aos.areas, soa.areas, aos.spanCount) != 0)
+		return false;
+	if ((aos.dist == 0) != (soa.dist == 0))
+		return false;
+	return !aos.dist || memcmp(aos.dist, soa.dist, sizeof(unsigned short)*aos.spanCount) == 0;
+}
+
+static bool sameContours(const rcContourSet& a, const rcContourSet& b)
+{
+	if (a.nconts != b.nconts)
+		return false;
+	for (int i = 0; i < a.nconts; ++i)
+	{
+		const rcContour& ca = a.conts[i];
+		const rcContour& cb = b.conts[i];
+		if (ca.reg != cb.reg || ca.area != cb.area || ca.nverts != cb.nverts || ca.nrverts != cb.nrverts ||
+			memcmp(ca.verts, cb.verts, sizeof(int)*4*ca.nverts) != 0 ||
+			memcmp(ca.rverts, cb.rverts, sizeof(int)*4*ca.nrverts) != 0)
+			return false;
+	}
+	return true;
+}
+
+TEST_CASE("rcSetCompactHeightfieldLayout")
+{
+	rcContext ctx(false);
+	rcCompactHeightfield aos;
+	REQUIRE(buildTestCompactHeightfield(&ctx, aos));
+	REQUIRE(aos.layout == RC_COMPACT_SPANS_AOS);
+
+	rcCompactHeightfield soa;
+	REQUIRE(buildTestCompactHeightfield(&ctx, soa));
+	REQUIRE(rcSetCompactHeightfieldLayout(&ctx, soa, RC_COMPACT_SPANS_SOA));
+	REQUIRE(soa.layout == RC_COMPACT_SPANS_SOA);
+	REQUIRE(soa.spans == 0);
+	REQUIRE(sameCompactSpans(aos, soa));
+
+	SECTION("Round trip restores the spans")
+	{
+		REQUIRE(rcSetCompactHeightfieldLayout(&ctx, soa, RC_COMPACT_SPANS_AOS));
+		REQUIRE(soa.layout == RC_COMPACT_SPANS_AOS);
+		REQUIRE(soa.spanZ == 0);
+		REQUIRE(memcmp(aos.spans, soa.spans, sizeof(rcCompactSpan)*aos.spanCount) == 0);
+	}
+
+	SECTION("Area stages match the AoS layout")
+	{
+		const float bmin[] = { 10, 10, 0 };
+		const float bmax[] = { 30, 40, 30 };
+		const float verts[] = { 50,50,0, 80,55,0, 70,90,0, 45,75,0 };
+		const float pos[] = { 20, 70, 0 };
+		rcCompactHeightfield* chfs[] = { &aos, &soa };
+		for (int i = 0; i < 2; ++i)
+		{
+			REQUIRE(rcErodeWalkableArea(&ctx, 2, *chfs[i]));
+			REQUIRE(rcMedianFilterWalkableArea(&ctx, *chfs[i]));
+			rcMarkBoxArea(&ctx, bmin, bmax, 4, *chfs[i]);
+			rcMarkConvexPolyArea(&ctx, verts, 4, 0, 30, 5, *chfs[i]);
+			rcMarkCylinderArea(&ctx, pos, 8, 30, 6, *chfs[i]);
+		}
+		REQUIRE(sameCompactSpans(aos, soa));
+	}
+
+	SECTION("Region stages match the AoS layout")
+	{
+		REQUIRE(rcBuildRegionsMonotone(&ctx, aos, 2, 4, 20));
+		REQUIRE(rcBuildRegionsMonotone(&ctx, soa, 2, 4, 20));
+		REQUIRE(sameCompactSpans(aos, soa));
+		REQUIRE(rcBuildLayerRegions(&ctx, aos, 2, 4));
+		REQUIRE(rcBuildLayerRegions(&ctx, soa, 2, 4));
+		REQUIRE(sameCompactSpans(aos, soa));
+		REQUIRE(rcBuildDistanceField(&ctx, aos));
+		REQUIRE(rcBuildDistanceField(&ctx, soa));
+		REQUIRE(rcBuildRegions(&ctx, aos, 2, 4, 20));
+		REQUIRE(rcBuildRegions(&ctx, soa, 2, 4, 20));
+		REQUIRE(sameCompactSpans(aos, soa));
+	}
+
+	SECTION("Contours and detail mesh match the AoS layout")
+	{
+		rcContourSet csetAoS, csetSoA;
+		REQUIRE(rcBuildContours(&ctx, aos, 1.3f, 12, csetAoS));
+		REQUIRE(rcBuildContours(&ctx, soa, 1.3f, 12, csetSoA));
+		REQUIRE(sameContours(csetAoS, csetSoA));
+
+		rcThreadPool pool(3);
+		ctx.setTaskScheduler(&pool);
+		rcContourSet csetParallel;
+		REQUIRE(rcBuildContoursParallel(&ctx, soa, 1.3f, 12, csetParallel));
+		ctx.setTaskScheduler(0);
+		REQUIRE(sameContours(csetAoS, csetParallel));
+
+		rcPolyMesh pmesh;
+		REQUIRE(rcBuildPolyMesh(&ctx, csetAoS, 6, pmesh));
+		rcPolyMeshDetail* dmeshAoS = rcAllocPolyMeshDetail();
+		rcPolyMeshDetail* dmeshSoA = rcAllocPolyMeshDetail();
+		REQUIRE(rcBuildPolyMeshDetail(&ctx, pmesh, aos, 6.0f, 1.0f, *dmeshAoS));
+		REQUIRE(rcBuildPolyMeshDetail(&ctx, pmesh, soa, 6.0f, 1.0f, *dmeshSoA));
+		REQUIRE(dmeshAoS->nmeshes == dmeshSoA->nmeshes);
+		REQUIRE(dmeshAoS->nverts == dmeshSoA->nverts);
+		REQUIRE(dmeshAoS->ntris == dmeshSoA->ntris);
+		REQUIRE(memcmp(dmeshAoS->meshes, dmeshSoA->meshes, sizeof(unsigned int)*4*dmeshAoS->nmeshes) == 0);
+		REQUIRE(memcmp(dmeshAoS->verts, dmeshSoA->verts, sizeof(float)*3*dmeshAoS->nverts) == 0);
+		REQUIRE(memcmp(dmeshAoS->tris, dmeshSoA->tris, 4*dmeshAoS->ntris) == 0);
+		rcFreePolyMeshDetail(dmeshAoS);
+		rcFreePolyMeshDetail(dmeshSoA);
+	}
+
+	SECTION("Heightfield layers match the AoS layout")
+	{
+		rcCompactHeightfield stackAoS, stackSoA;
+		REQUIRE(buildTestFloorStack(&ctx, stackAoS, 12, 4, 48));
+		REQUIRE(buildTestFloorStack(&ctx, stackSoA, 12, 4, 48));
+		REQUIRE(rcSetCompactHeightfieldLayout(&ctx, stackSoA, RC_COMPACT_SPANS_SOA));
+		rcHeightfieldLayerSet lsetAoS, lsetSoA;
+		REQUIRE(rcBuildHeightfieldLayers(&ctx, stackAoS, 2, 4, lsetAoS));
+		REQUIRE(rcBuildHeightfieldLayers(&ctx, stackSoA, 2, 4, lsetSoA));
+		REQUIRE(lsetAoS.nlayers == 12);
+		REQUIRE(sameLayers(lsetAoS, lsetSoA));
+	}
+}
+
+TEST_CASE("rcBuildRegions")
+{
+	rcContext ctx(false);
+	rcCompactHeightfield serial;
+	REQUIRE(buildTestCompactHeightfield(&ctx, serial));
+	REQUIRE(serial.maxRegions > 1);
+
+	SECTION("Matches the serial build")
+	{
+		const int threadCounts[] = { 1, 2, 4, 7 };
+		for (int t = 0; t < 4; ++t)
+		{
+			rcThreadPool pool(threadCounts[t]);
+			ctx.setTaskScheduler(&pool);
+			rcCompactHeightfield parallel;
+			REQUIRE(buildTestCompactHeightfield(&ctx, parallel));
+			ctx.setTaskScheduler(0);
+			REQUIRE(parallel.maxRegions == serial.maxRegions);
+			REQUIRE(parallel.spanCount == serial.spanCount);
+			REQUIRE(memcmp(parallel.spans, serial.spans, sizeof(rcCompactSpan)*serial.spanCount) == 0);
+		}
+	}
+}
+
+TEST_CASE("rcBuildPolyMeshDetail")
+{
+	rcContext ctx(false);
+	rcCompactHeightfield chf;
+	REQUIRE(buildTestCompactHeightfield(&ctx, chf));
+	rcContourSet cset;
+	REQUIRE(rcBuildContours(&ctx, chf, 1.3f, 12, cset));
+	rcPolyMesh pmesh;
+	REQUIRE(rcBuildPolyMesh(&ctx, cset, 6, pmesh));
+
+	rcPolyMeshDetail* serial = rcAllocPolyMeshDetail();
+	REQUIRE(rcBuildPolyMeshDetail(&ctx, pmesh, chf, 6.0f, 1.0f, *serial));
+	REQUIRE(serial->nmeshes == pmesh.npolys);
+	REQUIRE(serial->nverts > pmesh.nverts);
+
+	SECTION("Matches the serial build")
+	{
+		const int threadCounts[] = { 1, 2, 4, 7 };
+		for (int t = 0; t < 4; ++t)
+		{
+			rcThreadPool pool(threadCounts[t]);
+			ctx.setTaskScheduler(&pool);
+			rcPolyMeshDetail* parallel = rcAllocPolyMeshDetail();
+			REQUIRE(rcBuildPolyMeshDetail(&ctx, pmesh, chf, 6.0f, 1.0f, *parallel));
+			ctx.setTaskScheduler(0);
+			REQUIRE(parallel->nmeshes == serial->nmeshes);
+			REQUIRE(parallel->nverts == serial->nverts);
+			REQUIRE(parallel->ntris == serial->ntris);
+			REQUIRE(memcmp(parallel->meshes, serial->meshes, sizeof(unsigned int)*4*serial->nmeshes) == 0);
+			REQUIRE(memcmp(parallel->verts, serial->verts, sizeof(float)*3*serial->nverts) == 0);
+			REQUIRE(memcmp(parallel->tris, serial->tris, 4*serial->ntris) == 0);
+			rcFreePolyMeshDetail(parallel);
+		}
+	}
+
+	rcFreePolyMeshDetail(serial);
+}
+
+// Installs the telemetry allocator for the lifetime of the guard, also when a test fails.
+struct AllocTrackingGuard
+{
+	AllocTrackingGuard() { rcBuildTelemetry::installAllocTracking(); }
+	~AllocTrackingGuard() { rcBuildTelemetry::uninstallAllocTracking(); }
+};
+
+// Allocates temporary memory in each range of a parallel loop that runs on a worker thread.
+struct TempAllocBody
+{
+	int size;
+	std::thread::id caller;
+	std::atomic<int>* workerRanges;
+	void operator()(const int begin, const int end) const
+	{
+		if (std::this_thread::get_id() == caller)
+		{
+			// Give the workers a chance to pick up ranges.
+			for (int i = 0; i < 1000 && *workerRanges == 0; ++i)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			return;
+		}
+		(*workerRanges)++;
+		for (int i = begin; i < end; ++i)
+		{
+			void* mem = rcAlloc(size, RC_ALLOC_TEMP);
+			if (!mem)
+				continue;
+			memset(mem, 0, size);
+			rcFree(mem);
+		}
+	}
+};
+
+TEST_CASE("rcBuildTelemetry")
+{
+	void* untracked = rcAlloc(64, RC_ALLOC_TEMP);
+	REQUIRE(untracked);
+	AllocTrackingGuard guard;
+	{
+		rcBuildTelemetry telemetry;
+		rcContext ctx(false);
+		ctx.setTelemetry(&telemetry);
+		ctx.setTelemetryTile(3, 4, 1);
+
+		rcCompactHeightfield chf;
+		rcContourSet cset;
+		ctx.startTimer(RC_TIMER_TOTAL);
+		REQUIRE(buildTestCompactHeightfield(&ctx, chf));
+		REQUIRE(rcBuildContours(&ctx, chf, 1.3f, 12, cset));
+		ctx.stopTimer(RC_TIMER_TOTAL);
+
+		SECTION("Samples are nested under the enclosing timer")
+		{
+			REQUIRE(telemetry.getSampleCount() > 1);
+			const rcTelemetrySample& root = telemetry.getSample(0);
+			REQUIRE(root.label == RC_TIMER_TOTAL);
+			REQUIRE(root.parent == -1);
+			REQUIRE(root.depth == 0);
+			REQUIRE(root.tileX == 3);
+			REQUIRE(root.tileY == 4);
+			REQUIRE(root.tileLayer == 1);
+			for (int i = 1; i < telemetry.getSampleCount(); ++i)
+			{
+				const rcTelemetrySample& s = telemetry.getSample(i);
+				REQUIRE(s.parent >= 0);
+				REQUIRE(s.parent < i);
+				REQUIRE(s.depth == telemetry.getSample(s.parent).depth + 1);
+				REQUIRE(s.durationUsec <= root.durationUsec);
+			}
+		}
+
+		SECTION("Stages record their counters and temp memory")
+		{
+			bool foundCompact = false;
+			bool foundContours = false;
+			bool foundTrace = false;
+			for (int i = 0; i < telemetry.getSampleCount(); ++i)
+			{
+				const rcTelemetrySample& s = telemetry.getSample(i);
+				if (s.label == RC_TIMER_BUILD_COMPACTHEIGHTFIELD)
+				{
+					foundCompact = true;
+					REQUIRE(s.counters[RC_COUNTER_COMPACT_SPANS] == chf.spanCount);
+					REQUIRE(s.counters[RC_COUNTER_SPANS] >= chf.spanCount);
+				}
+				if (s.label == RC_TIMER_BUILD_CONTOURS)
+				{
+					foundContours = true;
+					REQUIRE(s.counters[RC_COUNTER_CONTOURS] == cset.nconts);
+					REQUIRE(s.peakTempBytes >= chf.spanCount);
+				}
+				if (s.label == RC_TIMER_BUILD_CONTOURS_TRACE)
+				{
+					// The per contour trace timers are merged into one sample.
+					REQUIRE(!foundTrace);
+					foundTrace = true;
+					REQUIRE(s.calls > 1);
+				}
+			}
+			REQUIRE(foundCompact);
+			REQUIRE(foundContours);
+			REQUIRE(foundTrace);
+		}
+
+		SECTION("Temp memory of parallel loops is charged to the enclosing sample")
+		{
+			rcThreadPool pool(4);
+			ctx.setTaskScheduler(&pool);
+			telemetry.reset();
+			std::atomic<int> workerRanges(0);
+			TempAllocBody body = { 1 << 20, std::this_thread::get_id(), &workerRanges };
+			ctx.startTimer(RC_TIMER_TEMP);
+			ctx.parallelFor(64, 1, rcParallelForBody<TempAllocBody>, &body);
+			ctx.stopTimer(RC_TIMER_TEMP);
+			ctx.setTaskScheduler(0);
+			REQUIRE(telemetry.getSampleCount() == 1);
+			if (workerRanges > 0)
+				REQUIRE(telemetry.getSample(0).peakTempBytes >= body.size);
+		}
+
+		SECTION("The default allocator is only restored once no tracked temp blocks are live")
+		{
+			void* tracked = rcAlloc(64, RC_ALLOC_TEMP);
+			REQUIRE(tracked);
+			REQUIRE(!rcBuildTelemetry::uninstallAllocTracking());
+			rcFree(tracked);
+		}
+	}
+	// Blocks allocated before tracking was installed can still be freed.
+	rcFree(untracked);
+	// The heightfield and its distance field are freed now.
+	REQUIRE(rcBuildTelemetry::uninstallAllocTracking());
+}
+
 // Used to verify that rcVector constructs/destroys objects correctly.
 struct Incrementor {
 	static int constructions;
@@ -1085,46 +2324,11 @@ TEST_CASE("rcVector")
 	}
 }
 
-// TODO: Implement benchmarking for platforms other than posix.
-#ifdef __unix__
-#include <unistd.h>
-#ifdef _POSIX_TIMERS
-#include <time.h>
-#include <stdint.h>
-
-int64_t NowNanos() {
-	struct timespec tp;
-	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tp);
-	return tp.tv_nsec + 1000000000LL * tp.tv_sec;
-}
-
-#define BM(name, iterations) \
-	struct BM_ ## name { \
-		static void Run() { \
-			int64_t begin_time = NowNanos(); \
-			for (int i = 0 ; i < iterations; i++) { \
-				Body(); \
-			} \
-			int64_t nanos = NowNanos() - begin_time; \
-			printf("BM_%-35s %ld iterations in %10ld nanos: %10.2f nanos/it\n", #name ":", (int64_t)iterations, nanos, double(nanos) / iterations); \
-		} \
-		static void Body(); \
-	}; \
-	TEST_CASE(#name) { \
-		BM_ ## name::Run(); \
-	} \
-	void BM_ ## name::Body()
+#ifdef BM
 
 const int64_t kNumLoops = 100;
 const int64_t kNumInserts = 100000;
 
-// Prevent compiler from eliding a calculation.
-// TODO: Implement for MSVC.
-template <typename T>
-void DoNotOptimize(T* v) {
-	asm volatile ("" : "+r" (v));
-}
-
 BM(FlatArray_Push, kNumLoops)
 {
 	int cap = 64;
@@ -1240,6 +2444,82 @@ BM(stdvector_Resize, kNumLoops)
 	DoNotOptimize(v.data());
 }
 
+// Compact heightfields shared by the span layout benchmarks.
+static rcCompactHeightfield& benchCompactHeightfield(const rcCompactSpanLayout layout)
+{
+	static rcContext ctx(false);
+	static rcCompactHeightfield chfs[2];
+	static bool built[2] = { false, false };
+	if (!built[layout])
+	{
+		buildTestCompactHeightfield(&ctx, chfs[layout]);
+		rcSetCompactHeightfieldLayout(&ctx, chfs[layout], layout);
+		built[layout] = true;
+	}
+	return chfs[layout];
+}
+
+static void benchErode(const rcCompactSpanLayout layout)
+{
+	rcContext ctx(false);
+	rcCompactHeightfield& chf = benchCompactHeightfield(layout);
+	rcTempVector<unsigned char> areas(chf.areas, chf.areas + chf.spanCount);
+	rcErodeWalkableArea(&ctx, 3, chf);
+	memcpy(chf.areas, areas.data(), chf.spanCount);
+}
+
+static void benchDistanceField(const rcCompactSpanLayout layout)
+{
+	rcContext ctx(false);
+	rcBuildDistanceField(&ctx, benchCompactHeightfield(layout));
+}
+
+static void benchRegions(const rcCompactSpanLayout layout)
+{
+	rcContext ctx(false);
+	rcBuildRegions(&ctx, benchCompactHeightfield(layout), 0, 4, 20);
+}
+
+static void benchContours(const rcCompactSpanLayout layout)
+{
+	rcContext ctx(false);
+	rcContourSet cset;
+	rcBuildContours(&ctx, benchCompactHeightfield(layout), 1.3f, 12, cset);
+	DoNotOptimize(cset.conts);
+}
+
+BM(Erode_AoS, kNumLoops)
+{
+	benchErode(RC_COMPACT_SPANS_AOS);
+}
+BM(Erode_SoA, kNumLoops)
+{
+	benchErode(RC_COMPACT_SPANS_SOA);
+}
+BM(DistanceField_AoS, kNumLoops)
+{
+	benchDistanceField(RC_COMPACT_SPANS_AOS);
+}
+BM(DistanceField_SoA, kNumLoops)
+{
+	benchDistanceField(RC_COMPACT_SPANS_SOA);
+}
+BM(Regions_AoS, kNumLoops)
+{
+	benchRegions(RC_COMPACT_SPANS_AOS);
+}
+BM(Regions_SoA, kNumLoops)
+{
+	benchRegions(RC_COMPACT_SPANS_SOA);
+}
+BM(Contours_AoS, kNumLoops)
+{
+	benchContours(RC_COMPACT_SPANS_AOS);
+}
+BM(Contours_SoA, kNumLoops)
+{
+	benchContours(RC_COMPACT_SPANS_SOA);
+}
+
 #undef BM
-#endif  // _POSIX_TIMERS
-#endif  // __unix__
+#endif  // BM